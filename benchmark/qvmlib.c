@@ -1,13 +1,275 @@
 #include "qvmlib.h"
 #include <stddef.h>
 #include <stdarg.h>
+#include <stdint.h>
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
 
+// --- Host calls ---------------------------------------------------------
+
+#ifndef QVMLIB_NO_ECALL
+// ECALL numbers, see r5vm_ecall_t in r5vm.h. Memory blocks of at least
+// QVM_ECALL_MIN_SIZE bytes are handed to the host, smaller ones are cheaper
+// to copy here than to set up the call. Float arguments and results are
+// passed as bit patterns in integer registers.
+#define QVM_ECALL_MEMCPY   2
+#define QVM_ECALL_MEMMOVE  3
+#define QVM_ECALL_MEMSET   4
+#define QVM_ECALL_MEMCMP   5
+#define QVM_ECALL_SINF     6
+#define QVM_ECALL_COSF     7
+#define QVM_ECALL_EXPF     8
+#define QVM_ECALL_LOGF     9
+#define QVM_ECALL_SQRTF    10
+#define QVM_ECALL_POWF     11
+#define QVM_ECALL_ATAN2F   12
+#define QVM_ECALL_FMODF    13
+#define QVM_ECALL_MAP_INFO 14
+#define QVM_ECALL_CHECKPOINT 15
+#define QVM_ECALL_RESPOND  16
+#define QVM_ECALL_STREAM_INIT 17
+#define QVM_ECALL_STREAM_IN   18
+#define QVM_ECALL_STREAM_OUT  19
+#define QVM_ECALL_RING_INFO   20
+#define QVM_ECALL_RING_WAIT   21
+#define QVM_ECALL_RING_WAKE   22
+#define QVM_ECALL_CHAN_OPEN   23
+#define QVM_ECALL_CHAN_SEND   24
+#define QVM_ECALL_CHAN_RECV   25
+#define QVM_ECALL_CHAN_POLL   26
+#define QVM_ECALL_RPC_EXPORT  27
+#define QVM_ECALL_RPC_CALL    28
+#define QVM_ECALL_RPC_RETURN  29
+#define QVM_ECALL_MIN_SIZE 16
+
+static inline unsigned qvm_ecall3(unsigned id, unsigned x, unsigned y, unsigned z)
+{
+    register unsigned a0 asm("a0") = x;
+    register unsigned a1 asm("a1") = y;
+    register unsigned a2 asm("a2") = z;
+    register unsigned a7 asm("a7") = id;
+    asm volatile ("ecall" : "+r"(a0) : "r"(a1), "r"(a2), "r"(a7) : "memory");
+    return a0;
+}
+
+static inline float qvm_ecall_f(unsigned id, float x, float y)
+{
+    union { float f; unsigned u; } a = { x }, b = { y }, r;
+    r.u = qvm_ecall3(id, a.u, b.u, 0);
+    return r.f;
+}
+
+const void *qvm_host_map(unsigned slot, size_t *size)
+{
+    register unsigned a0 asm("a0") = slot;
+    register unsigned a1 asm("a1");
+    register unsigned a7 asm("a7") = QVM_ECALL_MAP_INFO;
+    asm volatile ("ecall" : "+r"(a0), "=r"(a1) : "r"(a7));
+    if (size)
+        *size = a1;
+    return a0 ? (const void *)a0 : NULL;
+}
+
+size_t qvm_checkpoint(void *buf, size_t size)
+{
+    return qvm_ecall3(QVM_ECALL_CHECKPOINT, (unsigned)buf, size, 0);
+}
+
+void qvm_respond(const void *buf, size_t size)
+{
+    qvm_ecall3(QVM_ECALL_RESPOND, (unsigned)buf, size, 0);
+    for (;;) {
+    }
+}
+
+// Stream calls return a window as address (a0) and size (a1)
+static inline void *qvm_ecall_window(unsigned id, unsigned x, size_t *size)
+{
+    register unsigned a0 asm("a0") = x;
+    register unsigned a1 asm("a1");
+    register unsigned a7 asm("a7") = id;
+    asm volatile ("ecall" : "+r"(a0), "=r"(a1) : "r"(a7) : "memory");
+    *size = a1;
+    return (void *)a0;
+}
+
+size_t qvm_stream_init(void *buf, size_t size)
+{
+    return qvm_ecall3(QVM_ECALL_STREAM_INIT, (unsigned)buf, size, 0);
+}
+
+const void *qvm_stream_in(size_t *len)
+{
+    return qvm_ecall_window(QVM_ECALL_STREAM_IN, 0, len);
+}
+
+void *qvm_stream_out(size_t used, size_t *cap)
+{
+    return qvm_ecall_window(QVM_ECALL_STREAM_OUT, used, cap);
+}
+
+// Pipeline ring, layout of r5vm_pipe.h. The counters are free-running, the
+// host sets wait_data/wait_space while a stage blocks in RING_WAIT.
+typedef struct {
+    volatile unsigned head;       // bytes written, producer only
+    unsigned pad0[15];
+    volatile unsigned tail;       // bytes read, consumer only
+    unsigned pad1[15];
+    volatile unsigned wait_data;  // consumer blocked
+    volatile unsigned wait_space; // producer blocked
+    unsigned pad2[30];
+    unsigned char data[];
+} qvm_ring_t;
+
+#define QVM_FENCE() asm volatile ("fence" ::: "memory")
+
+static qvm_ring_t *qvm_ring(unsigned which, unsigned *size)
+{
+    static qvm_ring_t *rings[2];
+    static unsigned sizes[2];
+    if (!rings[which]) {
+        size_t n;
+        rings[which] = qvm_ecall_window(QVM_ECALL_RING_INFO, which, &n);
+        sizes[which] = n;
+    }
+    *size = sizes[which];
+    return rings[which];
+}
+
+size_t qvm_ring_read(void *buf, size_t n)
+{
+    unsigned size;
+    qvm_ring_t *r = qvm_ring(0, &size);
+    if (!r || !n)
+        return 0;
+    const unsigned tail = r->tail;
+    unsigned avail = r->head - tail;
+    while (!avail) {
+        if (!qvm_ecall3(QVM_ECALL_RING_WAIT, (unsigned)r, 0, 0))
+            return 0; // producer halted, ring drained
+        avail = r->head - tail;
+    }
+    QVM_FENCE();
+    if (n > avail)
+        n = avail;
+    const unsigned off = tail & (size - 1);
+    const size_t first = n < size - off ? n : size - off;
+    memcpy(buf, r->data + off, first);
+    memcpy((char *)buf + first, r->data, n - first);
+    QVM_FENCE();
+    r->tail = tail + n;
+    QVM_FENCE();
+    if (r->wait_space)
+        qvm_ecall3(QVM_ECALL_RING_WAKE, (unsigned)r, 0, 0);
+    return n;
+}
+
+size_t qvm_ring_write(const void *buf, size_t n)
+{
+    unsigned size;
+    qvm_ring_t *r = qvm_ring(1, &size);
+    size_t done = 0;
+    if (!r)
+        return 0;
+    while (done < n) {
+        const unsigned head = r->head;
+        unsigned space = size - (head - r->tail);
+        if (!space) {
+            if (!qvm_ecall3(QVM_ECALL_RING_WAIT, (unsigned)r, 0, 0))
+                break; // consumer halted
+            continue;
+        }
+        if (space > n - done)
+            space = n - done;
+        const unsigned off = head & (size - 1);
+        const size_t first = space < size - off ? space : size - off;
+        memcpy(r->data + off, (const char *)buf + done, first);
+        memcpy(r->data, (const char *)buf + done + first, space - first);
+        QVM_FENCE();
+        r->head = head + space;
+        QVM_FENCE();
+        if (r->wait_data)
+            qvm_ecall3(QVM_ECALL_RING_WAKE, (unsigned)r, 0, 0);
+        done += space;
+    }
+    return done;
+}
+
+int qvm_chan_open(unsigned key)
+{
+    return (int)qvm_ecall3(QVM_ECALL_CHAN_OPEN, key, 0, 0);
+}
+
+int qvm_chan_send(int chan, const void *buf, size_t len)
+{
+    return (int)qvm_ecall3(QVM_ECALL_CHAN_SEND, (unsigned)chan, (unsigned)buf, len);
+}
+
+size_t qvm_chan_recv(int chan, void *buf, size_t size)
+{
+    return qvm_ecall3(QVM_ECALL_CHAN_RECV, (unsigned)chan, (unsigned)buf, size);
+}
+
+int qvm_chan_poll(int chan, unsigned timeout_ms)
+{
+    return (int)qvm_ecall3(QVM_ECALL_CHAN_POLL, (unsigned)chan, timeout_ms, 0);
+}
+
+static inline unsigned qvm_ecall6(unsigned id, unsigned x, unsigned y, unsigned z,
+                                  unsigned u, unsigned v, unsigned w)
+{
+    register unsigned a0 asm("a0") = x;
+    register unsigned a1 asm("a1") = y;
+    register unsigned a2 asm("a2") = z;
+    register unsigned a3 asm("a3") = u;
+    register unsigned a4 asm("a4") = v;
+    register unsigned a5 asm("a5") = w;
+    register unsigned a7 asm("a7") = id;
+    asm volatile ("ecall" : "+r"(a0)
+                  : "r"(a1), "r"(a2), "r"(a3), "r"(a4), "r"(a5), "r"(a7) : "memory");
+    return a0;
+}
+
+// Entry of every export, the host passes the export's cookie (fn) in a5
+static void qvm_rpc_entry(unsigned a, unsigned b, unsigned c, void *buf, size_t len,
+                          qvm_rpc_fn fn)
+{
+    qvm_ecall3(QVM_ECALL_RPC_RETURN, fn(a, b, c, buf, len), 0, 0);
+    for (;;) {
+    }
+}
+
+int qvm_rpc_export(unsigned key, qvm_rpc_fn fn, void *stack, size_t stack_size,
+                   void *buf, size_t size)
+{
+    const unsigned top = ((unsigned)stack + stack_size) & ~15u;
+    return (int)qvm_ecall6(QVM_ECALL_RPC_EXPORT, key, (unsigned)qvm_rpc_entry,
+                           (unsigned)fn, top, (unsigned)buf, size);
+}
+
+unsigned qvm_rpc_call(unsigned key, unsigned a, unsigned b, unsigned c, void *buf, size_t len)
+{
+    return qvm_ecall6(QVM_ECALL_RPC_CALL, key, a, b, c, (unsigned)buf, len);
+}
+#endif
+
 // --- Math ---------------------------------------------------------------
 
+#ifndef QVMLIB_NO_ECALL
+
+float sqrtf(float x) { return qvm_ecall_f(QVM_ECALL_SQRTF, x, 0.0f); }
+float fmodf(float x, float y) { return qvm_ecall_f(QVM_ECALL_FMODF, x, y); }
+float sinf(float x) { return qvm_ecall_f(QVM_ECALL_SINF, x, 0.0f); }
+float cosf(float x) { return qvm_ecall_f(QVM_ECALL_COSF, x, 0.0f); }
+float expf(float x) { return qvm_ecall_f(QVM_ECALL_EXPF, x, 0.0f); }
+float logf(float x) { return qvm_ecall_f(QVM_ECALL_LOGF, x, 0.0f); }
+float powf(float x, float y) { return qvm_ecall_f(QVM_ECALL_POWF, x, y); }
+float atan2f(float y, float x) { return qvm_ecall_f(QVM_ECALL_ATAN2F, y, x); }
+
+#else
+
 float sqrtf(float x) {
     if (x <= 0.0f) return 0.0f;
     float y = x;
@@ -39,28 +301,71 @@ float cosf(float x) {
     return sinf(x + (float)M_PI * 0.5f);
 }
 
+#endif // QVMLIB_NO_ECALL
+
 // --- String -------------------------------------------------------------
+//
+// The string and memory routines work on aligned 32-bit words where they
+// can, so the VM interprets far fewer instructions per byte. A word is
+// scanned for a terminating NUL with the "has zero byte" trick.
+
+typedef uint32_t __attribute__((__may_alias__)) qvm_word_t;
+
+#define QVM_ALIGNED(p)    (((uintptr_t)(p) & 3) == 0)
+#define QVM_HAS_ZERO(w)   (((w) - 0x01010101u) & ~(w) & 0x80808080u)
 
 size_t strlen(const char *s) {
     const char *p = s;
+    while (!QVM_ALIGNED(p)) {
+        if (!*p) return (size_t)(p - s);
+        p++;
+    }
+    const qvm_word_t *w = (const qvm_word_t *)p;
+    for (;;) {
+        if (QVM_HAS_ZERO(w[0])) break;
+        if (QVM_HAS_ZERO(w[1])) { w += 1; break; }
+        w += 2;
+    }
+    p = (const char *)w;
     while (*p) p++;
     return (size_t)(p - s);
 }
 
 char *strcpy(char *dst, const char *src) {
     char *d = dst;
+    if (((uintptr_t)d & 3) == ((uintptr_t)src & 3)) {
+        while (!QVM_ALIGNED(src)) {
+            if (!(*d++ = *src++)) return dst;
+        }
+        qvm_word_t *wd = (qvm_word_t *)d;
+        const qvm_word_t *ws = (const qvm_word_t *)src;
+        for (uint32_t w = *ws; !QVM_HAS_ZERO(w); w = *++ws)
+            *wd++ = w;
+        d = (char *)wd;
+        src = (const char *)ws;
+    }
     while ((*d++ = *src++));
     return dst;
 }
 
 char *strcat(char *dst, const char *src) {
-    char *d = dst;
-    while (*d) d++;
-    while ((*d++ = *src++));
+    strcpy(dst + strlen(dst), src);
     return dst;
 }
 
 int strcmp(const char *a, const char *b) {
+    if (((uintptr_t)a & 3) == ((uintptr_t)b & 3)) {
+        while (!QVM_ALIGNED(a)) {
+            if (!*a || *a != *b)
+                return (unsigned char)*a - (unsigned char)*b;
+            a++; b++;
+        }
+        const qvm_word_t *wa = (const qvm_word_t *)a;
+        const qvm_word_t *wb = (const qvm_word_t *)b;
+        while (*wa == *wb && !QVM_HAS_ZERO(*wa)) { wa++; wb++; }
+        a = (const char *)wa;
+        b = (const char *)wb;
+    }
     while (*a && (*a == *b)) { a++; b++; }
     return (unsigned char)*a - (unsigned char)*b;
 }
@@ -235,18 +540,87 @@ int sprintf(char *buffer, const char *fmt, ...) {
 
 // --- Memory -------------------------------------------------------------
 
-void *memcpy(void *dst, const void *src, size_t n)
+/** Copy forwards, word-wise if dst and src share the same alignment */
+static void qvm_copy_fwd(unsigned char *d, const unsigned char *s, size_t n)
 {
-    unsigned char *d = (unsigned char *)dst;
-    const unsigned char *s = (const unsigned char *)src;
+    if (n >= 8 && ((uintptr_t)d & 3) == ((uintptr_t)s & 3)) {
+        while (!QVM_ALIGNED(d)) {
+            *d++ = *s++;
+            n--;
+        }
+        qvm_word_t *wd = (qvm_word_t *)d;
+        const qvm_word_t *ws = (const qvm_word_t *)s;
+        for (; n >= 16; n -= 16, wd += 4, ws += 4) {
+            uint32_t w0 = ws[0], w1 = ws[1], w2 = ws[2], w3 = ws[3];
+            wd[0] = w0; wd[1] = w1; wd[2] = w2; wd[3] = w3;
+        }
+        for (; n >= 4; n -= 4)
+            *wd++ = *ws++;
+        d = (unsigned char *)wd;
+        s = (const unsigned char *)ws;
+    }
     while (n--)
         *d++ = *s++;
+}
+
+/** Copy backwards (for overlapping memmove with dst > src) */
+static void qvm_copy_bwd(unsigned char *d, const unsigned char *s, size_t n)
+{
+    d += n;
+    s += n;
+    if (n >= 8 && ((uintptr_t)d & 3) == ((uintptr_t)s & 3)) {
+        while (!QVM_ALIGNED(d)) {
+            *--d = *--s;
+            n--;
+        }
+        qvm_word_t *wd = (qvm_word_t *)d;
+        const qvm_word_t *ws = (const qvm_word_t *)s;
+        for (; n >= 4; n -= 4)
+            *--wd = *--ws;
+        d = (unsigned char *)wd;
+        s = (const unsigned char *)ws;
+    }
+    while (n--)
+        *--d = *--s;
+}
+
+void *memcpy(void *dst, const void *src, size_t n)
+{
+#ifndef QVMLIB_NO_ECALL
+    if (n >= QVM_ECALL_MIN_SIZE) {
+        qvm_ecall3(QVM_ECALL_MEMCPY, (unsigned)dst, (unsigned)src, n);
+        return dst;
+    }
+#endif
+    qvm_copy_fwd((unsigned char *)dst, (const unsigned char *)src, n);
     return dst;
 }
 
 void *memset(void *dst, int c, size_t n)
 {
+#ifndef QVMLIB_NO_ECALL
+    if (n >= QVM_ECALL_MIN_SIZE) {
+        qvm_ecall3(QVM_ECALL_MEMSET, (unsigned)dst, (unsigned)c, n);
+        return dst;
+    }
+#endif
     unsigned char *d = (unsigned char *)dst;
+    if (n >= 8) {
+        while (!QVM_ALIGNED(d)) {
+            *d++ = (unsigned char)c;
+            n--;
+        }
+        uint32_t w = (unsigned char)c;
+        w |= w << 8;
+        w |= w << 16;
+        qvm_word_t *wd = (qvm_word_t *)d;
+        for (; n >= 16; n -= 16, wd += 4) {
+            wd[0] = w; wd[1] = w; wd[2] = w; wd[3] = w;
+        }
+        for (; n >= 4; n -= 4)
+            *wd++ = w;
+        d = (unsigned char *)wd;
+    }
     while (n--)
         *d++ = (unsigned char)c;
     return dst;
@@ -254,8 +628,29 @@ void *memset(void *dst, int c, size_t n)
 
 int memcmp(const void *a, const void *b, size_t n)
 {
+#ifndef QVMLIB_NO_ECALL
+    if (n >= QVM_ECALL_MIN_SIZE)
+        return (int)qvm_ecall3(QVM_ECALL_MEMCMP, (unsigned)a, (unsigned)b, n);
+#endif
     const unsigned char *p1 = (const unsigned char *)a;
     const unsigned char *p2 = (const unsigned char *)b;
+    if (n >= 8 && ((uintptr_t)p1 & 3) == ((uintptr_t)p2 & 3)) {
+        while (!QVM_ALIGNED(p1)) {
+            if (*p1 != *p2)
+                return (int)*p1 - (int)*p2;
+            p1++;
+            p2++;
+            n--;
+        }
+        const qvm_word_t *w1 = (const qvm_word_t *)p1;
+        const qvm_word_t *w2 = (const qvm_word_t *)p2;
+        for (; n >= 4 && *w1 == *w2; n -= 4) {
+            w1++;
+            w2++;
+        }
+        p1 = (const unsigned char *)w1;
+        p2 = (const unsigned char *)w2;
+    }
     while (n--) {
         if (*p1 != *p2)
             return (int)*p1 - (int)*p2;
@@ -272,16 +667,132 @@ void* memmove(void *dst, const void *src, size_t n)
 
     if (d == s || n == 0)
         return dst;
-
-    if (d < s) {
-        while (n--)
-            *d++ = *s++;
-    } else {
-        d += n;
-        s += n;
-        while (n--)
-            *--d = *--s;
+#ifndef QVMLIB_NO_ECALL
+    if (n >= QVM_ECALL_MIN_SIZE) {
+        qvm_ecall3(QVM_ECALL_MEMMOVE, (unsigned)dst, (unsigned)src, n);
+        return dst;
     }
+#endif
+
+    if (d < s || d >= s + n)
+        qvm_copy_fwd(d, s, n);
+    else
+        qvm_copy_bwd(d, s, n);
     return dst;
 }
 
+// --- Heap ---------------------------------------------------------------
+//
+// Arena between the end of .bss and the stack reserve below _stack_top.
+// Blocks are rounded up to a power of two (including an 8 byte header) and
+// recycled through one free list per size class, so malloc and free are
+// O(1). With QVMLIB_BUMP_ALLOC, blocks are carved off the arena with exact
+// sizes and free() does nothing, for guests that run to completion.
+
+extern char _ebss[];
+extern char _stack_top[];
+
+#ifndef QVM_STACK_SIZE
+#define QVM_STACK_SIZE   (64 * 1024) // bytes below _stack_top kept for the stack
+#endif
+#define QVM_HEAP_HDR     8           // header size, keeps payloads 8-byte aligned
+#define QVM_HEAP_MIN_CLS 4           // smallest block: 16 bytes
+#define QVM_HEAP_MAX_CLS 30          // largest block: 1 GiB
+#define QVM_HEAP_MAX     ((size_t)1 << QVM_HEAP_MAX_CLS)
+
+typedef struct qvm_block_s {
+    size_t size;              // block size in bytes, including the header
+    struct qvm_block_s *next; // free list link
+} qvm_block_t;
+
+static char *qvm_heap_top;    // first unused arena byte, NULL before first use
+#ifndef QVMLIB_BUMP_ALLOC
+static qvm_block_t *qvm_free_list[QVM_HEAP_MAX_CLS + 1];
+#endif
+
+static void *qvm_heap_bump(size_t size) {
+    char *end = _stack_top - QVM_STACK_SIZE;
+    if (!qvm_heap_top)
+        qvm_heap_top = (char *)(((uintptr_t)_ebss + 7) & ~(uintptr_t)7);
+    if (qvm_heap_top > end || size > (size_t)(end - qvm_heap_top))
+        return NULL;
+    void *p = qvm_heap_top;
+    qvm_heap_top += size;
+    return p;
+}
+
+// Internal allocator. malloc() itself is not called from calloc/realloc,
+// so the compiler cannot fuse malloc + memset into a recursive calloc.
+static void *qvm_alloc(size_t n) {
+    if (n > QVM_HEAP_MAX - QVM_HEAP_HDR)
+        return NULL;
+    size_t total = n + QVM_HEAP_HDR;
+#ifdef QVMLIB_BUMP_ALLOC
+    total = (total + 7) & ~(size_t)7;
+    qvm_block_t *b = (qvm_block_t *)qvm_heap_bump(total);
+    if (!b)
+        return NULL;
+#else
+    unsigned cls = total <= (1u << QVM_HEAP_MIN_CLS)
+                 ? QVM_HEAP_MIN_CLS : 32 - (unsigned)__builtin_clz(total - 1);
+    total = (size_t)1 << cls;
+    qvm_block_t *b = qvm_free_list[cls];
+    if (b) {
+        qvm_free_list[cls] = b->next;
+        return (char *)b + QVM_HEAP_HDR;
+    }
+    b = (qvm_block_t *)qvm_heap_bump(total);
+    if (!b)
+        return NULL;
+#endif
+    b->size = total;
+    return (char *)b + QVM_HEAP_HDR;
+}
+
+void *malloc(size_t n) {
+    return qvm_alloc(n);
+}
+
+void free(void *p) {
+#ifndef QVMLIB_BUMP_ALLOC
+    if (!p)
+        return;
+    qvm_block_t *b = (qvm_block_t *)((char *)p - QVM_HEAP_HDR);
+    unsigned cls = 31 - (unsigned)__builtin_clz(b->size);
+    b->next = qvm_free_list[cls];
+    qvm_free_list[cls] = b;
+#else
+    (void)p;
+#endif
+}
+
+void *calloc(size_t n, size_t size) {
+    if (size && n > QVM_HEAP_MAX / size)
+        return NULL;
+    void *p = qvm_alloc(n * size);
+    if (p)
+        memset(p, 0, n * size);
+    return p;
+}
+
+void *realloc(void *p, size_t n) {
+    if (!p)
+        return qvm_alloc(n);
+    const size_t avail = ((qvm_block_t *)((char *)p - QVM_HEAP_HDR))->size - QVM_HEAP_HDR;
+    if (n <= avail)
+        return p;
+    void *q = qvm_alloc(n);
+    if (q) {
+        memcpy(q, p, avail);
+        free(p);
+    }
+    return q;
+}
+
+void qvm_heap_reset(void) {
+    qvm_heap_top = NULL;
+#ifndef QVMLIB_BUMP_ALLOC
+    for (int i = 0; i <= QVM_HEAP_MAX_CLS; i++)
+        qvm_free_list[i] = NULL;
+#endif
+}
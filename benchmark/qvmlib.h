@@ -18,6 +18,11 @@ float fmodf(float x, float y);
 float sinf(float x);
 float cosf(float x);
 float fabsf(float x);
+// Host libm via ECALL, not available with QVMLIB_NO_ECALL:
+float expf(float x);
+float logf(float x);
+float powf(float x, float y);
+float atan2f(float y, float x);
 
 // --- String -------------------------------------------------------------
 size_t strlen(const char *s);
@@ -47,6 +52,79 @@ void *memset(void *dst, int c, size_t n);
 int   memcmp(const void *a, const void *b, size_t n);
 void *memmove(void *dst, const void *src, size_t n);
 
+// --- Heap ---------------------------------------------------------------
+// Size-class allocator over the arena between _ebss and the stack.
+// Define QVMLIB_BUMP_ALLOC when building qvmlib.c for a bump-only heap.
+void *malloc(size_t n);
+void  free(void *p);
+void *calloc(size_t n, size_t size);
+void *realloc(void *p, size_t n);
+void  qvm_heap_reset(void); // release all blocks at once
+
+// --- Host files ---------------------------------------------------------
+// Window of the host file mapped with --map/--map-cow (slot in command line
+// order) and its size in bytes; NULL if the slot is unused. Not available
+// with QVMLIB_NO_ECALL.
+const void *qvm_host_map(unsigned slot, size_t *size);
+
+// --- Job input ----------------------------------------------------------
+// Checkpoint for --fork-server: code before the first call runs once, each
+// job resumes here. Reads the job input (stdin, or the fork-server client)
+// into buf and returns its length. Not available with QVMLIB_NO_ECALL.
+size_t qvm_checkpoint(void *buf, size_t size);
+// Send the job result (--serve response, stdout otherwise) and stop.
+void   qvm_respond(const void *buf, size_t size) __attribute__((noreturn));
+
+// --- Streams ------------------------------------------------------------
+// Window I/O for --filter. qvm_stream_init() splits buf into two input and
+// two output windows and returns the window size. qvm_stream_in() returns
+// the next input window and its length (0 at the end of the input), the
+// previous one goes back to the host. qvm_stream_out() flushes the first
+// `used` bytes of the current output window (pass 0 on the first call) and
+// returns an empty one of *cap bytes. Not available with QVMLIB_NO_ECALL.
+size_t      qvm_stream_init(void *buf, size_t size);
+const void *qvm_stream_in(size_t *len);
+void       *qvm_stream_out(size_t used, size_t *cap);
+
+// --- Pipeline rings -----------------------------------------------------
+// Byte rings between --pipeline stages. qvm_ring_read() blocks until data
+// is available and returns 1..n bytes, 0 once the previous stage halted and
+// the ring is drained. qvm_ring_write() blocks until all n bytes are in the
+// ring, it returns less if the next stage halted. Only an empty or full
+// ring costs a host call. Not available with QVMLIB_NO_ECALL.
+size_t qvm_ring_read(void *buf, size_t n);
+size_t qvm_ring_write(const void *buf, size_t n);
+
+// --- Channels -----------------------------------------------------------
+// Message channels between --actors guests. qvm_chan_open() returns the
+// channel for `key`, shared by every guest opening the same key (-1 if the
+// host table is full). qvm_chan_send() blocks while the channel is full and
+// returns -1 if the message would exceed the guest's --mem-limit; a
+// page-aligned buffer of at least one page is moved, not copied, and reads
+// as zero afterwards. qvm_chan_recv() blocks until a message arrives and
+// returns its length, bytes beyond `size` are dropped. qvm_chan_poll()
+// waits up to timeout_ms (QVM_CHAN_FOREVER: no limit) and returns the length
+// of the next message without taking it, or -1. Not available with
+// QVMLIB_NO_ECALL.
+#define QVM_CHAN_FOREVER 0xFFFFFFFFu
+int    qvm_chan_open(unsigned key);
+int    qvm_chan_send(int chan, const void *buf, size_t len);
+size_t qvm_chan_recv(int chan, void *buf, size_t size);
+int    qvm_chan_poll(int chan, unsigned timeout_ms);
+
+// --- Cross-VM calls -----------------------------------------------------
+// Synchronous calls between --actors guests. qvm_rpc_export() makes fn
+// callable under `key`: calls run on `stack` and get the caller's data in
+// `buf` (at most `size` bytes). A service may exit after exporting, its
+// exports stay callable. qvm_rpc_call() runs the export of `key` on the
+// caller's host thread with three arguments, copies `len` bytes of buf to
+// the service and back, and returns fn's result. Not available with
+// QVMLIB_NO_ECALL.
+typedef unsigned (*qvm_rpc_fn)(unsigned a, unsigned b, unsigned c, void *buf, size_t len);
+int      qvm_rpc_export(unsigned key, qvm_rpc_fn fn, void *stack, size_t stack_size,
+                        void *buf, size_t size);
+unsigned qvm_rpc_call(unsigned key, unsigned a, unsigned b, unsigned c, void *buf, size_t len);
+
 #ifdef __cplusplus
 }
 #endif
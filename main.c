@@ -33,12 +33,32 @@
 #include <string.h> // for strcmp
 #include <ctype.h> // for isspace, tolower
 #include <inttypes.h> // for PRIu32
+#include <time.h> // for clock
 
 #include "r5vm.h"
+#include "r5vm_host.h"
+#include "r5vm_gdb.h"
+#include "r5vm_fork.h"
+#include "r5vm_serve.h"
+#include "r5vm_batch.h"
+#include "r5vm_filter.h"
+#include "r5vm_pipe.h"
+#include "r5vm_chan.h"
+#include "r5vm_dedup.h"
+#include "r5vm_slab.h"
+#include "r5vm_hle.h"
 
 // -------------------------------------------------------------
 
 #define R5VM_MIN_MEM_SIZE   (64 * 1024) // 64 KiB
+#define R5VM_DUMP_CONTEXT   4           // instructions before/after PC in dumps
+#define R5VM_PROFILE_PERIOD 1009        // steps between samples (prime)
+#define R5VM_PROFILE_SLOTS  4096        // distinct PCs tracked (power of two)
+#define R5VM_PROFILE_TOP    20          // PCs printed in the report
+
+static bool g_abi_names = true; // ABI register names in disassembly
+static bool g_quiet = false;    // batch mode: no load messages and dumps
+static size_t g_mem_limit = 0;  // --mem-limit, 0: none
 
 // -------------------------------------------------------------
 
@@ -60,8 +80,54 @@ static size_t parse_mem_arg(const char* s)
 
 // -------------------------------------------------------------
 
-static bool load_file(const char* path, uint8_t** out_mem, size_t*
-                      out_mem_size, size_t override_mem)
+/** Guest memory for an image of `fsize` bytes, 0 if `override_mem` is too small */
+static size_t image_mem_size(size_t fsize, size_t override_mem)
+{
+    // If override_mem is less than fsize, error
+    if (override_mem && override_mem < fsize) {
+        fprintf(stderr, "error: override mem size %zu is less than file size %zu\n",
+                override_mem, fsize);
+        return 0;
+    }
+
+    // Heuristic: +25% or at least fsize+R5VM_MIN_MEM_SIZE
+    size_t base_mem = fsize + (fsize / 4);
+    if (base_mem < fsize + R5VM_MIN_MEM_SIZE) {
+        base_mem = fsize + R5VM_MIN_MEM_SIZE;
+    }
+
+    // If user override, use that
+    size_t total_mem = override_mem ? override_mem : base_mem;
+    // Make sure that total_mem is power of two
+    size_t pow2_mem = 64;
+    while (pow2_mem < total_mem)
+        pow2_mem *= 2;
+    return pow2_mem;
+}
+
+/** Apply --mem-limit to a fresh VM, false if its memory is too large */
+static bool apply_mem_limit(r5vm_host_t* host)
+{
+    if (r5vm_host_set_limit(host, g_mem_limit))
+        return true;
+    fprintf(stderr, "error: guest memory of %zu bytes exceeds --mem-limit %zu\n",
+            host->map_size, g_mem_limit);
+    return false;
+}
+
+static void print_mem_stats(const char* prefix, const r5vm_host_t* host)
+{
+    r5vm_host_stats_t st;
+    r5vm_host_stats(host, &st);
+    fprintf(stderr, "[r5vm] %smemory: guest %zu KiB (%zu KiB resident, %zu KiB mapped), "
+                    "buffers %zu KiB, peak %zu KiB, limit %zu KiB, %u denied\n",
+            prefix, st.guest_bytes / 1024, st.resident_bytes / 1024,
+            st.mapped_bytes / 1024, st.buffer_bytes / 1024, st.peak_bytes / 1024,
+            st.limit_bytes / 1024, st.denied);
+}
+
+static bool load_file(const char* path, r5vm_host_t* host, size_t* out_fsize,
+                      size_t override_mem)
 {
     FILE* f = fopen(path, "rb");
     if (!f) { perror("fopen"); return false; }
@@ -75,61 +141,138 @@ static bool load_file(const char* path, uint8_t** out_mem, size_t*
         return false;
     }
 
-    // If override_mem is less than fsize, error
-    if (override_mem && override_mem < (size_t)fsize) {
+    const size_t total_mem = image_mem_size((size_t)fsize, override_mem);
+    if (!total_mem) {
         fclose(f);
-        fprintf(stderr, "error: override mem size %zu is less than file size %ld\n",
-                override_mem, fsize);
         return false;
     }
 
-    // Heuristic: +25% or at least fsize+R5VM_MIN_MEM_SIZE
-    size_t base_mem = (size_t)fsize + ((size_t)fsize / 4);
-    if (base_mem < (size_t)fsize + R5VM_MIN_MEM_SIZE) {
-        base_mem = (size_t)fsize + R5VM_MIN_MEM_SIZE;
+    if (!r5vm_host_init(host, (uint32_t)total_mem)) {
+        fclose(f);
+        fprintf(stderr, "error: cannot allocate %zu bytes of VM memory\n", total_mem);
+        return false;
     }
-
-    // If user override, use that
-    size_t total_mem = override_mem ? override_mem : base_mem;
-    // Make sure that total_mem is power of two
-    size_t pow2_mem = 64;
-    while (pow2_mem < total_mem)
-        pow2_mem *= 2;
-    total_mem = pow2_mem;
-
-    uint8_t* mem = calloc(total_mem, 1);
-    if (!mem) {
+    if (!apply_mem_limit(host)) {
         fclose(f);
-        perror("calloc");
+        r5vm_host_destroy(host);
         return false;
     }
 
-    size_t nread = fread(mem, 1, (size_t)fsize, f);
+    size_t nread = fread(host->vm.mem, 1, (size_t)fsize, f);
     if (nread != (size_t)fsize) {
         fprintf(stderr, "error: fread failed (read %zu of %zu bytes)\n", nread, (size_t)fsize);
         fclose(f);
-        free(mem);
+        r5vm_host_destroy(host);
         return false;
     }
     fclose(f);
 
-    fprintf(stderr, "[r5vm] program=%ld bytes (%ld.%02ld KiB), allocated=%zu bytes (%zu KiB)%s\n",
-        fsize,
-        fsize / 1024, (fsize % 1024) * 100 / 1024,
-        total_mem,
-        total_mem / 1024,
-        override_mem ? " (user override)" : "");
+    if (!g_quiet) {
+        fprintf(stderr, "[r5vm] program=%ld bytes (%ld.%02ld KiB), allocated=%zu bytes (%zu KiB)%s\n",
+            fsize,
+            fsize / 1024, (fsize % 1024) * 100 / 1024,
+            total_mem,
+            total_mem / 1024,
+            override_mem ? " (user override)" : "");
+    }
+
+    *out_fsize = (size_t)fsize;
+    return true;
+}
+
+static uint8_t* read_file(const char* path, size_t* out_size)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f) { perror("fopen"); return NULL; }
+
+    fseek(f, 0, SEEK_END);
+    long fsize = ftell(f);
+    rewind(f);
+    uint8_t* buf = fsize > 0 ? malloc((size_t)fsize) : NULL;
+    if (!buf || fread(buf, 1, (size_t)fsize, f) != (size_t)fsize) {
+        fprintf(stderr, "error: cannot read %s\n", path);
+        free(buf);
+        fclose(f);
+        return NULL;
+    }
+    fclose(f);
+    *out_size = (size_t)fsize;
+    return buf;
+}
+
+/** Size of the file at `path`, 0 with a message if it is missing or empty */
+static size_t file_size(const char* path)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f) { perror("fopen"); return 0; }
+
+    fseek(f, 0, SEEK_END);
+    long fsize = ftell(f);
+    fclose(f);
+    if (fsize <= 0) {
+        fprintf(stderr, "error: empty file\n");
+        return 0;
+    }
+    return (size_t)fsize;
+}
+
+static bool on_watch_hit(r5vm_host_t* host, uint32_t pc, uint32_t addr,
+                         uint32_t len, uint32_t old_val)
+{
+    uint32_t new_val = 0;
+    for (uint32_t i = 0; i < len && i < 4; i++) /* bulk writes: first word */
+        new_val |= (uint32_t)host->vm.mem[addr + i] << (8 * i);
 
-    *out_mem = mem;
-    *out_mem_size = total_mem;
+    fprintf(stderr, "[r5vm] watch: PC=0x%08" PRIX32 " wrote %" PRIu32
+            " byte(s) at 0x%08" PRIX32 ": 0x%0*" PRIX32 " -> 0x%0*" PRIX32 "\n",
+            pc, len, addr, (int)len * 2, old_val, (int)len * 2, new_val);
     return true;
 }
 
+static bool parse_watch_arg(const char* s, uint32_t* addr, uint32_t* len)
+{
+    char* end;
+    *addr = (uint32_t)strtoul(s, &end, 0);
+    if (*end != ':')
+        return false;
+    *len = (uint32_t)parse_mem_arg(end + 1);
+    return *len > 0;
+}
+
+static bool parse_map_arg(char* s, const char** path, uint32_t* addr)
+{
+    char* at = strrchr(s, '@');
+    char* end;
+    if (!at || at == s)
+        return false;
+    *at = '\0';
+    *path = s;
+    *addr = (uint32_t)strtoul(at + 1, &end, 0);
+    return *end == '\0' && end != at + 1;
+}
+
 // -------------------------------------------------------------
 
-static void r5vm_dump_state(const r5vm_t* vm)
+/**
+ * Instruction word at `addr`, assembled little-endian like the core's fetch.
+ * Returns `false` for words the host cannot read, e.g. in the stack guard
+ * of `host` (NULL: plain VM).
+ */
+static bool inst_at(const r5vm_host_t* host, const r5vm_t* vm, uint32_t addr,
+                    uint32_t* word)
+{
+    addr &= vm->mem_mask & ~3u;
+    if (!r5vm_host_readable(host, vm, addr, 4))
+        return false;
+    const uint8_t* p = vm->mem + addr;
+    *word = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+    return true;
+}
+
+static void r5vm_dump_state(const r5vm_t* vm, uint32_t pc)
 {
     if (!vm) return;
+    const r5vm_host_t* host = r5vm_host_active(vm);
 
     fprintf(stderr, "---- R5VM STATE DUMP ----\n");
     fprintf(stderr, " PC:  0x%08X\n", vm->pc);
@@ -145,48 +288,884 @@ static void r5vm_dump_state(const r5vm_t* vm)
 
     fprintf(stderr, " MEM: 0x%p .. 0x%p (%" PRIu32 " bytes)\n",
             (void*)vm->mem, (void*)(vm->mem + vm->mem_size - 1), vm->mem_size);
+
+    // Code around the faulting PC, which is marked with '>'
+    pc &= vm->mem_mask & ~3u;
+    for (int i = -R5VM_DUMP_CONTEXT; i <= R5VM_DUMP_CONTEXT; i++) {
+        uint32_t addr = pc + 4u * (uint32_t)i;
+        if (addr > vm->mem_size - 4)
+            continue;
+        uint32_t word;
+        if (!inst_at(host, vm, addr, &word)) {
+            fprintf(stderr, " %c %08X: ????????\n", i == 0 ? '>' : ' ', addr);
+            continue;
+        }
+        char text[64];
+        r5vm_disasm(text, sizeof(text), word, addr, g_abi_names);
+        fprintf(stderr, " %c %08X: %08X  %s\n", i == 0 ? '>' : ' ', addr, word, text);
+    }
     fprintf(stderr, "--------------------------\n");
 }
 
 void r5vm_error(r5vm_t* vm, const char* msg, uint32_t pc, uint32_t instr)
 {
-    fprintf(stderr, "R5VM ERROR at PC=0x%08X: %s (instr=0x%08X)\n", pc, msg, instr);
+    char text[64];
+    r5vm_disasm(text, sizeof(text), instr, pc, g_abi_names);
+    fprintf(stderr, "R5VM ERROR at PC=0x%08X: %s (instr=0x%08X: %s)\n",
+            pc, msg, instr, text);
 
-    r5vm_dump_state(vm);
+    if (!g_quiet)
+        r5vm_dump_state(vm, pc);
 }
 
 // -------------------------------------------------------------
 
-int main(int argc, char** argv)
+static void disasm_image(const r5vm_t* vm, size_t size)
 {
-    if (argc < 2) {
-        fprintf(stderr, "usage: %s <binary> [--mem N|Nk|Nm]\n", argv[0]);
+    char text[64];
+    for (uint32_t addr = 0; addr + 4 <= size; addr += 4) {
+        uint32_t word = 0;
+        inst_at(NULL, vm, addr, &word);
+        r5vm_disasm(text, sizeof(text), word, addr, g_abi_names);
+        printf("%8" PRIx32 ":\t%08" PRIx32 "  \t%s\n", addr, word, text);
+    }
+}
+
+static void run_trace(r5vm_host_t* host)
+{
+    r5vm_t* vm = &host->vm;
+    char text[64];
+    do {
+        uint32_t word;
+        if (!inst_at(host, vm, vm->pc, &word)) {
+            fprintf(stderr, "[trace] %08" PRIX32 ": ????????\n", vm->pc);
+            continue;
+        }
+        r5vm_disasm(text, sizeof(text), word, vm->pc, g_abi_names);
+        fprintf(stderr, "[trace] %08" PRIX32 ": %08" PRIX32 "  %s\n", vm->pc, word, text);
+    } while ((r5vm_host_run(host, 1) == 1 && vm->status == R5VM_RUNNING) ||
+             r5vm_paused(vm));
+}
+
+typedef struct profile_slot_s
+{
+    uint32_t pc;
+    uint32_t count; /**< 0 = free slot */
+} profile_slot_t;
+
+static int profile_cmp(const void* a, const void* b)
+{
+    const profile_slot_t* x = a;
+    const profile_slot_t* y = b;
+    return (x->count < y->count) - (x->count > y->count);
+}
+
+/**
+ * Sampling profiler: run in slices of R5VM_PROFILE_PERIOD steps and count
+ * the PC at the end of each slice. A prime period avoids locking onto loops.
+ */
+static void run_profile(r5vm_host_t* host)
+{
+    static profile_slot_t slots[R5VM_PROFILE_SLOTS];
+    r5vm_t* vm = &host->vm;
+    uint32_t samples = 0, dropped = 0;
+    uint64_t steps = 0;
+
+    for (;;) {
+        steps += r5vm_host_run(host, R5VM_PROFILE_PERIOD);
+        if (vm->status != R5VM_RUNNING && !r5vm_paused(vm))
+            break;
+        samples++;
+        uint32_t h = (vm->pc >> 2) * 2654435761u;
+        uint32_t i, n;
+        for (i = h >> 20, n = 0; n < R5VM_PROFILE_SLOTS; i++, n++) {
+            profile_slot_t* s = &slots[i & (R5VM_PROFILE_SLOTS - 1)];
+            if (s->count == 0 || s->pc == vm->pc) {
+                s->pc = vm->pc;
+                s->count++;
+                break;
+            }
+        }
+        if (n == R5VM_PROFILE_SLOTS)
+            dropped++;
+    }
+
+    qsort(slots, R5VM_PROFILE_SLOTS, sizeof(slots[0]), profile_cmp);
+    fprintf(stderr, "[r5vm] profile: %" PRIu64 " instructions, %" PRIu32
+            " samples every %u steps", steps, samples, R5VM_PROFILE_PERIOD);
+    if (dropped)
+        fprintf(stderr, " (%" PRIu32 " dropped)", dropped);
+    fprintf(stderr, "\n");
+    for (int i = 0; i < R5VM_PROFILE_TOP && slots[i].count; i++) {
+        uint32_t word;
+        char text[64] = "????????";
+        if (inst_at(host, vm, slots[i].pc, &word))
+            r5vm_disasm(text, sizeof(text), word, slots[i].pc, g_abi_names);
+        fprintf(stderr, "  %5.1f%%  %8" PRIu32 "  %08" PRIX32 ": %s\n",
+                100.0 * slots[i].count / samples, slots[i].count, slots[i].pc, text);
+    }
+}
+
+// -------------------------------------------------------------
+
+/** Image and per-image host setup, shared by the first load and reloads */
+typedef struct image_opts_s
+{
+    const char* path;        // guest binary
+    size_t      mem;         // --mem, 0: derived from the image size
+    const char* hle_elf;     // --hle
+    size_t      stack_limit; // --stack-guard
+    const char* map_path[R5VM_HOST_MAX_MAPS];
+    uint32_t    map_addr[R5VM_HOST_MAX_MAPS];
+    bool        map_cow[R5VM_HOST_MAX_MAPS];
+    int         map_count;
+    uint32_t    watch_addr[R5VM_HOST_MAX_WATCH]; // --watch
+    uint32_t    watch_len[R5VM_HOST_MAX_WATCH];
+    int         watch_count;
+} image_opts_t;
+
+/** Load the image, bind HLE natives, map files, place the stack guard and
+    add the watchpoints */
+static bool setup_image(r5vm_host_t* host, r5vm_hle_t* hle, const image_opts_t* o)
+{
+    size_t fsize = 0;
+    if (!load_file(o->path, host, &fsize, o->mem))
+        return false;
+
+    if (o->hle_elf) {
+        size_t elf_size = 0;
+        uint8_t* elf = read_file(o->hle_elf, &elf_size);
+        r5vm_hle_init(hle, &host->vm);
+        int bound = elf ? r5vm_hle_bind_builtins(hle, &host->vm, elf, elf_size) : -1;
+        free(elf);
+        if (bound < 0) {
+            fprintf(stderr, "error: no symbol table in '%s'\n", o->hle_elf);
+            r5vm_host_destroy(host);
+            return false;
+        }
+        fprintf(stderr, "[r5vm] hle: %d function(s) replaced by host natives\n", bound);
+    }
+
+    for (int i = 0; i < o->map_count; i++) {
+        if (o->map_addr[i] < fsize ||
+            r5vm_host_map_file(host, o->map_path[i], o->map_addr[i], o->map_cow[i]) < 0) {
+            fprintf(stderr, "error: cannot map '%s' at 0x%08" PRIX32 "\n",
+                    o->map_path[i], o->map_addr[i]);
+            r5vm_host_destroy(host);
+            return false;
+        }
+        fprintf(stderr, "[r5vm] map %d: '%s' at 0x%08" PRIX32 " (%" PRIu32 " bytes%s)\n",
+                i, o->map_path[i], o->map_addr[i], host->files[i].file_size,
+                o->map_cow[i] ? ", copy-on-write" : "");
+    }
+
+    if (o->stack_limit) {
+        if (!r5vm_host_stack_guard(host, (uint32_t)o->stack_limit) ||
+            host->guard_lo < fsize) {
+            fprintf(stderr, "error: cannot place stack guard below 0x%zX\n",
+                    o->stack_limit);
+            r5vm_host_destroy(host);
+            return false;
+        }
+        fprintf(stderr, "[r5vm] stack guard at 0x%08" PRIX32 "..0x%08" PRIX32 "\n",
+                host->guard_lo, host->guard_hi - 1);
+    }
+
+    host->watch_fn = on_watch_hit;
+    for (int i = 0; i < o->watch_count; i++) {
+        if (r5vm_host_watch(host, o->watch_addr[i], o->watch_len[i]) < 0) {
+            fprintf(stderr, "error: cannot watch 0x%08" PRIX32 ":%" PRIu32 "\n",
+                    o->watch_addr[i], o->watch_len[i]);
+            r5vm_host_destroy(host);
+            return false;
+        }
+    }
+    return true;
+}
+
+/** A reloaded --serve image, owns the HLE table its VMs point to */
+typedef struct serve_image_s
+{
+    r5vm_host_t host; // first member, serve_release() casts back
+    r5vm_hle_t  hle;
+} serve_image_t;
+
+static r5vm_host_t* serve_load(void* user)
+{
+    serve_image_t* img = malloc(sizeof(*img));
+    if (!img)
+        return NULL;
+    if (!setup_image(&img->host, &img->hle, user)) {
+        free(img);
+        return NULL;
+    }
+    r5vm_reset(&img->host.vm);
+    return &img->host;
+}
+
+static void serve_release(r5vm_host_t* host, void* user)
+{
+    (void)user;
+    r5vm_host_destroy(host);
+    free((serve_image_t*)host);
+}
+
+static r5vm_host_t* batch_load(r5vm_pool_t* pool, const r5vm_batch_job_t* job)
+{
+    const uint8_t* data = job->data;
+    size_t size = job->data_size;
+    uint8_t* file = NULL;
+    if (!data) { // not preloaded by the coordinator
+        file = read_file(job->image, &size);
+        if (!file)
+            return NULL;
+        data = file;
+    }
+
+    const size_t mem = image_mem_size(size, job->mem_size);
+    r5vm_host_t* host = mem ? r5vm_pool_acquire(pool, (uint32_t)mem) : NULL;
+    if (host && !apply_mem_limit(host)) {
+        r5vm_pool_release(pool, host);
+        host = NULL;
+    }
+    if (host)
+        memcpy(host->vm.mem, data, size);
+    free(file);
+    return host;
+}
+
+static char* next_token(char** p)
+{
+    char* s = *p;
+    while (*s == ' ' || *s == '\t' || *s == '\r')
+        s++;
+    if (!*s)
+        return NULL;
+    char* end = s;
+    while (*end && *end != ' ' && *end != '\t' && *end != '\r')
+        end++;
+    *p = *end ? end + 1 : end;
+    *end = '\0';
+    return s;
+}
+
+static bool add_job(r5vm_batch_job_t** jobs, unsigned* count, const char* image,
+                    size_t mem, uint64_t fuel)
+{
+    if ((*count & (*count - 1)) == 0) { // grow at powers of two
+        r5vm_batch_job_t* p = realloc(*jobs, (*count ? *count * 2 : 16) * sizeof(**jobs));
+        if (!p)
+            return false;
+        *jobs = p;
+    }
+    memset(&(*jobs)[*count], 0, sizeof(**jobs));
+    (*jobs)[*count].image = image;
+    (*jobs)[*count].mem_size = (uint32_t)mem;
+    (*jobs)[*count].fuel = fuel;
+    (*count)++;
+    return true;
+}
+
+/**
+ * Manifest: one job per line, "IMAGE [MEM [FUEL]]", '#' starts a comment.
+ * Missing or zero values take the --mem/--fuel defaults. Job images point
+ * into `text`, which must stay allocated.
+ */
+static bool parse_manifest(char* text, r5vm_batch_job_t** jobs, unsigned* count)
+{
+    for (char* line = text; line && *line;) {
+        char* nl = strchr(line, '\n');
+        if (nl)
+            *nl = '\0';
+        char* hash = strchr(line, '#');
+        if (hash)
+            *hash = '\0';
+        char* p = line;
+        const char* image = next_token(&p);
+        const char* mem = image ? next_token(&p) : NULL;
+        const char* fuel = mem ? next_token(&p) : NULL;
+        if (image && !add_job(jobs, count, image, mem ? parse_mem_arg(mem) : 0,
+                              fuel ? strtoull(fuel, NULL, 0) : 0))
+            return false;
+        line = nl ? nl + 1 : NULL;
+    }
+    return true;
+}
+
+static int run_batch(int argc, char** argv)
+{
+    r5vm_batch_job_t* jobs = NULL;
+    unsigned count = 0;
+    char* manifest[16];
+    int manifests = 0;
+    size_t mem = 0;
+    uint64_t fuel = 0;
+    unsigned long threads = 0, procs = 0;
+    int rc = 1;
+
+    g_quiet = true;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            threads = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--procs") == 0 && i + 1 < argc) {
+            procs = strtoul(argv[++i], NULL, 0);
+            if (procs == 0 || procs > 1024) {
+                fprintf(stderr, "error: invalid process count '%s'\n", argv[i]);
+                goto done;
+            }
+        } else if (strcmp(argv[i], "--mem") == 0 && i + 1 < argc) {
+            mem = parse_mem_arg(argv[++i]);
+        } else if (strcmp(argv[i], "--mem-limit") == 0 && i + 1 < argc) {
+            g_mem_limit = parse_mem_arg(argv[++i]);
+        } else if (strcmp(argv[i], "--fuel") == 0 && i + 1 < argc) {
+            fuel = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--manifest") == 0 && i + 1 < argc &&
+                   manifests < (int)(sizeof(manifest) / sizeof(manifest[0]))) {
+            size_t size = 0;
+            uint8_t* text = read_file(argv[++i], &size);
+            char* str = text ? realloc(text, size + 1) : NULL;
+            if (!str) {
+                free(text);
+                goto done;
+            }
+            str[size] = '\0';
+            manifest[manifests++] = str;
+            if (!parse_manifest(str, &jobs, &count))
+                goto done;
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "error: unknown batch option '%s'\n", argv[i]);
+            goto done;
+        } else if (!add_job(&jobs, &count, argv[i], 0, 0)) {
+            goto done;
+        }
+    }
+    if (!count) {
+        fprintf(stderr, "error: no batch jobs\n");
+        goto done;
+    }
+    for (unsigned i = 0; i < count; i++) {
+        if (!jobs[i].mem_size)
+            jobs[i].mem_size = (uint32_t)mem;
+        if (!jobs[i].fuel)
+            jobs[i].fuel = fuel;
+    }
+
+    const double seconds = procs ?
+        r5vm_batch_run_procs(jobs, count, (unsigned)procs, batch_load) :
+        r5vm_batch_run(jobs, count, (unsigned)threads, batch_load);
+    if (seconds < 0.0) {
+        fprintf(stderr, "error: cannot start batch %s\n", procs ? "workers" : "threads");
+        goto done;
+    }
+    rc = r5vm_batch_report(jobs, count, seconds, stderr) ? 0 : 1;
+
+done:
+    for (int i = 0; i < manifests; i++)
+        free(manifest[i]);
+    free(jobs);
+    return rc;
+}
+
+static int run_pipeline(int argc, char** argv)
+{
+    r5vm_host_t hosts[R5VM_PIPE_MAX_STAGES];
+    r5vm_host_t* stages[R5VM_PIPE_MAX_STAGES];
+    const char* images[R5VM_PIPE_MAX_STAGES];
+    unsigned count = 0, loaded = 0;
+    size_t mem = 0, ring_addr = 0, ring_size = 64 * 1024;
+    bool pin = true;
+    int rc = 1;
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--mem") == 0 && i + 1 < argc) {
+            mem = parse_mem_arg(argv[++i]);
+        } else if (strcmp(argv[i], "--mem-limit") == 0 && i + 1 < argc) {
+            g_mem_limit = parse_mem_arg(argv[++i]);
+        } else if (strcmp(argv[i], "--ring") == 0 && i + 1 < argc) {
+            ring_addr = parse_mem_arg(argv[++i]);
+        } else if (strcmp(argv[i], "--ring-size") == 0 && i + 1 < argc) {
+            ring_size = parse_mem_arg(argv[++i]);
+        } else if (strcmp(argv[i], "--no-pin") == 0) {
+            pin = false;
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "error: unknown pipeline option '%s'\n", argv[i]);
+            return 1;
+        } else if (count < R5VM_PIPE_MAX_STAGES) {
+            images[count++] = argv[i];
+        } else {
+            fprintf(stderr, "error: more than %d pipeline stages\n", R5VM_PIPE_MAX_STAGES);
+            return 1;
+        }
+    }
+    if (!count) {
+        fprintf(stderr, "error: no pipeline stages\n");
         return 1;
     }
 
-    size_t override_mem = 0;
-    if (argc >= 4 && strcmp(argv[2], "--mem") == 0)
-        override_mem = parse_mem_arg(argv[3]);
+    if (ring_size > (1u << 30)) {
+        fprintf(stderr, "error: ring size %zu exceeds 1 GiB\n", ring_size);
+        return 1;
+    }
 
-    uint8_t* mem = NULL;
-    size_t mem_size = 0;
-    if (!load_file(argv[1], &mem, &mem_size, override_mem)) {
+    // The rings go above the memory the largest image would get on its own,
+    // which holds its code, .bss and stack; every stage grows to fit them.
+    size_t fsizes[R5VM_PIPE_MAX_STAGES], base = 0;
+    for (unsigned i = 0; i < count; i++) {
+        fsizes[i] = file_size(images[i]);
+        if (!fsizes[i])
+            return 1;
+        const size_t own = image_mem_size(fsizes[i], 0);
+        if (own > base)
+            base = own;
+    }
+    const size_t page = r5vm_host_page_size();
+    const size_t span = r5vm_pipe_ring_span(count, (uint32_t)ring_size);
+    if (!ring_addr)
+        ring_addr = base;
+    const size_t ring_end = ring_addr + span;
+    for (unsigned i = 0; i < count && span; i++) {
+        const size_t image_end = (fsizes[i] + page - 1) & ~(page - 1);
+        if (ring_addr < image_end) {
+            fprintf(stderr, "error: rings at 0x%08zX overlap stage %u (%s), "
+                            "its image ends at 0x%08zX\n",
+                    ring_addr, i + 1, images[i], image_end);
+            return 1;
+        }
+    }
+    if (ring_end > UINT32_MAX || (mem && ring_end > mem)) {
+        fprintf(stderr, "error: rings at 0x%08zX..0x%08zX do not fit in %zu bytes "
+                        "of guest memory\n", ring_addr, ring_end - 1,
+                mem ? mem : (size_t)UINT32_MAX + 1);
         return 1;
     }
+    if (!mem) // smallest power of two that holds the rings
+        mem = image_mem_size(ring_end, ring_end);
+
+    for (; loaded < count; loaded++) {
+        size_t fsize;
+        if (!load_file(images[loaded], &hosts[loaded], &fsize, mem))
+            goto done;
+        r5vm_reset(&hosts[loaded].vm);
+        stages[loaded] = &hosts[loaded];
+    }
+
+    if (!r5vm_pipe_run(stages, count, (uint32_t)ring_addr, (uint32_t)ring_size, pin))
+        goto done;
+    rc = 0;
+    for (unsigned i = 0; i < count; i++) {
+        const r5vm_t* vm = &hosts[i].vm;
+        if (vm->status == R5VM_EXIT) {
+            fprintf(stderr, "[r5vm] stage %u (%s): exit code %" PRIu32 "\n",
+                    i + 1, images[i], vm->a0 & 0xFF);
+        } else {
+            fprintf(stderr, "[r5vm] stage %u (%s): stopped at PC=0x%08" PRIX32 "\n",
+                    i + 1, images[i], vm->pc);
+        }
+        if (vm->status != R5VM_EXIT || (vm->a0 & 0xFF))
+            rc = 1;
+    }
 
-    r5vm_t vm;
-    if (!r5vm_init(&vm, mem, (uint32_t)mem_size)) {
-        fprintf(stderr, "error: r5vm_init failed\n");
-        free(mem);
+done:
+    for (unsigned i = 0; i < loaded; i++)
+        r5vm_host_destroy(&hosts[i]);
+    return rc;
+}
+
+static int run_actors(int argc, char** argv)
+{
+    r5vm_host_t* hosts = calloc((size_t)argc, sizeof(*hosts));
+    r5vm_host_t** vms = calloc((size_t)argc, sizeof(*vms));
+    const char** images = calloc((size_t)argc, sizeof(*images));
+    unsigned count = 0, loaded = 0;
+    unsigned long threads = 0;
+    long dedup_ms = -1;
+    bool dedup_on = false;
+    r5vm_dedup_t dedup;
+    size_t mem = 0;
+    int rc = 1;
+
+    if (!hosts || !vms || !images)
+        goto done;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--mem") == 0 && i + 1 < argc) {
+            mem = parse_mem_arg(argv[++i]);
+        } else if (strcmp(argv[i], "--mem-limit") == 0 && i + 1 < argc) {
+            g_mem_limit = parse_mem_arg(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--dedup") == 0 && i + 1 < argc) {
+            dedup_ms = (long)strtoul(argv[++i], NULL, 0);
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "error: unknown actors option '%s'\n", argv[i]);
+            goto done;
+        } else {
+            images[count++] = argv[i];
+        }
+    }
+    if (!count) {
+        fprintf(stderr, "error: no actors\n");
+        goto done;
+    }
+
+    for (; loaded < count; loaded++) {
+        size_t fsize;
+        if (!load_file(images[loaded], &hosts[loaded], &fsize, mem))
+            goto done;
+        r5vm_reset(&hosts[loaded].vm);
+        vms[loaded] = &hosts[loaded];
+    }
+    if (dedup_ms >= 0) {
+        if (!r5vm_dedup_init(&dedup)) {
+            fprintf(stderr, "error: page dedup requires memfd and /proc/self/pagemap\n");
+            goto done;
+        }
+        dedup_on = true;
+        for (unsigned i = 0; i < count; i++) {
+            if (!r5vm_dedup_add(&dedup, vms[i])) {
+                fprintf(stderr, "error: out of memory\n");
+                goto done;
+            }
+        }
+        if (dedup_ms && !r5vm_dedup_start(&dedup, (uint32_t)dedup_ms)) {
+            fprintf(stderr, "error: cannot start dedup thread\n");
+            goto done;
+        }
+    }
+    if (!r5vm_chan_run(vms, count, (unsigned)threads, dedup_on ? &dedup : NULL))
+        goto done;
+    rc = 0;
+    for (unsigned i = 0; i < count; i++) {
+        const r5vm_t* vm = &hosts[i].vm;
+        if (vm->status == R5VM_EXIT) {
+            fprintf(stderr, "[r5vm] actor %u (%s): exit code %" PRIu32 "\n",
+                    i + 1, images[i], vm->a0 & 0xFF);
+        } else {
+            fprintf(stderr, "[r5vm] actor %u (%s): stopped at PC=0x%08" PRIX32 "\n",
+                    i + 1, images[i], vm->pc);
+        }
+        if (g_mem_limit) {
+            char prefix[32];
+            snprintf(prefix, sizeof(prefix), "actor %u ", i + 1);
+            print_mem_stats(prefix, &hosts[i]);
+        }
+        if (vm->status != R5VM_EXIT || (vm->a0 & 0xFF))
+            rc = 1;
+    }
+    if (dedup_on) {
+        r5vm_dedup_stats_t st;
+        r5vm_dedup_scan(&dedup);
+        r5vm_dedup_stats(&dedup, &st);
+        fprintf(stderr, "[r5vm] dedup: %u scans, %zu pages share %zu store pages, "
+                        "%zu zero pages dropped, %zu KiB saved, %zu merges failed\n",
+                st.scans, st.shared_pages, st.store_pages, st.zero_pages,
+                st.saved_bytes / 1024, st.share_failed);
+    }
+
+done:
+    if (dedup_on) /* merged pages stay valid until their VM is destroyed */
+        r5vm_dedup_destroy(&dedup);
+    for (unsigned i = 0; i < loaded; i++)
+        r5vm_host_destroy(&hosts[i]);
+    free(images);
+    free(vms);
+    free(hosts);
+    return rc;
+}
+
+static double elapsed_s(clock_t start)
+{
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/** Rate in millions per second, guarded against a too coarse clock */
+static double mega_rate(unsigned n, double seconds)
+{
+    return n / (seconds > 1e-6 ? seconds : 1e-6) / 1e6;
+}
+
+static int run_slab(int argc, char** argv)
+{
+    unsigned long count = 0;
+    size_t mem = 0;
+    unsigned fuel = 0;
+    const char* image = NULL;
+
+    g_quiet = true;
+    count = strtoul(argv[2], NULL, 0);
+    if (count == 0 || count > UINT32_MAX) {
+        fprintf(stderr, "error: invalid instance count '%s'\n", argv[2]);
+        return 1;
+    }
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "--mem") == 0 && i + 1 < argc) {
+            mem = parse_mem_arg(argv[++i]);
+        } else if (strcmp(argv[i], "--fuel") == 0 && i + 1 < argc) {
+            fuel = (unsigned)strtoul(argv[++i], NULL, 0);
+        } else if (argv[i][0] == '-' || image) {
+            fprintf(stderr, "error: unknown slab option '%s'\n", argv[i]);
+            return 1;
+        } else {
+            image = argv[i];
+        }
+    }
+    if (!image) {
+        fprintf(stderr, "error: no slab image\n");
         return 1;
     }
 
-    r5vm_reset(&vm);
-    r5vm_run(&vm, 0);
+    size_t fsize = 0;
+    uint8_t* data = read_file(image, &fsize);
+    const size_t slot = data ? image_mem_size(fsize, mem) : 0;
+    r5vm_slab_t slab;
+    if (!slot || slot > UINT32_MAX || !r5vm_slab_init(&slab, (uint32_t)count, (uint32_t)slot)) {
+        if (slot)
+            fprintf(stderr, "error: cannot reserve %lu VMs of %zu bytes\n", count, slot);
+        free(data);
+        return 1;
+    }
+    r5vm_t** vms = malloc(count * sizeof(*vms));
+#if !defined(_WIN32)
+    FILE* null_out = fopen("/dev/null", "w");
+#else
+    FILE* null_out = fopen("NUL", "w");
+#endif
+    int rc = 1;
+    if (!vms || !null_out)
+        goto done;
 
-    r5vm_destroy(&vm);
-    free(mem);
+    /* cold: every slot is fresh, warm: slots come back from the free list */
+    clock_t t = clock();
+    for (unsigned long i = 0; i < count; i++)
+        vms[i] = r5vm_slab_create(&slab, data, (uint32_t)fsize);
+    const double cold_s = elapsed_s(t);
 
-    return 0;
+    unsigned ok = 0;
+    uint64_t steps = 0;
+    t = clock();
+    for (unsigned long i = 0; i < count; i++) {
+        r5vm_t* vm = vms[i];
+        unsigned n = 0;
+        vm->out = null_out;
+        do {
+            n += r5vm_run(vm, fuel ? fuel - n : 0);
+        } while (r5vm_paused(vm) && (!fuel || n < fuel));
+        steps += n;
+        ok += vm->status == R5VM_EXIT && (vm->a0 & 0xFF) == 0;
+    }
+    const double run_s = elapsed_s(t);
+    const size_t resident = r5vm_slab_resident(&slab);
+
+    t = clock();
+    for (unsigned long i = 0; i < count; i++)
+        r5vm_slab_free(&slab, vms[i]);
+    const double free_s = elapsed_s(t);
+
+    t = clock();
+    for (unsigned long i = 0; i < count; i++)
+        vms[i] = r5vm_slab_create(&slab, data, (uint32_t)fsize);
+    const double warm_s = elapsed_s(t);
+
+    fprintf(stderr, "[r5vm] slab: %lu VMs of %zu KiB, %zu bytes resident per VM after the run, "
+                    "%.0f VMs/GiB\n",
+            count, slot / 1024, resident / count,
+            (double)count * (1024.0 * 1024.0 * 1024.0) / (double)resident);
+    fprintf(stderr, "[r5vm] slab: create %.2f M/s (cold), %.2f M/s (warm), free %.2f M/s\n",
+            mega_rate((unsigned)count, cold_s), mega_rate((unsigned)count, warm_s),
+            mega_rate((unsigned)count, free_s));
+    fprintf(stderr, "[r5vm] slab: ran %lu guests in %.3f s, %u exited with code 0, "
+                    "%" PRIu64 " instructions\n", count, run_s, ok, steps);
+    rc = ok == count ? 0 : 1;
+
+done:
+    if (null_out)
+        fclose(null_out);
+    free(vms);
+    r5vm_slab_destroy(&slab);
+    free(data);
+    return rc;
+}
+
+// -------------------------------------------------------------
+
+static void usage(const char* prog)
+{
+    fprintf(stderr, "usage: %s <binary> [options]\n"
+                    "       %s --batch [--jobs N | --procs N] [--mem N] [--fuel N] [--manifest FILE]\n"
+                    "             [binary...]  run many jobs on all cores, see README\n"
+                    "       %s --pipeline [--mem N] [--ring ADDR] [--ring-size N] [--no-pin]\n"
+                    "             stage.bin...  run VMs as stages connected by rings,\n"
+                    "             by default placed above the largest image and its stack\n"
+                    "       %s --actors [--threads N] [--mem N] [--dedup MS] actor.bin...\n"
+                    "             run VMs on a thread pool, talking over channels,\n"
+                    "             merge identical pages every MS ms (0: once at the end)\n"
+                    "       %s --slab COUNT [--mem N] [--fuel N] binary\n"
+                    "             pack COUNT tiny VMs into one slab, report density and rates\n"
+                    "  --mem N|Nk|Nm        guest memory size\n"
+                    "  --mem-limit N        per-VM quota for guest memory and host buffers;\n"
+                    "                       --serve workers and --fork-server jobs inherit\n"
+                    "                       it, also for --batch, --pipeline and --actors,\n"
+                    "                       not for --slab\n"
+                    "  --stack-guard ADDR   no-access guard page below stack limit ADDR\n"
+                    "  --watch ADDR:LEN     report guest stores to ADDR..ADDR+LEN-1\n"
+                    "  --map FILE@ADDR      map FILE read-only at page-aligned ADDR\n"
+                    "  --map-cow FILE@ADDR  map a private copy-on-write view of FILE\n"
+                    "  --gdb PORT           wait for gdb on 127.0.0.1:PORT\n"
+                    "  --fork-server PATH   run to the checkpoint ECALL, fork a job per\n"
+                    "                       connection on Unix socket PATH\n"
+                    "  --serve PATH         serve requests on Unix socket PATH with a pool\n"
+                    "                       of VMs warmed up to the checkpoint ECALL\n"
+                    "  --jobs N             number of VMs for --serve (default 4)\n"
+                    "  --fuel N             instructions per --serve request (default 2^32,\n"
+                    "                       0: unlimited)\n"
+                    "  --filter             stream stdin through the guest's stream windows\n"
+                    "                       to stdout, I/O runs on host threads\n"
+                    "  --hle ELF            run libc/libgcc functions found in ELF as host natives\n"
+                    "  --trace              print every executed instruction\n"
+                    "  --profile            sample PCs and print the hottest instructions\n"
+                    "  --disasm             disassemble the binary and exit\n"
+                    "  --numeric            x0..x31 register names in disassembly\n",
+            prog, prog, prog, prog, prog);
 }
 
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (strcmp(argv[1], "--batch") == 0)
+        return run_batch(argc, argv);
+    if (strcmp(argv[1], "--pipeline") == 0)
+        return run_pipeline(argc, argv);
+    if (strcmp(argv[1], "--actors") == 0)
+        return run_actors(argc, argv);
+    if (strcmp(argv[1], "--slab") == 0 && argc > 2)
+        return run_slab(argc, argv);
+
+    image_opts_t opts;
+    unsigned long gdb_port = 0;
+    bool trace = false, profile = false, disasm = false, filter = false;
+    const char* fork_path = NULL;
+    const char* serve_path = NULL;
+    unsigned long jobs = 4;
+    uint64_t fuel = R5VM_SERVE_FUEL;
+    memset(&opts, 0, sizeof(opts));
+    opts.path = argv[1];
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--mem") == 0 && i + 1 < argc) {
+            opts.mem = parse_mem_arg(argv[++i]);
+        } else if (strcmp(argv[i], "--mem-limit") == 0 && i + 1 < argc) {
+            g_mem_limit = parse_mem_arg(argv[++i]);
+        } else if (strcmp(argv[i], "--stack-guard") == 0 && i + 1 < argc) {
+            opts.stack_limit = parse_mem_arg(argv[++i]);
+        } else if (strcmp(argv[i], "--watch") == 0 && i + 1 < argc &&
+                   opts.watch_count < R5VM_HOST_MAX_WATCH) {
+            if (!parse_watch_arg(argv[++i], &opts.watch_addr[opts.watch_count],
+                                 &opts.watch_len[opts.watch_count])) {
+                fprintf(stderr, "error: invalid watch '%s', expected ADDR:LEN\n", argv[i]);
+                return 1;
+            }
+            opts.watch_count++;
+        } else if ((strcmp(argv[i], "--map") == 0 ||
+                    strcmp(argv[i], "--map-cow") == 0) && i + 1 < argc &&
+                   opts.map_count < R5VM_HOST_MAX_MAPS) {
+            opts.map_cow[opts.map_count] = strcmp(argv[i], "--map-cow") == 0;
+            if (!parse_map_arg(argv[++i], &opts.map_path[opts.map_count],
+                               &opts.map_addr[opts.map_count])) {
+                fprintf(stderr, "error: invalid map '%s', expected FILE@ADDR\n", argv[i]);
+                return 1;
+            }
+            opts.map_count++;
+        } else if (strcmp(argv[i], "--gdb") == 0 && i + 1 < argc) {
+            gdb_port = strtoul(argv[++i], NULL, 0);
+            if (gdb_port == 0 || gdb_port > 65535) {
+                fprintf(stderr, "error: invalid gdb port '%s'\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--fork-server") == 0 && i + 1 < argc) {
+            fork_path = argv[++i];
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            serve_path = argv[++i];
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            jobs = strtoul(argv[++i], NULL, 0);
+            if (jobs == 0 || jobs > 1024) {
+                fprintf(stderr, "error: invalid job count '%s'\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--fuel") == 0 && i + 1 < argc) {
+            fuel = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--hle") == 0 && i + 1 < argc) {
+            opts.hle_elf = argv[++i];
+        } else if (strcmp(argv[i], "--filter") == 0) {
+            filter = true;
+        } else if (strcmp(argv[i], "--trace") == 0) {
+            trace = true;
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            profile = true;
+        } else if (strcmp(argv[i], "--disasm") == 0) {
+            disasm = true;
+        } else if (strcmp(argv[i], "--numeric") == 0) {
+            g_abi_names = false;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    r5vm_host_t host;
+    size_t fsize = 0;
+    if (disasm) {
+        if (!load_file(opts.path, &host, &fsize, opts.mem))
+            return 1;
+        disasm_image(&host.vm, fsize);
+        r5vm_host_destroy(&host);
+        return 0;
+    }
+
+    r5vm_hle_t hle;
+    int rc = 0;
+    if (!setup_image(&host, &hle, &opts))
+        return 1;
+
+    r5vm_reset(&host.vm);
+    if (gdb_port) {
+        if (!r5vm_gdb_serve(&host, (uint16_t)gdb_port)) {
+            r5vm_host_destroy(&host);
+            return 1;
+        }
+    } else if (fork_path) {
+        r5vm_fork_serve(&host, fork_path);
+        r5vm_host_destroy(&host);
+        return 1;
+    } else if (serve_path) {
+        const r5vm_serve_loader_t loader = { serve_load, serve_release, &opts };
+        r5vm_serve(&host, serve_path, (unsigned)jobs, fuel, &loader);
+        r5vm_host_destroy(&host);
+        return 1;
+    } else if (filter) {
+        fflush(stdout); /* the filter writes to the descriptor directly */
+        if (!r5vm_filter_run(&host, 0, 1)) {
+            fprintf(stderr, "error: stream filter failed, output incomplete\n");
+            rc = 1;
+        }
+    } else if (trace) {
+        run_trace(&host);
+    } else if (profile) {
+        run_profile(&host);
+    } else {
+        do {
+            r5vm_host_run(&host, 0);
+        } while (r5vm_paused(&host.vm));
+    }
+    if (host.vm.status == R5VM_BREAK)
+        fprintf(stderr, "[r5vm] EBREAK at PC=0x%08" PRIX32 "\n", host.vm.pc);
+    if (host.vm.status == R5VM_IDLE)
+        fprintf(stderr, "[r5vm] guest idle at PC=0x%08" PRIX32 ", nothing can wake it\n",
+                host.vm.pc);
+    if (g_mem_limit)
+        print_mem_stats("", &host);
+
+    r5vm_host_destroy(&host);
+
+    return rc;
+}
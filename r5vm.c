@@ -32,6 +32,9 @@
 #include <string.h>
 #include <assert.h>
 #include <stdio.h> /* for putchar in ecall */
+#ifndef R5VM_NO_LIBM
+#include <math.h>  /* for the math ecalls */
+#endif
 
 #include "r5vm.h"
 
@@ -62,6 +65,28 @@
                                        (((inst >> 20) & 0x1) << 11) | \
                                        (((inst >> 21) & 0x3FF) << 1), 21)
 
+/* Full host memory barrier for `fence`, orders guest memory that other
+   host threads share (see r5vm_host_map_shared()) */
+#if defined(__GNUC__) || defined(__clang__)
+#define HOST_FENCE()        __sync_synchronize()
+#elif defined(_MSC_VER)
+#include <intrin.h>
+static volatile long r5vm_fence_word;
+#define HOST_FENCE()        ((void)_InterlockedExchange(&r5vm_fence_word, 0))
+#else
+#define HOST_FENCE()        ((void)0)
+#endif
+
+/* Guest words are little-endian. Naturally aligned words are loaded and
+   stored in one host access, so a counter that another host thread reads
+   (e.g. a pipe ring head) never tears. */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define LE32(x)             __builtin_bswap32(x)
+#else
+#define LE32(x)             (x)
+#endif
+#define WORD_ALIGNED(p)     (((uintptr_t)(p) & 3) == 0)
+
 // ---- Defines ---------------------------------------------------------------
 
 #define R5VM_OPCODE_R_TYPE  0x33 /**< Register-Register operations */
@@ -74,7 +99,8 @@
 #define R5VM_OPCODE_LUI     0x37 /**< Load Upper Immediate */
 #define R5VM_OPCODE_JAL     0x6F /**< Jump and Link */
 #define R5VM_OPCODE_JALR    0x67 /**< Jump and Link Register */
-#define R5VM_OPCODE_FENCE   0x0F /**< Fence Instructions (Noop for R5VM) */
+#define R5VM_OPCODE_FENCE   0x0F /**< Fence Instructions (host barrier) */
+#define R5VM_OPCODE_HLE     0x0B /**< custom-0: HLE trap into a host native */
 
 /* Function 3 (F3) */
 #define R5VM_R_F3_ADD_SUB   0x00 /**< Reg. Add / Subtract */
@@ -145,8 +171,79 @@ void r5vm_reset(r5vm_t* vm)
 {
     memset(vm->regs, 0, sizeof vm->regs);
     vm->pc = 0;
+    vm->status = R5VM_RUNNING;
+}
+
+/** true if the guest range [addr, addr + len) lies inside VM memory */
+static bool r5vm_range_ok(const r5vm_t* vm, uint32_t addr, uint32_t len)
+{
+    return addr <= vm->mem_size && len <= vm->mem_size - addr;
+}
+
+void r5vm_write_probe(r5vm_t* vm, uint32_t addr, uint32_t len)
+{
+    volatile uint8_t* m = vm->mem;
+
+    vm->wr_addr = addr;
+    vm->wr_len = len;
+    if (!len)
+        return;
+    for (uint32_t p = addr; p - addr < len; p = (p | 0xFFFu) + 1)
+        m[p] = m[p];
+    m[addr + len - 1] = m[addr + len - 1];
+}
+
+/**
+ * true if the branch at `pc` jumped to `vm->pc` and spins forever unless
+ * memory changes: a branch to itself, or a branch back to a load of one of
+ * its operands whose address register the load does not overwrite.
+ */
+static bool r5vm_spin_branch(const r5vm_t* vm, uint32_t inst, uint32_t pc)
+{
+    if (vm->pc == pc)
+        return true;
+    if (vm->pc != ((pc - 4) & vm->mem_mask))
+        return false;
+    const uint32_t ld =  vm->mem[(vm->pc + 0) & vm->mem_mask]
+                      | (vm->mem[(vm->pc + 1) & vm->mem_mask] << 8)
+                      | (vm->mem[(vm->pc + 2) & vm->mem_mask] << 16)
+                      | ((uint32_t)vm->mem[(vm->pc + 3) & vm->mem_mask] << 24);
+    const uint32_t rd = RD(ld);
+    return OPCODE(ld) == R5VM_OPCODE_LW && rd != 0 && rd != RS1(ld) &&
+           (rd == RS1(inst) || rd == RS2(inst));
+}
+
+/** memcmp() returning the difference of the first mismatching bytes */
+static int r5vm_memcmp(const uint8_t* a, const uint8_t* b, uint32_t n)
+{
+    if (memcmp(a, b, n) == 0)
+        return 0;
+    while (*a == *b) { a++; b++; }
+    return (int)*a - (int)*b;
 }
 
+#ifndef R5VM_NO_LIBM
+/** Math ECALLs: float arguments x, y and the result as IEEE bit patterns */
+static uint32_t r5vm_ecall_math(uint32_t id, uint32_t x, uint32_t y)
+{
+    float fx, fy, r;
+    memcpy(&fx, &x, sizeof fx);
+    memcpy(&fy, &y, sizeof fy);
+    switch (id) {
+    case R5VM_ECALL_SINF:   r = sinf(fx); break;
+    case R5VM_ECALL_COSF:   r = cosf(fx); break;
+    case R5VM_ECALL_EXPF:   r = expf(fx); break;
+    case R5VM_ECALL_LOGF:   r = logf(fx); break;
+    case R5VM_ECALL_SQRTF:  r = sqrtf(fx); break;
+    case R5VM_ECALL_POWF:   r = powf(fx, fy); break;
+    case R5VM_ECALL_ATAN2F: r = atan2f(fx, fy); break;
+    default:                r = fmodf(fx, fy); break;
+    }
+    memcpy(&x, &r, sizeof x);
+    return x;
+}
+#endif
+
 /**
  * @brief Execute a single instruction.
  *
@@ -244,24 +341,31 @@ static bool r5vm_step(r5vm_t* vm)
         {
         const uint32_t addr = R[rs1] + IMM_I(inst);
 #ifdef R5VM_DEBUG
-        if (addr > vm->mem_size - 4)
+        if (addr > vm->mem_size - (1u << (FUNCT3(inst) & 0x3)))
         {
             r5vm_error(vm, "Memory access out of bounds", vm->pc-4, inst);
             retcode = false;
             break;
         }
 #endif
-        const uint8_t b0 = vm->mem[(addr + 0) & vm->mem_mask];
-        const uint8_t b1 = vm->mem[(addr + 1) & vm->mem_mask];
-        const uint8_t b2 = vm->mem[(addr + 2) & vm->mem_mask];
-        const uint8_t b3 = vm->mem[(addr + 3) & vm->mem_mask];
+        /* touch only the bytes of the access, a guard page may follow */
+        const uint8_t* m = vm->mem;
+        const uint32_t mask = vm->mem_mask;
 
         switch (FUNCT3(inst)) {
-        case R5VM_I_F3_LB:  R[rd] = (int8_t)b0; break;
-        case R5VM_I_F3_LH:  R[rd] = (int16_t)(b0 | (b1 << 8)); break;
-        case R5VM_I_F3_LW:  R[rd] = b0 | (b1 << 8) | (b2 << 16) | (b3 << 24); break;
-        case R5VM_I_F3_LBU: R[rd] = b0; break;
-        case R5VM_I_F3_LHU: R[rd] = b0 | (b1 << 8); break;
+        case R5VM_I_F3_LB:  R[rd] = (int8_t)m[addr & mask]; break;
+        case R5VM_I_F3_LH:  R[rd] = (int16_t)(m[addr & mask] | (m[(addr + 1) & mask] << 8)); break;
+        case R5VM_I_F3_LW:
+            if (WORD_ALIGNED(m + (addr & mask))) {
+                R[rd] = LE32(*(const volatile uint32_t*)(m + (addr & mask)));
+                break;
+            }
+            R[rd] = m[addr & mask] | (m[(addr + 1) & mask] << 8) |
+                    (m[(addr + 2) & mask] << 16) |
+                    ((uint32_t)m[(addr + 3) & mask] << 24);
+            break;
+        case R5VM_I_F3_LBU: R[rd] = m[addr & mask]; break;
+        case R5VM_I_F3_LHU: R[rd] = m[addr & mask] | (m[(addr + 1) & mask] << 8); break;
 #ifdef R5VM_DEBUG
         default:
             r5vm_error(vm, "Unknown Load funct3", vm->pc-4, inst);
@@ -275,14 +379,26 @@ static bool r5vm_step(r5vm_t* vm)
         {
         const uint32_t addr = R[rs1] + IMM_S(inst);
 #ifdef R5VM_DEBUG
-        if (addr > vm->mem_size - 4) {
+        if (addr > vm->mem_size - (1u << (FUNCT3(inst) & 0x3))) {
             r5vm_error(vm, "Memory access out of bounds", vm->pc-4, inst);
             retcode = false;
             break;
         }
 #endif
+        const uint32_t last = (1u << (FUNCT3(inst) & 0x3)) - 1;
+        if (addr & last) {
+            /* misaligned: rewrite both ends first, so a protected page
+               faults before any byte of the store changed */
+            volatile uint8_t* m = vm->mem;
+            m[(addr + last) & vm->mem_mask] = m[(addr + last) & vm->mem_mask];
+            m[addr & vm->mem_mask] = m[addr & vm->mem_mask];
+        }
         switch (FUNCT3(inst)) {
         case R5VM_S_F3_SW: // 32-bit store (4 bytes)
+            if (WORD_ALIGNED(vm->mem + (addr & vm->mem_mask))) {
+                *(volatile uint32_t*)(vm->mem + (addr & vm->mem_mask)) = LE32(R[rs2]);
+                break;
+            }
             vm->mem[(addr + 3) & vm->mem_mask] = (R[rs2] >> 24) & 0xFF;
             vm->mem[(addr + 2) & vm->mem_mask] = (R[rs2] >> 16) & 0xFF;
             /* fall through */
@@ -302,6 +418,8 @@ static bool r5vm_step(r5vm_t* vm)
         break;
     /* _--------------------- Branch ---------------------------------_ */
     case (R5VM_OPCODE_BRANCH):
+        {
+        const uint32_t next = vm->pc;
         switch (FUNCT3(inst)) {
         case R5VM_B_F3_BEQ:  if (R[rs1] == R[rs2]) vm->pc = ((vm->pc-4 + IMM_B(inst)) & vm->mem_mask); break;
         case R5VM_B_F3_BNE:  if (R[rs1] != R[rs2]) vm->pc = ((vm->pc-4 + IMM_B(inst)) & vm->mem_mask); break;
@@ -314,12 +432,23 @@ static bool r5vm_step(r5vm_t* vm)
             r5vm_error(vm, "Unknown Branch funct3", vm->pc-4, inst);
             retcode = false;
 #endif
+        }
+        /* only a taken backward branch by at most one instruction can spin */
+        if (((next - 4 - vm->pc) & vm->mem_mask) <= 4 &&
+            r5vm_spin_branch(vm, inst, (next - 4) & vm->mem_mask)) {
+            vm->status = R5VM_IDLE;
+            retcode = false;
+        }
         }
         break;
     /* _--------------------- JAL ------------------------------------_ */
     case (R5VM_OPCODE_JAL):
         R[rd] = vm->pc;
         vm->pc = (vm->pc + IMM_J(inst) - 4) & vm->mem_mask;
+        if (IMM_J(inst) == 0) { /* jump to itself */
+            vm->status = R5VM_IDLE;
+            retcode = false;
+        }
         break;
     /* _--------------------- JALR -----------------------------------_ */
     case (R5VM_OPCODE_JALR):
@@ -338,17 +467,91 @@ static bool r5vm_step(r5vm_t* vm)
         break;
     /* _--------------------- System Call ----------------------------_ */
     case (R5VM_OPCODE_SYSTEM):
+        if (inst == R5VM_INSTR_EBREAK) {
+            /* trap to the host, pc stays at the EBREAK */
+            vm->pc = (vm->pc - 4) & vm->mem_mask;
+            vm->status = R5VM_BREAK;
+            retcode = false;
+            break;
+        }
+        if (inst == R5VM_INSTR_WFI) {
+            vm->status = R5VM_IDLE;
+            retcode = false;
+            break;
+        }
         {
         uint32_t syscall_id = vm->a7;
         switch (syscall_id) {
-        case 0:
+        case R5VM_ECALL_EXIT:
+            vm->status = R5VM_EXIT;
             retcode = false;
             break;
-        case 1:
-            putchar(vm->a0 & 0xff);
-            fflush(stdout);
+        case R5VM_ECALL_PUTCHAR:
+            if (vm->out) {
+                fputc(vm->a0 & 0xff, vm->out);
+            } else {
+                putchar(vm->a0 & 0xff);
+                fflush(stdout);
+            }
+            break;
+        case R5VM_ECALL_MEMCPY:
+        case R5VM_ECALL_MEMMOVE:
+            if (!r5vm_range_ok(vm, vm->a0, vm->a2) ||
+                !r5vm_range_ok(vm, vm->a1, vm->a2)) {
+                r5vm_error(vm, "ECALL memory out of bounds", vm->pc-4, syscall_id);
+                retcode = false;
+                break;
+            }
+            /* pc at the ECALL while copying, a host fault handler reports
+               or restarts it */
+            vm->pc = (vm->pc - 4) & vm->mem_mask;
+            vm->in_native = 1;
+            r5vm_write_probe(vm, vm->a0, vm->a2);
+            memmove(vm->mem + vm->a0, vm->mem + vm->a1, vm->a2);
+            vm->wr_len = 0;
+            vm->in_native = 0;
+            vm->pc = (vm->pc + 4) & vm->mem_mask;
+            break;
+        case R5VM_ECALL_MEMSET:
+            if (!r5vm_range_ok(vm, vm->a0, vm->a2)) {
+                r5vm_error(vm, "ECALL memory out of bounds", vm->pc-4, syscall_id);
+                retcode = false;
+                break;
+            }
+            vm->pc = (vm->pc - 4) & vm->mem_mask;
+            vm->in_native = 1;
+            r5vm_write_probe(vm, vm->a0, vm->a2);
+            memset(vm->mem + vm->a0, (int)(vm->a1 & 0xff), vm->a2);
+            vm->wr_len = 0;
+            vm->in_native = 0;
+            vm->pc = (vm->pc + 4) & vm->mem_mask;
             break;
+        case R5VM_ECALL_MEMCMP:
+            if (!r5vm_range_ok(vm, vm->a0, vm->a2) ||
+                !r5vm_range_ok(vm, vm->a1, vm->a2)) {
+                r5vm_error(vm, "ECALL memory out of bounds", vm->pc-4, syscall_id);
+                retcode = false;
+                break;
+            }
+            vm->a0 = (uint32_t)r5vm_memcmp(vm->mem + vm->a0, vm->mem + vm->a1, vm->a2);
+            break;
+#ifndef R5VM_NO_LIBM
+        case R5VM_ECALL_SINF:
+        case R5VM_ECALL_COSF:
+        case R5VM_ECALL_EXPF:
+        case R5VM_ECALL_LOGF:
+        case R5VM_ECALL_SQRTF:
+        case R5VM_ECALL_POWF:
+        case R5VM_ECALL_ATAN2F:
+        case R5VM_ECALL_FMODF:
+            vm->a0 = r5vm_ecall_math(syscall_id, vm->a0, vm->a1);
+            break;
+#endif
         default:
+            if (vm->ecall_fn) {
+                retcode = vm->ecall_fn(vm, syscall_id);
+                break;
+            }
             r5vm_error(vm, "Unknown ECALL", vm->pc-4, syscall_id);
             retcode = false;
         }
@@ -356,7 +559,30 @@ static bool r5vm_step(r5vm_t* vm)
         break;
     /* _--------------------- FENCE / FENCE.I --------------------------_ */
     case (R5VM_OPCODE_FENCE):
-        // no-op
+        // PAUSE is a FENCE encoding without ordering, FENCE.I is a no-op
+        if (inst == R5VM_INSTR_PAUSE) {
+            vm->status = R5VM_IDLE;
+            retcode = false;
+        } else if (FUNCT3(inst) == 0) {
+            HOST_FENCE();
+        }
+        break;
+    /* _--------------------- HLE trap (custom-0) ---------------------_ */
+    case (R5VM_OPCODE_HLE):
+        {
+        const uint32_t idx = inst >> 20;
+        vm->pc = (vm->pc - 4) & vm->mem_mask;
+        if (idx >= vm->hle_count || !vm->hle[idx]) {
+            r5vm_error(vm, "Unknown HLE trap", vm->pc, inst);
+            retcode = false;
+            break;
+        }
+        vm->in_native = 1; /* a host fault in the native reports its pc */
+        retcode = vm->hle[idx](vm);
+        vm->in_native = 0;
+        if (retcode)
+            vm->pc = vm->ra & vm->mem_mask; /* return to the caller */
+        }
         break;
     default:
         r5vm_error(vm, "Unknown opcode", vm->pc-4, inst);
@@ -370,11 +596,189 @@ static bool r5vm_step(r5vm_t* vm)
 unsigned r5vm_run(r5vm_t* vm, unsigned max_steps)
 {
     unsigned i;
+    vm->status = R5VM_RUNNING;
     for (i = 0; i < max_steps || max_steps == 0; i++) {
         if (!r5vm_step(vm)) {
+            if (vm->status == R5VM_RUNNING)
+                vm->status = R5VM_ERROR;
             break;
         }
     }
     return i;
 }
 
+bool r5vm_paused(const r5vm_t* vm)
+{
+    uint32_t prev = 0;
+    if (vm->status != R5VM_IDLE)
+        return false;
+    for (int i = 0; i < 4; i++)
+        prev |= (uint32_t)vm->mem[(vm->pc - 4 + i) & vm->mem_mask] << (8 * i);
+    return prev == R5VM_INSTR_PAUSE;
+}
+
+
+// ---- Disassembler ----------------------------------------------------------
+
+/** Operand formats of the disassembler table */
+enum {
+    R5VM_FMT_NONE,   /**< no operands */
+    R5VM_FMT_R,      /**< rd, rs1, rs2 */
+    R5VM_FMT_I,      /**< rd, rs1, imm */
+    R5VM_FMT_SHIFT,  /**< rd, rs1, shamt */
+    R5VM_FMT_LOAD,   /**< rd, imm(rs1) */
+    R5VM_FMT_STORE,  /**< rs2, imm(rs1) */
+    R5VM_FMT_BRANCH, /**< rs1, rs2, target */
+    R5VM_FMT_U,      /**< rd, imm[31:12] */
+    R5VM_FMT_JAL,    /**< rd, target */
+    R5VM_FMT_JALR,   /**< rd, imm(rs1) */
+    R5VM_FMT_LI,     /**< rd, imm (addi rd, zero, imm) */
+    R5VM_FMT_MV,     /**< rd, rs1 (addi rd, rs1, 0) */
+    R5VM_FMT_J,      /**< target (jal zero, target) */
+    R5VM_FMT_HLE     /**< trap number */
+};
+
+/** Instruction pattern: an instruction matches if (inst & mask) == match */
+typedef struct r5vm_disasm_op_s
+{
+    uint32_t    mask;
+    uint32_t    match;
+    const char* name;
+    int         fmt;
+} r5vm_disasm_op_t;
+
+#define DIS_MASK_OP     0x0000007Fu /**< opcode */
+#define DIS_MASK_F3     0x0000707Fu /**< opcode + funct3 */
+#define DIS_MASK_F7     0xFE00707Fu /**< opcode + funct3 + funct7 */
+#define DIS_MASK_RD     0x00000F80u
+#define DIS_MASK_RS1    0x000F8000u
+#define DIS_MASK_IMM    0xFFF00000u
+#define DIS_MATCH(op, f3, f7) ((op) | ((f3) << 12) | ((uint32_t)(f7) << 25))
+
+/**
+ * Instruction table, searched in order. Aliases (nop, li, mv, j, ret) are
+ * listed before the generic instruction they specialize.
+ */
+static const r5vm_disasm_op_t r5vm_disasm_ops[] = {
+    { 0xFFFFFFFFu, 0x00000013u, "nop",    R5VM_FMT_NONE },
+    { 0xFFFFFFFFu, 0x00008067u, "ret",    R5VM_FMT_NONE },
+    { 0xFFFFFFFFu, 0x00000073u, "ecall",  R5VM_FMT_NONE },
+    { 0xFFFFFFFFu, R5VM_INSTR_EBREAK, "ebreak", R5VM_FMT_NONE },
+    { 0xFFFFFFFFu, R5VM_INSTR_WFI,    "wfi",    R5VM_FMT_NONE },
+    { 0xFFFFFFFFu, R5VM_INSTR_PAUSE,  "pause",  R5VM_FMT_NONE },
+    { DIS_MASK_F3 | DIS_MASK_RS1, DIS_MATCH(R5VM_OPCODE_I_TYPE, R5VM_I_F3_ADDI, 0), "li", R5VM_FMT_LI },
+    { DIS_MASK_F3 | DIS_MASK_IMM, DIS_MATCH(R5VM_OPCODE_I_TYPE, R5VM_I_F3_ADDI, 0), "mv", R5VM_FMT_MV },
+    { DIS_MASK_OP | DIS_MASK_RD,  R5VM_OPCODE_JAL, "j", R5VM_FMT_J },
+
+    { DIS_MASK_F7, DIS_MATCH(R5VM_OPCODE_R_TYPE, R5VM_R_F3_ADD_SUB, R5VM_R_F7_ADD), "add",  R5VM_FMT_R },
+    { DIS_MASK_F7, DIS_MATCH(R5VM_OPCODE_R_TYPE, R5VM_R_F3_ADD_SUB, R5VM_R_F7_SUB), "sub",  R5VM_FMT_R },
+    { DIS_MASK_F7, DIS_MATCH(R5VM_OPCODE_R_TYPE, R5VM_R_F3_XOR, 0),  "xor",  R5VM_FMT_R },
+    { DIS_MASK_F7, DIS_MATCH(R5VM_OPCODE_R_TYPE, R5VM_R_F3_OR, 0),   "or",   R5VM_FMT_R },
+    { DIS_MASK_F7, DIS_MATCH(R5VM_OPCODE_R_TYPE, R5VM_R_F3_AND, 0),  "and",  R5VM_FMT_R },
+    { DIS_MASK_F7, DIS_MATCH(R5VM_OPCODE_R_TYPE, R5VM_R_F3_SLL, 0),  "sll",  R5VM_FMT_R },
+    { DIS_MASK_F7, DIS_MATCH(R5VM_OPCODE_R_TYPE, R5VM_R_F3_SRL_SRA, R5VM_R_F7_SRL), "srl", R5VM_FMT_R },
+    { DIS_MASK_F7, DIS_MATCH(R5VM_OPCODE_R_TYPE, R5VM_R_F3_SRL_SRA, R5VM_R_F7_SRA), "sra", R5VM_FMT_R },
+    { DIS_MASK_F7, DIS_MATCH(R5VM_OPCODE_R_TYPE, R5VM_R_F3_SLT, 0),  "slt",  R5VM_FMT_R },
+    { DIS_MASK_F7, DIS_MATCH(R5VM_OPCODE_R_TYPE, R5VM_R_F3_SLTU, 0), "sltu", R5VM_FMT_R },
+
+    { DIS_MASK_F3, DIS_MATCH(R5VM_OPCODE_I_TYPE, R5VM_I_F3_ADDI, 0),  "addi",  R5VM_FMT_I },
+    { DIS_MASK_F3, DIS_MATCH(R5VM_OPCODE_I_TYPE, R5VM_I_F3_XORI, 0),  "xori",  R5VM_FMT_I },
+    { DIS_MASK_F3, DIS_MATCH(R5VM_OPCODE_I_TYPE, R5VM_I_F3_ORI, 0),   "ori",   R5VM_FMT_I },
+    { DIS_MASK_F3, DIS_MATCH(R5VM_OPCODE_I_TYPE, R5VM_I_F3_ANDI, 0),  "andi",  R5VM_FMT_I },
+    { DIS_MASK_F3, DIS_MATCH(R5VM_OPCODE_I_TYPE, R5VM_I_F3_SLTI, 0),  "slti",  R5VM_FMT_I },
+    { DIS_MASK_F3, DIS_MATCH(R5VM_OPCODE_I_TYPE, R5VM_I_F3_SLTIU, 0), "sltiu", R5VM_FMT_I },
+    { DIS_MASK_F7, DIS_MATCH(R5VM_OPCODE_I_TYPE, R5VM_I_F3_SLLI, R5VM_I_F7_SLLI), "slli", R5VM_FMT_SHIFT },
+    { DIS_MASK_F7, DIS_MATCH(R5VM_OPCODE_I_TYPE, R5VM_I_F3_SRLI_SRAI, R5VM_I_F7_SRLI), "srli", R5VM_FMT_SHIFT },
+    { DIS_MASK_F7, DIS_MATCH(R5VM_OPCODE_I_TYPE, R5VM_I_F3_SRLI_SRAI, R5VM_I_F7_SRAI), "srai", R5VM_FMT_SHIFT },
+
+    { DIS_MASK_F3, DIS_MATCH(R5VM_OPCODE_LW, R5VM_I_F3_LB, 0),  "lb",  R5VM_FMT_LOAD },
+    { DIS_MASK_F3, DIS_MATCH(R5VM_OPCODE_LW, R5VM_I_F3_LH, 0),  "lh",  R5VM_FMT_LOAD },
+    { DIS_MASK_F3, DIS_MATCH(R5VM_OPCODE_LW, R5VM_I_F3_LW, 0),  "lw",  R5VM_FMT_LOAD },
+    { DIS_MASK_F3, DIS_MATCH(R5VM_OPCODE_LW, R5VM_I_F3_LBU, 0), "lbu", R5VM_FMT_LOAD },
+    { DIS_MASK_F3, DIS_MATCH(R5VM_OPCODE_LW, R5VM_I_F3_LHU, 0), "lhu", R5VM_FMT_LOAD },
+    { DIS_MASK_F3, DIS_MATCH(R5VM_OPCODE_SW, R5VM_S_F3_SB, 0),  "sb",  R5VM_FMT_STORE },
+    { DIS_MASK_F3, DIS_MATCH(R5VM_OPCODE_SW, R5VM_S_F3_SH, 0),  "sh",  R5VM_FMT_STORE },
+    { DIS_MASK_F3, DIS_MATCH(R5VM_OPCODE_SW, R5VM_S_F3_SW, 0),  "sw",  R5VM_FMT_STORE },
+
+    { DIS_MASK_F3, DIS_MATCH(R5VM_OPCODE_BRANCH, R5VM_B_F3_BEQ, 0),  "beq",  R5VM_FMT_BRANCH },
+    { DIS_MASK_F3, DIS_MATCH(R5VM_OPCODE_BRANCH, R5VM_B_F3_BNE, 0),  "bne",  R5VM_FMT_BRANCH },
+    { DIS_MASK_F3, DIS_MATCH(R5VM_OPCODE_BRANCH, R5VM_B_F3_BLT, 0),  "blt",  R5VM_FMT_BRANCH },
+    { DIS_MASK_F3, DIS_MATCH(R5VM_OPCODE_BRANCH, R5VM_B_F3_BGE, 0),  "bge",  R5VM_FMT_BRANCH },
+    { DIS_MASK_F3, DIS_MATCH(R5VM_OPCODE_BRANCH, R5VM_B_F3_BLTU, 0), "bltu", R5VM_FMT_BRANCH },
+    { DIS_MASK_F3, DIS_MATCH(R5VM_OPCODE_BRANCH, R5VM_B_F3_BGEU, 0), "bgeu", R5VM_FMT_BRANCH },
+
+    { DIS_MASK_OP, R5VM_OPCODE_LUI,   "lui",   R5VM_FMT_U },
+    { DIS_MASK_OP, R5VM_OPCODE_AUIPC, "auipc", R5VM_FMT_U },
+    { DIS_MASK_OP, R5VM_OPCODE_JAL,   "jal",   R5VM_FMT_JAL },
+    { DIS_MASK_F3, R5VM_OPCODE_JALR,  "jalr",  R5VM_FMT_JALR },
+    { DIS_MASK_F3, DIS_MATCH(R5VM_OPCODE_FENCE, 0, 0), "fence",   R5VM_FMT_NONE },
+    { DIS_MASK_F3, DIS_MATCH(R5VM_OPCODE_FENCE, 1, 0), "fence.i", R5VM_FMT_NONE },
+    { DIS_MASK_F3 | DIS_MASK_RD | DIS_MASK_RS1, R5VM_OPCODE_HLE, "hle", R5VM_FMT_HLE },
+};
+
+/** Register names: [0] numeric (x0..x31), [1] ABI */
+static const char* const r5vm_reg_names[2][32] = {
+    { "x0",  "x1",  "x2",  "x3",  "x4",  "x5",  "x6",  "x7",
+      "x8",  "x9",  "x10", "x11", "x12", "x13", "x14", "x15",
+      "x16", "x17", "x18", "x19", "x20", "x21", "x22", "x23",
+      "x24", "x25", "x26", "x27", "x28", "x29", "x30", "x31" },
+    { "zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2",
+      "s0",   "s1", "a0", "a1", "a2", "a3", "a4", "a5",
+      "a6",   "a7", "s2", "s3", "s4", "s5", "s6", "s7",
+      "s8",   "s9", "s10", "s11", "t3", "t4", "t5", "t6" }
+};
+
+const char* r5vm_reg_name(unsigned reg, bool abi)
+{
+    return r5vm_reg_names[abi ? 1 : 0][reg & 0x1F];
+}
+
+int r5vm_disasm(char* buf, size_t size, uint32_t inst, uint32_t pc, bool abi)
+{
+    const char* const* r = r5vm_reg_names[abi ? 1 : 0];
+    const r5vm_disasm_op_t* op = NULL;
+
+    for (size_t i = 0; i < sizeof(r5vm_disasm_ops) / sizeof(r5vm_disasm_ops[0]); i++) {
+        if ((inst & r5vm_disasm_ops[i].mask) == r5vm_disasm_ops[i].match) {
+            op = &r5vm_disasm_ops[i];
+            break;
+        }
+    }
+    if (!op)
+        return snprintf(buf, size, ".word   0x%08x", (unsigned)inst);
+
+    const char* rd  = r[RD(inst)];
+    const char* rs1 = r[RS1(inst)];
+    const char* rs2 = r[RS2(inst)];
+    switch (op->fmt) {
+    case R5VM_FMT_R:
+        return snprintf(buf, size, "%-7s %s,%s,%s", op->name, rd, rs1, rs2);
+    case R5VM_FMT_I:
+        return snprintf(buf, size, "%-7s %s,%s,%d", op->name, rd, rs1, (int)IMM_I(inst));
+    case R5VM_FMT_SHIFT:
+        return snprintf(buf, size, "%-7s %s,%s,%u", op->name, rd, rs1, (unsigned)RS2(inst));
+    case R5VM_FMT_LOAD:
+        return snprintf(buf, size, "%-7s %s,%d(%s)", op->name, rd, (int)IMM_I(inst), rs1);
+    case R5VM_FMT_STORE:
+        return snprintf(buf, size, "%-7s %s,%d(%s)", op->name, rs2, (int)IMM_S(inst), rs1);
+    case R5VM_FMT_BRANCH:
+        return snprintf(buf, size, "%-7s %s,%s,0x%x", op->name, rs1, rs2,
+                        (unsigned)(pc + IMM_B(inst)));
+    case R5VM_FMT_U:
+        return snprintf(buf, size, "%-7s %s,0x%x", op->name, rd, (unsigned)(inst >> 12));
+    case R5VM_FMT_JAL:
+        return snprintf(buf, size, "%-7s %s,0x%x", op->name, rd, (unsigned)(pc + IMM_J(inst)));
+    case R5VM_FMT_JALR:
+        return snprintf(buf, size, "%-7s %s,%d(%s)", op->name, rd, (int)IMM_I(inst), rs1);
+    case R5VM_FMT_LI:
+        return snprintf(buf, size, "%-7s %s,%d", op->name, rd, (int)IMM_I(inst));
+    case R5VM_FMT_MV:
+        return snprintf(buf, size, "%-7s %s,%s", op->name, rd, rs1);
+    case R5VM_FMT_J:
+        return snprintf(buf, size, "%-7s 0x%x", op->name, (unsigned)(pc + IMM_J(inst)));
+    case R5VM_FMT_HLE:
+        return snprintf(buf, size, "%-7s %u", op->name, (unsigned)(inst >> 20));
+    default:
+        return snprintf(buf, size, "%s", op->name);
+    }
+}
@@ -68,6 +68,7 @@
 #ifndef R5VM_H
 #define R5VM_H
 
+#include <stdio.h>
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
@@ -80,8 +81,106 @@
 /** @brief Base RISC-V ISA implemented by this VM. */
 #define R5VM_BASE_ISA    "RV32I"
 
+/** @brief Encoding of the EBREAK instruction (software breakpoint). */
+#define R5VM_INSTR_EBREAK 0x00100073u
+
+/** @brief Encoding of WFI (wait for interrupt), stops the VM as idle. */
+#define R5VM_INSTR_WFI    0x10500073u
+
+/** @brief Encoding of the Zihintpause PAUSE hint, stops the VM as idle. */
+#define R5VM_INSTR_PAUSE  0x0100000Fu
+
+/**
+ * @brief Encoding of the HLE trap for host native `n` (0..4095).
+ *
+ * Uses the RISC-V custom-0 opcode with `n` in the I-type immediate. Patched
+ * over the entry of a guest function by `r5vm_hle_bind()`.
+ */
+#define R5VM_INSTR_HLE(n) ((((uint32_t)(n) & 0xFFFu) << 20) | 0x0Bu)
+
 // ---- VM data structure -----------------------------------------------------
 
+/**
+ * @brief Reason why `r5vm_run()` returned.
+ */
+typedef enum r5vm_status_e
+{
+    R5VM_RUNNING = 0, /**< Step limit reached, the VM can be resumed */
+    R5VM_EXIT,        /**< Guest called the exit ECALL (exit code in a0) */
+    R5VM_BREAK,       /**< EBREAK executed, `pc` points to the EBREAK */
+    R5VM_ERROR,       /**< `r5vm_error()` was raised */
+    R5VM_IDLE         /**< Guest waits, see r5vm_run(); resume when it can progress */
+} r5vm_status_t;
+
+/**
+ * @brief ECALL numbers (passed in `a7`).
+ *
+ * The bulk memory calls run as host `memmove()`/`memset()`/`memcmp()` on
+ * guest memory. All ranges are validated, an out-of-bounds range raises
+ * `r5vm_error()`. `a0` keeps the destination pointer where the C function
+ * returns it.
+ *
+ * The math calls evaluate the host libm single precision function. Float
+ * arguments (`a0`, `a1`) and the result (`a0`) are IEEE bit patterns. Build
+ * with `R5VM_NO_LIBM` to leave them out.
+ */
+typedef enum r5vm_ecall_e
+{
+    R5VM_ECALL_EXIT    = 0, /**< Stop the VM, exit code in a0 */
+    R5VM_ECALL_PUTCHAR = 1, /**< Write character a0 to stdout */
+    R5VM_ECALL_MEMCPY  = 2, /**< memcpy(a0 dst, a1 src, a2 n) */
+    R5VM_ECALL_MEMMOVE = 3, /**< memmove(a0 dst, a1 src, a2 n) */
+    R5VM_ECALL_MEMSET  = 4, /**< memset(a0 dst, a1 byte, a2 n) */
+    R5VM_ECALL_MEMCMP  = 5, /**< a0 = memcmp(a0, a1, a2 n) */
+    R5VM_ECALL_SINF    = 6, /**< a0 = sinf(a0) */
+    R5VM_ECALL_COSF    = 7, /**< a0 = cosf(a0) */
+    R5VM_ECALL_EXPF    = 8, /**< a0 = expf(a0) */
+    R5VM_ECALL_LOGF    = 9, /**< a0 = logf(a0) */
+    R5VM_ECALL_SQRTF   = 10, /**< a0 = sqrtf(a0) */
+    R5VM_ECALL_POWF    = 11, /**< a0 = powf(a0, a1) */
+    R5VM_ECALL_ATAN2F  = 12, /**< a0 = atan2f(a0 y, a1 x) */
+    R5VM_ECALL_FMODF   = 13, /**< a0 = fmodf(a0, a1) */
+    R5VM_ECALL_MAP_INFO = 14, /**< a0, a1 = addr, size of file mapping a0 */
+    R5VM_ECALL_CHECKPOINT = 15, /**< Read job input to a0 (max a1 bytes), a0 = length */
+    R5VM_ECALL_RESPOND = 16, /**< Send a1 bytes at a0 as job result and stop */
+    R5VM_ECALL_STREAM_INIT = 17, /**< Stream windows in a0 (a1 bytes), a0 = window size */
+    R5VM_ECALL_STREAM_IN  = 18, /**< a0, a1 = addr, length of next input window */
+    R5VM_ECALL_STREAM_OUT = 19, /**< Flush a0 bytes, a0, a1 = next output window */
+    R5VM_ECALL_RING_INFO = 20, /**< a0, a1 = addr, capacity of ring a0 (0 in, 1 out) */
+    R5VM_ECALL_RING_WAIT = 21, /**< Block on ring at a0, a0 = bytes to read/write */
+    R5VM_ECALL_RING_WAKE = 22, /**< Wake the peer blocked on ring at a0 */
+    R5VM_ECALL_CHAN_OPEN = 23, /**< a0 = handle of channel with key a0, -1: full */
+    R5VM_ECALL_CHAN_SEND = 24, /**< Send a2 bytes at a1 to channel a0, a0 = 0 */
+    R5VM_ECALL_CHAN_RECV = 25, /**< Receive into a1 (max a2 bytes), a0 = length */
+    R5VM_ECALL_CHAN_POLL = 26, /**< Wait a1 ms, a0 = next length on a0, -1: none */
+    R5VM_ECALL_RPC_EXPORT = 27, /**< Export entry a1 as key a0, see r5vm_chan.h */
+    R5VM_ECALL_RPC_CALL   = 28, /**< Call export a0 (a1-a3, buf a4, a5 bytes), a0 = result */
+    R5VM_ECALL_RPC_RETURN = 29 /**< Return a0 from an exported entry */
+} r5vm_ecall_t;
+
+struct r5vm_s;
+
+/**
+ * @brief Host native that replaces a guest function (see r5vm_hle.h).
+ *
+ * Called with `vm->pc` at the trapped function entry and the guest ABI
+ * arguments in `a0`..`a7`. Results go to `a0`/`a1`. On return the VM
+ * continues at `ra`.
+ *
+ * @return `true` to continue, `false` to halt (`pc` stays at the trap).
+ */
+typedef bool (*r5vm_hle_fn)(struct r5vm_s* vm);
+
+/**
+ * @brief Handler for ECALL numbers the core does not implement.
+ *
+ * @param vm  VM instance, `pc` points behind the ECALL.
+ * @param id  ECALL number from `a7`.
+ * @return `true` to continue, `false` to halt. Report errors via
+ *         `r5vm_error()` before returning `false`.
+ */
+typedef bool (*r5vm_ecall_fn)(struct r5vm_s* vm, uint32_t id);
+
 /**
  * @brief CPU and memory state of the R5VM virtual machine.
  *
@@ -130,10 +229,19 @@ typedef struct r5vm_s
         };
     };
 
+    /* hot fields next to the register file, no padding holes */
     uint32_t pc;       /**< Program counter (byte offset into "mem") */
-    uint8_t* mem;      /**< Pointer to VM memory buffer */
     uint32_t mem_size; /**< Total memory size in bytes (must be power of two) */
     uint32_t mem_mask; /**< Address mask for sandbox memory accesses */
+    r5vm_status_t status; /**< Why the last r5vm_run() returned */
+    uint8_t* mem;      /**< Pointer to VM memory buffer */
+    r5vm_hle_fn* hle;     /**< Host natives indexed by HLE trap number */
+    r5vm_ecall_fn ecall_fn; /**< Extra ECALLs (NULL: unknown ECALL error) */
+    FILE* out;            /**< Guest output stream (NULL: stdout, flushed per character) */
+    uint32_t hle_count;   /**< Number of entries in `hle` (0 = no HLE) */
+    uint32_t in_native;   /**< Nonzero while a bulk ECALL or HLE native runs, `pc` at it */
+    uint32_t wr_addr;     /**< Destination of the bulk write in progress */
+    uint32_t wr_len;      /**< Its length in bytes (0 = none), see r5vm_write_probe() */
 } r5vm_t;
 
 // ---- Lifecycle -------------------------------------------------------------
@@ -177,7 +285,19 @@ void r5vm_reset(r5vm_t* vm);
  * @brief Run the VM for a given number of steps.
  *
  * Executes up to `max_steps` instructions, or indefinitely if `max_steps == 0`.
- * Stops when a halt condition or error occurs.
+ * Stops when a halt condition or error occurs. The reason is stored in
+ * `vm->status`.
+ *
+ * A guest that cannot make progress on its own stops with `R5VM_IDLE`
+ * instead of spinning, so the host can sleep or run other work:
+ * - `wfi` and `pause`: `pc` points behind the instruction.
+ * - A taken jump or branch to itself (`5: j 5b`): `pc` points to it.
+ * - A taken branch back to a load of one of its operands from a fixed
+ *   address (`1: lw t0, 0(a0); beqz t0, 1b`): `pc` points to the load.
+ *   Only a host or another VM writing guest memory ends such a loop.
+ *
+ * Resuming an idle VM with r5vm_run() continues the guest, a loop that is
+ * still spinning stops again after one iteration.
  *
  * @param vm         Pointer to an initialized VM.
  * @param max_steps  Maximum instruction count, or 0 for unlimited.
@@ -185,6 +305,60 @@ void r5vm_reset(r5vm_t* vm);
  */
 unsigned r5vm_run(r5vm_t* vm, unsigned max_steps);
 
+/**
+ * @brief `true` if the VM stopped with `R5VM_IDLE` at a `pause` hint.
+ *
+ * A `pause` only yields the host thread. Hosts without other work resume
+ * the guest, unlike other idle stops that need a host event to continue.
+ *
+ * @param vm Pointer to an initialized VM.
+ */
+bool r5vm_paused(const r5vm_t* vm);
+
+/**
+ * @brief Announce a host-side bulk write to guest `[addr, addr + len)`.
+ *
+ * Stores the range in `vm->wr_addr`/`vm->wr_len` and rewrites one byte of
+ * every 4 KiB page in it, so a write-protected page faults before any byte
+ * changes. A host fault handler can then check the range and restart the
+ * write at `vm->pc`. ECALLs and HLE natives call this before writing guest
+ * memory directly and clear `vm->wr_len` afterwards. While they run,
+ * `vm->in_native` tells the handler that `pc` already points at the ECALL
+ * or native, also for faults on the memory they read.
+ *
+ * @param vm    Pointer to an initialized VM.
+ * @param addr  First guest address written (range checked by the caller).
+ * @param len   Number of bytes written.
+ */
+void r5vm_write_probe(r5vm_t* vm, uint32_t addr, uint32_t len);
+
+// ---- Disassembler ----------------------------------------------------------
+
+/**
+ * @brief Disassemble one instruction into text.
+ *
+ * Table-driven RV32I disassembler with `objdump`-like output, including the
+ * common aliases (`nop`, `li`, `mv`, `j`, `ret`). Branch and jump targets
+ * are printed as absolute addresses. Unknown words are shown as `.word`.
+ *
+ * @param buf   Output buffer (always NUL-terminated if `size > 0`).
+ * @param size  Size of the output buffer in bytes (64 is always enough).
+ * @param inst  Instruction word.
+ * @param pc    Address of the instruction.
+ * @param abi   `true` for ABI register names (`a0`, `sp`), `false` for
+ *              numeric names (`x10`, `x2`).
+ * @return Length of the text, as returned by `snprintf()`.
+ */
+int r5vm_disasm(char* buf, size_t size, uint32_t inst, uint32_t pc, bool abi);
+
+/**
+ * @brief Name of integer register `reg` (0..31).
+ *
+ * @param reg  Register number.
+ * @param abi  `true` for ABI names, `false` for `x0`..`x31`.
+ */
+const char* r5vm_reg_name(unsigned reg, bool abi);
+
 // ---- Error -----------------------------------------------------------------
 
 /**
@@ -0,0 +1,410 @@
+/*
+ * R5VM - Minimal RISC-V RV32I Virtual Machine
+ *       _____
+ *      | ____|
+ *  _ __| |____   ___ __ ___
+ * | '__|___ \ \ / / '_ ` _ \
+ * | |   ___) \ V /| | | | | |
+ * |_|  |____/ \_/ |_| |_| |_|
+ *
+ * Copyright (c) 2025 Jan Zwiener
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "r5vm_asm.h"
+
+// ---- Defines ---------------------------------------------------------------
+
+#define OP_LOAD     0x03
+#define OP_FENCE    0x0F
+#define OP_IMM      0x13
+#define OP_AUIPC    0x17
+#define OP_STORE    0x23
+#define OP_REG      0x33
+#define OP_LUI      0x37
+#define OP_BRANCH   0x63
+#define OP_JALR     0x67
+#define OP_JAL      0x6F
+#define OP_SYSTEM   0x73
+
+#define FITS_SIGNED(v, bits) \
+    ((v) >= -(1L << ((bits) - 1)) && (v) < (1L << ((bits) - 1)))
+
+// ---- Encoding --------------------------------------------------------------
+
+static bool valid_reg(r5vm_asm_t* a, int r)
+{
+    if (r < 0 || r > 31) {
+        a->error = true;
+        return false;
+    }
+    return true;
+}
+
+static uint32_t enc_r(uint32_t op, uint32_t f3, uint32_t f7,
+                      int rd, int rs1, int rs2)
+{
+    return op | ((uint32_t)rd << 7) | (f3 << 12) | ((uint32_t)rs1 << 15) |
+           ((uint32_t)rs2 << 20) | (f7 << 25);
+}
+
+static uint32_t enc_i(uint32_t op, uint32_t f3, int rd, int rs1, int32_t imm)
+{
+    return op | ((uint32_t)rd << 7) | (f3 << 12) | ((uint32_t)rs1 << 15) |
+           (((uint32_t)imm & 0xFFF) << 20);
+}
+
+static uint32_t enc_s(uint32_t f3, int rs1, int rs2, int32_t imm)
+{
+    const uint32_t u = (uint32_t)imm;
+    return OP_STORE | ((u & 0x1F) << 7) | (f3 << 12) | ((uint32_t)rs1 << 15) |
+           ((uint32_t)rs2 << 20) | (((u >> 5) & 0x7F) << 25);
+}
+
+static uint32_t enc_b_imm(int32_t off)
+{
+    const uint32_t u = (uint32_t)off;
+    return (((u >> 11) & 0x1) << 7) | (((u >> 1) & 0xF) << 8) |
+           (((u >> 5) & 0x3F) << 25) | (((u >> 12) & 0x1) << 31);
+}
+
+static uint32_t enc_j_imm(int32_t off)
+{
+    const uint32_t u = (uint32_t)off;
+    return (((u >> 12) & 0xFF) << 12) | (((u >> 11) & 0x1) << 20) |
+           (((u >> 1) & 0x3FF) << 21) | (((u >> 20) & 0x1) << 31);
+}
+
+/** Split a 32-bit value into `lui`/`auipc` upper part and `addi` lower part. */
+static void split_hi_lo(uint32_t v, uint32_t* hi, int32_t* lo)
+{
+    *lo = (int32_t)(v << 20) >> 20;
+    *hi = v - (uint32_t)*lo;
+}
+
+static uint32_t load32(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void store32(uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+/**
+ * @brief Patch the PC-relative offset of the instruction at `pos`.
+ *
+ * Handles branches, `jal` and `auipc` + `addi` pairs emitted by `la`.
+ */
+static void patch(r5vm_asm_t* a, uint32_t pos, int32_t off)
+{
+    uint32_t inst = load32(a->buf + pos);
+
+    switch (inst & 0x7F) {
+    case OP_BRANCH:
+        if (!FITS_SIGNED(off, 13) || (off & 1)) {
+            a->error = true;
+            return;
+        }
+        inst = (inst & 0x01FFF07F) | enc_b_imm(off);
+        break;
+    case OP_JAL:
+        if (!FITS_SIGNED(off, 21) || (off & 1)) {
+            a->error = true;
+            return;
+        }
+        inst = (inst & 0x00000FFF) | enc_j_imm(off);
+        break;
+    case OP_AUIPC: {
+        uint32_t hi;
+        int32_t lo;
+        split_hi_lo((uint32_t)off, &hi, &lo);
+        inst = (inst & 0x00000FFF) | hi;
+        const uint32_t next = load32(a->buf + pos + 4);
+        store32(a->buf + pos + 4, (next & 0x000FFFFF) | ((uint32_t)lo << 20));
+        break;
+    }
+    default:
+        a->error = true;
+        return;
+    }
+    store32(a->buf + pos, inst);
+}
+
+/** Emit an instruction that refers to `label` relative to its own address. */
+static void emit_ref(r5vm_asm_t* a, uint32_t inst, int label)
+{
+    const uint32_t pos = a->pos;
+
+    if (label < 0 || label >= a->num_labels) {
+        a->error = true;
+        return;
+    }
+    r5vm_asm_word(a, inst);
+    if (a->error)
+        return;
+    if (a->labels[label] >= 0) {
+        patch(a, pos, a->labels[label] - (int32_t)pos);
+    } else if (a->num_fixups < R5VM_ASM_MAX_FIXUPS) {
+        a->fixups[a->num_fixups].pos = pos;
+        a->fixups[a->num_fixups].label = label;
+        a->num_fixups++;
+    } else {
+        a->error = true;
+    }
+}
+
+static void emit_r(r5vm_asm_t* a, uint32_t f3, uint32_t f7,
+                   int rd, int rs1, int rs2)
+{
+    if (valid_reg(a, rd) && valid_reg(a, rs1) && valid_reg(a, rs2))
+        r5vm_asm_word(a, enc_r(OP_REG, f3, f7, rd, rs1, rs2));
+}
+
+static void emit_i(r5vm_asm_t* a, uint32_t op, uint32_t f3,
+                   int rd, int rs1, int32_t imm)
+{
+    if (!FITS_SIGNED(imm, 12)) {
+        a->error = true;
+        return;
+    }
+    if (valid_reg(a, rd) && valid_reg(a, rs1))
+        r5vm_asm_word(a, enc_i(op, f3, rd, rs1, imm));
+}
+
+static void emit_shift(r5vm_asm_t* a, uint32_t f3, uint32_t f7,
+                       int rd, int rs1, int shamt)
+{
+    if (shamt < 0 || shamt > 31) {
+        a->error = true;
+        return;
+    }
+    if (valid_reg(a, rd) && valid_reg(a, rs1))
+        r5vm_asm_word(a, enc_r(OP_IMM, f3, f7, rd, rs1, shamt));
+}
+
+static void emit_s(r5vm_asm_t* a, uint32_t f3, int rs2, int32_t off, int rs1)
+{
+    if (!FITS_SIGNED(off, 12)) {
+        a->error = true;
+        return;
+    }
+    if (valid_reg(a, rs1) && valid_reg(a, rs2))
+        r5vm_asm_word(a, enc_s(f3, rs1, rs2, off));
+}
+
+static void emit_b(r5vm_asm_t* a, uint32_t f3, int rs1, int rs2, int label)
+{
+    if (valid_reg(a, rs1) && valid_reg(a, rs2))
+        emit_ref(a, enc_r(OP_BRANCH, f3, 0, 0, rs1, rs2), label);
+}
+
+// ---- Lifecycle -------------------------------------------------------------
+
+void r5vm_asm_init(r5vm_asm_t* a, uint8_t* buf, uint32_t size, uint32_t origin)
+{
+    memset(a, 0, sizeof(*a));
+    a->buf = buf;
+    a->size = size;
+    a->origin = origin;
+}
+
+bool r5vm_asm_finish(r5vm_asm_t* a)
+{
+    for (int i = 0; i < a->num_fixups; i++) {
+        const r5vm_asm_fixup_t* f = &a->fixups[i];
+        if (a->labels[f->label] < 0) {
+            a->error = true; /* referenced but never bound */
+            continue;
+        }
+        patch(a, f->pos, a->labels[f->label] - (int32_t)f->pos);
+    }
+    a->num_fixups = 0;
+    return !a->error;
+}
+
+uint32_t r5vm_asm_here(const r5vm_asm_t* a)
+{
+    return a->origin + a->pos;
+}
+
+void r5vm_asm_word(r5vm_asm_t* a, uint32_t word)
+{
+    if (a->pos > a->size || a->size - a->pos < 4) {
+        a->error = true;
+        return;
+    }
+    store32(a->buf + a->pos, word);
+    a->pos += 4;
+}
+
+// ---- Labels ----------------------------------------------------------------
+
+int r5vm_asm_label(r5vm_asm_t* a)
+{
+    if (a->num_labels >= R5VM_ASM_MAX_LABELS) {
+        a->error = true;
+        return -1;
+    }
+    a->labels[a->num_labels] = -1;
+    return a->num_labels++;
+}
+
+void r5vm_asm_bind(r5vm_asm_t* a, int label)
+{
+    if (label < 0 || label >= a->num_labels || a->labels[label] >= 0) {
+        a->error = true;
+        return;
+    }
+    a->labels[label] = (int32_t)a->pos;
+}
+
+// ---- RV32I -----------------------------------------------------------------
+
+void r5vm_asm_add(r5vm_asm_t* a, int rd, int rs1, int rs2)  { emit_r(a, 0x0, 0x00, rd, rs1, rs2); }
+void r5vm_asm_sub(r5vm_asm_t* a, int rd, int rs1, int rs2)  { emit_r(a, 0x0, 0x20, rd, rs1, rs2); }
+void r5vm_asm_sll(r5vm_asm_t* a, int rd, int rs1, int rs2)  { emit_r(a, 0x1, 0x00, rd, rs1, rs2); }
+void r5vm_asm_slt(r5vm_asm_t* a, int rd, int rs1, int rs2)  { emit_r(a, 0x2, 0x00, rd, rs1, rs2); }
+void r5vm_asm_sltu(r5vm_asm_t* a, int rd, int rs1, int rs2) { emit_r(a, 0x3, 0x00, rd, rs1, rs2); }
+void r5vm_asm_xor(r5vm_asm_t* a, int rd, int rs1, int rs2)  { emit_r(a, 0x4, 0x00, rd, rs1, rs2); }
+void r5vm_asm_srl(r5vm_asm_t* a, int rd, int rs1, int rs2)  { emit_r(a, 0x5, 0x00, rd, rs1, rs2); }
+void r5vm_asm_sra(r5vm_asm_t* a, int rd, int rs1, int rs2)  { emit_r(a, 0x5, 0x20, rd, rs1, rs2); }
+void r5vm_asm_or(r5vm_asm_t* a, int rd, int rs1, int rs2)   { emit_r(a, 0x6, 0x00, rd, rs1, rs2); }
+void r5vm_asm_and(r5vm_asm_t* a, int rd, int rs1, int rs2)  { emit_r(a, 0x7, 0x00, rd, rs1, rs2); }
+
+void r5vm_asm_addi(r5vm_asm_t* a, int rd, int rs1, int32_t imm)  { emit_i(a, OP_IMM, 0x0, rd, rs1, imm); }
+void r5vm_asm_slti(r5vm_asm_t* a, int rd, int rs1, int32_t imm)  { emit_i(a, OP_IMM, 0x2, rd, rs1, imm); }
+void r5vm_asm_sltiu(r5vm_asm_t* a, int rd, int rs1, int32_t imm) { emit_i(a, OP_IMM, 0x3, rd, rs1, imm); }
+void r5vm_asm_xori(r5vm_asm_t* a, int rd, int rs1, int32_t imm)  { emit_i(a, OP_IMM, 0x4, rd, rs1, imm); }
+void r5vm_asm_ori(r5vm_asm_t* a, int rd, int rs1, int32_t imm)   { emit_i(a, OP_IMM, 0x6, rd, rs1, imm); }
+void r5vm_asm_andi(r5vm_asm_t* a, int rd, int rs1, int32_t imm)  { emit_i(a, OP_IMM, 0x7, rd, rs1, imm); }
+void r5vm_asm_slli(r5vm_asm_t* a, int rd, int rs1, int shamt)    { emit_shift(a, 0x1, 0x00, rd, rs1, shamt); }
+void r5vm_asm_srli(r5vm_asm_t* a, int rd, int rs1, int shamt)    { emit_shift(a, 0x5, 0x00, rd, rs1, shamt); }
+void r5vm_asm_srai(r5vm_asm_t* a, int rd, int rs1, int shamt)    { emit_shift(a, 0x5, 0x20, rd, rs1, shamt); }
+
+void r5vm_asm_lui(r5vm_asm_t* a, int rd, uint32_t imm)
+{
+    if (valid_reg(a, rd))
+        r5vm_asm_word(a, OP_LUI | ((uint32_t)rd << 7) | (imm & 0xFFFFF000));
+}
+
+void r5vm_asm_auipc(r5vm_asm_t* a, int rd, uint32_t imm)
+{
+    if (valid_reg(a, rd))
+        r5vm_asm_word(a, OP_AUIPC | ((uint32_t)rd << 7) | (imm & 0xFFFFF000));
+}
+
+void r5vm_asm_lb(r5vm_asm_t* a, int rd, int32_t off, int rs1)  { emit_i(a, OP_LOAD, 0x0, rd, rs1, off); }
+void r5vm_asm_lh(r5vm_asm_t* a, int rd, int32_t off, int rs1)  { emit_i(a, OP_LOAD, 0x1, rd, rs1, off); }
+void r5vm_asm_lw(r5vm_asm_t* a, int rd, int32_t off, int rs1)  { emit_i(a, OP_LOAD, 0x2, rd, rs1, off); }
+void r5vm_asm_lbu(r5vm_asm_t* a, int rd, int32_t off, int rs1) { emit_i(a, OP_LOAD, 0x4, rd, rs1, off); }
+void r5vm_asm_lhu(r5vm_asm_t* a, int rd, int32_t off, int rs1) { emit_i(a, OP_LOAD, 0x5, rd, rs1, off); }
+void r5vm_asm_sb(r5vm_asm_t* a, int rs2, int32_t off, int rs1) { emit_s(a, 0x0, rs2, off, rs1); }
+void r5vm_asm_sh(r5vm_asm_t* a, int rs2, int32_t off, int rs1) { emit_s(a, 0x1, rs2, off, rs1); }
+void r5vm_asm_sw(r5vm_asm_t* a, int rs2, int32_t off, int rs1) { emit_s(a, 0x2, rs2, off, rs1); }
+
+void r5vm_asm_beq(r5vm_asm_t* a, int rs1, int rs2, int label)  { emit_b(a, 0x0, rs1, rs2, label); }
+void r5vm_asm_bne(r5vm_asm_t* a, int rs1, int rs2, int label)  { emit_b(a, 0x1, rs1, rs2, label); }
+void r5vm_asm_blt(r5vm_asm_t* a, int rs1, int rs2, int label)  { emit_b(a, 0x4, rs1, rs2, label); }
+void r5vm_asm_bge(r5vm_asm_t* a, int rs1, int rs2, int label)  { emit_b(a, 0x5, rs1, rs2, label); }
+void r5vm_asm_bltu(r5vm_asm_t* a, int rs1, int rs2, int label) { emit_b(a, 0x6, rs1, rs2, label); }
+void r5vm_asm_bgeu(r5vm_asm_t* a, int rs1, int rs2, int label) { emit_b(a, 0x7, rs1, rs2, label); }
+
+void r5vm_asm_jal(r5vm_asm_t* a, int rd, int label)
+{
+    if (valid_reg(a, rd))
+        emit_ref(a, OP_JAL | ((uint32_t)rd << 7), label);
+}
+
+void r5vm_asm_jalr(r5vm_asm_t* a, int rd, int32_t off, int rs1)
+{
+    emit_i(a, OP_JALR, 0x0, rd, rs1, off);
+}
+
+void r5vm_asm_ecall(r5vm_asm_t* a)  { r5vm_asm_word(a, 0x00000073); }
+void r5vm_asm_ebreak(r5vm_asm_t* a) { r5vm_asm_word(a, 0x00100073); }
+void r5vm_asm_fence(r5vm_asm_t* a)  { r5vm_asm_word(a, 0x0FF0000F); }
+void r5vm_asm_wfi(r5vm_asm_t* a)    { r5vm_asm_word(a, 0x10500073); }
+void r5vm_asm_pause(r5vm_asm_t* a)  { r5vm_asm_word(a, 0x0100000F); }
+
+// ---- Pseudo instructions ---------------------------------------------------
+
+void r5vm_asm_nop(r5vm_asm_t* a)
+{
+    r5vm_asm_addi(a, R5VM_ZERO, R5VM_ZERO, 0);
+}
+
+void r5vm_asm_mv(r5vm_asm_t* a, int rd, int rs)
+{
+    r5vm_asm_addi(a, rd, rs, 0);
+}
+
+void r5vm_asm_li(r5vm_asm_t* a, int rd, uint32_t value)
+{
+    uint32_t hi;
+    int32_t lo;
+
+    split_hi_lo(value, &hi, &lo);
+    if (hi == 0) {
+        r5vm_asm_addi(a, rd, R5VM_ZERO, lo);
+        return;
+    }
+    r5vm_asm_lui(a, rd, hi);
+    if (lo != 0)
+        r5vm_asm_addi(a, rd, rd, lo);
+}
+
+void r5vm_asm_la(r5vm_asm_t* a, int rd, int label)
+{
+    if (!valid_reg(a, rd))
+        return;
+    /* the addi is emitted first as a placeholder, patch() fills both */
+    const uint32_t pos = a->pos;
+    r5vm_asm_word(a, 0);
+    r5vm_asm_addi(a, rd, rd, 0);
+    if (a->error)
+        return;
+    a->pos = pos;
+    emit_ref(a, OP_AUIPC | ((uint32_t)rd << 7), label);
+    a->pos = pos + 8;
+}
+
+void r5vm_asm_j(r5vm_asm_t* a, int label)         { r5vm_asm_jal(a, R5VM_ZERO, label); }
+void r5vm_asm_call(r5vm_asm_t* a, int label)      { r5vm_asm_jal(a, R5VM_RA, label); }
+void r5vm_asm_ret(r5vm_asm_t* a)                  { r5vm_asm_jalr(a, R5VM_ZERO, 0, R5VM_RA); }
+void r5vm_asm_beqz(r5vm_asm_t* a, int rs, int label) { r5vm_asm_beq(a, rs, R5VM_ZERO, label); }
+void r5vm_asm_bnez(r5vm_asm_t* a, int rs, int label) { r5vm_asm_bne(a, rs, R5VM_ZERO, label); }
+
+void r5vm_asm_syscall(r5vm_asm_t* a, uint32_t id)
+{
+    r5vm_asm_li(a, R5VM_A7, id);
+    r5vm_asm_ecall(a);
+}
+
+void r5vm_asm_exit(r5vm_asm_t* a)
+{
+    r5vm_asm_syscall(a, 0);
+}
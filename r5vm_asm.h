@@ -0,0 +1,236 @@
+/*
+ * R5VM - Minimal RISC-V RV32I Virtual Machine
+ *       _____
+ *      | ____|
+ *  _ __| |____   ___ __ ___
+ * | '__|___ \ \ / / '_ ` _ \
+ * | |   ___) \ V /| | | | | |
+ * |_|  |____/ \_/ |_| |_| |_|
+ *
+ * Copyright (c) 2025 Jan Zwiener
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file r5vm_asm.h
+ * @brief In-process RV32I assembler.
+ *
+ * Emits RV32I machine code into a caller-provided buffer, so host programs
+ * (benchmarks, fuzzers, differential tests) can generate guest instruction
+ * streams at runtime without a RISC-V cross toolchain:
+ *
+ * @code
+ * uint8_t code[256];
+ * r5vm_asm_t a;
+ * r5vm_asm_init(&a, code, sizeof(code), 0);
+ * int loop = r5vm_asm_label(&a);
+ * r5vm_asm_li(&a, R5VM_A0, 0);
+ * r5vm_asm_li(&a, R5VM_T0, 10);
+ * r5vm_asm_bind(&a, loop);
+ * r5vm_asm_add(&a, R5VM_A0, R5VM_A0, R5VM_T0);
+ * r5vm_asm_addi(&a, R5VM_T0, R5VM_T0, -1);
+ * r5vm_asm_bnez(&a, R5VM_T0, loop);
+ * r5vm_asm_exit(&a);
+ * if (!r5vm_asm_finish(&a)) { ... }
+ * @endcode
+ *
+ * Branch and jump targets are labels. Forward references are patched by
+ * r5vm_asm_finish(). Errors (buffer overflow, immediates out of range,
+ * unbound labels) are sticky and reported by r5vm_asm_finish().
+ */
+
+#ifndef R5VM_ASM_H
+#define R5VM_ASM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// ---- Defines ---------------------------------------------------------------
+
+/** @brief Maximum number of labels per assembler instance. */
+#define R5VM_ASM_MAX_LABELS  256
+
+/** @brief Maximum number of unresolved forward references. */
+#define R5VM_ASM_MAX_FIXUPS  512
+
+/** @brief Integer register numbers (ABI names). */
+enum r5vm_reg_e
+{
+    R5VM_ZERO = 0, R5VM_RA, R5VM_SP, R5VM_GP, R5VM_TP,
+    R5VM_T0, R5VM_T1, R5VM_T2,
+    R5VM_S0, R5VM_S1,
+    R5VM_A0, R5VM_A1, R5VM_A2, R5VM_A3, R5VM_A4, R5VM_A5, R5VM_A6, R5VM_A7,
+    R5VM_S2, R5VM_S3, R5VM_S4, R5VM_S5, R5VM_S6, R5VM_S7, R5VM_S8, R5VM_S9,
+    R5VM_S10, R5VM_S11,
+    R5VM_T3, R5VM_T4, R5VM_T5, R5VM_T6
+};
+
+// ---- Assembler state -------------------------------------------------------
+
+/** @brief Pending reference to a label that was not bound yet. */
+typedef struct r5vm_asm_fixup_s
+{
+    uint32_t pos;   /**< Offset of the referencing instruction */
+    int      label; /**< Referenced label */
+} r5vm_asm_fixup_t;
+
+/**
+ * @brief Assembler instance writing into a fixed buffer.
+ */
+typedef struct r5vm_asm_s
+{
+    uint8_t* buf;      /**< Output buffer */
+    uint32_t size;     /**< Size of the output buffer in bytes */
+    uint32_t pos;      /**< Current write offset (= guest address - origin) */
+    uint32_t origin;   /**< Guest address of buf[0] */
+    bool     error;    /**< Sticky error flag */
+    int      num_labels;
+    int      num_fixups;
+    int32_t  labels[R5VM_ASM_MAX_LABELS]; /**< Label offsets, -1 = unbound */
+    r5vm_asm_fixup_t fixups[R5VM_ASM_MAX_FIXUPS];
+} r5vm_asm_t;
+
+// ---- Lifecycle -------------------------------------------------------------
+
+/**
+ * @brief Start assembling into `buf`.
+ *
+ * @param a       Assembler instance.
+ * @param buf     Output buffer.
+ * @param size    Size of the output buffer in bytes.
+ * @param origin  Guest address at which `buf` will be loaded.
+ */
+void r5vm_asm_init(r5vm_asm_t* a, uint8_t* buf, uint32_t size,
+                   uint32_t origin);
+
+/**
+ * @brief Resolve forward references.
+ *
+ * @param a Assembler instance.
+ * @return `true` if the code was assembled without errors.
+ */
+bool r5vm_asm_finish(r5vm_asm_t* a);
+
+/** @brief Guest address of the next emitted instruction. */
+uint32_t r5vm_asm_here(const r5vm_asm_t* a);
+
+/** @brief Emit a raw 32-bit word. */
+void r5vm_asm_word(r5vm_asm_t* a, uint32_t word);
+
+// ---- Labels ----------------------------------------------------------------
+
+/**
+ * @brief Create a new, unbound label.
+ * @return Label id, or -1 (and the error flag is set) if none are left.
+ */
+int r5vm_asm_label(r5vm_asm_t* a);
+
+/** @brief Bind `label` to the current position. */
+void r5vm_asm_bind(r5vm_asm_t* a, int label);
+
+// ---- RV32I: register-register ----------------------------------------------
+
+void r5vm_asm_add(r5vm_asm_t* a, int rd, int rs1, int rs2);
+void r5vm_asm_sub(r5vm_asm_t* a, int rd, int rs1, int rs2);
+void r5vm_asm_xor(r5vm_asm_t* a, int rd, int rs1, int rs2);
+void r5vm_asm_or(r5vm_asm_t* a, int rd, int rs1, int rs2);
+void r5vm_asm_and(r5vm_asm_t* a, int rd, int rs1, int rs2);
+void r5vm_asm_sll(r5vm_asm_t* a, int rd, int rs1, int rs2);
+void r5vm_asm_srl(r5vm_asm_t* a, int rd, int rs1, int rs2);
+void r5vm_asm_sra(r5vm_asm_t* a, int rd, int rs1, int rs2);
+void r5vm_asm_slt(r5vm_asm_t* a, int rd, int rs1, int rs2);
+void r5vm_asm_sltu(r5vm_asm_t* a, int rd, int rs1, int rs2);
+
+// ---- RV32I: register-immediate (imm: -2048..2047, shamt: 0..31) ------------
+
+void r5vm_asm_addi(r5vm_asm_t* a, int rd, int rs1, int32_t imm);
+void r5vm_asm_xori(r5vm_asm_t* a, int rd, int rs1, int32_t imm);
+void r5vm_asm_ori(r5vm_asm_t* a, int rd, int rs1, int32_t imm);
+void r5vm_asm_andi(r5vm_asm_t* a, int rd, int rs1, int32_t imm);
+void r5vm_asm_slti(r5vm_asm_t* a, int rd, int rs1, int32_t imm);
+void r5vm_asm_sltiu(r5vm_asm_t* a, int rd, int rs1, int32_t imm);
+void r5vm_asm_slli(r5vm_asm_t* a, int rd, int rs1, int shamt);
+void r5vm_asm_srli(r5vm_asm_t* a, int rd, int rs1, int shamt);
+void r5vm_asm_srai(r5vm_asm_t* a, int rd, int rs1, int shamt);
+
+// ---- RV32I: upper immediates (imm: upper 20 bits, low 12 bits ignored) -----
+
+void r5vm_asm_lui(r5vm_asm_t* a, int rd, uint32_t imm);
+void r5vm_asm_auipc(r5vm_asm_t* a, int rd, uint32_t imm);
+
+// ---- RV32I: loads and stores -----------------------------------------------
+
+void r5vm_asm_lb(r5vm_asm_t* a, int rd, int32_t off, int rs1);
+void r5vm_asm_lh(r5vm_asm_t* a, int rd, int32_t off, int rs1);
+void r5vm_asm_lw(r5vm_asm_t* a, int rd, int32_t off, int rs1);
+void r5vm_asm_lbu(r5vm_asm_t* a, int rd, int32_t off, int rs1);
+void r5vm_asm_lhu(r5vm_asm_t* a, int rd, int32_t off, int rs1);
+void r5vm_asm_sb(r5vm_asm_t* a, int rs2, int32_t off, int rs1);
+void r5vm_asm_sh(r5vm_asm_t* a, int rs2, int32_t off, int rs1);
+void r5vm_asm_sw(r5vm_asm_t* a, int rs2, int32_t off, int rs1);
+
+// ---- RV32I: control transfer -----------------------------------------------
+
+void r5vm_asm_beq(r5vm_asm_t* a, int rs1, int rs2, int label);
+void r5vm_asm_bne(r5vm_asm_t* a, int rs1, int rs2, int label);
+void r5vm_asm_blt(r5vm_asm_t* a, int rs1, int rs2, int label);
+void r5vm_asm_bge(r5vm_asm_t* a, int rs1, int rs2, int label);
+void r5vm_asm_bltu(r5vm_asm_t* a, int rs1, int rs2, int label);
+void r5vm_asm_bgeu(r5vm_asm_t* a, int rs1, int rs2, int label);
+void r5vm_asm_jal(r5vm_asm_t* a, int rd, int label);
+void r5vm_asm_jalr(r5vm_asm_t* a, int rd, int32_t off, int rs1);
+
+// ---- RV32I: system ---------------------------------------------------------
+
+void r5vm_asm_ecall(r5vm_asm_t* a);
+void r5vm_asm_ebreak(r5vm_asm_t* a);
+void r5vm_asm_fence(r5vm_asm_t* a);
+/** @brief Wait for interrupt, the VM stops with `R5VM_IDLE`. */
+void r5vm_asm_wfi(r5vm_asm_t* a);
+/** @brief Zihintpause spin-loop hint, the VM stops with `R5VM_IDLE`. */
+void r5vm_asm_pause(r5vm_asm_t* a);
+
+// ---- Pseudo instructions ---------------------------------------------------
+
+/** @brief `addi x0, x0, 0` */
+void r5vm_asm_nop(r5vm_asm_t* a);
+/** @brief `addi rd, rs, 0` */
+void r5vm_asm_mv(r5vm_asm_t* a, int rd, int rs);
+/** @brief Load a 32-bit constant (`addi` or `lui` + `addi`). */
+void r5vm_asm_li(r5vm_asm_t* a, int rd, uint32_t value);
+/** @brief Load the address of `label` (`auipc` + `addi`). */
+void r5vm_asm_la(r5vm_asm_t* a, int rd, int label);
+/** @brief `jal x0, label` */
+void r5vm_asm_j(r5vm_asm_t* a, int label);
+/** @brief `jal ra, label` */
+void r5vm_asm_call(r5vm_asm_t* a, int label);
+/** @brief `jalr x0, 0(ra)` */
+void r5vm_asm_ret(r5vm_asm_t* a);
+/** @brief `beq rs, x0, label` */
+void r5vm_asm_beqz(r5vm_asm_t* a, int rs, int label);
+/** @brief `bne rs, x0, label` */
+void r5vm_asm_bnez(r5vm_asm_t* a, int rs, int label);
+/** @brief Host syscall: `li a7, id` + `ecall`. */
+void r5vm_asm_syscall(r5vm_asm_t* a, uint32_t id);
+/** @brief Exit the VM with the exit code in a0 (`li a7, 0` + `ecall`). */
+void r5vm_asm_exit(r5vm_asm_t* a);
+
+#endif // R5VM_ASM_H
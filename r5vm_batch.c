@@ -0,0 +1,506 @@
+/*
+ * R5VM - Minimal RISC-V RV32I Virtual Machine
+ *       _____
+ *      | ____|
+ *  _ __| |____   ___ __ ___
+ * | '__|___ \ \ / / '_ ` _ \
+ * | |   ___) \ V /| | | | | |
+ * |_|  |____/ \_/ |_| |_| |_|
+ *
+ * Copyright (c) 2025 Jan Zwiener
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#if !defined(_WIN32)
+#define _DEFAULT_SOURCE   /* clock_gettime on glibc */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+
+#if !defined(_WIN32)
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#endif
+
+#include "r5vm_batch.h"
+
+// ---- Defines ---------------------------------------------------------------
+
+#define R5VM_BATCH_SLICE  (1u << 24) /**< Max. steps per r5vm_host_run() call */
+#define R5VM_BATCH_POOL   1          /**< Free VMs per size kept by a single worker */
+
+// ---- Job execution ---------------------------------------------------------
+
+/** Monotonic time in seconds */
+static double batch_now(void)
+{
+#if !defined(_WIN32)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/** Load and run one job, guest output goes to `out` (NULL: stdout) */
+static void batch_job(r5vm_batch_job_t* job, r5vm_batch_load_fn load,
+                      r5vm_pool_t* pool, FILE* out)
+{
+    const double t0 = batch_now();
+
+    job->status = R5VM_ERROR;
+    r5vm_host_t* host = load(pool, job);
+    if (!host) {
+        job->seconds = batch_now() - t0;
+        return;
+    }
+    job->loaded = true;
+    host->vm.out = out;
+    r5vm_reset(&host->vm);
+    do {
+        unsigned slice = R5VM_BATCH_SLICE;
+        if (job->fuel && job->fuel - job->steps < slice)
+            slice = (unsigned)(job->fuel - job->steps);
+        job->steps += r5vm_host_run(host, slice);
+    } while ((host->vm.status == R5VM_RUNNING || r5vm_paused(&host->vm)) &&
+             (!job->fuel || job->steps < job->fuel));
+
+    job->status = host->vm.status;
+    job->exit_code = host->vm.a0 & 0xFF;
+    r5vm_pool_release(pool, host);
+    job->seconds = batch_now() - t0;
+}
+
+/**
+ * Read up to `max` bytes from offset `off` of `f` into a new buffer.
+ * Returns NULL if there is nothing to read or memory runs out.
+ */
+static char* batch_read(FILE* f, long off, size_t max, size_t* size)
+{
+    char* buf = NULL;
+    size_t len = 0, cap = 0;
+
+    *size = 0;
+    if (fflush(f) != 0 || fseek(f, off, SEEK_SET) != 0)
+        return NULL;
+    while (len < max) {
+        if (len == cap) {
+            cap = cap ? cap * 2 : 4096;
+            char* p = realloc(buf, cap);
+            if (!p)
+                break;
+            buf = p;
+        }
+        const size_t want = cap - len < max - len ? cap - len : max - len;
+        const size_t n = fread(buf + len, 1, want, f);
+        len += n;
+        if (n < want)
+            break;
+    }
+    if (!len) {
+        free(buf);
+        return NULL;
+    }
+    *size = len;
+    return buf;
+}
+
+/**
+ * Run one job with its output in a temporary file that is read back into
+ * `job->output` and closed when the job ends, so a batch holds one file
+ * per running job only.
+ */
+static void batch_job_captured(r5vm_batch_job_t* job, r5vm_batch_load_fn load,
+                               r5vm_pool_t* pool)
+{
+    FILE* out = tmpfile(); /* NULL: write to stdout directly */
+
+    batch_job(job, load, pool, out);
+    if (out) {
+        job->output = batch_read(out, 0, (size_t)-1, &job->output_size);
+        fclose(out);
+    }
+}
+
+#if !defined(_WIN32)
+
+/** Work list shared by the worker threads */
+typedef struct r5vm_batch_s
+{
+    pthread_mutex_t    lock;
+    r5vm_batch_job_t*  jobs;
+    unsigned           count;
+    unsigned           next;  /**< Next job to hand out */
+    r5vm_batch_load_fn load;
+    r5vm_pool_t        pool;  /**< VMs shared by the workers */
+} r5vm_batch_t;
+
+static void* batch_worker(void* arg)
+{
+    r5vm_batch_t* b = arg;
+
+    for (;;) {
+        pthread_mutex_lock(&b->lock);
+        const unsigned i = b->next < b->count ? b->next++ : b->count;
+        pthread_mutex_unlock(&b->lock);
+        if (i == b->count)
+            break;
+        batch_job_captured(&b->jobs[i], b->load, &b->pool);
+    }
+    return NULL;
+}
+
+/** Where a worker process left the output of one job */
+typedef struct r5vm_batch_capture_s
+{
+    unsigned slot; /**< Worker slot, selects the capture file */
+    long     off;  /**< Offset of the output in the file */
+    long     len;  /**< Output length, 0: none or the worker died */
+} r5vm_batch_capture_t;
+
+/** Coordinator state, the pointers refer to a segment shared with the workers */
+typedef struct r5vm_batch_shm_s
+{
+    volatile unsigned* next;       /**< Next job, taken with an atomic add */
+    volatile unsigned* running;    /**< Per worker: job index + 1, 0: idle */
+    r5vm_batch_job_t*  jobs;       /**< Shared copy of the job list */
+    r5vm_batch_capture_t* capture; /**< Per job: output location */
+    FILE**             files;      /**< Per worker slot: capture file (NULL: stdout) */
+    unsigned           count;
+} r5vm_batch_shm_t;
+
+/** Worker process: run jobs until the list is exhausted */
+static void batch_proc(r5vm_batch_shm_t* shm, unsigned slot, r5vm_batch_load_fn load)
+{
+    FILE* out = shm->files[slot]; /* appended to by every worker in this slot */
+    r5vm_pool_t pool;
+
+    r5vm_pool_init(&pool, R5VM_BATCH_POOL);
+    for (;;) {
+        const unsigned i = __sync_fetch_and_add(shm->next, 1);
+        if (i >= shm->count)
+            break;
+        shm->running[slot] = i + 1;
+        const long off = out && fseek(out, 0, SEEK_END) == 0 ? ftell(out) : -1;
+        batch_job(&shm->jobs[i], load, &pool, off >= 0 ? out : NULL);
+        if (off >= 0 && fflush(out) == 0) {
+            shm->capture[i].slot = slot;
+            shm->capture[i].off = off;
+            shm->capture[i].len = ftell(out) - off;
+        }
+        shm->running[slot] = 0;
+    }
+    fflush(NULL);
+    _exit(0);
+}
+
+/** Fork the worker for `slot`, returns its pid or -1 */
+static pid_t batch_spawn(r5vm_batch_shm_t* shm, unsigned slot, r5vm_batch_load_fn load)
+{
+    fflush(NULL); /* do not duplicate pending stdio output */
+    const pid_t pid = fork();
+    if (pid == 0)
+        batch_proc(shm, slot, load);
+    return pid;
+}
+
+/** Size of an image file, 0 if it cannot be read */
+static size_t batch_file_size(const char* path)
+{
+    FILE* f = fopen(path, "rb");
+    long size = -1;
+
+    if (f && fseek(f, 0, SEEK_END) == 0)
+        size = ftell(f);
+    if (f)
+        fclose(f);
+    return size > 0 ? (size_t)size : 0;
+}
+
+/** qsort() order of job pointers by image path */
+static int batch_cmp_image(const void* a, const void* b)
+{
+    const r5vm_batch_job_t* x = *(const r5vm_batch_job_t* const*)a;
+    const r5vm_batch_job_t* y = *(const r5vm_batch_job_t* const*)b;
+    return strcmp(x->image, y->image);
+}
+
+/**
+ * Read every distinct image once into one shared mapping and point the jobs
+ * at it. Jobs whose image cannot be read keep `data` NULL, the loader then
+ * reports the error. Returns the mapping (NULL if nothing was loaded).
+ */
+static uint8_t* batch_load_images(r5vm_batch_job_t* jobs, unsigned count, size_t* out_size)
+{
+    r5vm_batch_job_t** order = malloc(count * sizeof(*order));
+    size_t total = 0;
+    uint8_t* base = NULL;
+
+    *out_size = 0;
+    if (!order)
+        return NULL;
+    /* sorted by path, the first job of a run of equal paths reads the file */
+    for (unsigned i = 0; i < count; i++)
+        order[i] = &jobs[i];
+    qsort(order, count, sizeof(*order), batch_cmp_image);
+    for (unsigned i = 0; i < count; i++) {
+        if (i && strcmp(order[i - 1]->image, order[i]->image) == 0) {
+            order[i]->data_size = order[i - 1]->data_size;
+            continue;
+        }
+        order[i]->data_size = batch_file_size(order[i]->image);
+        total += order[i]->data_size;
+    }
+    if (total)
+        base = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (!base || base == MAP_FAILED) {
+        free(order);
+        return NULL;
+    }
+
+    size_t off = 0;
+    for (unsigned i = 0; i < count; i++) {
+        r5vm_batch_job_t* job = order[i];
+        if (i && strcmp(order[i - 1]->image, job->image) == 0) {
+            job->data = order[i - 1]->data;
+            continue;
+        }
+        if (!job->data_size)
+            continue;
+        FILE* f = fopen(job->image, "rb");
+        if (f && fread(base + off, 1, job->data_size, f) == job->data_size)
+            job->data = base + off;
+        if (f)
+            fclose(f);
+        off += job->data_size;
+    }
+    mprotect(base, total, PROT_READ);
+    free(order);
+    *out_size = total;
+    return base;
+}
+
+#endif /* !_WIN32 */
+
+// ---- Functions -------------------------------------------------------------
+
+double r5vm_batch_run(r5vm_batch_job_t* jobs, unsigned count, unsigned threads,
+                      r5vm_batch_load_fn load)
+{
+    const double t0 = batch_now();
+#if !defined(_WIN32)
+    r5vm_batch_t b;
+    unsigned started = 0;
+
+    if (!threads) {
+        const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (unsigned)cpus : 1;
+    }
+    pthread_t* tid = calloc(threads, sizeof(*tid));
+
+    if (!tid)
+        return -1.0;
+    pthread_mutex_init(&b.lock, NULL);
+    b.jobs = jobs;
+    b.count = count;
+    b.next = 0;
+    b.load = load;
+    if (threads > count)
+        threads = count;
+    r5vm_pool_init(&b.pool, threads);
+    while (started < threads &&
+           pthread_create(&tid[started], NULL, batch_worker, &b) == 0)
+        started++;
+    for (unsigned i = 0; i < started; i++)
+        pthread_join(tid[i], NULL);
+    pthread_mutex_destroy(&b.lock);
+    r5vm_pool_destroy(&b.pool);
+    free(tid);
+    if (!started && count)
+        return -1.0;
+#else
+    r5vm_pool_t pool;
+    (void)threads;
+    r5vm_pool_init(&pool, R5VM_BATCH_POOL);
+    for (unsigned i = 0; i < count; i++)
+        batch_job_captured(&jobs[i], load, &pool);
+    r5vm_pool_destroy(&pool);
+#endif
+    return batch_now() - t0;
+}
+
+double r5vm_batch_run_procs(r5vm_batch_job_t* jobs, unsigned count,
+                            unsigned procs, r5vm_batch_load_fn load)
+{
+#if !defined(_WIN32)
+    const double t0 = batch_now();
+    r5vm_batch_shm_t shm;
+    size_t image_size = 0;
+    unsigned alive = 0;
+
+    if (!procs) {
+        const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        procs = cpus > 0 ? (unsigned)cpus : 1;
+    }
+    if (procs > count)
+        procs = count;
+    if (!count)
+        return 0.0;
+
+    /* Layout: next, running[procs], jobs[count], capture[count] */
+    const size_t jobs_off = ((procs + 1) * sizeof(unsigned) + 63) & ~(size_t)63;
+    const size_t capture_off = jobs_off + count * sizeof(*jobs);
+    const size_t shm_size = capture_off + count * sizeof(r5vm_batch_capture_t);
+    uint8_t* seg = mmap(NULL, shm_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    pid_t* pids = calloc(procs, sizeof(*pids));
+    FILE** files = calloc(procs, sizeof(*files));
+    if (seg == MAP_FAILED || !pids || !files) {
+        if (seg != MAP_FAILED)
+            munmap(seg, shm_size);
+        free(pids);
+        free(files);
+        return -1.0;
+    }
+    uint8_t* images = batch_load_images(jobs, count, &image_size);
+    for (unsigned slot = 0; slot < procs; slot++)
+        files[slot] = tmpfile(); /* one per worker slot, not per job */
+
+    shm.next = (volatile unsigned*)seg;
+    shm.running = shm.next + 1;
+    shm.jobs = memcpy(seg + jobs_off, jobs, count * sizeof(*jobs));
+    shm.capture = (r5vm_batch_capture_t*)(seg + capture_off);
+    shm.files = files;
+    shm.count = count;
+    for (unsigned slot = 0; slot < procs; slot++) {
+        pids[slot] = batch_spawn(&shm, slot, load);
+        alive += pids[slot] > 0;
+    }
+
+    while (alive) {
+        int wstatus;
+        const pid_t pid = waitpid(-1, &wstatus, 0);
+        if (pid < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        unsigned slot = 0;
+        while (slot < procs && pids[slot] != pid)
+            slot++;
+        if (slot == procs)
+            continue;
+        pids[slot] = -1;
+        alive--;
+        if (WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0)
+            continue;
+
+        const unsigned running = shm.running[slot];
+        if (running) {
+            r5vm_batch_job_t* job = &shm.jobs[running - 1];
+            job->crashed = true;
+            job->status = R5VM_ERROR;
+            shm.running[slot] = 0;
+            fprintf(stderr, "[r5vm] batch: worker %d died (%s %d) in job %u (%s)\n",
+                    (int)pid, WIFSIGNALED(wstatus) ? "signal" : "exit",
+                    WIFSIGNALED(wstatus) ? WTERMSIG(wstatus) : WEXITSTATUS(wstatus),
+                    running, job->image);
+        }
+        if (*shm.next < count) {
+            pids[slot] = batch_spawn(&shm, slot, load);
+            alive += pids[slot] > 0;
+        }
+    }
+
+    const bool started = *shm.next != 0;
+    memcpy(jobs, shm.jobs, count * sizeof(*jobs));
+    for (unsigned i = 0; i < count; i++) {
+        const r5vm_batch_capture_t* c = &shm.capture[i];
+        jobs[i].data = NULL; /* the image mapping is released below */
+        if (c->len > 0)
+            jobs[i].output = batch_read(files[c->slot], c->off, (size_t)c->len,
+                                        &jobs[i].output_size);
+    }
+    for (unsigned slot = 0; slot < procs; slot++) {
+        if (files[slot])
+            fclose(files[slot]);
+    }
+    if (images)
+        munmap(images, image_size);
+    munmap(seg, shm_size);
+    free(files);
+    free(pids);
+    if (!started)
+        return -1.0; /* no worker could be forked */
+    return batch_now() - t0;
+#else
+    return r5vm_batch_run(jobs, count, procs, load);
+#endif
+}
+
+bool r5vm_batch_report(r5vm_batch_job_t* jobs, unsigned count, double seconds,
+                       FILE* f)
+{
+    static const char* const names[] = { "fuel", "exit", "break", "error", "idle" };
+    uint64_t steps = 0;
+    unsigned ok = 0;
+
+    for (unsigned i = 0; i < count; i++) {
+        r5vm_batch_job_t* job = &jobs[i];
+        if (!job->output)
+            continue;
+        printf("==> [%u] %s <==\n", i + 1, job->image);
+        fwrite(job->output, 1, job->output_size, stdout);
+        free(job->output);
+        job->output = NULL;
+        job->output_size = 0;
+    }
+    fflush(stdout);
+
+    fprintf(f, "\n%5s  %-6s %5s %14s %11s  %s\n",
+            "job", "status", "exit", "instructions", "time [ms]", "image");
+    for (unsigned i = 0; i < count; i++) {
+        const r5vm_batch_job_t* job = &jobs[i];
+        const char* status = job->crashed ? "crash" :
+                             job->loaded ? names[job->status] : "load";
+        if (job->loaded && job->status == R5VM_EXIT) {
+            fprintf(f, "%5u  %-6s %5" PRIu32, i + 1, status, job->exit_code);
+            ok += job->exit_code == 0;
+        } else {
+            fprintf(f, "%5u  %-6s %5s", i + 1, status, "-");
+        }
+        fprintf(f, " %14" PRIu64 " %11.3f  %s\n", job->steps,
+                job->seconds * 1e3, job->image);
+        steps += job->steps;
+    }
+    fprintf(f, "[r5vm] batch: %u job(s), %u ok, %u failed, %" PRIu64
+            " instructions in %.3f s (%.1f MIPS)\n", count, ok, count - ok,
+            steps, seconds, seconds > 0.0 ? (double)steps / seconds * 1e-6 : 0.0);
+    return ok == count;
+}
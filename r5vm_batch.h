@@ -0,0 +1,132 @@
+/*
+ * R5VM - Minimal RISC-V RV32I Virtual Machine
+ *       _____
+ *      | ____|
+ *  _ __| |____   ___ __ ___
+ * | '__|___ \ \ / / '_ ` _ \
+ * | |   ___) \ V /| | | | | |
+ * |_|  |____/ \_/ |_| |_| |_|
+ *
+ * Copyright (c) 2025 Jan Zwiener
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file r5vm_batch.h
+ * @brief Run many guest jobs in one process, spread over worker threads.
+ *
+ * Each job is a guest image with its own memory size and instruction limit
+ * ("fuel"). Worker threads take the next job from the list, load it, run it
+ * and record exit status, instruction count and wall time. Guest output is
+ * captured per job, so concurrent jobs do not interleave. Running many
+ * short jobs this way avoids one process creation per job.
+ *
+ * r5vm_batch_run_procs() runs the same job list in worker processes for
+ * fault isolation: a worker that crashes only fails its current job.
+ *
+ * VMs come from a pool (r5vm_pool.h) and go back to it after each job, so
+ * a worker recycles the guest memory of earlier jobs of the same size.
+ */
+
+#ifndef R5VM_BATCH_H
+#define R5VM_BATCH_H
+
+#include "r5vm_pool.h"
+
+// ---- Batch job -------------------------------------------------------------
+
+/** @brief A guest job and its results. */
+typedef struct r5vm_batch_job_s
+{
+    const char*   image;     /**< Path of the guest binary */
+    uint32_t      mem_size;  /**< Guest memory size (0: loader default) */
+    uint64_t      fuel;      /**< Instruction limit (0: unlimited) */
+    const uint8_t* data;     /**< Preloaded image contents (NULL: read `image`) */
+    size_t        data_size; /**< Size of `data` in bytes */
+
+    bool          loaded;    /**< Image was loaded and run */
+    r5vm_status_t status;    /**< Final status, R5VM_RUNNING: out of fuel */
+    uint32_t      exit_code; /**< Low byte of `a0` after the exit ECALL */
+    uint64_t      steps;     /**< Executed instructions */
+    double        seconds;   /**< Wall time of load and run */
+    char*         output;    /**< Captured guest output (NULL: none) */
+    size_t        output_size; /**< Bytes in `output` */
+    bool          crashed;   /**< Worker process died while running the job */
+} r5vm_batch_job_t;
+
+/**
+ * @brief Load `job->image` into a VM taken from `pool`.
+ *
+ * Called on worker threads or processes. Uses `job->data` if set. On
+ * success the VM is loaded and may carry further setup (HLE, stack guard);
+ * the batch releases it to `pool` after the job. On failure the loader
+ * releases the VM itself and returns NULL.
+ */
+typedef r5vm_host_t* (*r5vm_batch_load_fn)(r5vm_pool_t* pool,
+                                           const r5vm_batch_job_t* job);
+
+// ---- Functions -------------------------------------------------------------
+
+/**
+ * @brief Run all jobs on `threads` worker threads.
+ *
+ * Jobs are handed out in order, each runs to completion on one thread.
+ *
+ * @param jobs     Job list, results are stored in place.
+ * @param count    Number of jobs.
+ * @param threads  Number of worker threads, 0 for one per online CPU.
+ * @param load     Image loader.
+ * @return Wall time of the whole batch in seconds, or a negative value if
+ *         no worker thread could be started.
+ */
+double r5vm_batch_run(r5vm_batch_job_t* jobs, unsigned count, unsigned threads,
+                      r5vm_batch_load_fn load);
+
+/**
+ * @brief Run all jobs in `procs` forked worker processes.
+ *
+ * Every distinct image is read once into a shared read-only mapping that
+ * all workers load from (`job->data`). The job list and results live in a
+ * shared segment; workers take the next job with an atomic increment, so
+ * the load stays balanced without a lock. A worker that dies is replaced,
+ * its current job is reported as crashed. Without `fork()` this falls back
+ * to r5vm_batch_run().
+ *
+ * @param jobs   Job list, results are stored in place.
+ * @param count  Number of jobs.
+ * @param procs  Number of worker processes, 0 for one per online CPU.
+ * @param load   Image loader, runs in the workers.
+ * @return Wall time of the whole batch in seconds, or a negative value if
+ *         the shared segment or the first worker could not be created.
+ */
+double r5vm_batch_run_procs(r5vm_batch_job_t* jobs, unsigned count,
+                            unsigned procs, r5vm_batch_load_fn load);
+
+/**
+ * @brief Print the captured output of every job and a summary table.
+ *
+ * Output goes to `stdout`, the summary to `f`. Releases the captured output.
+ *
+ * @return `true` if every job exited with code 0.
+ */
+bool r5vm_batch_report(r5vm_batch_job_t* jobs, unsigned count, double seconds,
+                       FILE* f);
+
+#endif // R5VM_BATCH_H
@@ -0,0 +1,766 @@
+/*
+ * R5VM - Minimal RISC-V RV32I Virtual Machine
+ *       _____
+ *      | ____|
+ *  _ __| |____   ___ __ ___
+ * | '__|___ \ \ / / '_ ` _ \
+ * | |   ___) \ V /| | | | | |
+ * |_|  |____/ \_/ |_| |_| |_|
+ *
+ * Copyright (c) 2025 Jan Zwiener
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#if !defined(_WIN32)
+#define _DEFAULT_SOURCE   /* clock_gettime on glibc */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#endif
+
+#include "r5vm_chan.h"
+
+// ---- Defines ---------------------------------------------------------------
+
+#define R5VM_CHAN_SLICE  (1u << 20) /**< Max. steps before a VM yields its thread */
+
+#if !defined(_WIN32)
+
+// ---- Scheduler state -------------------------------------------------------
+
+/** A queued message */
+typedef struct r5vm_chan_msg_s
+{
+    uint8_t* data;  /**< Moved pages or a malloc() copy */
+    uint8_t* tail;  /**< Copy of the bytes behind the moved pages, or NULL */
+    uint32_t len;   /**< Message length in bytes */
+    bool     pages; /**< `data` holds the whole pages, from r5vm_host_take_pages() */
+    r5vm_host_t* owner; /**< Sender, charged until the message is consumed */
+} r5vm_chan_msg_t;
+
+/** A channel: ring of queued messages */
+typedef struct r5vm_chan_s
+{
+    uint32_t        key;   /**< Key passed to CHAN_OPEN */
+    bool            open;  /**< Slot in use */
+    unsigned        head;  /**< Index of the oldest message */
+    unsigned        count; /**< Number of queued messages */
+    r5vm_chan_msg_t msg[R5VM_CHAN_DEPTH];
+} r5vm_chan_t;
+
+struct r5vm_chan_sys_s;
+struct r5vm_chan_export_s;
+
+/** Per-VM state, installed as `host->user` */
+typedef struct r5vm_chan_task_s
+{
+    struct r5vm_chan_sys_s*  sys;
+    r5vm_host_t*             host;
+    r5vm_ecall_fn            next;     /**< ECALL handler of the host layer */
+    void*                    user;     /**< Saved `host->user` */
+    uint32_t                 idle_ms;  /**< Saved `host->idle_ms` */
+    r5vm_chan_t*             waiting;  /**< Channel the VM blocks on, or NULL */
+    uint64_t                 deadline; /**< CHAN_POLL timeout [ms], 0: none */
+    bool                     parked;   /**< Blocked and not in the run queue */
+    struct r5vm_chan_task_s* link;     /**< Next VM in the run queue */
+    struct r5vm_chan_export_s* call;   /**< Export this call context runs, NULL: none */
+} r5vm_chan_task_t;
+
+/** An exported entry point and its call context */
+typedef struct r5vm_chan_export_s
+{
+    uint32_t         key;
+    uint32_t         entry;     /**< Guest address of the entry point */
+    uint32_t         cookie;    /**< Passed to the entry in a5 */
+    uint32_t         stack;     /**< `sp` of a call */
+    uint32_t         buf;       /**< Service buffer */
+    uint32_t         buf_size;
+    uint32_t         regs[32];  /**< Service registers at export (gp, tp) */
+    bool             plain;     /**< Service memory cannot fault, see chan_plain() */
+    pthread_mutex_t  lock;      /**< One call at a time */
+    pthread_t        owner;     /**< Thread running the call */
+    bool             busy;      /**< A call is running */
+    struct r5vm_chan_export_s* inner; /**< Export the running call calls or waits for */
+    bool             returned;  /**< Entry reached RPC_RETURN */
+    r5vm_host_t      ctx;       /**< Service memory with the call's registers */
+    r5vm_chan_task_t frame;     /**< `ctx.user` */
+} r5vm_chan_export_t;
+
+/** Channels and run queue shared by the scheduler threads */
+typedef struct r5vm_chan_sys_s
+{
+    pthread_mutex_t   lock;    /**< Protects all fields and the channels */
+    pthread_cond_t    cond;    /**< Run queue, halts and timeouts */
+    r5vm_chan_task_t* tasks;
+    unsigned          count;
+    unsigned          done;    /**< Halted VMs */
+    unsigned          running; /**< VMs executing on a thread */
+    r5vm_chan_task_t* head;    /**< Run queue */
+    r5vm_chan_task_t* tail;
+    r5vm_chan_t       chan[R5VM_CHAN_MAX];
+    r5vm_chan_t       export_wait; /**< Callers of a key not exported yet */
+    r5vm_chan_export_t exports[R5VM_RPC_MAX]; /**< Append-only */
+    volatile unsigned exports_count;
+    r5vm_dedup_t*     dedup;   /**< Optional page dedup scanner */
+} r5vm_chan_sys_t;
+
+/** Monotonic time in milliseconds */
+static uint64_t chan_now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
+
+static void chan_push(r5vm_chan_sys_t* s, r5vm_chan_task_t* t)
+{
+    t->link = NULL;
+    if (s->tail)
+        s->tail->link = t;
+    else
+        s->head = t;
+    s->tail = t;
+    pthread_cond_signal(&s->cond);
+}
+
+static r5vm_chan_task_t* chan_pop(r5vm_chan_sys_t* s)
+{
+    r5vm_chan_task_t* t = s->head;
+    if (t) {
+        s->head = t->link;
+        if (!s->head)
+            s->tail = NULL;
+    }
+    return t;
+}
+
+/** Bytes of a `len` byte message that fill whole host pages */
+static uint32_t chan_whole_pages(uint32_t len)
+{
+    return len & ~((uint32_t)r5vm_host_page_size() - 1);
+}
+
+static void chan_free_msg(r5vm_chan_msg_t* m)
+{
+    if (m->data && m->pages)
+        munmap(m->data, chan_whole_pages(m->len));
+    else
+        free(m->data);
+    free(m->tail);
+    m->data = NULL;
+    m->tail = NULL;
+    r5vm_host_uncharge(m->owner, m->len);
+}
+
+// ---- Channel ECALLs --------------------------------------------------------
+
+/** Make the VMs blocked on `c` retry their ECALL */
+static void chan_wake(r5vm_chan_sys_t* s, const r5vm_chan_t* c)
+{
+    for (unsigned i = 0; i < s->count; i++) {
+        r5vm_chan_task_t* t = &s->tasks[i];
+        if (t->waiting != c)
+            continue;
+        t->waiting = NULL;
+        if (t->parked) {
+            t->parked = false;
+            chan_push(s, t);
+        }
+    }
+}
+
+/** Stop the VM at the current ECALL until chan_wake() */
+static bool chan_block(r5vm_chan_task_t* t, r5vm_chan_t* c)
+{
+    r5vm_t* vm = &t->host->vm;
+
+    if (t->call) {
+        /* a call context has no scheduler slot to give up */
+        r5vm_error(vm, "Blocking ECALL in RPC entry", (vm->pc - 4) & vm->mem_mask, vm->a7);
+        return false;
+    }
+    t->waiting = c;
+    vm->pc = (vm->pc - 4) & vm->mem_mask; /* run the ECALL again on resume */
+    vm->status = R5VM_IDLE;
+    return false;
+}
+
+static bool chan_range_ok(r5vm_t* vm, uint32_t addr, uint32_t len, uint32_t id)
+{
+    if (addr > vm->mem_size || len > vm->mem_size - addr) {
+        r5vm_error(vm, "ECALL memory out of bounds", (vm->pc - 4) & vm->mem_mask, id);
+        return false;
+    }
+    return true;
+}
+
+static void chan_open(r5vm_chan_sys_t* s, r5vm_t* vm)
+{
+    int free_slot = -1;
+
+    for (int i = 0; i < R5VM_CHAN_MAX; i++) {
+        if (s->chan[i].open && s->chan[i].key == vm->a0) {
+            vm->a0 = (uint32_t)i;
+            return;
+        }
+        if (!s->chan[i].open && free_slot < 0)
+            free_slot = i;
+    }
+    if (free_slot >= 0) {
+        s->chan[free_slot].open = true;
+        s->chan[free_slot].key = vm->a0;
+    }
+    vm->a0 = (uint32_t)free_slot;
+}
+
+static bool chan_send(r5vm_chan_task_t* t, r5vm_chan_t* c)
+{
+    r5vm_host_t* host = t->host;
+    r5vm_t* vm = &host->vm;
+    const uint32_t addr = vm->a1, len = vm->a2;
+
+    if (!chan_range_ok(vm, addr, len, R5VM_ECALL_CHAN_SEND))
+        return false;
+    if (addr < host->guard_hi && addr + len > host->guard_lo) {
+        r5vm_error(vm, "ECALL memory out of bounds", (vm->pc - 4) & vm->mem_mask,
+                   R5VM_ECALL_CHAN_SEND);
+        return false;
+    }
+    if (c->count == R5VM_CHAN_DEPTH)
+        return chan_block(t, c);
+    if (!r5vm_host_charge(host, len)) {
+        vm->a0 = UINT32_MAX; /* over the memory quota */
+        return true;
+    }
+
+    /* move only the pages inside the message, the sender keeps the rest
+       of its last page and the bytes of the message in it are copied */
+    const uint32_t whole = chan_whole_pages(len);
+    r5vm_chan_msg_t* m = &c->msg[(c->head + c->count) % R5VM_CHAN_DEPTH];
+    m->len = len;
+    m->owner = host;
+    m->data = NULL;
+    m->tail = NULL;
+    if (whole && (whole == len || (m->tail = malloc(len - whole)) != NULL))
+        m->data = r5vm_host_take_pages(host, addr, whole);
+    m->pages = m->data != NULL;
+    if (m->pages) {
+        if (m->tail)
+            memcpy(m->tail, vm->mem + addr + whole, len - whole);
+    } else {
+        free(m->tail);
+        m->tail = NULL;
+        m->data = malloc(len ? len : 1);
+        if (!m->data) {
+            r5vm_host_uncharge(host, len);
+            r5vm_error(vm, "Out of host memory", (vm->pc - 4) & vm->mem_mask,
+                       R5VM_ECALL_CHAN_SEND);
+            return false;
+        }
+        memcpy(m->data, vm->mem + addr, len);
+    }
+    c->count++;
+    vm->a0 = 0;
+    chan_wake(t->sys, c);
+    return true;
+}
+
+static bool chan_recv(r5vm_chan_task_t* t, r5vm_chan_t* c)
+{
+    r5vm_host_t* host = t->host;
+    r5vm_t* vm = &host->vm;
+    const uint32_t addr = vm->a1, cap = vm->a2;
+
+    if (!chan_range_ok(vm, addr, cap, R5VM_ECALL_CHAN_RECV))
+        return false;
+    if (!c->count)
+        return chan_block(t, c);
+
+    r5vm_chan_msg_t* m = &c->msg[c->head];
+    const uint32_t n = m->len < cap ? m->len : cap;
+    const uint32_t whole = m->pages ? chan_whole_pages(m->len) : 0;
+    const uint8_t* rest = m->pages ? m->tail : m->data; /* bytes behind the pages */
+    bool ok = n <= whole || r5vm_host_write(host, addr + whole, rest, n - whole);
+    if (ok && whole) {
+        if (whole <= cap && r5vm_host_give_pages(host, addr, m->data, whole))
+            m->data = NULL; /* the pages belong to the receiver now */
+        else
+            ok = r5vm_host_write(host, addr, m->data, n < whole ? n : whole);
+    }
+    if (!ok) {
+        /* the message stays queued */
+        r5vm_error(vm, "ECALL memory out of bounds", (vm->pc - 4) & vm->mem_mask,
+                   R5VM_ECALL_CHAN_RECV);
+        return false;
+    }
+    chan_free_msg(m);
+    c->head = (c->head + 1) % R5VM_CHAN_DEPTH;
+    c->count--;
+    vm->a0 = m->len;
+    chan_wake(t->sys, c);
+    return true;
+}
+
+static bool chan_poll(r5vm_chan_task_t* t, r5vm_chan_t* c)
+{
+    r5vm_t* vm = &t->host->vm;
+    const uint32_t timeout = vm->a1;
+
+    if (c->count) {
+        t->deadline = 0;
+        vm->a0 = c->msg[c->head].len;
+        return true;
+    }
+    if (timeout == R5VM_CHAN_FOREVER)
+        return chan_block(t, c);
+    const uint64_t now = chan_now_ms();
+    if (!t->deadline) /* first try, a resumed poll keeps its deadline */
+        t->deadline = now + timeout;
+    if (now >= t->deadline) {
+        t->deadline = 0;
+        vm->a0 = UINT32_MAX;
+        return true;
+    }
+    return chan_block(t, c);
+}
+
+// ---- Cross-VM calls --------------------------------------------------------
+
+/** Export of `key` or NULL. Exports are only appended, no lock needed. */
+static r5vm_chan_export_t* chan_find_export(r5vm_chan_sys_t* s, uint32_t key)
+{
+    const unsigned n = s->exports_count;
+    __sync_synchronize(); /* pairs with the fence in chan_export() */
+    for (unsigned i = 0; i < n; i++) {
+        if (s->exports[i].key == key)
+            return &s->exports[i];
+    }
+    return NULL;
+}
+
+/**
+ * Set up the call context of `e` over the guest memory of `host`: the VM
+ * with its memory, HLE table and hooks, the stack guard and the descriptors
+ * of the watchpoints and file mappings, which cannot change during
+ * r5vm_chan_run(). Registers are loaded per call. The context has its own
+ * idle lock and charge counter under the service's quota, and owns no
+ * mapping: nothing is released with it.
+ */
+static void chan_call_ctx(r5vm_chan_export_t* e, const r5vm_host_t* host)
+{
+    r5vm_host_t* ctx = &e->ctx;
+
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->vm = host->vm;
+    ctx->map = host->map;
+    ctx->map_size = host->map_size;
+    ctx->guard_lo = host->guard_lo;
+    ctx->guard_hi = host->guard_hi;
+    memcpy(ctx->watch, host->watch, sizeof(ctx->watch));
+    ctx->watch_fn = host->watch_fn;
+    memcpy(ctx->files, host->files, sizeof(ctx->files));
+    pthread_mutex_init(&ctx->idle_lock, NULL);
+    pthread_cond_init(&ctx->idle_cond, NULL);
+    ctx->mem_limit = host->mem_limit;
+    ctx->user = &e->frame;
+}
+
+/**
+ * `true` if guest accesses cannot fault: no stack guard, watchpoint or
+ * read-only mapping. Calls then run with r5vm_run() instead of
+ * r5vm_host_run(), which saves the signal mask per call.
+ */
+static bool chan_plain(const r5vm_host_t* host)
+{
+    bool plain = host->guard_hi <= host->guard_lo;
+    for (int i = 0; i < R5VM_HOST_MAX_WATCH; i++)
+        plain &= !host->watch[i].len;
+    for (int i = 0; i < R5VM_HOST_MAX_MAPS; i++)
+        plain &= !host->files[i].len || host->files[i].writable;
+    return plain;
+}
+
+static bool chan_export(r5vm_chan_task_t* t)
+{
+    r5vm_chan_sys_t* s = t->sys;
+    r5vm_host_t* host = t->host;
+    r5vm_t* vm = &host->vm;
+
+    if (t->call) {
+        r5vm_error(vm, "RPC export in RPC entry", (vm->pc - 4) & vm->mem_mask, vm->a0);
+        return false;
+    }
+    if (!chan_range_ok(vm, vm->a4, vm->a5, R5VM_ECALL_RPC_EXPORT))
+        return false;
+    if (chan_find_export(s, vm->a0) || s->exports_count == R5VM_RPC_MAX) {
+        vm->a0 = UINT32_MAX;
+        return true;
+    }
+
+    r5vm_chan_export_t* e = &s->exports[s->exports_count];
+    e->key = vm->a0;
+    e->entry = vm->a1 & vm->mem_mask;
+    e->cookie = vm->a2;
+    e->stack = vm->a3;
+    e->buf = vm->a4;
+    e->buf_size = vm->a5;
+    memcpy(e->regs, vm->regs, sizeof(e->regs));
+    e->plain = chan_plain(host);
+    e->busy = false;
+    e->inner = NULL;
+    chan_call_ctx(e, host);
+    e->frame = *t;
+    e->frame.host = &e->ctx;
+    e->frame.waiting = NULL;
+    e->frame.call = e;
+    pthread_mutex_init(&e->lock, NULL);
+    __sync_synchronize(); /* complete before chan_find_export() sees it */
+    s->exports_count++;
+    vm->a0 = 0;
+    chan_wake(s, &s->export_wait);
+    return true;
+}
+
+/**
+ * Check that waiting for the lock of `e` cannot close a cycle: follow the
+ * exports their running calls call into, starting at `e`. Reaching an
+ * export this thread runs means a call it is inside of waits for it, e.g.
+ * A calls B on one thread while B calls A on another. Records `e` as the
+ * export the caller's own call waits for.
+ */
+static bool chan_call_enter(r5vm_chan_task_t* t, r5vm_chan_export_t* e)
+{
+    r5vm_chan_sys_t* s = t->sys;
+    r5vm_t* vm = &t->host->vm;
+    const r5vm_chan_export_t* x = e;
+    bool cycle = false;
+
+    pthread_mutex_lock(&s->lock);
+    for (unsigned n = 0; x && x->busy && n <= R5VM_RPC_MAX; n++) {
+        if (pthread_equal(x->owner, pthread_self())) {
+            cycle = true;
+            break;
+        }
+        x = x->inner;
+    }
+    if (!cycle && t->call)
+        t->call->inner = e;
+    pthread_mutex_unlock(&s->lock);
+
+    if (cycle)
+        r5vm_error(vm, x == e ? "Recursive RPC" : "RPC deadlock",
+                   (vm->pc - 4) & vm->mem_mask, e->key);
+    return !cycle;
+}
+
+/** Run the exported entry on this thread, in the export's call context */
+static bool chan_call(r5vm_chan_task_t* t)
+{
+    r5vm_chan_sys_t* s = t->sys;
+    r5vm_host_t* host = t->host;
+    r5vm_t* vm = &host->vm;
+    const uint32_t addr = vm->a4, len = vm->a5;
+    r5vm_chan_export_t* e = chan_find_export(s, vm->a0);
+
+    if (!e) {
+        pthread_mutex_lock(&s->lock);
+        e = chan_find_export(s, vm->a0);
+        const bool ok = e || chan_block(t, &s->export_wait);
+        pthread_mutex_unlock(&s->lock);
+        if (!e)
+            return ok;
+    }
+    if (!chan_range_ok(vm, addr, len, R5VM_ECALL_RPC_CALL))
+        return false;
+    if (len > e->buf_size || (addr < host->guard_hi && addr + len > host->guard_lo)) {
+        r5vm_error(vm, "RPC buffer out of bounds", (vm->pc - 4) & vm->mem_mask, len);
+        return false;
+    }
+    if (!chan_call_enter(t, e))
+        return false;
+    pthread_mutex_lock(&e->lock);
+    pthread_mutex_lock(&s->lock);
+    e->owner = pthread_self();
+    e->busy = true;
+    pthread_mutex_unlock(&s->lock);
+    e->returned = false;
+
+    r5vm_t* svc = &e->ctx.vm;
+    if (r5vm_host_write(&e->ctx, e->buf, vm->mem + addr, len)) {
+        memcpy(svc->regs, e->regs, sizeof(svc->regs));
+        svc->sp = e->stack;
+        svc->ra = 0; /* entries leave with RPC_RETURN */
+        svc->a0 = vm->a1;
+        svc->a1 = vm->a2;
+        svc->a2 = vm->a3;
+        svc->a3 = e->buf;
+        svc->a4 = len;
+        svc->a5 = e->cookie;
+        svc->pc = e->entry;
+        /* the caller's thread runs the entry, so it gets a budget too */
+        uint32_t steps = 0;
+        do {
+            const unsigned max = R5VM_RPC_STEPS - steps < R5VM_CHAN_SLICE ?
+                                 R5VM_RPC_STEPS - steps : R5VM_CHAN_SLICE;
+            steps += e->plain ? r5vm_run(svc, max) : r5vm_host_run(&e->ctx, max);
+        } while ((svc->status == R5VM_RUNNING || svc->status == R5VM_IDLE) &&
+                 !e->returned && steps < R5VM_RPC_STEPS);
+    }
+    const bool ok = e->returned && r5vm_host_write(host, addr, svc->mem + e->buf, len);
+    const uint32_t result = svc->a0;
+    pthread_mutex_lock(&s->lock);
+    e->busy = false;
+    if (t->call)
+        t->call->inner = NULL;
+    pthread_mutex_unlock(&s->lock);
+    pthread_mutex_unlock(&e->lock);
+
+    if (!ok) {
+        r5vm_error(vm, "RPC call failed", (vm->pc - 4) & vm->mem_mask, e->key);
+        return false;
+    }
+    vm->a0 = result;
+    return true;
+}
+
+static bool chan_ecall(r5vm_t* vm, uint32_t id)
+{
+    r5vm_chan_task_t* t = (r5vm_chan_task_t*)((r5vm_host_t*)vm)->user;
+    r5vm_chan_sys_t* s = t->sys;
+    bool ok = true;
+
+    if (id == R5VM_ECALL_RPC_CALL)
+        return chan_call(t);
+    if (id == R5VM_ECALL_RPC_RETURN) {
+        if (!t->call) {
+            r5vm_error(vm, "RPC return outside of a call", (vm->pc - 4) & vm->mem_mask, id);
+            return false;
+        }
+        t->call->returned = true;
+        vm->status = R5VM_EXIT;
+        return false;
+    }
+    if (id < R5VM_ECALL_CHAN_OPEN || id > R5VM_ECALL_RPC_EXPORT)
+        return t->next(vm, id);
+
+    pthread_mutex_lock(&s->lock);
+    if (id == R5VM_ECALL_CHAN_OPEN) {
+        chan_open(s, vm);
+    } else if (id == R5VM_ECALL_RPC_EXPORT) {
+        ok = chan_export(t);
+    } else if (vm->a0 >= R5VM_CHAN_MAX || !s->chan[vm->a0].open) {
+        r5vm_error(vm, "Invalid channel", (vm->pc - 4) & vm->mem_mask, vm->a0);
+        ok = false;
+    } else {
+        r5vm_chan_t* c = &s->chan[vm->a0];
+        ok = id == R5VM_ECALL_CHAN_SEND ? chan_send(t, c) :
+             id == R5VM_ECALL_CHAN_RECV ? chan_recv(t, c) : chan_poll(t, c);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return ok;
+}
+
+// ---- Scheduler -------------------------------------------------------------
+
+/**
+ * Nothing to run: resume VMs whose poll timed out, stop a deadlock, or
+ * sleep until the next timeout or run queue change. Called with the lock.
+ */
+static void chan_idle(r5vm_chan_sys_t* s)
+{
+    const uint64_t now = chan_now_ms();
+    uint64_t next = 0; /* earliest pending deadline */
+
+    for (unsigned i = 0; i < s->count; i++) {
+        r5vm_chan_task_t* t = &s->tasks[i];
+        if (!t->parked || !t->deadline)
+            continue;
+        if (t->deadline <= now) {
+            t->waiting = NULL;
+            t->parked = false;
+            chan_push(s, t);
+        } else if (!next || t->deadline < next) {
+            next = t->deadline;
+        }
+    }
+    if (s->head)
+        return;
+    if (!next && !s->running) {
+        /* every VM left waits for a message nobody can send */
+        for (unsigned i = 0; i < s->count; i++) {
+            r5vm_chan_task_t* t = &s->tasks[i];
+            if (!t->parked)
+                continue;
+            t->parked = false;
+            t->waiting = NULL;
+            r5vm_error(&t->host->vm, "Channel deadlock", t->host->vm.pc,
+                       t->host->vm.a7);
+            t->host->vm.status = R5VM_ERROR;
+            s->done++;
+        }
+        pthread_cond_broadcast(&s->cond);
+        return;
+    }
+    if (!next) {
+        pthread_cond_wait(&s->cond, &s->lock);
+        return;
+    }
+
+    struct timeval tv;
+    struct timespec until;
+    gettimeofday(&tv, NULL);
+    const uint64_t ns = (uint64_t)tv.tv_usec * 1000u + (next - now) * 1000000u;
+    until.tv_sec = tv.tv_sec + (time_t)(ns / 1000000000u);
+    until.tv_nsec = (long)(ns % 1000000000u);
+    pthread_cond_timedwait(&s->cond, &s->lock, &until);
+}
+
+static void* chan_worker(void* arg)
+{
+    r5vm_chan_sys_t* s = arg;
+
+    pthread_mutex_lock(&s->lock);
+    while (s->done < s->count) {
+        r5vm_chan_task_t* t = chan_pop(s);
+        if (!t) {
+            chan_idle(s);
+            continue;
+        }
+        s->running++;
+        pthread_mutex_unlock(&s->lock);
+        if (s->dedup)
+            r5vm_dedup_enter(s->dedup);
+        r5vm_host_run(t->host, R5VM_CHAN_SLICE);
+        if (s->dedup)
+            r5vm_dedup_leave(s->dedup);
+        pthread_mutex_lock(&s->lock);
+        s->running--;
+
+        const r5vm_status_t status = t->host->vm.status;
+        if (status == R5VM_IDLE && t->waiting)
+            t->parked = true; /* chan_wake() or a timeout requeues it */
+        else if (status == R5VM_RUNNING || status == R5VM_IDLE)
+            chan_push(s, t);  /* end of slice or idle guest: yield */
+        else
+            s->done++;
+        if (!s->running)
+            pthread_cond_broadcast(&s->cond); /* deadlock and halt checks */
+    }
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+// ---- Functions -------------------------------------------------------------
+
+bool r5vm_chan_run(r5vm_host_t* const* vms, unsigned count, unsigned threads,
+                   r5vm_dedup_t* dedup)
+{
+    unsigned started = 0;
+
+    if (!threads) {
+        const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (unsigned)cpus : 1;
+    }
+    if (threads > count)
+        threads = count;
+    if (!count)
+        return true;
+
+    r5vm_chan_sys_t* s = calloc(1, sizeof(*s));
+    r5vm_chan_task_t* tasks = calloc(count, sizeof(*tasks));
+    pthread_t* tid = calloc(threads, sizeof(*tid));
+    if (!s || !tasks || !tid) {
+        free(s);
+        free(tasks);
+        free(tid);
+        return false;
+    }
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    s->tasks = tasks;
+    s->count = count;
+    s->dedup = dedup;
+    for (unsigned i = 0; i < count; i++) {
+        r5vm_chan_task_t* t = &tasks[i];
+        t->sys = s;
+        t->host = vms[i];
+        t->next = t->host->vm.ecall_fn;
+        t->user = t->host->user;
+        t->idle_ms = t->host->idle_ms;
+        t->host->user = t;
+        t->host->vm.ecall_fn = chan_ecall;
+        t->host->idle_ms = 0; /* idle guests return to the scheduler */
+        chan_push(s, t);
+    }
+
+    while (started < threads &&
+           pthread_create(&tid[started], NULL, chan_worker, s) == 0)
+        started++;
+    if (!started)
+        fprintf(stderr, "error: cannot start channel threads\n");
+    for (unsigned i = 0; i < started; i++)
+        pthread_join(tid[i], NULL);
+
+    for (unsigned i = 0; i < count; i++) {
+        tasks[i].host->vm.ecall_fn = tasks[i].next;
+        tasks[i].host->user = tasks[i].user;
+        tasks[i].host->idle_ms = tasks[i].idle_ms;
+    }
+    for (unsigned i = 0; i < R5VM_CHAN_MAX; i++) {
+        r5vm_chan_t* c = &s->chan[i];
+        for (; c->count; c->count--, c->head = (c->head + 1) % R5VM_CHAN_DEPTH)
+            chan_free_msg(&c->msg[c->head]);
+    }
+    for (unsigned i = 0; i < s->exports_count; i++) {
+        pthread_cond_destroy(&s->exports[i].ctx.idle_cond);
+        pthread_mutex_destroy(&s->exports[i].ctx.idle_lock);
+        pthread_mutex_destroy(&s->exports[i].lock);
+    }
+    pthread_cond_destroy(&s->cond);
+    pthread_mutex_destroy(&s->lock);
+    free(tid);
+    free(tasks);
+    free(s);
+    return started > 0;
+}
+
+#else /* _WIN32 */
+
+bool r5vm_chan_run(r5vm_host_t* const* vms, unsigned count, unsigned threads,
+                   r5vm_dedup_t* dedup)
+{
+    (void)vms;
+    (void)count;
+    (void)threads;
+    (void)dedup;
+    fprintf(stderr, "error: channels require a POSIX host\n");
+    return false;
+}
+
+#endif /* !_WIN32 */
@@ -0,0 +1,135 @@
+/*
+ * R5VM - Minimal RISC-V RV32I Virtual Machine
+ *       _____
+ *      | ____|
+ *  _ __| |____   ___ __ ___
+ * | '__|___ \ \ / / '_ ` _ \
+ * | |   ___) \ V /| | | | | |
+ * |_|  |____/ \_/ |_| |_| |_|
+ *
+ * Copyright (c) 2025 Jan Zwiener
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file r5vm_chan.h
+ * @brief Message channels and calls between VMs on a pool of host threads.
+ *
+ * A group of VMs ("actors") runs on a few host threads and exchanges
+ * messages through channels kept by the host:
+ *
+ * - `R5VM_ECALL_CHAN_OPEN` returns the handle of the channel with a 32-bit
+ *   key. Every VM that opens the same key gets the same channel.
+ * - `R5VM_ECALL_CHAN_SEND` queues a message and blocks while the channel
+ *   holds `R5VM_CHAN_DEPTH` messages. a0 is 0, or -1 if the queued message
+ *   would exceed the sender's memory quota (r5vm_host_set_limit()): it is
+ *   charged to the sender until a receiver takes it.
+ * - `R5VM_ECALL_CHAN_RECV` takes the next message and blocks while there
+ *   is none. A longer message is truncated to the buffer, a0 is its length.
+ * - `R5VM_ECALL_CHAN_POLL` waits up to a1 ms (0: just check,
+ *   `R5VM_CHAN_FOREVER`: no limit) and returns the length of the next
+ *   message without taking it, or -1.
+ *
+ * A page-aligned buffer of at least one host page is sent by moving the
+ * whole pages inside the message (r5vm_host_take_pages()): the channel
+ * owns them and they read as zero in the sender afterwards. Bytes behind
+ * the last whole page are copied, so the sender keeps the rest of a
+ * partial last page. The receiver gets the pages without a copy if its
+ * buffer is page aligned and covers them. Other messages are copied.
+ *
+ * A blocked guest does not hold its host thread. The ECALL stops the VM,
+ * the thread runs the next ready VM, and the blocked VM resumes at the same
+ * ECALL once a peer uses the channel or its poll timeout expires.
+ *
+ * Guests can also call each other synchronously. A service exports an
+ * entry point with `R5VM_ECALL_RPC_EXPORT`:
+ *
+ * | Register | Export                   | Entry sees           |
+ * |----------|--------------------------|----------------------|
+ * | a0       | key                      | argument 1           |
+ * | a1       | entry address            | argument 2           |
+ * | a2       | cookie                   | argument 3           |
+ * | a3       | stack top for calls      | buffer address       |
+ * | a4       | buffer address           | buffer length        |
+ * | a5       | buffer size              | cookie               |
+ *
+ * `R5VM_ECALL_RPC_CALL` takes the key, three arguments in a1..a3 and a
+ * buffer (a4, length a5). It runs the entry on the caller's host thread,
+ * in a context of its own over the service's memory: the service's
+ * registers at export time, `sp` at the call stack and `pc` at the entry.
+ * No thread switch and no queue are involved. The caller's buffer is
+ * copied to the service's buffer before the call and back afterwards. The
+ * entry finishes with `R5VM_ECALL_RPC_RETURN`, whose a0 becomes the
+ * caller's a0. One call per export runs at a time, a call to a key not yet
+ * exported waits for the export. Exports stay callable after the service
+ * halted, so a service can export its entries and exit. Blocking channel
+ * calls are not allowed inside an entry, and an entry that has not
+ * returned after `R5VM_RPC_STEPS` instructions fails the call. A call
+ * that would wait for a call it is part of fails with an error instead of
+ * blocking: an entry calling its own export, or A calling B on one thread
+ * while B calls A on another.
+ */
+
+#ifndef R5VM_CHAN_H
+#define R5VM_CHAN_H
+
+#include "r5vm_host.h"
+#include "r5vm_dedup.h"
+
+// ---- Defines ---------------------------------------------------------------
+
+/** @brief Maximum number of channels. */
+#define R5VM_CHAN_MAX      64
+
+/** @brief Maximum number of queued messages per channel. */
+#define R5VM_CHAN_DEPTH    64
+
+/** @brief Maximum number of exported entry points. */
+#define R5VM_RPC_MAX       32
+
+/** @brief Instructions one RPC entry may run before the call fails. */
+#define R5VM_RPC_STEPS     (1u << 26)
+
+/** @brief `R5VM_ECALL_CHAN_POLL` timeout without limit. */
+#define R5VM_CHAN_FOREVER  0xFFFFFFFFu
+
+// ---- Functions -------------------------------------------------------------
+
+/**
+ * @brief Run `count` VMs on `threads` host threads until every VM halted.
+ *
+ * VMs run in slices and give up their thread when a slice ends, when they
+ * block on a channel and when they go idle. If every remaining VM waits on
+ * a channel without timeout, they are stopped with a "Channel deadlock"
+ * error. Messages left in the channels are dropped.
+ *
+ * @param vms      Initialized and reset host VMs.
+ * @param count    Number of VMs.
+ * @param threads  Number of host threads, 0 for one per online CPU.
+ * @param dedup    Page dedup scanner holding the VMs, run slices are
+ *                 bracketed with r5vm_dedup_enter() and r5vm_dedup_leave().
+ *                 `NULL` for none.
+ * @return `false` if no thread could be started, the VM status of each
+ *         VM is set independently.
+ */
+bool r5vm_chan_run(r5vm_host_t* const* vms, unsigned count, unsigned threads,
+                   r5vm_dedup_t* dedup);
+
+#endif // R5VM_CHAN_H
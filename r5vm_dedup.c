@@ -0,0 +1,544 @@
+/*
+ * R5VM - Minimal RISC-V RV32I Virtual Machine
+ *       _____
+ *      | ____|
+ *  _ __| |____   ___ __ ___
+ * | '__|___ \ \ / / '_ ` _ \
+ * | |   ___) \ V /| | | | | |
+ * |_|  |____/ \_/ |_| |_| |_|
+ *
+ * Copyright (c) 2025 Jan Zwiener
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#if defined(__linux__)
+#define _GNU_SOURCE       /* memfd_create, fallocate, mremap */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#endif
+
+#include "r5vm_dedup.h"
+
+#if defined(__linux__)
+
+// ---- Defines ---------------------------------------------------------------
+
+#define DEDUP_ZERO       UINT32_MAX      /**< page_ref: dropped zero page */
+#define DEDUP_FREE       UINT32_MAX      /**< store_refs: released store page */
+#define PAGEMAP_PRESENT  (1ull << 63)
+#define PAGEMAP_FILE     (1ull << 61)    /**< File page or shared anonymous */
+#define PAGEMAP_EXCL     (1ull << 56)    /**< Mapped once, not the zero page */
+
+// ---- Scanner state ---------------------------------------------------------
+
+/** A scanned VM */
+typedef struct r5vm_dedup_vm_s
+{
+    r5vm_host_t* host;
+    uint32_t*    page_ref; /**< Per guest page: 0, DEDUP_ZERO or store + 1 */
+    uint32_t     pages;
+} r5vm_dedup_vm_t;
+
+/** A hash table entry, rebuilt every pass */
+typedef struct r5vm_dedup_slot_s
+{
+    uint64_t hash;
+    uint32_t store; /**< Store page + 1, 0 if none */
+    uint32_t vm;    /**< Candidate VM + 1 without store page, 0: empty slot */
+    uint32_t page;  /**< Candidate guest page */
+} r5vm_dedup_slot_t;
+
+// ---- Store -----------------------------------------------------------------
+
+/** Hash a page, sets `*zero` if it only holds zero bytes */
+static uint64_t dedup_hash(const uint8_t* p, size_t len, bool* zero)
+{
+    const uint64_t* w = (const uint64_t*)(const void*)p;
+    uint64_t h = 0x9e3779b97f4a7c15ull;
+    uint64_t any = 0;
+
+    for (size_t i = 0; i < len / 8; i++) {
+        any |= w[i];
+        h = (h ^ w[i]) * 0xff51afd7ed558ccdull;
+        h ^= h >> 32;
+    }
+    *zero = any == 0;
+    return h;
+}
+
+/** Take a store page, the store grows by doubling. UINT32_MAX if full */
+static uint32_t dedup_store_alloc(r5vm_dedup_t* d)
+{
+    const size_t page = r5vm_host_page_size();
+
+    if (d->free_count)
+        return d->store_free[--d->free_count];
+    if (d->store_used == d->store_cap) {
+        const uint32_t cap = d->store_cap ? d->store_cap * 2 : 64;
+        uint64_t* hash = realloc(d->store_hash, cap * sizeof(*hash));
+        if (hash)
+            d->store_hash = hash;
+        uint32_t* refs = realloc(d->store_refs, cap * sizeof(*refs));
+        if (refs)
+            d->store_refs = refs;
+        uint32_t* stack = realloc(d->store_free, cap * sizeof(*stack));
+        if (stack)
+            d->store_free = stack;
+        if (!hash || !refs || !stack || ftruncate(d->fd, (off_t)(cap * page)))
+            return UINT32_MAX;
+        void* p = d->store
+                ? mremap(d->store, d->store_cap * page, cap * page, MREMAP_MAYMOVE)
+                : mmap(NULL, cap * page, PROT_READ | PROT_WRITE, MAP_SHARED,
+                       d->fd, 0);
+        if (p == MAP_FAILED)
+            return UINT32_MAX;
+        d->store = p;
+        d->store_cap = cap;
+    }
+    return d->store_used++;
+}
+
+/** Release a store page nobody maps anymore */
+static void dedup_store_free(r5vm_dedup_t* d, uint32_t s)
+{
+    const size_t page = r5vm_host_page_size();
+
+    fallocate(d->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+              (off_t)(s * page), (off_t)page);
+    d->store_refs[s] = DEDUP_FREE;
+    d->store_free[d->free_count++] = s;
+}
+
+/** Find the slot of `hash`, or the empty slot to insert it */
+static r5vm_dedup_slot_t* dedup_slot(r5vm_dedup_t* d, uint64_t hash)
+{
+    uint32_t i = (uint32_t)hash & (d->table_size - 1);
+
+    for (;; i = (i + 1) & (d->table_size - 1)) {
+        r5vm_dedup_slot_t* slot = &d->table[i];
+        if ((!slot->store && !slot->vm) || slot->hash == hash)
+            return slot;
+    }
+}
+
+/** Rebuild the hash table with the live store pages */
+static bool dedup_table(r5vm_dedup_t* d)
+{
+    size_t pages = d->store_used;
+    uint32_t size = 1024;
+
+    for (unsigned i = 0; i < d->count; i++)
+        pages += d->vms[i].pages;
+    while (size < 2 * pages)
+        size *= 2;
+    if (size != d->table_size) {
+        r5vm_dedup_slot_t* table = realloc(d->table, size * sizeof(*table));
+        if (!table)
+            return false;
+        d->table = table;
+        d->table_size = size;
+    }
+    memset(d->table, 0, d->table_size * sizeof(*d->table));
+    for (uint32_t s = 0; s < d->store_used; s++) {
+        if (d->store_refs[s] == DEDUP_FREE)
+            continue;
+        d->store_refs[s] = 0;
+        r5vm_dedup_slot_t* slot = dedup_slot(d, d->store_hash[s]);
+        if (!slot->store) {
+            slot->hash = d->store_hash[s];
+            slot->store = s + 1;
+        }
+    }
+    return true;
+}
+
+// ---- Scan ------------------------------------------------------------------
+
+/** Guest pages the scanner must not read: stack guard and watchpoints */
+static bool dedup_skip(const r5vm_host_t* host, uint32_t addr, uint32_t len)
+{
+    bool overlap = addr < host->guard_hi && addr + len > host->guard_lo;
+    for (int i = 0; i < R5VM_HOST_MAX_WATCH; i++) {
+        const r5vm_watch_t* w = &host->watch[i];
+        overlap |= w->len && addr < w->addr + w->len && addr + len > w->addr;
+    }
+    return overlap;
+}
+
+/** Merge a guest page into store page `s` */
+static bool dedup_share(r5vm_dedup_t* d, r5vm_dedup_vm_t* v, uint32_t i,
+                        uint32_t s)
+{
+    const size_t page = r5vm_host_page_size();
+
+    if (!r5vm_host_share_page(v->host, (uint32_t)(i * page), d->fd,
+                              (uint64_t)s * page)) {
+        d->stats.share_failed++; /* e.g. vm.max_map_count reached */
+        return false;
+    }
+    v->page_ref[i] = s + 1;
+    d->store_refs[s]++;
+    d->stats.shared_pages++;
+    return true;
+}
+
+/** Scan guest page `i` of VM `vi`, `entry` is its pagemap entry */
+static void dedup_page(r5vm_dedup_t* d, uint32_t vi, uint32_t i, uint64_t entry)
+{
+    const size_t page = r5vm_host_page_size();
+    r5vm_dedup_vm_t* v = &d->vms[vi];
+    const uint32_t ref = v->page_ref[i];
+    /* Not present, the shared zero page or a private view of the store:
+       the guest did not write the page since it was merged or dropped */
+    const bool untouched = (entry & (PAGEMAP_PRESENT | PAGEMAP_FILE | PAGEMAP_EXCL))
+                        != (PAGEMAP_PRESENT | PAGEMAP_EXCL);
+
+    if (ref && untouched) {
+        if (ref == DEDUP_ZERO) {
+            d->stats.zero_pages++;
+        } else {
+            d->store_refs[ref - 1]++;
+            d->stats.shared_pages++;
+        }
+        return;
+    }
+    v->page_ref[i] = 0; /* split by a guest store */
+    if (untouched || dedup_skip(v->host, (uint32_t)(i * page), (uint32_t)page))
+        return;
+
+    const uint8_t* p = v->host->map + i * page;
+    bool zero;
+    const uint64_t hash = dedup_hash(p, page, &zero);
+    if (zero) {
+        if (r5vm_host_share_page(v->host, (uint32_t)(i * page), -1, 0)) {
+            v->page_ref[i] = DEDUP_ZERO;
+            d->stats.zero_pages++;
+        }
+        return;
+    }
+
+    r5vm_dedup_slot_t* slot = dedup_slot(d, hash);
+    if (slot->store) {
+        const uint32_t s = slot->store - 1;
+        if (!memcmp(d->store + s * page, p, page))
+            dedup_share(d, v, i, s);
+    } else if (slot->vm) {
+        r5vm_dedup_vm_t* cv = &d->vms[slot->vm - 1];
+        const uint8_t* cp = cv->host->map + slot->page * page;
+        if (memcmp(cp, p, page))
+            return; /* hash collision, keep the first candidate */
+        const uint32_t s = dedup_store_alloc(d);
+        if (s == UINT32_MAX)
+            return;
+        memcpy(d->store + s * page, p, page);
+        d->store_hash[s] = hash;
+        d->store_refs[s] = 0;
+        dedup_share(d, cv, slot->page, s);
+        dedup_share(d, v, i, s);
+        if (d->store_refs[s])
+            slot->store = s + 1;
+        else
+            dedup_store_free(d, s);
+    } else {
+        slot->hash = hash;
+        slot->vm = vi + 1;
+        slot->page = i;
+    }
+}
+
+/** One pass over all VMs, lock held and VMs stopped */
+static size_t dedup_pass(r5vm_dedup_t* d)
+{
+    const size_t page = r5vm_host_page_size();
+    bool complete = true; /* every VM counted its store references */
+
+    d->stats.shared_pages = 0;
+    d->stats.zero_pages = 0;
+    d->stats.share_failed = 0;
+    if (!dedup_table(d))
+        return d->stats.saved_bytes;
+
+    for (uint32_t vi = 0; vi < d->count; vi++) {
+        r5vm_dedup_vm_t* v = &d->vms[vi];
+        if (v->pages > d->scratch_cap) {
+            uint64_t* scratch = realloc(d->scratch, v->pages * sizeof(*scratch));
+            if (!scratch) {
+                complete = false;
+                continue;
+            }
+            d->scratch = scratch;
+            d->scratch_cap = v->pages;
+        }
+        const size_t len = v->pages * sizeof(uint64_t);
+        const off_t at = (off_t)((uintptr_t)v->host->map / page * sizeof(uint64_t));
+        if (pread(d->pagemap, d->scratch, len, at) != (ssize_t)len) {
+            complete = false;
+            continue;
+        }
+        for (uint32_t i = 0; i < v->pages; i++)
+            dedup_page(d, vi, i, d->scratch[i]);
+    }
+
+    /* a VM left out may still map store pages counted as unused */
+    for (uint32_t s = 0; complete && s < d->store_used; s++)
+        if (!d->store_refs[s])
+            dedup_store_free(d, s);
+    d->stats.store_pages = d->store_used - d->free_count;
+    d->stats.saved_bytes = d->stats.shared_pages + d->stats.zero_pages >
+                           d->stats.store_pages
+                         ? (d->stats.shared_pages + d->stats.zero_pages -
+                            d->stats.store_pages) * page
+                         : 0;
+    d->stats.scans++;
+    return d->stats.saved_bytes;
+}
+
+static void* dedup_thread(void* arg)
+{
+    r5vm_dedup_t* d = arg;
+
+    pthread_mutex_lock(&d->lock);
+    while (!d->quit) {
+        struct timeval tv;
+        struct timespec until;
+        gettimeofday(&tv, NULL);
+        const uint64_t ns = (uint64_t)tv.tv_usec * 1000u +
+                            (uint64_t)d->interval_ms * 1000000u;
+        until.tv_sec = tv.tv_sec + (time_t)(ns / 1000000000u);
+        until.tv_nsec = (long)(ns % 1000000000u);
+        pthread_cond_timedwait(&d->cond, &d->lock, &until);
+        if (d->quit)
+            break;
+
+        d->stop = true; /* new runners wait in r5vm_dedup_enter() */
+        while (d->running && !d->quit)
+            pthread_cond_wait(&d->cond, &d->lock);
+        if (!d->running)
+            dedup_pass(d);
+        d->stop = false;
+        pthread_cond_broadcast(&d->cond);
+    }
+    pthread_mutex_unlock(&d->lock);
+    return NULL;
+}
+
+// ---- Functions -------------------------------------------------------------
+
+bool r5vm_dedup_init(r5vm_dedup_t* d)
+{
+    memset(d, 0, sizeof(*d));
+    d->fd = memfd_create("r5vm-dedup", MFD_CLOEXEC);
+    d->pagemap = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+    if (d->fd < 0 || d->pagemap < 0) {
+        if (d->fd >= 0)
+            close(d->fd);
+        if (d->pagemap >= 0)
+            close(d->pagemap);
+        return false;
+    }
+    pthread_mutex_init(&d->lock, NULL);
+    pthread_cond_init(&d->cond, NULL);
+    return true;
+}
+
+void r5vm_dedup_destroy(r5vm_dedup_t* d)
+{
+    if (d->started) {
+        pthread_mutex_lock(&d->lock);
+        d->quit = true;
+        pthread_cond_broadcast(&d->cond);
+        pthread_mutex_unlock(&d->lock);
+        pthread_join(d->thread, NULL);
+    }
+    for (unsigned i = 0; i < d->count; i++)
+        free(d->vms[i].page_ref);
+    if (d->store)
+        munmap(d->store, d->store_cap * r5vm_host_page_size());
+    close(d->fd);
+    close(d->pagemap);
+    free(d->vms);
+    free(d->store_hash);
+    free(d->store_refs);
+    free(d->store_free);
+    free(d->table);
+    free(d->scratch);
+    pthread_cond_destroy(&d->cond);
+    pthread_mutex_destroy(&d->lock);
+    memset(d, 0, sizeof(*d));
+}
+
+bool r5vm_dedup_add(r5vm_dedup_t* d, r5vm_host_t* host)
+{
+    const uint32_t pages = (uint32_t)(host->map_size / r5vm_host_page_size());
+    bool ok = false;
+
+    pthread_mutex_lock(&d->lock);
+    if (d->count == d->cap) {
+        const unsigned cap = d->cap ? d->cap * 2 : 8;
+        r5vm_dedup_vm_t* vms = realloc(d->vms, cap * sizeof(*vms));
+        if (vms) {
+            d->vms = vms;
+            d->cap = cap;
+        }
+    }
+    if (d->count < d->cap) {
+        r5vm_dedup_vm_t* v = &d->vms[d->count];
+        v->host = host;
+        v->pages = pages;
+        v->page_ref = calloc(pages, sizeof(*v->page_ref));
+        if (v->page_ref) {
+            d->count++;
+            ok = true;
+        }
+    }
+    pthread_mutex_unlock(&d->lock);
+    return ok;
+}
+
+void r5vm_dedup_remove(r5vm_dedup_t* d, r5vm_host_t* host)
+{
+    const size_t page = r5vm_host_page_size();
+
+    pthread_mutex_lock(&d->lock);
+    for (unsigned i = 0; i < d->count; i++) {
+        r5vm_dedup_vm_t* v = &d->vms[i];
+        if (v->host != host)
+            continue;
+        /* Copy merged pages now, their store pages may be released later */
+        for (uint32_t p = 0; p < v->pages; p++) {
+            const uint32_t addr = (uint32_t)(p * page);
+            if (v->page_ref[p] && v->page_ref[p] != DEDUP_ZERO)
+                r5vm_host_write(host, addr, host->map + addr, 1);
+        }
+        free(v->page_ref);
+        d->vms[i] = d->vms[--d->count];
+        break;
+    }
+    pthread_mutex_unlock(&d->lock);
+}
+
+size_t r5vm_dedup_scan(r5vm_dedup_t* d)
+{
+    pthread_mutex_lock(&d->lock);
+    const size_t saved = dedup_pass(d);
+    pthread_mutex_unlock(&d->lock);
+    return saved;
+}
+
+bool r5vm_dedup_start(r5vm_dedup_t* d, uint32_t interval_ms)
+{
+    if (d->started)
+        return true;
+    d->interval_ms = interval_ms ? interval_ms : 1;
+    d->started = pthread_create(&d->thread, NULL, dedup_thread, d) == 0;
+    return d->started;
+}
+
+void r5vm_dedup_enter(r5vm_dedup_t* d)
+{
+    pthread_mutex_lock(&d->lock);
+    while (d->stop)
+        pthread_cond_wait(&d->cond, &d->lock);
+    d->running++;
+    pthread_mutex_unlock(&d->lock);
+}
+
+void r5vm_dedup_leave(r5vm_dedup_t* d)
+{
+    pthread_mutex_lock(&d->lock);
+    if (!--d->running && d->stop)
+        pthread_cond_broadcast(&d->cond);
+    pthread_mutex_unlock(&d->lock);
+}
+
+void r5vm_dedup_stats(r5vm_dedup_t* d, r5vm_dedup_stats_t* stats)
+{
+    pthread_mutex_lock(&d->lock);
+    *stats = d->stats;
+    pthread_mutex_unlock(&d->lock);
+}
+
+#else /* no memfd and pagemap */
+
+bool r5vm_dedup_init(r5vm_dedup_t* d)
+{
+    memset(d, 0, sizeof(*d));
+    return false;
+}
+
+void r5vm_dedup_destroy(r5vm_dedup_t* d)
+{
+    (void)d;
+}
+
+bool r5vm_dedup_add(r5vm_dedup_t* d, r5vm_host_t* host)
+{
+    (void)d;
+    (void)host;
+    return false;
+}
+
+void r5vm_dedup_remove(r5vm_dedup_t* d, r5vm_host_t* host)
+{
+    (void)d;
+    (void)host;
+}
+
+size_t r5vm_dedup_scan(r5vm_dedup_t* d)
+{
+    (void)d;
+    return 0;
+}
+
+bool r5vm_dedup_start(r5vm_dedup_t* d, uint32_t interval_ms)
+{
+    (void)d;
+    (void)interval_ms;
+    return false;
+}
+
+void r5vm_dedup_enter(r5vm_dedup_t* d)
+{
+    (void)d;
+}
+
+void r5vm_dedup_leave(r5vm_dedup_t* d)
+{
+    (void)d;
+}
+
+void r5vm_dedup_stats(r5vm_dedup_t* d, r5vm_dedup_stats_t* stats)
+{
+    (void)d;
+    memset(stats, 0, sizeof(*stats));
+}
+
+#endif
@@ -0,0 +1,181 @@
+/*
+ * R5VM - Minimal RISC-V RV32I Virtual Machine
+ *       _____
+ *      | ____|
+ *  _ __| |____   ___ __ ___
+ * | '__|___ \ \ / / '_ ` _ \
+ * | |   ___) \ V /| | | | | |
+ * |_|  |____/ \_/ |_| |_| |_|
+ *
+ * Copyright (c) 2025 Jan Zwiener
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file r5vm_dedup.h
+ * @brief Merge identical guest pages of several VMs copy-on-write.
+ *
+ * Many VMs of the same or similar images hold identical pages: code,
+ * unchanged `.data`, lookup tables, zero-filled buffers. A dedup scanner
+ * hashes the touched pages of its VMs and merges equal ones:
+ *
+ * - A zero page is dropped, it reads as zero without host memory.
+ * - Two equal pages are copied once into a `memfd` store, and both guest
+ *   pages are replaced by a private view of the store page
+ *   (r5vm_host_share_page()). Further equal pages map the same store page.
+ * - A guest store to a merged page makes the kernel give that VM its own
+ *   copy again. The scanner notices the split (`/proc/self/pagemap`) and
+ *   frees store pages nobody maps anymore.
+ *
+ * This works with any kernel configuration (no KSM needed), but it has
+ * two costs:
+ *
+ * - Every merged page is a host mapping of its own (one `mmap()` with
+ *   `MAP_FIXED`). The whole process shares `vm.max_map_count` (65530 by
+ *   default, about 256 MiB of 4 KiB pages); past it `mmap()` fails and
+ *   the page stays private. Such refusals are counted in `share_failed`.
+ * - A VM with merged pages cannot move pages out anymore:
+ *   r5vm_host_take_pages() refuses until the VM is recycled, so its channel
+ *   messages (r5vm_chan.h) are copied instead of moved.
+ *
+ * Merging must not race with the guests: r5vm_dedup_scan() runs while no
+ * VM of the scanner executes. The background scanner of
+ * r5vm_dedup_start() stops the world for each pass; runners bracket every
+ * run slice with r5vm_dedup_enter() and r5vm_dedup_leave(). A pass skips
+ * pages still merged or never touched and hashes every other resident
+ * page again; merging costs a few microseconds per page (one `mmap()`).
+ * Linux only.
+ */
+
+#ifndef R5VM_DEDUP_H
+#define R5VM_DEDUP_H
+
+#include "r5vm_host.h"
+
+// ---- Dedup data structure --------------------------------------------------
+
+struct r5vm_dedup_vm_s;
+struct r5vm_dedup_slot_s;
+
+/** @brief Memory saved by a scanner, see r5vm_dedup_stats(). */
+typedef struct r5vm_dedup_stats_s
+{
+    unsigned scans;        /**< Completed passes */
+    size_t   shared_pages; /**< Guest pages mapping a store page */
+    size_t   store_pages;  /**< Host pages in the store */
+    size_t   zero_pages;   /**< Dropped zero pages not touched since */
+    size_t   saved_bytes;  /**< Host memory saved at the last pass */
+    size_t   share_failed; /**< Merges the host refused at the last pass */
+} r5vm_dedup_stats_t;
+
+/** @brief A page dedup scanner over a set of VMs. */
+typedef struct r5vm_dedup_s
+{
+#if !defined(_WIN32)
+    pthread_mutex_t lock;     /**< VM list, store and stop-the-world state */
+    pthread_cond_t  cond;     /**< Runners leaving, passes ending, quit */
+    pthread_t       thread;   /**< Background scanner */
+#endif
+    bool            started;  /**< Background scanner runs */
+    bool            quit;     /**< Ask the background scanner to stop */
+    bool            stop;     /**< A pass waits for or holds the VMs */
+    unsigned        running;  /**< Runners between enter and leave */
+    uint32_t        interval_ms;
+
+    struct r5vm_dedup_vm_s* vms;
+    unsigned        count;
+    unsigned        cap;
+
+    int             fd;         /**< memfd holding the store pages */
+    int             pagemap;    /**< /proc/self/pagemap */
+    uint8_t*        store;      /**< Shared view of the store */
+    uint32_t        store_cap;  /**< Pages mapped at `store` */
+    uint32_t        store_used; /**< Store pages handed out so far */
+    uint64_t*       store_hash; /**< Hash per store page */
+    uint32_t*       store_refs; /**< Guest pages per store page, last pass */
+    uint32_t*       store_free; /**< Stack of released store pages */
+    uint32_t        free_count;
+    struct r5vm_dedup_slot_s* table; /**< Hash -> store page or candidate */
+    uint32_t        table_size; /**< Power of two */
+    uint64_t*       scratch;    /**< Pagemap entries of one VM */
+    uint32_t        scratch_cap;
+
+    r5vm_dedup_stats_t stats;
+} r5vm_dedup_t;
+
+// ---- Functions -------------------------------------------------------------
+
+/**
+ * @brief Initialize a scanner without VMs.
+ *
+ * @return `false` without memfd or pagemap support (non-Linux hosts).
+ */
+bool r5vm_dedup_init(r5vm_dedup_t* d);
+
+/**
+ * @brief Stop the background scanner and release the store.
+ *
+ * Merged guest pages stay valid: they keep their view of the store until
+ * they are written or their VM is destroyed.
+ */
+void r5vm_dedup_destroy(r5vm_dedup_t* d);
+
+/**
+ * @brief Add a VM to the scanner. Remove it before destroying the VM.
+ *
+ * @return `false` on allocation failure.
+ */
+bool r5vm_dedup_add(r5vm_dedup_t* d, r5vm_host_t* host);
+
+/**
+ * @brief Remove a VM added with r5vm_dedup_add().
+ */
+void r5vm_dedup_remove(r5vm_dedup_t* d, r5vm_host_t* host);
+
+/**
+ * @brief Run one pass over all VMs, none of which may execute meanwhile.
+ *
+ * @return Host memory saved after the pass, in bytes.
+ */
+size_t r5vm_dedup_scan(r5vm_dedup_t* d);
+
+/**
+ * @brief Start a background thread running a pass every `interval_ms`.
+ *
+ * @return `false` if the thread cannot be started.
+ */
+bool r5vm_dedup_start(r5vm_dedup_t* d, uint32_t interval_ms);
+
+/**
+ * @brief Enter a run slice of any scanned VM, waits while a pass runs.
+ */
+void r5vm_dedup_enter(r5vm_dedup_t* d);
+
+/**
+ * @brief Leave a run slice entered with r5vm_dedup_enter().
+ */
+void r5vm_dedup_leave(r5vm_dedup_t* d);
+
+/**
+ * @brief Copy the statistics of the last pass. Thread-safe.
+ */
+void r5vm_dedup_stats(r5vm_dedup_t* d, r5vm_dedup_stats_t* stats);
+
+#endif // R5VM_DEDUP_H
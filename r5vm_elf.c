@@ -0,0 +1,134 @@
+/*
+ * R5VM - Minimal RISC-V RV32I Virtual Machine
+ *       _____
+ *      | ____|
+ *  _ __| |____   ___ __ ___
+ * | '__|___ \ \ / / '_ ` _ \
+ * | |   ___) \ V /| | | | | |
+ * |_|  |____/ \_/ |_| |_| |_|
+ *
+ * Copyright (c) 2025 Jan Zwiener
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "r5vm_elf.h"
+
+// ---- Defines ---------------------------------------------------------------
+
+#define ELF_EHDR_SIZE   52  /**< sizeof(Elf32_Ehdr) */
+#define ELF_SHDR_SIZE   40  /**< sizeof(Elf32_Shdr) */
+#define ELF_SYM_SIZE    16  /**< sizeof(Elf32_Sym) */
+#define ELF_CLASS32     1
+#define ELF_DATA2LSB    1
+#define ELF_EM_RISCV    243
+#define ELF_SHT_SYMTAB  2
+#define ELF_STT_FUNC    2
+#define ELF_SHN_UNDEF   0
+
+// ---- Helpers ---------------------------------------------------------------
+
+static uint32_t rd16(const uint8_t* p) { return p[0] | (p[1] << 8); }
+
+static uint32_t rd32(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/** true if [off, off + len) lies inside the image */
+static bool in_image(size_t size, uint32_t off, uint32_t len)
+{
+    return off <= size && len <= size - off;
+}
+
+// ---- Functions -------------------------------------------------------------
+
+bool r5vm_elf_functions(const uint8_t* elf, size_t size, r5vm_elf_sym_fn fn,
+                        void* user)
+{
+    if (!elf || size < ELF_EHDR_SIZE || memcmp(elf, "\x7f" "ELF", 4) != 0 ||
+        elf[4] != ELF_CLASS32 || elf[5] != ELF_DATA2LSB ||
+        rd16(elf + 18) != ELF_EM_RISCV)
+        return false;
+
+    const uint32_t shoff = rd32(elf + 32);
+    const uint32_t shentsize = rd16(elf + 46);
+    const uint32_t shnum = rd16(elf + 48);
+    if (shentsize < ELF_SHDR_SIZE || !in_image(size, shoff, shnum * shentsize))
+        return false;
+
+    bool found = false;
+    for (uint32_t i = 0; i < shnum; i++) {
+        const uint8_t* sh = elf + shoff + i * shentsize;
+        if (rd32(sh + 4) != ELF_SHT_SYMTAB)
+            continue;
+        const uint32_t sym_off = rd32(sh + 16);
+        const uint32_t sym_size = rd32(sh + 20);
+        const uint32_t link = rd32(sh + 24);
+        if (link >= shnum || !in_image(size, sym_off, sym_size))
+            return false;
+        const uint8_t* strsh = elf + shoff + link * shentsize;
+        const uint32_t str_off = rd32(strsh + 16);
+        const uint32_t str_size = rd32(strsh + 20);
+        if (!in_image(size, str_off, str_size) || str_size == 0 ||
+            elf[str_off + str_size - 1] != '\0')
+            return false;
+
+        for (uint32_t s = 0; s + ELF_SYM_SIZE <= sym_size; s += ELF_SYM_SIZE) {
+            const uint8_t* sym = elf + sym_off + s;
+            const uint32_t name = rd32(sym);
+            if ((sym[12] & 0xF) != ELF_STT_FUNC ||
+                rd16(sym + 14) == ELF_SHN_UNDEF || name >= str_size)
+                continue;
+            fn(user, (const char*)elf + str_off + name, rd32(sym + 4), rd32(sym + 8));
+        }
+        found = true;
+    }
+    return found;
+}
+
+typedef struct elf_lookup_s
+{
+    const char* name;
+    uint32_t    addr;
+    bool        found;
+} elf_lookup_t;
+
+static void elf_lookup_cb(void* user, const char* name, uint32_t addr,
+                          uint32_t size)
+{
+    elf_lookup_t* l = user;
+    (void)size;
+    if (!l->found && strcmp(name, l->name) == 0) {
+        l->addr = addr;
+        l->found = true;
+    }
+}
+
+bool r5vm_elf_lookup(const uint8_t* elf, size_t size, const char* name,
+                     uint32_t* addr)
+{
+    elf_lookup_t l = { name, 0, false };
+    if (!r5vm_elf_functions(elf, size, elf_lookup_cb, &l) || !l.found)
+        return false;
+    *addr = l.addr;
+    return true;
+}
@@ -0,0 +1,86 @@
+/*
+ * R5VM - Minimal RISC-V RV32I Virtual Machine
+ *       _____
+ *      | ____|
+ *  _ __| |____   ___ __ ___
+ * | '__|___ \ \ / / '_ ` _ \
+ * | |   ___) \ V /| | | | | |
+ * |_|  |____/ \_/ |_| |_| |_|
+ *
+ * Copyright (c) 2025 Jan Zwiener
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file r5vm_elf.h
+ * @brief Minimal ELF32 symbol table reader.
+ *
+ * The VM runs flat binaries (`objcopy -O binary`) linked at address 0, so
+ * symbol values in the matching `.elf` file are guest addresses. This module
+ * only reads the symbol table; program headers and relocations are ignored.
+ * Portable C, no dependency on `<elf.h>`.
+ */
+
+#ifndef R5VM_ELF_H
+#define R5VM_ELF_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// ---- Symbols ---------------------------------------------------------------
+
+/**
+ * @brief Callback for each defined function symbol.
+ *
+ * @param user  Opaque pointer passed to r5vm_elf_functions().
+ * @param name  NUL-terminated symbol name (points into the ELF image).
+ * @param addr  Symbol value (guest address of the function).
+ * @param size  Symbol size in bytes (0 if unknown).
+ */
+typedef void (*r5vm_elf_sym_fn)(void* user, const char* name, uint32_t addr,
+                                uint32_t size);
+
+/**
+ * @brief Call `fn` for every defined `STT_FUNC` symbol in `.symtab`.
+ *
+ * @param elf   ELF file contents.
+ * @param size  Size of `elf` in bytes.
+ * @param fn    Callback.
+ * @param user  Passed to `fn`.
+ * @return `false` if the image is not a little-endian RISC-V ELF32 file with
+ *         a symbol table.
+ */
+bool r5vm_elf_functions(const uint8_t* elf, size_t size, r5vm_elf_sym_fn fn,
+                        void* user);
+
+/**
+ * @brief Look up the address of a function symbol by name.
+ *
+ * @param elf   ELF file contents.
+ * @param size  Size of `elf` in bytes.
+ * @param name  Symbol name.
+ * @param addr  Receives the symbol value.
+ * @return `true` if found.
+ */
+bool r5vm_elf_lookup(const uint8_t* elf, size_t size, const char* name,
+                     uint32_t* addr);
+
+#endif // R5VM_ELF_H
@@ -0,0 +1,345 @@
+/*
+ * R5VM - Minimal RISC-V RV32I Virtual Machine
+ *       _____
+ *      | ____|
+ *  _ __| |____   ___ __ ___
+ * | '__|___ \ \ / / '_ ` _ \
+ * | |   ___) \ V /| | | | | |
+ * |_|  |____/ \_/ |_| |_| |_|
+ *
+ * Copyright (c) 2025 Jan Zwiener
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#include "r5vm_filter.h"
+
+#if !defined(_WIN32)
+
+// ---- Filter state ----------------------------------------------------------
+
+/** Owner of a stream window */
+enum {
+    R5VM_WIN_HOST,  /**< input: to be filled, output: free */
+    R5VM_WIN_READY, /**< input: filled, output: flushed by the guest */
+    R5VM_WIN_GUEST  /**< handed to the guest */
+};
+
+/** A window of guest memory */
+typedef struct r5vm_filter_win_s
+{
+    uint32_t addr;  /**< Guest address */
+    uint32_t len;   /**< Valid bytes (input: 0 = end of stream) */
+    int      state; /**< R5VM_WIN_* */
+} r5vm_filter_win_t;
+
+/** Filter state, installed as `host->user` */
+typedef struct r5vm_filter_s
+{
+    r5vm_host_t*      host;
+    r5vm_ecall_fn     next;     /**< ECALL handler of the host layer */
+    int               in_fd;
+    int               out_fd;
+    pthread_mutex_t   lock;     /**< Protects the windows and flags */
+    pthread_cond_t    cond;     /**< Signalled on every window change */
+    r5vm_filter_win_t in[2];    /**< Input windows, used alternately */
+    r5vm_filter_win_t out[2];   /**< Output windows, used alternately */
+    uint32_t          win_size; /**< Size of each window (0: not started) */
+    unsigned          in_next;  /**< Next input window for the guest */
+    unsigned          out_next; /**< Next output window for the guest */
+    bool              eof;      /**< End of input delivered to the guest */
+    bool              closing;  /**< Guest halted, threads finish */
+    bool              failed;   /**< Writing the output failed */
+    pthread_t         reader;
+    pthread_t         writer;
+} r5vm_filter_t;
+
+/** Fill the input windows, one read() per window */
+static void* filter_reader(void* arg)
+{
+    r5vm_filter_t* f = arg;
+
+    /* only a blocking read() may be cancelled when the guest halts */
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    for (unsigned i = 0;; i ^= 1) {
+        r5vm_filter_win_t* w = &f->in[i];
+        ssize_t n;
+
+        pthread_mutex_lock(&f->lock);
+        while (w->state != R5VM_WIN_HOST && !f->closing)
+            pthread_cond_wait(&f->cond, &f->lock);
+        const bool closing = f->closing;
+        pthread_mutex_unlock(&f->lock);
+        if (closing)
+            break;
+
+        do {
+            pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+            n = read(f->in_fd, f->host->map + w->addr, f->win_size);
+            pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+        } while (n < 0 && errno == EINTR);
+        if (n < 0)
+            perror("read");
+
+        pthread_mutex_lock(&f->lock);
+        w->len = n > 0 ? (uint32_t)n : 0;
+        w->state = R5VM_WIN_READY;
+        pthread_cond_broadcast(&f->cond);
+        pthread_mutex_unlock(&f->lock);
+        if (n <= 0)
+            break; /* end of stream */
+    }
+    return NULL;
+}
+
+/** Write flushed output windows in order */
+static void* filter_writer(void* arg)
+{
+    r5vm_filter_t* f = arg;
+
+    for (unsigned i = 0;; i ^= 1) {
+        r5vm_filter_win_t* w = &f->out[i];
+
+        pthread_mutex_lock(&f->lock);
+        while (w->state != R5VM_WIN_READY && !f->closing)
+            pthread_cond_wait(&f->cond, &f->lock);
+        const bool ready = w->state == R5VM_WIN_READY;
+        pthread_mutex_unlock(&f->lock);
+        /* windows are flushed alternately, nothing follows a free one */
+        if (!ready)
+            break;
+
+        const uint8_t* p = f->host->map + w->addr;
+        uint32_t left = w->len;
+        while (left && !f->failed) {
+            const ssize_t n = write(f->out_fd, p, left);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0) {
+                perror("write");
+                f->failed = true; /* discard the rest, the guest continues */
+                break;
+            }
+            p += n;
+            left -= (uint32_t)n;
+        }
+
+        pthread_mutex_lock(&f->lock);
+        w->state = R5VM_WIN_HOST;
+        pthread_cond_broadcast(&f->cond);
+        pthread_mutex_unlock(&f->lock);
+    }
+    return NULL;
+}
+
+/** true if [addr, addr + len) touches the stack guard, a watch or a file */
+static bool filter_overlaps(const r5vm_host_t* host, uint32_t addr,
+                            uint32_t len)
+{
+    const uint32_t end = addr + len;
+
+    if (addr < host->guard_hi && host->guard_lo < end)
+        return true;
+    for (int i = 0; i < R5VM_HOST_MAX_WATCH; i++) {
+        const r5vm_watch_t* w = &host->watch[i];
+        if (w->len && addr < w->addr + w->len && w->addr < end)
+            return true;
+    }
+    for (int i = 0; i < R5VM_HOST_MAX_MAPS; i++) {
+        const r5vm_file_map_t* m = &host->files[i];
+        if (m->len && addr < m->addr + m->len && m->addr < end)
+            return true;
+    }
+    return false;
+}
+
+/** STREAM_INIT: split the guest buffer into windows, start the threads */
+static bool filter_init(r5vm_filter_t* f, uint32_t addr, uint32_t size)
+{
+    r5vm_t* vm = &f->host->vm;
+    const uint32_t win = (size / 4) & ~3u;
+
+    if (f->win_size) {
+        r5vm_error(vm, "Stream already initialized", (vm->pc - 4) & vm->mem_mask, addr);
+        return false;
+    }
+    if (win == 0 || addr > vm->mem_size || size > vm->mem_size - addr ||
+        filter_overlaps(f->host, addr, size)) {
+        r5vm_error(vm, "Invalid stream buffer", (vm->pc - 4) & vm->mem_mask, addr);
+        return false;
+    }
+    for (unsigned i = 0; i < 2; i++) {
+        f->in[i].addr = addr + i * win;
+        f->out[i].addr = addr + (2 + i) * win;
+    }
+    f->win_size = win;
+    if (pthread_create(&f->reader, NULL, filter_reader, f) != 0) {
+        f->win_size = 0;
+        r5vm_error(vm, "Cannot start stream reader", (vm->pc - 4) & vm->mem_mask, 0);
+        return false;
+    }
+    if (pthread_create(&f->writer, NULL, filter_writer, f) != 0) {
+        pthread_cancel(f->reader);
+        pthread_join(f->reader, NULL);
+        f->win_size = 0;
+        r5vm_error(vm, "Cannot start stream writer", (vm->pc - 4) & vm->mem_mask, 0);
+        return false;
+    }
+    vm->a0 = win;
+    return true;
+}
+
+/** STREAM_IN: release the current input window, wait for the next one */
+static void filter_in(r5vm_filter_t* f)
+{
+    r5vm_t* vm = &f->host->vm;
+    r5vm_filter_win_t* cur = &f->in[f->in_next ^ 1];
+    r5vm_filter_win_t* w = &f->in[f->in_next];
+
+    pthread_mutex_lock(&f->lock);
+    if (cur->state == R5VM_WIN_GUEST) {
+        cur->state = R5VM_WIN_HOST;
+        pthread_cond_broadcast(&f->cond);
+    }
+    if (!f->eof) {
+        while (w->state != R5VM_WIN_READY)
+            pthread_cond_wait(&f->cond, &f->lock);
+        if (w->len) {
+            w->state = R5VM_WIN_GUEST;
+            f->in_next ^= 1;
+        } else {
+            f->eof = true;
+        }
+    }
+    vm->a0 = w->addr;
+    vm->a1 = f->eof ? 0 : w->len;
+    pthread_mutex_unlock(&f->lock);
+}
+
+/** STREAM_OUT: flush `len` bytes of the current window, wait for a free one */
+static bool filter_out(r5vm_filter_t* f, uint32_t len)
+{
+    r5vm_t* vm = &f->host->vm;
+    r5vm_filter_win_t* cur = &f->out[f->out_next ^ 1];
+    r5vm_filter_win_t* w = &f->out[f->out_next];
+
+    if (len > f->win_size) {
+        r5vm_error(vm, "Stream output exceeds window", (vm->pc - 4) & vm->mem_mask, len);
+        return false;
+    }
+    pthread_mutex_lock(&f->lock);
+    if (cur->state == R5VM_WIN_GUEST) {
+        cur->len = len;
+        cur->state = R5VM_WIN_READY;
+        pthread_cond_broadcast(&f->cond);
+    }
+    while (w->state != R5VM_WIN_HOST)
+        pthread_cond_wait(&f->cond, &f->lock);
+    w->state = R5VM_WIN_GUEST;
+    f->out_next ^= 1;
+    pthread_mutex_unlock(&f->lock);
+    vm->a0 = w->addr;
+    vm->a1 = f->win_size;
+    return true;
+}
+
+static bool filter_ecall(r5vm_t* vm, uint32_t id)
+{
+    r5vm_filter_t* f = (r5vm_filter_t*)((r5vm_host_t*)vm)->user;
+
+    switch (id) {
+    case R5VM_ECALL_STREAM_INIT:
+        return filter_init(f, vm->a0, vm->a1);
+    case R5VM_ECALL_STREAM_IN:
+    case R5VM_ECALL_STREAM_OUT:
+        if (!f->win_size) {
+            r5vm_error(vm, "Stream not initialized", (vm->pc - 4) & vm->mem_mask, id);
+            return false;
+        }
+        if (id == R5VM_ECALL_STREAM_IN) {
+            filter_in(f);
+            return true;
+        }
+        return filter_out(f, vm->a0);
+    default:
+        return f->next(vm, id);
+    }
+}
+
+bool r5vm_filter_run(r5vm_host_t* host, int in_fd, int out_fd)
+{
+    r5vm_filter_t f;
+
+    memset(&f, 0, sizeof(f));
+    f.host = host;
+    f.next = host->vm.ecall_fn;
+    f.in_fd = in_fd;
+    f.out_fd = out_fd;
+    if (pthread_mutex_init(&f.lock, NULL) != 0)
+        return false;
+    if (pthread_cond_init(&f.cond, NULL) != 0) {
+        pthread_mutex_destroy(&f.lock);
+        return false;
+    }
+
+    void* saved_user = host->user;
+    host->user = &f;
+    host->vm.ecall_fn = filter_ecall;
+    do {
+        r5vm_host_run(host, 0);
+    } while (r5vm_paused(&host->vm));
+    host->vm.ecall_fn = f.next;
+    host->user = saved_user;
+
+    if (f.win_size) {
+        pthread_mutex_lock(&f.lock);
+        f.closing = true;
+        pthread_cond_broadcast(&f.cond);
+        pthread_mutex_unlock(&f.lock);
+        pthread_cancel(f.reader); /* may block on input nobody needs */
+        pthread_join(f.reader, NULL);
+        pthread_join(f.writer, NULL);
+    }
+    pthread_cond_destroy(&f.cond);
+    pthread_mutex_destroy(&f.lock);
+    return !f.failed;
+}
+
+#else /* _WIN32 */
+
+bool r5vm_filter_run(r5vm_host_t* host, int in_fd, int out_fd)
+{
+    (void)host;
+    (void)in_fd;
+    (void)out_fd;
+    fprintf(stderr, "error: filter mode requires a POSIX host\n");
+    return false;
+}
+
+#endif /* !_WIN32 */
@@ -0,0 +1,80 @@
+/*
+ * R5VM - Minimal RISC-V RV32I Virtual Machine
+ *       _____
+ *      | ____|
+ *  _ __| |____   ___ __ ___
+ * | '__|___ \ \ / / '_ ` _ \
+ * | |   ___) \ V /| | | | | |
+ * |_|  |____/ \_/ |_| |_| |_|
+ *
+ * Copyright (c) 2025 Jan Zwiener
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file r5vm_filter.h
+ * @brief Streaming filter mode for R5VM: stdin -> guest -> stdout.
+ *
+ * Stream transformers exchange data with the host through windows in guest
+ * memory instead of one ECALL per byte. The guest hands the host a buffer
+ * with `R5VM_ECALL_STREAM_INIT`, which is split into two input and two
+ * output windows. A reader thread `read()`s the input directly into the
+ * input window the guest is not using, a writer thread `write()`s full
+ * output windows directly from guest memory. Guest compute and host I/O
+ * overlap, a guest only waits when it outruns its input or its output:
+ *
+ * @code
+ * for (;;) {
+ *     size_t n;
+ *     const char* in = qvm_stream_in(&n); // window A, host fills window B
+ *     if (!n)
+ *         break;
+ *     ... transform into out, call qvm_stream_out() when it is full ...
+ * }
+ * @endcode
+ *
+ * Input windows are owned by the guest until its next `STREAM_IN`, output
+ * windows until the `STREAM_OUT` that flushes them. Output that is not
+ * flushed before the guest exits is lost.
+ */
+
+#ifndef R5VM_FILTER_H
+#define R5VM_FILTER_H
+
+#include "r5vm_host.h"
+
+// ---- Functions -------------------------------------------------------------
+
+/**
+ * @brief Run the guest as a stream filter from `in_fd` to `out_fd`.
+ *
+ * The VM must be initialized and reset. Runs until the guest halts, the
+ * I/O threads start with the guest's `R5VM_ECALL_STREAM_INIT`. Flushed
+ * output is written completely before the function returns.
+ *
+ * @param host    Host VM instance.
+ * @param in_fd   File descriptor of the input stream, e.g. 0.
+ * @param out_fd  File descriptor of the output stream, e.g. 1.
+ * @return `false` if the I/O threads could not be started or writing the
+ *         output failed, the VM status is set independently.
+ */
+bool r5vm_filter_run(r5vm_host_t* host, int in_fd, int out_fd);
+
+#endif // R5VM_FILTER_H
@@ -0,0 +1,218 @@
+/*
+ * R5VM - Minimal RISC-V RV32I Virtual Machine
+ *       _____
+ *      | ____|
+ *  _ __| |____   ___ __ ___
+ * | '__|___ \ \ / / '_ ` _ \
+ * | |   ___) \ V /| | | | | |
+ * |_|  |____/ \_/ |_| |_| |_|
+ *
+ * Copyright (c) 2025 Jan Zwiener
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#if !defined(_WIN32)
+#define _DEFAULT_SOURCE   /* struct sockaddr_un on glibc */
+#define _DARWIN_C_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#endif
+
+#include "r5vm_fork.h"
+
+#if !defined(_WIN32)
+
+// ---- Fork server state -----------------------------------------------------
+
+/** Fork server state, installed as `host->user` */
+typedef struct r5vm_fork_s
+{
+    r5vm_ecall_fn next; /**< ECALL handler of the host layer */
+    bool          warm; /**< Checkpoint reached, jobs execute it normally */
+} r5vm_fork_t;
+
+/** Stop the warm-up run at the first checkpoint ECALL. */
+static bool fork_ecall(r5vm_t* vm, uint32_t id)
+{
+    r5vm_fork_t* fs = (r5vm_fork_t*)((r5vm_host_t*)vm)->user;
+
+    if (id == R5VM_ECALL_CHECKPOINT && !fs->warm) {
+        /* rewind, every forked child executes the ECALL again */
+        vm->pc = (vm->pc - 4) & vm->mem_mask;
+        vm->status = R5VM_BREAK;
+        fs->warm = true;
+        return false;
+    }
+    return fs->next(vm, id);
+}
+
+/** Run until the guest halts, a `pause` hint only yields. */
+static void fork_run(r5vm_host_t* host)
+{
+    do {
+        r5vm_host_run(host, 0);
+    } while (r5vm_paused(&host->vm));
+}
+
+/** Child: run one job with stdin/stdout connected to the client. */
+static void fork_job(r5vm_host_t* host, int conn, unsigned job)
+{
+    dup2(conn, STDIN_FILENO);
+    dup2(conn, STDOUT_FILENO);
+    close(conn);
+
+    fork_run(host);
+    fflush(stdout);
+
+    const int code = host->vm.status == R5VM_EXIT ? (int)(host->vm.a0 & 0xFF) : 1;
+    fprintf(stderr, "[r5vm] fork-server: job %u exit code %d\n", job, code);
+    _exit(code);
+}
+
+/** Remove a stale socket at `path`, refuse to replace anything else. */
+static bool fork_unlink(const char* path)
+{
+    struct stat st;
+
+    if (lstat(path, &st) != 0)
+        return true;
+    if (!S_ISSOCK(st.st_mode)) {
+        fprintf(stderr, "error: '%s' exists and is not a socket\n", path);
+        return false;
+    }
+    unlink(path);
+    return true;
+}
+
+/** Reap finished jobs, block for one if `wait` is set. Returns the rest. */
+static unsigned fork_reap(unsigned live, bool wait)
+{
+    while (live) {
+        const pid_t pid = waitpid(-1, NULL, wait ? 0 : WNOHANG);
+        if (pid < 0 && errno == EINTR)
+            continue;
+        if (pid < 0 && errno == ECHILD)
+            return 0;
+        if (pid <= 0)
+            break;
+        live--;
+        wait = false;
+    }
+    return live;
+}
+
+// ---- Functions -------------------------------------------------------------
+
+bool r5vm_fork_serve(r5vm_host_t* host, const char* path)
+{
+    struct sockaddr_un addr;
+    r5vm_fork_t fs;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "error: socket path too long '%s'\n", path);
+        return false;
+    }
+
+    /* warm up: run the one-time setup of the guest */
+    void* saved_user = host->user;
+    fs.next = host->vm.ecall_fn;
+    fs.warm = false;
+    host->user = &fs;
+    host->vm.ecall_fn = fork_ecall;
+    fork_run(host);
+    if (!fs.warm || host->vm.status != R5VM_BREAK) {
+        fprintf(stderr, "error: guest halted before the checkpoint ECALL\n");
+        goto restore;
+    }
+
+    const int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (lfd < 0) {
+        perror("socket");
+        goto restore;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if (!fork_unlink(path)) {
+        close(lfd);
+        goto restore;
+    }
+    if (bind(lfd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(lfd, SOMAXCONN) != 0) {
+        perror("bind");
+        close(lfd);
+        goto restore;
+    }
+    fprintf(stderr, "[r5vm] fork-server: checkpoint at PC=0x%08X, listening on %s\n",
+            (unsigned)host->vm.pc, path);
+
+    unsigned live = 0; /* forked jobs not yet reaped */
+    for (unsigned job = 1;; job++) {
+        /* at the cap, further clients wait in the listen backlog */
+        live = fork_reap(live, live >= R5VM_FORK_MAX_JOBS);
+        const int conn = accept(lfd, NULL, NULL);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            perror("accept");
+            break;
+        }
+        fflush(stdout); /* no buffered output may be inherited */
+        const pid_t pid = fork();
+        if (pid == 0) {
+            close(lfd);
+            fork_job(host, conn, job);
+        }
+        if (pid < 0)
+            perror("fork");
+        else
+            live++;
+        close(conn);
+    }
+    close(lfd);
+
+restore:
+    host->vm.ecall_fn = fs.next;
+    host->user = saved_user;
+    return false;
+}
+
+#else /* _WIN32 */
+
+bool r5vm_fork_serve(r5vm_host_t* host, const char* path)
+{
+    (void)host;
+    (void)path;
+    fprintf(stderr, "error: fork server requires a POSIX host\n");
+    return false;
+}
+
+#endif /* !_WIN32 */
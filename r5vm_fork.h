@@ -0,0 +1,79 @@
+/*
+ * R5VM - Minimal RISC-V RV32I Virtual Machine
+ *       _____
+ *      | ____|
+ *  _ __| |____   ___ __ ___
+ * | '__|___ \ \ / / '_ ` _ \
+ * | |   ___) \ V /| | | | | |
+ * |_|  |____/ \_/ |_| |_| |_|
+ *
+ * Copyright (c) 2025 Jan Zwiener
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file r5vm_fork.h
+ * @brief Fork server for R5VM: run many jobs from one warm guest image.
+ *
+ * The guest runs once up to its checkpoint, `R5VM_ECALL_CHECKPOINT`, which
+ * separates one-time setup (loading tables, building indexes) from the
+ * per-job work. The server then listens on a Unix socket and forks a child
+ * for every connection. The child starts from a copy-on-write copy of the
+ * warm VM, reads the job input from the connection at the checkpoint and
+ * sends its `putchar` output back:
+ *
+ * @code
+ * ./r5vm job.bin --fork-server /tmp/r5vm.sock
+ * nc -NU /tmp/r5vm.sock < input.txt
+ * @endcode
+ *
+ * Run without a fork server, the same guest reads its input from stdin.
+ */
+
+#ifndef R5VM_FORK_H
+#define R5VM_FORK_H
+
+#include "r5vm_host.h"
+
+// ---- Macros ----------------------------------------------------------------
+
+/** Jobs running at once, further connections wait in the listen backlog */
+#define R5VM_FORK_MAX_JOBS  64u
+
+// ---- Functions -------------------------------------------------------------
+
+/**
+ * @brief Run the guest to its checkpoint, then serve jobs on `path`.
+ *
+ * The VM must be initialized and reset. Each connection is one job: the
+ * client sends the input and shuts down its write side, the child answers
+ * with the guest output and closes the connection. Up to
+ * `R5VM_FORK_MAX_JOBS` jobs run concurrently. Only returns on errors, with
+ * the ECALL handler and `host->user` of the caller restored.
+ *
+ * @param host  Host VM instance to warm up and fork.
+ * @param path  Unix socket path, a stale socket is replaced, any other
+ *              existing file is an error.
+ * @return `false` if the guest halted before the checkpoint or the socket
+ *         could not be set up.
+ */
+bool r5vm_fork_serve(r5vm_host_t* host, const char* path);
+
+#endif // R5VM_FORK_H
@@ -0,0 +1,736 @@
+/*
+ * R5VM - Minimal RISC-V RV32I Virtual Machine
+ *       _____
+ *      | ____|
+ *  _ __| |____   ___ __ ___
+ * | '__|___ \ \ / / '_ ` _ \
+ * | |   ___) \ V /| | | | | |
+ * |_|  |____/ \_/ |_| |_| |_|
+ *
+ * Copyright (c) 2025 Jan Zwiener
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#if !defined(_WIN32)
+#define _DEFAULT_SOURCE   /* MSG_DONTWAIT, struct sockaddr_in on glibc */
+#define _DARWIN_C_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#endif
+
+#include "r5vm_gdb.h"
+
+#if !defined(_WIN32)
+
+// ---- Defines ---------------------------------------------------------------
+
+#define R5VM_GDB_BUF_SIZE   4096 /**< Max. packet size (announced to gdb) */
+#define R5VM_GDB_NUM_REGS   33   /**< x0..x31 and pc */
+
+#define R5VM_GDB_SIGINT     2    /**< Stop signal: interrupted by gdb */
+#define R5VM_GDB_SIGTRAP    5    /**< Stop signal: breakpoint or step */
+#define R5VM_GDB_SIGSEGV    11   /**< Stop signal: VM error */
+
+/** Target description, so gdb knows the register layout without an ELF. */
+static const char r5vm_gdb_target_xml[] =
+    "<?xml version=\"1.0\"?>"
+    "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+    "<target version=\"1.0\">"
+    "<architecture>riscv:rv32</architecture>"
+    "<feature name=\"org.gnu.gdb.riscv.cpu\">"
+    "<reg name=\"zero\" bitsize=\"32\" type=\"int\" regnum=\"0\"/>"
+    "<reg name=\"ra\" bitsize=\"32\" type=\"code_ptr\"/>"
+    "<reg name=\"sp\" bitsize=\"32\" type=\"data_ptr\"/>"
+    "<reg name=\"gp\" bitsize=\"32\" type=\"data_ptr\"/>"
+    "<reg name=\"tp\" bitsize=\"32\" type=\"data_ptr\"/>"
+    "<reg name=\"t0\" bitsize=\"32\" type=\"int\"/>"
+    "<reg name=\"t1\" bitsize=\"32\" type=\"int\"/>"
+    "<reg name=\"t2\" bitsize=\"32\" type=\"int\"/>"
+    "<reg name=\"fp\" bitsize=\"32\" type=\"data_ptr\"/>"
+    "<reg name=\"s1\" bitsize=\"32\" type=\"int\"/>"
+    "<reg name=\"a0\" bitsize=\"32\" type=\"int\"/>"
+    "<reg name=\"a1\" bitsize=\"32\" type=\"int\"/>"
+    "<reg name=\"a2\" bitsize=\"32\" type=\"int\"/>"
+    "<reg name=\"a3\" bitsize=\"32\" type=\"int\"/>"
+    "<reg name=\"a4\" bitsize=\"32\" type=\"int\"/>"
+    "<reg name=\"a5\" bitsize=\"32\" type=\"int\"/>"
+    "<reg name=\"a6\" bitsize=\"32\" type=\"int\"/>"
+    "<reg name=\"a7\" bitsize=\"32\" type=\"int\"/>"
+    "<reg name=\"s2\" bitsize=\"32\" type=\"int\"/>"
+    "<reg name=\"s3\" bitsize=\"32\" type=\"int\"/>"
+    "<reg name=\"s4\" bitsize=\"32\" type=\"int\"/>"
+    "<reg name=\"s5\" bitsize=\"32\" type=\"int\"/>"
+    "<reg name=\"s6\" bitsize=\"32\" type=\"int\"/>"
+    "<reg name=\"s7\" bitsize=\"32\" type=\"int\"/>"
+    "<reg name=\"s8\" bitsize=\"32\" type=\"int\"/>"
+    "<reg name=\"s9\" bitsize=\"32\" type=\"int\"/>"
+    "<reg name=\"s10\" bitsize=\"32\" type=\"int\"/>"
+    "<reg name=\"s11\" bitsize=\"32\" type=\"int\"/>"
+    "<reg name=\"t3\" bitsize=\"32\" type=\"int\"/>"
+    "<reg name=\"t4\" bitsize=\"32\" type=\"int\"/>"
+    "<reg name=\"t5\" bitsize=\"32\" type=\"int\"/>"
+    "<reg name=\"t6\" bitsize=\"32\" type=\"int\"/>"
+    "<reg name=\"pc\" bitsize=\"32\" type=\"code_ptr\"/>"
+    "</feature>"
+    "</target>";
+
+// ---- Stub state ------------------------------------------------------------
+
+/** A software breakpoint: EBREAK patched over the original instruction. */
+typedef struct r5vm_gdb_bp_s
+{
+    uint32_t addr; /**< Guest address of the patched instruction */
+    uint32_t orig; /**< Original instruction word */
+    bool     used; /**< Slot in use */
+} r5vm_gdb_bp_t;
+
+typedef struct r5vm_gdb_s
+{
+    r5vm_host_t*  host;
+    int           fd;          /**< Connected gdb socket */
+    r5vm_gdb_bp_t bp[R5VM_GDB_MAX_BP];
+    uint32_t      watch_mask;  /**< Host watch slots created by gdb */
+    bool          watch_hit;   /**< Last stop was a watchpoint */
+    uint32_t      watch_addr;  /**< Address of the watched store */
+    char          stop[32];    /**< Last stop reply (for '?') */
+    char          rx[256];     /**< Socket receive buffer */
+    size_t        rx_len;
+    size_t        rx_pos;
+    char          in[R5VM_GDB_BUF_SIZE];
+    char          out[R5VM_GDB_BUF_SIZE];
+} r5vm_gdb_t;
+
+// ---- Packet I/O ------------------------------------------------------------
+
+static const char hexdigits[] = "0123456789abcdef";
+
+/** Blocking read of one byte, -1 on disconnect. */
+static int gdb_getc(r5vm_gdb_t* g)
+{
+    if (g->rx_pos == g->rx_len) {
+        ssize_t n = recv(g->fd, g->rx, sizeof(g->rx), 0);
+        if (n <= 0)
+            return -1;
+        g->rx_len = (size_t)n;
+        g->rx_pos = 0;
+    }
+    return (unsigned char)g->rx[g->rx_pos++];
+}
+
+static bool gdb_write(r5vm_gdb_t* g, const char* data, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = send(g->fd, data, len, 0);
+        if (n <= 0)
+            return false;
+        data += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+/** Frame `data` as `$data#cs` and send it. Acks from gdb are ignored. */
+static bool gdb_send(r5vm_gdb_t* g, const char* data)
+{
+    char frame[R5VM_GDB_BUF_SIZE + 4];
+    size_t len = strlen(data);
+    uint8_t cs = 0;
+
+    if (len > R5VM_GDB_BUF_SIZE - 1)
+        len = R5VM_GDB_BUF_SIZE - 1;
+    frame[0] = '$';
+    for (size_t i = 0; i < len; i++) {
+        frame[1 + i] = data[i];
+        cs += (uint8_t)data[i];
+    }
+    frame[1 + len] = '#';
+    frame[2 + len] = hexdigits[cs >> 4];
+    frame[3 + len] = hexdigits[cs & 0xF];
+    return gdb_write(g, frame, len + 4);
+}
+
+/** Receive the next packet into `g->in`, returns `false` on disconnect. */
+static bool gdb_recv(r5vm_gdb_t* g)
+{
+    int c;
+    size_t len;
+
+    for (;;) {
+        do { /* skip acks and stray ^C while stopped */
+            c = gdb_getc(g);
+            if (c < 0)
+                return false;
+        } while (c != '$');
+
+        uint8_t cs = 0;
+        len = 0;
+        while ((c = gdb_getc(g)) >= 0 && c != '#') {
+            if (len < sizeof(g->in) - 1)
+                g->in[len++] = (char)c;
+            cs += (uint8_t)c;
+        }
+        if (c < 0)
+            return false;
+        char sum[3] = { 0, 0, 0 };
+        if ((c = gdb_getc(g)) < 0)
+            return false;
+        sum[0] = (char)c;
+        if ((c = gdb_getc(g)) < 0)
+            return false;
+        sum[1] = (char)c;
+        if ((uint8_t)strtoul(sum, NULL, 16) == cs) {
+            g->in[len] = '\0';
+            return gdb_write(g, "+", 1);
+        }
+        if (!gdb_write(g, "-", 1))
+            return false;
+    }
+}
+
+/** Check for a pending ^C from gdb while the guest runs. */
+static bool gdb_interrupted(r5vm_gdb_t* g, bool* closed)
+{
+    char c;
+    ssize_t n;
+
+    while ((n = recv(g->fd, &c, 1, MSG_DONTWAIT)) == 1) {
+        if (c == 0x03)
+            return true;
+    }
+    if (n == 0)
+        *closed = true;
+    return *closed;
+}
+
+// ---- Helpers ---------------------------------------------------------------
+
+static void put_hex32(char* out, uint32_t v)
+{
+    for (int i = 0; i < 4; i++) { /* little-endian byte order */
+        const uint8_t b = (uint8_t)(v >> (8 * i));
+        out[2 * i + 0] = hexdigits[b >> 4];
+        out[2 * i + 1] = hexdigits[b & 0xF];
+    }
+}
+
+static uint32_t get_hex32(const char* in)
+{
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++) {
+        char byte[3] = { in[2 * i], in[2 * i + 1], 0 };
+        v |= (uint32_t)strtoul(byte, NULL, 16) << (8 * i);
+    }
+    return v;
+}
+
+/** Check if `[addr, addr + len)` touches the no-access stack guard. */
+static bool gdb_in_guard(const r5vm_host_t* host, uint32_t addr, uint32_t len)
+{
+    return addr < host->guard_hi && addr + len > host->guard_lo;
+}
+
+/** Instruction word at `addr`, 0 inside the stack guard. */
+static uint32_t gdb_peek32(const r5vm_host_t* host, uint32_t addr)
+{
+    const r5vm_t* vm = &host->vm;
+    uint32_t v = 0;
+
+    if (gdb_in_guard(host, addr & vm->mem_mask, 4))
+        return 0;
+    for (int i = 0; i < 4; i++)
+        v |= (uint32_t)vm->mem[(addr + i) & vm->mem_mask] << (8 * i);
+    return v;
+}
+
+static int gdb_find_bp(const r5vm_gdb_t* g, uint32_t addr)
+{
+    for (int i = 0; i < R5VM_GDB_MAX_BP; i++) {
+        if (g->bp[i].used && g->bp[i].addr == addr)
+            return i;
+    }
+    return -1;
+}
+
+/** Patch EBREAK over the instruction of breakpoint `i`. */
+static bool gdb_arm_bp(r5vm_gdb_t* g, int i)
+{
+    const uint32_t ebreak = R5VM_INSTR_EBREAK;
+    uint8_t code[4];
+
+    for (int k = 0; k < 4; k++)
+        code[k] = (uint8_t)(ebreak >> (8 * k));
+    g->bp[i].orig = gdb_peek32(g->host, g->bp[i].addr);
+    return r5vm_host_write(g->host, g->bp[i].addr, code, 4);
+}
+
+/** Restore the original instruction of breakpoint `i`. */
+static void gdb_disarm_bp(r5vm_gdb_t* g, int i)
+{
+    uint8_t code[4];
+
+    for (int k = 0; k < 4; k++)
+        code[k] = (uint8_t)(g->bp[i].orig >> (8 * k));
+    r5vm_host_write(g->host, g->bp[i].addr, code, 4);
+}
+
+static bool gdb_insert_bp(r5vm_gdb_t* g, uint32_t addr)
+{
+    if (gdb_find_bp(g, addr) >= 0)
+        return true;
+    if ((addr & 3) || addr > g->host->vm.mem_size - 4 ||
+        gdb_in_guard(g->host, addr, 4))
+        return false;
+    for (int i = 0; i < R5VM_GDB_MAX_BP; i++) {
+        if (!g->bp[i].used) {
+            g->bp[i].addr = addr;
+            if (!gdb_arm_bp(g, i))
+                return false;
+            g->bp[i].used = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void gdb_remove_bp(r5vm_gdb_t* g, uint32_t addr)
+{
+    const int i = gdb_find_bp(g, addr);
+    if (i >= 0) {
+        gdb_disarm_bp(g, i);
+        g->bp[i].used = false;
+    }
+}
+
+static bool gdb_on_watch(r5vm_host_t* host, uint32_t pc, uint32_t addr,
+                         uint32_t len, uint32_t old_val)
+{
+    r5vm_gdb_t* g = (r5vm_gdb_t*)host->user;
+    (void)pc;
+    (void)len;
+    (void)old_val;
+    g->watch_hit = true;
+    g->watch_addr = addr;
+    return false; /* stop and report to gdb */
+}
+
+// ---- Execution -------------------------------------------------------------
+
+/** Build the stop reply for the current VM state. */
+static void gdb_stop_reply(r5vm_gdb_t* g, int sig)
+{
+    r5vm_t* vm = &g->host->vm;
+
+    if (vm->status == R5VM_EXIT)
+        snprintf(g->stop, sizeof(g->stop), "W%02x", (unsigned)(vm->a0 & 0xFF));
+    else if (vm->status == R5VM_ERROR)
+        snprintf(g->stop, sizeof(g->stop), "S%02x", R5VM_GDB_SIGSEGV);
+    else if (g->watch_hit)
+        snprintf(g->stop, sizeof(g->stop), "T%02xwatch:%08x;",
+                 R5VM_GDB_SIGTRAP, (unsigned)g->watch_addr);
+    else if (vm->status == R5VM_BREAK && gdb_find_bp(g, vm->pc) >= 0)
+        snprintf(g->stop, sizeof(g->stop), "T%02xswbreak:;", R5VM_GDB_SIGTRAP);
+    else
+        snprintf(g->stop, sizeof(g->stop), "S%02x", sig);
+}
+
+/**
+ * @brief Continue or single-step the guest.
+ *
+ * A breakpoint at the current pc is stepped over with its original
+ * instruction; an EBREAK that belongs to the guest itself is skipped.
+ * Between slices of R5VM_GDB_SLICE instructions the socket is polled for
+ * an interrupt request.
+ *
+ * @return `false` if gdb disconnected while the guest was running.
+ */
+static bool gdb_resume(r5vm_gdb_t* g, bool step)
+{
+    r5vm_t* vm = &g->host->vm;
+    bool closed = false;
+    int sig = R5VM_GDB_SIGTRAP;
+    const int bp = gdb_find_bp(g, vm->pc);
+
+    g->watch_hit = false;
+    if (vm->status == R5VM_EXIT)
+        return true;
+    if (bp >= 0) {
+        gdb_disarm_bp(g, bp);
+        r5vm_host_run(g->host, 1);
+        gdb_arm_bp(g, bp);
+        step = step || vm->status != R5VM_RUNNING;
+    } else if (gdb_peek32(g->host, vm->pc) == R5VM_INSTR_EBREAK) {
+        vm->pc = (vm->pc + 4) & vm->mem_mask;
+        vm->status = R5VM_RUNNING;
+    } else if (step) {
+        r5vm_host_run(g->host, 1);
+    }
+
+    while (!step) {
+        r5vm_host_run(g->host, R5VM_GDB_SLICE);
+        /* a pause hint only yields, other idle stops are reported */
+        if (vm->status != R5VM_RUNNING && !r5vm_paused(vm))
+            break;
+        if (gdb_interrupted(g, &closed)) {
+            sig = R5VM_GDB_SIGINT;
+            break;
+        }
+    }
+    gdb_stop_reply(g, sig);
+    return !closed;
+}
+
+// ---- Packet handlers -------------------------------------------------------
+
+static void gdb_read_regs(r5vm_gdb_t* g)
+{
+    const r5vm_t* vm = &g->host->vm;
+    for (int i = 0; i < 32; i++)
+        put_hex32(g->out + 8 * i, vm->regs[i]);
+    put_hex32(g->out + 8 * 32, vm->pc);
+    g->out[8 * R5VM_GDB_NUM_REGS] = '\0';
+}
+
+static void gdb_write_regs(r5vm_gdb_t* g, const char* p)
+{
+    r5vm_t* vm = &g->host->vm;
+    if (strlen(p) < 8 * R5VM_GDB_NUM_REGS) {
+        strcpy(g->out, "E01");
+        return;
+    }
+    for (int i = 1; i < 32; i++)
+        vm->regs[i] = get_hex32(p + 8 * i);
+    vm->pc = get_hex32(p + 8 * 32) & vm->mem_mask;
+    strcpy(g->out, "OK");
+}
+
+static void gdb_read_mem(r5vm_gdb_t* g, const char* p)
+{
+    const r5vm_t* vm = &g->host->vm;
+    char* end;
+    const uint32_t addr = (uint32_t)strtoul(p, &end, 16);
+    uint32_t len = (uint32_t)strtoul(end + 1, NULL, 16);
+
+    if (len > (sizeof(g->out) - 1) / 2)
+        len = (sizeof(g->out) - 1) / 2;
+    if (*end != ',' || addr >= vm->mem_size || len > vm->mem_size - addr) {
+        strcpy(g->out, "E01");
+        return;
+    }
+    if (gdb_in_guard(g->host, addr, len)) {
+        strcpy(g->out, "E14"); /* EFAULT, reading the guard would fault */
+        return;
+    }
+    for (uint32_t i = 0; i < len; i++) {
+        uint8_t b = vm->mem[addr + i];
+        for (int k = 0; k < R5VM_GDB_MAX_BP; k++) { /* hide our EBREAKs */
+            const r5vm_gdb_bp_t* bp = &g->bp[k];
+            if (bp->used && addr + i - bp->addr < 4)
+                b = (uint8_t)(bp->orig >> (8 * (addr + i - bp->addr)));
+        }
+        g->out[2 * i + 0] = hexdigits[b >> 4];
+        g->out[2 * i + 1] = hexdigits[b & 0xF];
+    }
+    g->out[2 * len] = '\0';
+}
+
+static void gdb_write_mem(r5vm_gdb_t* g, const char* p)
+{
+    uint8_t data[R5VM_GDB_BUF_SIZE / 2];
+    char* end;
+    const uint32_t addr = (uint32_t)strtoul(p, &end, 16);
+    const uint32_t len = (uint32_t)strtoul(end + 1, &end, 16);
+
+    if (*end != ':' || len > sizeof(data) || strlen(end + 1) < 2 * len) {
+        strcpy(g->out, "E01");
+        return;
+    }
+    for (uint32_t i = 0; i < len; i++) {
+        char byte[3] = { end[1 + 2 * i], end[2 + 2 * i], 0 };
+        data[i] = (uint8_t)strtoul(byte, NULL, 16);
+    }
+    /* lift breakpoints so they pick up the new original instructions */
+    for (int i = 0; i < R5VM_GDB_MAX_BP; i++) {
+        if (g->bp[i].used)
+            gdb_disarm_bp(g, i);
+    }
+    const bool ok = r5vm_host_write(g->host, addr, data, len);
+    for (int i = 0; i < R5VM_GDB_MAX_BP; i++) {
+        if (g->bp[i].used)
+            gdb_arm_bp(g, i);
+    }
+    strcpy(g->out, ok ? "OK" : "E01");
+}
+
+/** Z/z packets: type 0/1 = breakpoint, 2 = write watchpoint. */
+static void gdb_breakpoint(r5vm_gdb_t* g, const char* p, bool insert)
+{
+    r5vm_host_t* host = g->host;
+    char* end;
+    const int type = (int)strtol(p, &end, 10);
+    const uint32_t addr = (uint32_t)strtoul(end + 1, &end, 16);
+    const uint32_t len = (uint32_t)strtoul(end + 1, NULL, 16);
+
+    if (type == 0 || type == 1) {
+        if (insert)
+            strcpy(g->out, gdb_insert_bp(g, addr) ? "OK" : "E01");
+        else {
+            gdb_remove_bp(g, addr);
+            strcpy(g->out, "OK");
+        }
+    } else if (type == 2) {
+        if (insert) {
+            const int slot = r5vm_host_watch(host, addr, len);
+            if (slot >= 0)
+                g->watch_mask |= 1u << slot;
+            strcpy(g->out, slot >= 0 ? "OK" : "E01");
+            return;
+        }
+        for (int i = 0; i < R5VM_HOST_MAX_WATCH; i++) {
+            if ((g->watch_mask & (1u << i)) && host->watch[i].len == len &&
+                host->watch[i].addr == addr) {
+                r5vm_host_unwatch(host, i);
+                g->watch_mask &= ~(1u << i);
+                break;
+            }
+        }
+        strcpy(g->out, "OK");
+    } else {
+        g->out[0] = '\0'; /* read/access watchpoints unsupported */
+    }
+}
+
+static void gdb_query(r5vm_gdb_t* g, const char* p)
+{
+    static const char xfer[] = "qXfer:features:read:target.xml:";
+
+    if (strncmp(p, "qSupported", 10) == 0) {
+        snprintf(g->out, sizeof(g->out),
+                 "PacketSize=%x;qXfer:features:read+;swbreak+",
+                 R5VM_GDB_BUF_SIZE);
+    } else if (strncmp(p, xfer, sizeof(xfer) - 1) == 0) {
+        char* end;
+        const size_t total = sizeof(r5vm_gdb_target_xml) - 1;
+        size_t off = strtoul(p + sizeof(xfer) - 1, &end, 16);
+        size_t len = strtoul(end + 1, NULL, 16);
+        if (off > total)
+            off = total;
+        if (len > sizeof(g->out) - 2)
+            len = sizeof(g->out) - 2;
+        if (len > total - off)
+            len = total - off;
+        g->out[0] = (off + len < total) ? 'm' : 'l';
+        memcpy(g->out + 1, r5vm_gdb_target_xml + off, len);
+        g->out[1 + len] = '\0';
+    } else if (strcmp(p, "qAttached") == 0) {
+        strcpy(g->out, "1");
+    } else if (strcmp(p, "qfThreadInfo") == 0) {
+        strcpy(g->out, "m1");
+    } else if (strcmp(p, "qsThreadInfo") == 0) {
+        strcpy(g->out, "l");
+    } else if (strcmp(p, "qC") == 0) {
+        strcpy(g->out, "QC1");
+    } else if (strncmp(p, "qSymbol", 7) == 0) {
+        strcpy(g->out, "OK");
+    } else {
+        g->out[0] = '\0';
+    }
+}
+
+/** Remove all breakpoints and watchpoints set by gdb. */
+static void gdb_cleanup(r5vm_gdb_t* g)
+{
+    for (int i = 0; i < R5VM_GDB_MAX_BP; i++) {
+        if (g->bp[i].used) {
+            gdb_disarm_bp(g, i);
+            g->bp[i].used = false;
+        }
+    }
+    for (int i = 0; i < R5VM_HOST_MAX_WATCH; i++) {
+        if (g->watch_mask & (1u << i))
+            r5vm_host_unwatch(g->host, i);
+    }
+    g->watch_mask = 0;
+}
+
+/**
+ * @brief Serve packets until gdb detaches, kills or disconnects.
+ * @return `true` if the guest should keep running after a detach.
+ */
+static bool gdb_session(r5vm_gdb_t* g)
+{
+    r5vm_t* vm = &g->host->vm;
+
+    snprintf(g->stop, sizeof(g->stop), "S%02x", R5VM_GDB_SIGTRAP);
+    while (gdb_recv(g)) {
+        const char* p = g->in;
+
+        g->out[0] = '\0';
+        switch (p[0]) {
+        case '?': strcpy(g->out, g->stop); break;
+        case 'g': gdb_read_regs(g); break;
+        case 'G': gdb_write_regs(g, p + 1); break;
+        case 'm': gdb_read_mem(g, p + 1); break;
+        case 'M': gdb_write_mem(g, p + 1); break;
+        case 'p': {
+            const unsigned long r = strtoul(p + 1, NULL, 16);
+            if (r < R5VM_GDB_NUM_REGS) {
+                put_hex32(g->out, r < 32 ? vm->regs[r] : vm->pc);
+                g->out[8] = '\0';
+            } else {
+                strcpy(g->out, "E01");
+            }
+            break;
+        }
+        case 'P': {
+            char* end;
+            const unsigned long r = strtoul(p + 1, &end, 16);
+            if (*end == '=' && strlen(end + 1) >= 8 && r < R5VM_GDB_NUM_REGS) {
+                if (r == 32)
+                    vm->pc = get_hex32(end + 1) & vm->mem_mask;
+                else if (r > 0)
+                    vm->regs[r] = get_hex32(end + 1);
+                strcpy(g->out, "OK");
+            } else {
+                strcpy(g->out, "E01");
+            }
+            break;
+        }
+        case 'c':
+        case 's':
+            if (p[1])
+                vm->pc = (uint32_t)strtoul(p + 1, NULL, 16) & vm->mem_mask;
+            if (!gdb_resume(g, p[0] == 's'))
+                return false;
+            strcpy(g->out, g->stop);
+            break;
+        case 'Z':
+        case 'z':
+            gdb_breakpoint(g, p + 1, p[0] == 'Z');
+            break;
+        case 'q': gdb_query(g, p); break;
+        case 'H':
+        case 'T': strcpy(g->out, "OK"); break;
+        case 'D':
+            gdb_send(g, "OK");
+            return vm->status != R5VM_EXIT;
+        case 'k':
+            return false;
+        case 'v':
+            if (strncmp(p, "vKill", 5) == 0) {
+                gdb_send(g, "OK");
+                return false;
+            }
+            break; /* vCont, vMustReplyEmpty, ...: empty reply */
+        default:
+            break;
+        }
+        if (!gdb_send(g, g->out))
+            return false;
+    }
+    return false;
+}
+
+// ---- Functions -------------------------------------------------------------
+
+bool r5vm_gdb_serve(r5vm_host_t* host, uint16_t port)
+{
+    struct sockaddr_in addr;
+    const int one = 1;
+    r5vm_gdb_t* g;
+    int lfd;
+
+    lfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (lfd < 0) {
+        perror("socket");
+        return false;
+    }
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(lfd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(lfd, 1) != 0) {
+        perror("bind");
+        close(lfd);
+        return false;
+    }
+    fprintf(stderr, "[r5vm] waiting for gdb on 127.0.0.1:%u\n", (unsigned)port);
+    const int fd = accept(lfd, NULL, NULL);
+    close(lfd);
+    if (fd < 0) {
+        perror("accept");
+        return false;
+    }
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    g = calloc(1, sizeof(*g));
+    if (!g) {
+        close(fd);
+        return false;
+    }
+    g->host = host;
+    g->fd = fd;
+
+    r5vm_watch_fn saved_fn = host->watch_fn;
+    void* saved_user = host->user;
+    host->watch_fn = gdb_on_watch;
+    host->user = g;
+
+    const bool detached = gdb_session(g);
+
+    gdb_cleanup(g);
+    host->watch_fn = saved_fn;
+    host->user = saved_user;
+    close(fd);
+    free(g);
+
+    if (detached) {
+        fprintf(stderr, "[r5vm] gdb detached, resuming guest\n");
+        if (gdb_peek32(host, host->vm.pc) == R5VM_INSTR_EBREAK)
+            host->vm.pc = (host->vm.pc + 4) & host->vm.mem_mask;
+        do {
+            r5vm_host_run(host, 0);
+        } while (r5vm_paused(&host->vm));
+    }
+    return true;
+}
+
+#else /* _WIN32 */
+
+bool r5vm_gdb_serve(r5vm_host_t* host, uint16_t port)
+{
+    (void)host;
+    (void)port;
+    fprintf(stderr, "error: gdb stub requires a POSIX host\n");
+    return false;
+}
+
+#endif /* !_WIN32 */
@@ -0,0 +1,76 @@
+/*
+ * R5VM - Minimal RISC-V RV32I Virtual Machine
+ *       _____
+ *      | ____|
+ *  _ __| |____   ___ __ ___
+ * | '__|___ \ \ / / '_ ` _ \
+ * | |   ___) \ V /| | | | | |
+ * |_|  |____/ \_/ |_| |_| |_|
+ *
+ * Copyright (c) 2025 Jan Zwiener
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file r5vm_gdb.h
+ * @brief GDB remote serial protocol stub for R5VM.
+ *
+ * Lets `riscv64-unknown-elf-gdb` attach to a guest over a local TCP port:
+ *
+ * @code
+ * ./r5vm guest/vm.bin --gdb 1234
+ * riscv64-unknown-elf-gdb guest/vm.elf -ex "target remote :1234"
+ * @endcode
+ *
+ * Software breakpoints patch an EBREAK into guest memory, so a VM with
+ * breakpoints set runs at normal speed until one is hit; there is no
+ * per-instruction PC comparison. Write watchpoints (`watch` in gdb) use the
+ * page-protection watchpoints of `r5vm_host.h`.
+ */
+
+#ifndef R5VM_GDB_H
+#define R5VM_GDB_H
+
+#include "r5vm_host.h"
+
+// ---- Defines ---------------------------------------------------------------
+
+/** @brief Maximum number of software breakpoints. */
+#define R5VM_GDB_MAX_BP      64
+
+/** @brief Instructions executed between checks for a gdb interrupt (^C). */
+#define R5VM_GDB_SLICE       (1u << 20)
+
+// ---- Functions -------------------------------------------------------------
+
+/**
+ * @brief Wait for gdb on 127.0.0.1:`port` and serve the debug session.
+ *
+ * The VM must be initialized and reset. Returns when the guest exits, hits
+ * a fatal error, or gdb kills the session. After a detach the guest keeps
+ * running without the debugger until it halts.
+ *
+ * @param host  Host VM instance to debug.
+ * @param port  TCP port to listen on (loopback only).
+ * @return `false` if the socket could not be set up.
+ */
+bool r5vm_gdb_serve(r5vm_host_t* host, uint16_t port);
+
+#endif // R5VM_GDB_H
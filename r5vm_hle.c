@@ -0,0 +1,443 @@
+/*
+ * R5VM - Minimal RISC-V RV32I Virtual Machine
+ *       _____
+ *      | ____|
+ *  _ __| |____   ___ __ ___
+ * | '__|___ \ \ / / '_ ` _ \
+ * | |   ___) \ V /| | | | | |
+ * |_|  |____/ \_/ |_| |_| |_|
+ *
+ * Copyright (c) 2025 Jan Zwiener
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "r5vm_hle.h"
+#include "r5vm_elf.h"
+
+// ---- Helpers ---------------------------------------------------------------
+
+#define F32_CANONICAL_NAN 0x7FC00000u
+#define F64_CANONICAL_NAN 0x7FF8000000000000ull
+
+static float f32(uint32_t bits)
+{
+    float f;
+    memcpy(&f, &bits, sizeof f);
+    return f;
+}
+
+static uint32_t f32_bits(float f)
+{
+    uint32_t bits;
+    if (f != f)
+        return F32_CANONICAL_NAN;
+    memcpy(&bits, &f, sizeof bits);
+    return bits;
+}
+
+static double f64(uint32_t lo, uint32_t hi)
+{
+    const uint64_t bits = ((uint64_t)hi << 32) | lo;
+    double d;
+    memcpy(&d, &bits, sizeof d);
+    return d;
+}
+
+/** Return a 64-bit value in a0 (low) / a1 (high) */
+static void ret64(r5vm_t* vm, uint64_t v)
+{
+    vm->a0 = (uint32_t)v;
+    vm->a1 = (uint32_t)(v >> 32);
+}
+
+static void ret_f64(r5vm_t* vm, double d)
+{
+    uint64_t bits = F64_CANONICAL_NAN;
+    if (d == d)
+        memcpy(&bits, &d, sizeof bits);
+    ret64(vm, bits);
+}
+
+#define ARG64(lo, hi) (((uint64_t)(hi) << 32) | (lo))
+
+/** Compare result of the libgcc soft-float helpers */
+static uint32_t fcmp(double a, double b, int32_t unordered)
+{
+    if (a < b)  return (uint32_t)-1;
+    if (a > b)  return 1;
+    if (a == b) return 0;
+    return (uint32_t)unordered;
+}
+
+/** float -> int conversions saturate like RISC-V fcvt */
+static uint32_t to_i32(double d)
+{
+    if (d != d || d >= 2147483648.0) return 0x7FFFFFFFu;
+    if (d <= -2147483649.0)          return 0x80000000u;
+    return (uint32_t)(int32_t)d;
+}
+
+static uint32_t to_u32(double d)
+{
+    if (d != d || d >= 4294967296.0) return 0xFFFFFFFFu;
+    if (d <= -1.0)                   return 0;
+    return (uint32_t)d;
+}
+
+/** Report an invalid guest access of the native trapped at vm->pc */
+static void hle_fault(r5vm_t* vm)
+{
+    const uint8_t* p = vm->mem + vm->pc;
+    const uint32_t trap = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+    r5vm_error(vm, "HLE access out of bounds", vm->pc, trap);
+}
+
+bool r5vm_hle_range(r5vm_t* vm, uint32_t addr, uint32_t len)
+{
+    if (addr <= vm->mem_size && len <= vm->mem_size - addr)
+        return true;
+    hle_fault(vm);
+    return false;
+}
+
+/** Length of the guest string at `addr`, or -1 if unterminated */
+static int64_t guest_strlen(r5vm_t* vm, uint32_t addr)
+{
+    if (!r5vm_hle_range(vm, addr, 1))
+        return -1;
+    const uint8_t* end = memchr(vm->mem + addr, 0, vm->mem_size - addr);
+    if (!end) {
+        hle_fault(vm);
+        return -1;
+    }
+    return end - (vm->mem + addr);
+}
+
+// ---- libc natives ----------------------------------------------------------
+
+static bool hle_memcpy(r5vm_t* vm) /* also memmove */
+{
+    if (!r5vm_hle_range(vm, vm->a0, vm->a2) || !r5vm_hle_range(vm, vm->a1, vm->a2))
+        return false;
+    r5vm_write_probe(vm, vm->a0, vm->a2);
+    memmove(vm->mem + vm->a0, vm->mem + vm->a1, vm->a2);
+    vm->wr_len = 0;
+    return true;
+}
+
+static bool hle_memset(r5vm_t* vm)
+{
+    if (!r5vm_hle_range(vm, vm->a0, vm->a2))
+        return false;
+    r5vm_write_probe(vm, vm->a0, vm->a2);
+    memset(vm->mem + vm->a0, (int)(vm->a1 & 0xFF), vm->a2);
+    vm->wr_len = 0;
+    return true;
+}
+
+static bool hle_memcmp(r5vm_t* vm)
+{
+    if (!r5vm_hle_range(vm, vm->a0, vm->a2) || !r5vm_hle_range(vm, vm->a1, vm->a2))
+        return false;
+    const uint8_t* a = vm->mem + vm->a0;
+    const uint8_t* b = vm->mem + vm->a1;
+    uint32_t i = 0;
+    if (memcmp(a, b, vm->a2) != 0)
+        while (a[i] == b[i]) i++;
+    vm->a0 = i < vm->a2 ? (uint32_t)(a[i] - b[i]) : 0;
+    return true;
+}
+
+static bool hle_strlen(r5vm_t* vm)
+{
+    const int64_t len = guest_strlen(vm, vm->a0);
+    if (len < 0)
+        return false;
+    vm->a0 = (uint32_t)len;
+    return true;
+}
+
+static bool hle_strcmp(r5vm_t* vm)
+{
+    uint32_t a = vm->a0, b = vm->a1;
+    for (;;) {
+        if (!r5vm_hle_range(vm, a, 1) || !r5vm_hle_range(vm, b, 1))
+            return false;
+        const uint8_t ca = vm->mem[a++], cb = vm->mem[b++];
+        if (!ca || ca != cb) {
+            vm->a0 = (uint32_t)(ca - cb);
+            return true;
+        }
+    }
+}
+
+static bool hle_strcpy(r5vm_t* vm)
+{
+    const int64_t len = guest_strlen(vm, vm->a1);
+    if (len < 0 || !r5vm_hle_range(vm, vm->a0, (uint32_t)len + 1))
+        return false;
+    r5vm_write_probe(vm, vm->a0, (uint32_t)len + 1);
+    memmove(vm->mem + vm->a0, vm->mem + vm->a1, (size_t)len + 1);
+    vm->wr_len = 0;
+    return true;
+}
+
+// ---- libgcc integer natives ------------------------------------------------
+// Division by zero and overflow follow the RISC-V M extension results.
+
+static bool hle_mulsi3(r5vm_t* vm) { vm->a0 = vm->a0 * vm->a1; return true; }
+
+static bool hle_udivsi3(r5vm_t* vm)
+{
+    /* libgcc's div.S also returns the remainder in a1 */
+    const uint32_t a = vm->a0, b = vm->a1;
+    vm->a0 = b ? a / b : 0xFFFFFFFFu;
+    vm->a1 = b ? a % b : a;
+    return true;
+}
+
+static bool hle_umodsi3(r5vm_t* vm)
+{
+    if (vm->a1)
+        vm->a0 %= vm->a1;
+    return true;
+}
+
+static bool hle_divsi3(r5vm_t* vm)
+{
+    const int32_t a = (int32_t)vm->a0, b = (int32_t)vm->a1;
+    if (b == 0)
+        vm->a0 = 0xFFFFFFFFu;
+    else if (!(a == INT32_MIN && b == -1))
+        vm->a0 = (uint32_t)(a / b);
+    return true;
+}
+
+static bool hle_modsi3(r5vm_t* vm)
+{
+    const int32_t a = (int32_t)vm->a0, b = (int32_t)vm->a1;
+    if (b == -1)
+        vm->a0 = 0;
+    else if (b != 0)
+        vm->a0 = (uint32_t)(a % b);
+    return true;
+}
+
+static bool hle_muldi3(r5vm_t* vm)
+{
+    ret64(vm, ARG64(vm->a0, vm->a1) * ARG64(vm->a2, vm->a3));
+    return true;
+}
+
+static bool hle_udivdi3(r5vm_t* vm)
+{
+    const uint64_t a = ARG64(vm->a0, vm->a1), b = ARG64(vm->a2, vm->a3);
+    ret64(vm, b ? a / b : UINT64_MAX);
+    return true;
+}
+
+static bool hle_umoddi3(r5vm_t* vm)
+{
+    const uint64_t a = ARG64(vm->a0, vm->a1), b = ARG64(vm->a2, vm->a3);
+    ret64(vm, b ? a % b : a);
+    return true;
+}
+
+static bool hle_divdi3(r5vm_t* vm)
+{
+    const int64_t a = (int64_t)ARG64(vm->a0, vm->a1);
+    const int64_t b = (int64_t)ARG64(vm->a2, vm->a3);
+    if (b == 0)
+        ret64(vm, UINT64_MAX);
+    else if (!(a == INT64_MIN && b == -1))
+        ret64(vm, (uint64_t)(a / b));
+    return true;
+}
+
+static bool hle_moddi3(r5vm_t* vm)
+{
+    const int64_t a = (int64_t)ARG64(vm->a0, vm->a1);
+    const int64_t b = (int64_t)ARG64(vm->a2, vm->a3);
+    if (b == -1)
+        ret64(vm, 0);
+    else if (b != 0)
+        ret64(vm, (uint64_t)(a % b));
+    return true;
+}
+
+// ---- libgcc soft-float natives ---------------------------------------------
+// float arguments in a0/a1, double arguments in a0:a1 and a2:a3.
+
+#define SF_A  f32(vm->a0)
+#define SF_B  f32(vm->a1)
+#define DF_A  f64(vm->a0, vm->a1)
+#define DF_B  f64(vm->a2, vm->a3)
+
+#define HLE_SF(name, expr) \
+    static bool name(r5vm_t* vm) { vm->a0 = (expr); return true; }
+#define HLE_DF(name, expr) \
+    static bool name(r5vm_t* vm) { ret_f64(vm, (expr)); return true; }
+
+HLE_SF(hle_addsf3, f32_bits(SF_A + SF_B))
+HLE_SF(hle_subsf3, f32_bits(SF_A - SF_B))
+HLE_SF(hle_mulsf3, f32_bits(SF_A * SF_B))
+HLE_SF(hle_divsf3, f32_bits(SF_A / SF_B))
+HLE_SF(hle_eqsf2,  SF_A == SF_B ? 0 : 1)
+HLE_SF(hle_ltsf2,  fcmp(SF_A, SF_B, 1))   /* also __lesf2 */
+HLE_SF(hle_gtsf2,  fcmp(SF_A, SF_B, -1))  /* also __gesf2 */
+HLE_SF(hle_unordsf2, (SF_A != SF_A) || (SF_B != SF_B))
+HLE_SF(hle_fixsfsi,    to_i32(SF_A))
+HLE_SF(hle_fixunssfsi, to_u32(SF_A))
+HLE_SF(hle_floatsisf,   f32_bits((float)(int32_t)vm->a0))
+HLE_SF(hle_floatunsisf, f32_bits((float)vm->a0))
+HLE_SF(hle_truncdfsf2,  f32_bits((float)DF_A))
+
+HLE_DF(hle_adddf3, DF_A + DF_B)
+HLE_DF(hle_subdf3, DF_A - DF_B)
+HLE_DF(hle_muldf3, DF_A * DF_B)
+HLE_DF(hle_divdf3, DF_A / DF_B)
+HLE_SF(hle_eqdf2,  DF_A == DF_B ? 0 : 1)
+HLE_SF(hle_ltdf2,  fcmp(DF_A, DF_B, 1))   /* also __ledf2 */
+HLE_SF(hle_gtdf2,  fcmp(DF_A, DF_B, -1))  /* also __gedf2 */
+HLE_SF(hle_unorddf2, (DF_A != DF_A) || (DF_B != DF_B))
+HLE_SF(hle_fixdfsi,    to_i32(DF_A))
+HLE_SF(hle_fixunsdfsi, to_u32(DF_A))
+HLE_DF(hle_floatsidf,   (double)(int32_t)vm->a0)
+HLE_DF(hle_floatunsidf, (double)vm->a0)
+HLE_DF(hle_extendsfdf2, (double)SF_A)
+
+/** Built-in natives by guest symbol name */
+static const struct {
+    const char* name;
+    r5vm_hle_fn fn;
+} r5vm_hle_builtins[] = {
+    { "memcpy",  hle_memcpy },  { "memmove", hle_memcpy },
+    { "memset",  hle_memset },  { "memcmp",  hle_memcmp },
+    { "strlen",  hle_strlen },  { "strcmp",  hle_strcmp },
+    { "strcpy",  hle_strcpy },
+
+    { "__mulsi3",  hle_mulsi3 },  { "__divsi3",  hle_divsi3 },
+    { "__udivsi3", hle_udivsi3 }, { "__modsi3",  hle_modsi3 },
+    { "__umodsi3", hle_umodsi3 }, { "__muldi3",  hle_muldi3 },
+    { "__divdi3",  hle_divdi3 },  { "__udivdi3", hle_udivdi3 },
+    { "__moddi3",  hle_moddi3 },  { "__umoddi3", hle_umoddi3 },
+
+    { "__addsf3", hle_addsf3 }, { "__subsf3", hle_subsf3 },
+    { "__mulsf3", hle_mulsf3 }, { "__divsf3", hle_divsf3 },
+    { "__eqsf2",  hle_eqsf2 },  { "__nesf2",  hle_eqsf2 },
+    { "__ltsf2",  hle_ltsf2 },  { "__lesf2",  hle_ltsf2 },
+    { "__gtsf2",  hle_gtsf2 },  { "__gesf2",  hle_gtsf2 },
+    { "__unordsf2",   hle_unordsf2 },
+    { "__fixsfsi",    hle_fixsfsi },    { "__fixunssfsi",  hle_fixunssfsi },
+    { "__floatsisf",  hle_floatsisf },  { "__floatunsisf", hle_floatunsisf },
+    { "__truncdfsf2", hle_truncdfsf2 }, { "__extendsfdf2", hle_extendsfdf2 },
+
+    { "__adddf3", hle_adddf3 }, { "__subdf3", hle_subdf3 },
+    { "__muldf3", hle_muldf3 }, { "__divdf3", hle_divdf3 },
+    { "__eqdf2",  hle_eqdf2 },  { "__nedf2",  hle_eqdf2 },
+    { "__ltdf2",  hle_ltdf2 },  { "__ledf2",  hle_ltdf2 },
+    { "__gtdf2",  hle_gtdf2 },  { "__gedf2",  hle_gtdf2 },
+    { "__unorddf2",   hle_unorddf2 },
+    { "__fixdfsi",    hle_fixdfsi },    { "__fixunsdfsi",  hle_fixunsdfsi },
+    { "__floatsidf",  hle_floatsidf },  { "__floatunsidf", hle_floatunsidf },
+};
+
+// ---- Functions -------------------------------------------------------------
+
+void r5vm_hle_init(r5vm_hle_t* hle, r5vm_t* vm)
+{
+    memset(hle, 0, sizeof(*hle));
+    vm->hle = hle->fn;
+    vm->hle_count = 0;
+}
+
+int r5vm_hle_bind(r5vm_hle_t* hle, r5vm_t* vm, uint32_t addr, r5vm_hle_fn fn)
+{
+    if (!fn || (addr & 3) || addr > vm->mem_size - 4)
+        return -1;
+    for (uint32_t i = 0; i < hle->count; i++) {
+        if (hle->addr[i] == addr) {
+            hle->fn[i] = fn;
+            return (int)i;
+        }
+    }
+    if (hle->count >= R5VM_HLE_MAX)
+        return -1;
+
+    const uint32_t n = hle->count;
+    const uint32_t trap = R5VM_INSTR_HLE(n);
+    memcpy(&hle->orig[n], vm->mem + addr, 4);
+    vm->mem[addr + 0] = (uint8_t)(trap);
+    vm->mem[addr + 1] = (uint8_t)(trap >> 8);
+    vm->mem[addr + 2] = (uint8_t)(trap >> 16);
+    vm->mem[addr + 3] = (uint8_t)(trap >> 24);
+    hle->fn[n] = fn;
+    hle->addr[n] = addr;
+    hle->count = n + 1;
+    vm->hle = hle->fn;
+    vm->hle_count = hle->count;
+    return (int)n;
+}
+
+int r5vm_hle_bind_symbol(r5vm_hle_t* hle, r5vm_t* vm, const uint8_t* elf,
+                         size_t elf_size, const char* name, r5vm_hle_fn fn)
+{
+    uint32_t addr;
+    if (!r5vm_elf_lookup(elf, elf_size, name, &addr))
+        return -1;
+    return r5vm_hle_bind(hle, vm, addr, fn);
+}
+
+r5vm_hle_fn r5vm_hle_builtin(const char* name)
+{
+    for (size_t i = 0; i < sizeof(r5vm_hle_builtins) / sizeof(r5vm_hle_builtins[0]); i++) {
+        if (strcmp(r5vm_hle_builtins[i].name, name) == 0)
+            return r5vm_hle_builtins[i].fn;
+    }
+    return NULL;
+}
+
+typedef struct hle_bind_ctx_s
+{
+    r5vm_hle_t* hle;
+    r5vm_t*     vm;
+    int         bound;
+} hle_bind_ctx_t;
+
+static void hle_bind_cb(void* user, const char* name, uint32_t addr,
+                        uint32_t size)
+{
+    hle_bind_ctx_t* ctx = user;
+    r5vm_hle_fn fn = r5vm_hle_builtin(name);
+    (void)size;
+    if (fn && r5vm_hle_bind(ctx->hle, ctx->vm, addr, fn) >= 0)
+        ctx->bound++;
+}
+
+int r5vm_hle_bind_builtins(r5vm_hle_t* hle, r5vm_t* vm, const uint8_t* elf,
+                           size_t elf_size)
+{
+    hle_bind_ctx_t ctx = { hle, vm, 0 };
+    if (!r5vm_elf_functions(elf, elf_size, hle_bind_cb, &ctx))
+        return -1;
+    return ctx.bound;
+}
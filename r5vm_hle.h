@@ -0,0 +1,143 @@
+/*
+ * R5VM - Minimal RISC-V RV32I Virtual Machine
+ *       _____
+ *      | ____|
+ *  _ __| |____   ___ __ ___
+ * | '__|___ \ \ / / '_ ` _ \
+ * | |   ___) \ V /| | | | | |
+ * |_|  |____/ \_/ |_| |_| |_|
+ *
+ * Copyright (c) 2025 Jan Zwiener
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file r5vm_hle.h
+ * @brief High-level emulation: replace guest functions with host natives.
+ *
+ * Hot library routines (`memcpy`, `strlen`, libgcc's `__muldi3`, the
+ * soft-float helpers, ...) cost many interpreted instructions per call. A
+ * binding patches an HLE trap (`R5VM_INSTR_HLE(n)`, custom-0 opcode) over
+ * the first instruction of the guest function. When the guest calls it, the
+ * VM runs the host native with the guest ABI (arguments in `a0`..`a7`,
+ * results in `a0`/`a1`) and continues at `ra`. The guest body is never
+ * interpreted.
+ *
+ * @code
+ * static r5vm_hle_t hle;
+ * r5vm_hle_init(&hle, &vm);
+ * r5vm_hle_bind_builtins(&hle, &vm, elf, elf_size); // by symbol name
+ * r5vm_hle_bind(&hle, &vm, 0x1234, my_native);      // by address
+ * @endcode
+ *
+ * The trap replaces the whole function: every jump to its entry, including
+ * a fall-through or tail call, runs the native. Natives must only touch guest
+ * memory after checking the range, see r5vm_hle_range(), and announce writes
+ * with r5vm_write_probe() so watchpoints, the stack guard and read-only
+ * mappings of r5vm_host_run() apply to them. Bind after loading
+ * the image and before adding watchpoints, since bindings write to guest
+ * memory directly.
+ */
+
+#ifndef R5VM_HLE_H
+#define R5VM_HLE_H
+
+#include "r5vm.h"
+
+// ---- Defines ---------------------------------------------------------------
+
+/** @brief Maximum number of bound functions per VM. */
+#define R5VM_HLE_MAX  64
+
+// ---- HLE data structure ----------------------------------------------------
+
+/**
+ * @brief Bindings of one VM. Attached to the VM by r5vm_hle_init(), must
+ *        outlive it.
+ */
+typedef struct r5vm_hle_s
+{
+    r5vm_hle_fn fn[R5VM_HLE_MAX];   /**< Host natives, indexed by trap number */
+    uint32_t    addr[R5VM_HLE_MAX]; /**< Guest address of each bound function */
+    uint32_t    orig[R5VM_HLE_MAX]; /**< Instruction replaced by the trap */
+    uint32_t    count;              /**< Number of used slots */
+} r5vm_hle_t;
+
+// ---- Functions -------------------------------------------------------------
+
+/**
+ * @brief Clear `hle` and attach it to `vm`.
+ *
+ * @param hle  Binding table.
+ * @param vm   Initialized VM (see r5vm_init()).
+ */
+void r5vm_hle_init(r5vm_hle_t* hle, r5vm_t* vm);
+
+/**
+ * @brief Replace the guest function at `addr` with host native `fn`.
+ *
+ * Binding an address twice replaces the native.
+ *
+ * @param hle   Binding table attached to `vm`.
+ * @param vm    VM with the program image loaded.
+ * @param addr  Guest address of the function entry (4-byte aligned).
+ * @param fn    Host native.
+ * @return Trap number (>= 0), or -1 if `addr` is invalid or the table is full.
+ */
+int r5vm_hle_bind(r5vm_hle_t* hle, r5vm_t* vm, uint32_t addr, r5vm_hle_fn fn);
+
+/**
+ * @brief Bind `fn` to the function named `name` in the program's ELF file.
+ *
+ * @return Trap number (>= 0), or -1 if the symbol is missing or binding fails.
+ */
+int r5vm_hle_bind_symbol(r5vm_hle_t* hle, r5vm_t* vm, const uint8_t* elf,
+                         size_t elf_size, const char* name, r5vm_hle_fn fn);
+
+/**
+ * @brief Bind every built-in native whose symbol is defined in the ELF file.
+ *
+ * Built-ins cover `memcpy`, `memmove`, `memset`, `memcmp`, `strlen`,
+ * `strcmp`, `strcpy`, the libgcc integer multiply/divide helpers and the
+ * single/double precision soft-float arithmetic, compare and conversion
+ * helpers. Float results follow IEEE 754 round-to-nearest with canonical
+ * NaNs, like the RISC-V soft-float library.
+ *
+ * @return Number of functions bound, or -1 if `elf` has no symbol table.
+ */
+int r5vm_hle_bind_builtins(r5vm_hle_t* hle, r5vm_t* vm, const uint8_t* elf,
+                           size_t elf_size);
+
+/**
+ * @brief Built-in native for the guest symbol `name`, or NULL.
+ */
+r5vm_hle_fn r5vm_hle_builtin(const char* name);
+
+/**
+ * @brief Check that a native may access `[addr, addr + len)`.
+ *
+ * Reports "HLE access out of bounds" via `r5vm_error()` if not. Natives
+ * return `false` in that case to halt the VM.
+ *
+ * @return `true` if the range lies in guest memory.
+ */
+bool r5vm_hle_range(r5vm_t* vm, uint32_t addr, uint32_t len);
+
+#endif // R5VM_HLE_H
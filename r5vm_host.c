@@ -0,0 +1,960 @@
+/*
+ * R5VM - Minimal RISC-V RV32I Virtual Machine
+ *       _____
+ *      | ____|
+ *  _ __| |____   ___ __ ___
+ * | '__|___ \ \ / / '_ ` _ \
+ * | |   ___) \ V /| | | | | |
+ * |_|  |____/ \_/ |_| |_| |_|
+ *
+ * Copyright (c) 2025 Jan Zwiener
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#if !defined(_WIN32)
+#define _DEFAULT_SOURCE   /* MAP_ANONYMOUS, sigsetjmp on glibc */
+#define _DARWIN_C_SOURCE  /* MAP_ANON on macOS */
+#endif
+#if defined(__linux__)
+#define _GNU_SOURCE       /* mremap */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <errno.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#endif
+
+#include "r5vm_host.h"
+
+// ---- Macros ---------------------------------------------------------------
+
+#define IS_POWER_OF_TWO(n)  ((n) != 0 && ((n) & ((n) - 1)) == 0)
+
+#define R5VM_HOST_SLICE     1024u /**< Steps per r5vm_run() under the fault handler */
+
+// ---- Fault handling --------------------------------------------------------
+
+#if !defined(_WIN32)
+
+/** Per-thread context of the VM currently executing in r5vm_host_run(). */
+typedef struct r5vm_host_ctx_s
+{
+    r5vm_host_t* host;       /**< VM running on this thread */
+    sigjmp_buf   env;        /**< Resume point after a guest fault */
+    uint32_t     fault_addr; /**< Guest address of the last fault */
+    unsigned     slice;      /**< Steps per r5vm_run(), see r5vm_host_run_guarded() */
+} r5vm_host_ctx_t;
+
+static __thread r5vm_host_ctx_t* g_ctx;
+static struct sigaction g_old_segv;
+static struct sigaction g_old_bus;
+static volatile sig_atomic_t g_installed;
+
+/**
+ * @brief SIGSEGV/SIGBUS handler.
+ *
+ * Faults inside the guest memory mapping of the VM running on this thread
+ * jump back into r5vm_host_run(). Any other fault restores the previous
+ * handler and returns, so the faulting host instruction re-raises the
+ * signal with the original disposition.
+ */
+static void r5vm_host_signal(int sig, siginfo_t* si, void* uctx)
+{
+    r5vm_host_ctx_t* ctx = g_ctx;
+    const uint8_t* addr = (const uint8_t*)si->si_addr;
+    (void)uctx;
+
+    if (ctx && addr >= ctx->host->map &&
+        addr < ctx->host->map + ctx->host->map_size) {
+        ctx->fault_addr = (uint32_t)(addr - ctx->host->map);
+        siglongjmp(ctx->env, 1);
+    }
+    sigaction(sig, sig == SIGBUS ? &g_old_bus : &g_old_segv, NULL);
+}
+
+static void r5vm_host_install_handler(void)
+{
+    struct sigaction sa;
+
+    if (g_installed)
+        return;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = r5vm_host_signal;
+    sa.sa_flags = SA_SIGINFO;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGSEGV, &sa, &g_old_segv);
+    sigaction(SIGBUS, &sa, &g_old_bus);
+    g_installed = 1;
+}
+
+/** Index of the read-only file mapping overlapping `[addr, addr + len)`, or -1. */
+static int r5vm_host_readonly_file(const r5vm_host_t* host, uint32_t addr,
+                                   uint32_t len)
+{
+    for (int i = 0; i < R5VM_HOST_MAX_MAPS; i++) {
+        const r5vm_file_map_t* f = &host->files[i];
+        if (f->len && !f->writable && addr < f->addr + f->len &&
+            addr + len > f->addr)
+            return i;
+    }
+    return -1;
+}
+
+/** Set the protection of all pages overlapping `[addr, addr + len)`. */
+static void r5vm_host_protect(r5vm_host_t* host, uint32_t addr, uint32_t len,
+                              int prot)
+{
+    const uint32_t page = (uint32_t)r5vm_host_page_size();
+    uint32_t p = addr & ~(page - 1);
+
+    for (; p < addr + len && p < host->vm.mem_size; p += page) {
+        if (p >= host->guard_lo && p < host->guard_hi)
+            continue; /* the stack guard stays inaccessible */
+        if (r5vm_host_readonly_file(host, p, page) >= 0)
+            continue; /* read-only file mappings stay read-only */
+        mprotect(host->map + p, page, prot);
+    }
+}
+
+/** Sleep until r5vm_host_wake() or for at most `idle_ms` */
+static void r5vm_host_idle_wait(r5vm_host_t* host)
+{
+    struct timeval now;
+    struct timespec until;
+
+    gettimeofday(&now, NULL);
+    const uint64_t ns = (uint64_t)now.tv_usec * 1000u +
+                        (uint64_t)host->idle_ms * 1000000u;
+    until.tv_sec = now.tv_sec + (time_t)(ns / 1000000000u);
+    until.tv_nsec = (long)(ns % 1000000000u);
+
+    pthread_mutex_lock(&host->idle_lock);
+    while (!host->idle_wakes) {
+        if (pthread_cond_timedwait(&host->idle_cond, &host->idle_lock, &until) != 0)
+            break; /* timeout */
+    }
+    host->idle_wakes = 0;
+    pthread_mutex_unlock(&host->idle_lock);
+}
+
+/** ECALLs implemented by the host layer */
+static bool r5vm_host_ecall(r5vm_t* vm, uint32_t id)
+{
+    r5vm_host_t* host = (r5vm_host_t*)vm; /* vm is the first member */
+
+    if (id == R5VM_ECALL_MAP_INFO) {
+        const r5vm_file_map_t* f = vm->a0 < R5VM_HOST_MAX_MAPS ?
+                                   &host->files[vm->a0] : NULL;
+        vm->a0 = f && f->len ? f->addr : 0;
+        vm->a1 = f && f->len ? f->file_size : 0;
+        return true;
+    }
+    if (id == R5VM_ECALL_CHECKPOINT) {
+        /* the job input is stdin; a fork server connects it to a client */
+        uint8_t buf[4096];
+        uint32_t n = 0;
+        while (n < vm->a1) {
+            const uint32_t chunk = vm->a1 - n < sizeof(buf) ?
+                                   vm->a1 - n : (uint32_t)sizeof(buf);
+            const ssize_t got = read(STDIN_FILENO, buf, chunk);
+            if (got < 0 && errno == EINTR)
+                continue;
+            if (got <= 0)
+                break;
+            if (!r5vm_host_write(host, vm->a0 + n, buf, (uint32_t)got)) {
+                r5vm_error(vm, "ECALL memory out of bounds", (vm->pc - 4) & vm->mem_mask, id);
+                return false;
+            }
+            n += (uint32_t)got;
+        }
+        vm->a0 = n;
+        return true;
+    }
+    if (id == R5VM_ECALL_RESPOND) {
+        /* single runs print the result and stop like an exit with code 0 */
+        if (vm->a1 && !r5vm_host_readable(host, vm, vm->a0, vm->a1)) {
+            r5vm_error(vm, "ECALL memory out of bounds", (vm->pc - 4) & vm->mem_mask, id);
+            return false;
+        }
+        fwrite(vm->mem + vm->a0, 1, vm->a1, vm->out ? vm->out : stdout);
+        fflush(vm->out ? vm->out : stdout);
+        vm->a0 = 0;
+        vm->status = R5VM_EXIT;
+        return false;
+    }
+    r5vm_error(vm, "Unknown ECALL", (vm->pc - 4) & vm->mem_mask, id);
+    return false;
+}
+
+/** Write-protect the pages of all active watchpoints. */
+static void r5vm_host_protect_watches(r5vm_host_t* host)
+{
+    for (int i = 0; i < R5VM_HOST_MAX_WATCH; i++) {
+        if (host->watch[i].len) {
+            r5vm_host_protect(host, host->watch[i].addr, host->watch[i].len,
+                              PROT_READ);
+        }
+    }
+}
+
+/** Check if `addr` lies on a page covered by a watchpoint. */
+static bool r5vm_host_watched_page(const r5vm_host_t* host, uint32_t addr)
+{
+    const uint32_t mask = ~((uint32_t)r5vm_host_page_size() - 1);
+
+    for (int i = 0; i < R5VM_HOST_MAX_WATCH; i++) {
+        const r5vm_watch_t* w = &host->watch[i];
+        if (w->len && (addr & mask) >= (w->addr & mask) &&
+            (addr & mask) <= ((w->addr + w->len - 1) & mask))
+            return true;
+    }
+    return false;
+}
+
+/** Load up to 4 bytes little-endian from guest memory. */
+static uint32_t r5vm_host_peek(const r5vm_t* vm, uint32_t addr, uint32_t len)
+{
+    uint32_t val = 0;
+    for (uint32_t i = 0; i < len; i++)
+        val |= (uint32_t)vm->mem[(addr + i) & vm->mem_mask] << (8 * i);
+    return val;
+}
+
+/**
+ * Run the guest until it stops or faults on a protected page. Adds the
+ * completed instructions to `*steps`, returns `false` after a fault.
+ *
+ * r5vm_run() keeps its step count in a register, out of reach of the
+ * signal handler. The guest therefore runs in slices, and a fault charges
+ * its slice as if every step before the faulting one completed: step
+ * budgets hold, the count may run ahead by less than a slice per fault.
+ * Slices start at one step, again after each fault, and double up to
+ * R5VM_HOST_SLICE, which keeps the error small for guests that trap often.
+ */
+static bool r5vm_host_run_guarded(r5vm_host_ctx_t* ctx, unsigned max_steps,
+                                  unsigned* steps)
+{
+    r5vm_t* vm = &ctx->host->vm;
+    volatile unsigned done = 0;  /* steps of the completed slices */
+    volatile unsigned slice = 0; /* slice in progress */
+
+    if (sigsetjmp(ctx->env, 1) != 0) {
+        *steps += done + slice - 1;
+        ctx->slice = 1;
+        return false;
+    }
+    for (;;) {
+        const unsigned left = max_steps ? max_steps - done : ctx->slice;
+        slice = left < ctx->slice ? left : ctx->slice;
+        const unsigned ran = r5vm_run(vm, slice);
+        done += ran;
+        if (ctx->slice < R5VM_HOST_SLICE)
+            ctx->slice *= 2;
+        if (ran < slice || vm->status != R5VM_RUNNING || done == max_steps)
+            break;
+    }
+    *steps += done;
+    return true;
+}
+
+/**
+ * @brief Handle a guest access to a protected page.
+ *
+ * Watchpoint traps single-step the faulting store, or the ECALL or HLE
+ * native of a bulk write announced by r5vm_write_probe(), with its pages
+ * unlocked and compare the written range against all watchpoints.
+ * Everything else is fatal and reported via r5vm_error().
+ *
+ * The faulting instruction has already advanced `pc` unless the fault
+ * happened while fetching the instruction itself or inside a bulk ECALL or
+ * HLE native (`vm->in_native`), which hold `pc` at the ECALL or native.
+ * Those report faults on their source like their own.
+ * The re-executed step runs under the fault handler as well; a fault in it
+ * (`nested`) is reported, e.g. a bulk copy that also reads the guard.
+ *
+ * @return `true` if execution can resume, `false` to stop the VM.
+ */
+static bool r5vm_host_service_fault(r5vm_host_ctx_t* ctx, bool nested)
+{
+    r5vm_host_t* host = ctx->host;
+    r5vm_t* vm = &host->vm;
+    const uint32_t addr = ctx->fault_addr;
+    uint32_t pc = vm->pc;
+    uint32_t instr = 0;
+    uint32_t st_addr = vm->wr_addr;
+    uint32_t st_len = vm->wr_len;
+    const bool held = vm->in_native != 0;
+    const bool bulk = st_len && addr - st_addr < st_len;
+    const bool fetch = !held && ((addr - pc) & vm->mem_mask) < 4;
+
+    vm->wr_len = 0;
+    vm->in_native = 0;
+    if (!fetch) {
+        if (!held)
+            pc = (pc - 4) & vm->mem_mask;
+        instr = r5vm_host_peek(vm, pc, 4);
+    }
+    vm->status = R5VM_ERROR;
+    if (addr >= host->guard_lo && addr < host->guard_hi) {
+        r5vm_error(vm, "Stack overflow", pc, instr);
+        return false;
+    }
+    /* watched pages are read-only, so only stores (opcode 0x23) trap */
+    if (fetch || (!bulk && (instr & 0x7F) != 0x23)) {
+        r5vm_error(vm, "Memory protection fault", pc, instr);
+        return false;
+    }
+    if (!bulk) {
+        const uint32_t imm = (uint32_t)((int32_t)(instr & 0xFE000000) >> 20) |
+                             ((instr >> 7) & 0x1F);
+        st_addr = (vm->regs[(instr >> 15) & 0x1F] + imm) & vm->mem_mask;
+        st_len = 1u << ((instr >> 12) & 0x3);
+    }
+    /* a bulk write stopped at a watch may still run into the guard later */
+    if (st_addr < host->guard_hi && st_addr + st_len > host->guard_lo) {
+        r5vm_error(vm, "Stack overflow", pc, instr);
+        return false;
+    }
+    if (r5vm_host_readonly_file(host, st_addr, st_len) >= 0) {
+        r5vm_error(vm, "Write to read-only mapping", pc, instr);
+        return false;
+    }
+    if (nested || !r5vm_host_watched_page(host, addr)) {
+        r5vm_error(vm, "Memory protection fault", pc, instr);
+        return false;
+    }
+
+    /* first watch hit: a store reports itself, a bulk write the overlap */
+    uint32_t hit_addr = 0, hit_len = 0, old_val = 0;
+    for (int i = 0; i < R5VM_HOST_MAX_WATCH && !hit_len; i++) {
+        const r5vm_watch_t* w = &host->watch[i];
+        if (!w->len || st_addr >= w->addr + w->len || st_addr + st_len <= w->addr)
+            continue;
+        hit_addr = st_addr;
+        hit_len = st_len;
+        if (bulk) {
+            const uint32_t end = st_addr + st_len < w->addr + w->len ?
+                                 st_addr + st_len : w->addr + w->len;
+            hit_addr = st_addr > w->addr ? st_addr : w->addr;
+            hit_len = end - hit_addr;
+        }
+        old_val = r5vm_host_peek(vm, hit_addr, hit_len < 4 ? hit_len : 4);
+    }
+
+    /* re-execute the instruction with the written pages unlocked */
+    vm->pc = pc;
+    r5vm_host_protect(host, st_addr, st_len, PROT_READ | PROT_WRITE);
+    unsigned stepped = 0;
+    const bool clean = r5vm_host_run_guarded(ctx, 1, &stepped);
+    r5vm_host_protect_watches(host);
+    if (!clean)
+        return r5vm_host_service_fault(ctx, true);
+    if (!stepped)
+        return false;
+    if (!hit_len)
+        return true;
+
+    if (!host->watch_fn) {
+        vm->status = R5VM_ERROR;
+        r5vm_error(vm, "Watchpoint hit", pc, instr);
+        return false;
+    }
+    if (!host->watch_fn(host, pc, hit_addr, hit_len, old_val)) {
+        vm->status = R5VM_BREAK;
+        return false;
+    }
+    return true;
+}
+
+#endif /* !_WIN32 */
+
+// ---- Functions -------------------------------------------------------------
+
+size_t r5vm_host_page_size(void)
+{
+#if !defined(_WIN32)
+    long ps = sysconf(_SC_PAGESIZE);
+    return ps > 0 ? (size_t)ps : 4096;
+#else
+    return 4096;
+#endif
+}
+
+bool r5vm_host_init(r5vm_host_t* host, uint32_t mem_size)
+{
+    if (!host)
+        return false;
+    memset(host, 0, sizeof(*host));
+    if (!IS_POWER_OF_TWO(mem_size))
+        return false;
+
+    /* round up to full pages, guest accesses stay below mem_size */
+    const size_t page = r5vm_host_page_size();
+    const size_t map_size = (mem_size + page - 1) & ~(page - 1);
+#if !defined(_WIN32)
+    void* map = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED)
+        return false;
+#else
+    void* map = calloc(map_size, 1);
+    if (!map)
+        return false;
+#endif
+    host->map = map;
+    host->map_size = map_size;
+#if !defined(_WIN32)
+    pthread_mutex_init(&host->idle_lock, NULL);
+    pthread_cond_init(&host->idle_cond, NULL);
+#endif
+    if (!r5vm_init(&host->vm, host->map, mem_size)) {
+        r5vm_host_destroy(host);
+        return false;
+    }
+#if !defined(_WIN32)
+    host->vm.ecall_fn = r5vm_host_ecall;
+#endif
+    return true;
+}
+
+void r5vm_host_destroy(r5vm_host_t* host)
+{
+    if (!host)
+        return;
+    r5vm_destroy(&host->vm);
+    if (host->map) {
+#if !defined(_WIN32)
+        munmap(host->map, host->map_size);
+        pthread_cond_destroy(&host->idle_cond);
+        pthread_mutex_destroy(&host->idle_lock);
+#else
+        free(host->map);
+#endif
+    }
+    memset(host, 0, sizeof(*host));
+}
+
+bool r5vm_host_copy(r5vm_host_t* dst, const r5vm_host_t* src)
+{
+    if (dst->vm.mem_size != src->vm.mem_size)
+        return false;
+    for (int i = 0; i < R5VM_HOST_MAX_MAPS; i++) {
+        if (dst->files[i].len)
+            return false;
+    }
+    for (int i = 0; i < R5VM_HOST_MAX_WATCH; i++) {
+        if (dst->watch[i].len)
+            return false;
+    }
+    if (dst->guard_lo != src->guard_lo || dst->guard_hi != src->guard_hi) {
+        if (src->guard_hi > src->guard_lo) {
+            if (!r5vm_host_stack_guard(dst, src->guard_hi))
+                return false;
+        } else {
+#if !defined(_WIN32)
+            mprotect(dst->map + dst->guard_lo, dst->guard_hi - dst->guard_lo,
+                     PROT_READ | PROT_WRITE);
+#endif
+            dst->guard_lo = dst->guard_hi = 0;
+        }
+    }
+    /* the guard is inaccessible in both VMs */
+    memcpy(dst->map, src->map, src->guard_lo);
+    memcpy(dst->map + src->guard_hi, src->map + src->guard_hi,
+           src->vm.mem_size - src->guard_hi);
+
+    memcpy(dst->vm.regs, src->vm.regs, sizeof(dst->vm.regs));
+    dst->vm.pc = src->vm.pc;
+    dst->vm.status = src->vm.status;
+    dst->vm.hle = src->vm.hle;
+    dst->vm.hle_count = src->vm.hle_count;
+    return true;
+}
+
+bool r5vm_host_recycle(r5vm_host_t* host)
+{
+    if (!host->map)
+        return false;
+    for (int i = 0; i < R5VM_HOST_MAX_WATCH; i++)
+        r5vm_host_unwatch(host, i);
+    for (int i = 0; i < R5VM_HOST_MAX_MAPS; i++)
+        r5vm_host_unmap_file(host, i);
+#if !defined(_WIN32)
+    if (host->guard_hi > host->guard_lo) {
+        mprotect(host->map + host->guard_lo, host->guard_hi - host->guard_lo,
+                 PROT_READ | PROT_WRITE);
+    }
+#endif
+    host->guard_lo = host->guard_hi = 0;
+#if defined(__linux__)
+    /* lazy scrub: the kernel hands out zero pages on the next touch. Pages
+       shared from a file would read as the file again, replace those. */
+    if (host->shared) {
+        if (mmap(host->map, host->map_size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED)
+            return false;
+        host->shared = false;
+    } else if (madvise(host->map, host->map_size, MADV_DONTNEED) != 0)
+#endif
+        memset(host->map, 0, host->map_size);
+
+    host->watch_fn = NULL;
+    host->idle_wakes = 0;
+    host->idle_ms = 0;
+    host->user = NULL;
+    host->mem_limit = 0;
+    host->charged = 0;
+    host->charged_peak = 0;
+    host->denied = 0;
+    r5vm_init(&host->vm, host->map, host->vm.mem_size);
+#if !defined(_WIN32)
+    host->vm.ecall_fn = r5vm_host_ecall;
+#endif
+    return true;
+}
+
+bool r5vm_host_stack_guard(r5vm_host_t* host, uint32_t stack_limit)
+{
+#if !defined(_WIN32)
+    const size_t page = r5vm_host_page_size();
+    const uint32_t hi = stack_limit & ~(uint32_t)(page - 1);
+
+    if (hi < page || hi > host->vm.mem_size)
+        return false;
+    for (int i = 0; i < R5VM_HOST_MAX_MAPS; i++) {
+        const r5vm_file_map_t* f = &host->files[i];
+        if (f->len && hi - page < f->addr + f->len && hi > f->addr)
+            return false; /* the guard would drop file pages */
+    }
+    if (host->guard_hi > host->guard_lo) { /* move an existing guard */
+        mprotect(host->map + host->guard_lo,
+                 host->guard_hi - host->guard_lo, PROT_READ | PROT_WRITE);
+    }
+    if (mprotect(host->map + hi - page, page, PROT_NONE) != 0)
+        return false;
+    host->guard_lo = hi - (uint32_t)page;
+    host->guard_hi = hi;
+    return true;
+#else
+    (void)host;
+    (void)stack_limit;
+    return false; /* not supported without mmap/mprotect */
+#endif
+}
+
+int r5vm_host_watch(r5vm_host_t* host, uint32_t addr, uint32_t len)
+{
+#if !defined(_WIN32)
+    const uint32_t page = (uint32_t)r5vm_host_page_size();
+    if (!len || addr >= host->vm.mem_size || len > host->vm.mem_size - addr)
+        return -1;
+    /* watched pages are unlocked to single-step stores */
+    const uint32_t lo = addr & ~(page - 1);
+    if (r5vm_host_readonly_file(host, lo, ((addr + len - lo) + page - 1) & ~(page - 1)) >= 0)
+        return -1;
+    for (int i = 0; i < R5VM_HOST_MAX_WATCH; i++) {
+        if (host->watch[i].len == 0) {
+            host->watch[i].addr = addr;
+            host->watch[i].len = len;
+            r5vm_host_protect(host, addr, len, PROT_READ);
+            return i;
+        }
+    }
+#else
+    (void)host;
+    (void)addr;
+    (void)len;
+#endif
+    return -1;
+}
+
+void r5vm_host_unwatch(r5vm_host_t* host, int slot)
+{
+#if !defined(_WIN32)
+    if (slot < 0 || slot >= R5VM_HOST_MAX_WATCH || !host->watch[slot].len)
+        return;
+    r5vm_host_protect(host, host->watch[slot].addr, host->watch[slot].len,
+                      PROT_READ | PROT_WRITE);
+    host->watch[slot].len = 0;
+    r5vm_host_protect_watches(host); /* pages shared with other watches */
+#else
+    (void)host;
+    (void)slot;
+#endif
+}
+
+bool r5vm_host_write(r5vm_host_t* host, uint32_t addr, const void* src,
+                     uint32_t len)
+{
+    if (addr >= host->vm.mem_size || len > host->vm.mem_size - addr)
+        return false;
+    if (addr < host->guard_hi && addr + len > host->guard_lo)
+        return false;
+#if !defined(_WIN32)
+    if (r5vm_host_readonly_file(host, addr, len) >= 0)
+        return false;
+    bool watched = false;
+    for (int i = 0; i < R5VM_HOST_MAX_WATCH; i++)
+        watched |= host->watch[i].len != 0;
+    if (!watched) { /* nothing is write-protected, skip the mprotect() calls */
+        memcpy(host->map + addr, src, len);
+        return true;
+    }
+    r5vm_host_protect(host, addr, len, PROT_READ | PROT_WRITE);
+    memcpy(host->map + addr, src, len);
+    r5vm_host_protect_watches(host);
+#else
+    memcpy(host->map + addr, src, len);
+#endif
+    return true;
+}
+
+bool r5vm_host_readable(const r5vm_host_t* host, const r5vm_t* vm,
+                        uint32_t addr, uint32_t len)
+{
+    if (addr >= vm->mem_size || len > vm->mem_size - addr)
+        return false;
+    return !host || addr >= host->guard_hi || addr + len <= host->guard_lo;
+}
+
+const r5vm_host_t* r5vm_host_active(const r5vm_t* vm)
+{
+#if !defined(_WIN32)
+    return g_ctx && &g_ctx->host->vm == vm ? g_ctx->host : NULL;
+#else
+    (void)vm;
+    return NULL;
+#endif
+}
+
+#if !defined(_WIN32)
+/**
+ * `true` if `[addr, addr + len)` is page aligned, inside the mapping and
+ * plain guest memory: no stack guard, watchpoint or file mapping.
+ */
+static bool host_plain_pages(const r5vm_host_t* host, uint32_t addr, uint32_t len)
+{
+    const uint32_t page = (uint32_t)r5vm_host_page_size();
+
+    if ((addr & (page - 1)) || len == 0 || (uint64_t)addr + len > host->map_size)
+        return false;
+    bool overlap = addr < host->guard_hi && addr + len > host->guard_lo;
+    for (int i = 0; i < R5VM_HOST_MAX_MAPS; i++) {
+        const r5vm_file_map_t* f = &host->files[i];
+        overlap |= f->len && addr < f->addr + f->len && addr + len > f->addr;
+    }
+    for (int i = 0; i < R5VM_HOST_MAX_WATCH; i++) {
+        const r5vm_watch_t* w = &host->watch[i];
+        overlap |= w->len && addr < w->addr + w->len && addr + len > w->addr;
+    }
+    return !overlap;
+}
+
+/** Map `fd` over the guest window `[addr, addr + len)`, `len` in pages */
+static int host_map_fd(r5vm_host_t* host, int fd, uint32_t addr, uint32_t len,
+                       int prot, int flags)
+{
+    int slot = -1;
+
+    for (int i = 0; i < R5VM_HOST_MAX_MAPS && slot < 0; i++) {
+        if (!host->files[i].len)
+            slot = i;
+    }
+    if (slot < 0 || !host_plain_pages(host, addr, len))
+        return -1;
+
+    void* p = mmap(host->map + addr, len, prot, flags | MAP_FIXED, fd, 0);
+    if (p == MAP_FAILED) {
+        /* MAP_FIXED may have dropped the old pages, restore zero pages */
+        mmap(host->map + addr, len, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+        return -1;
+    }
+    host->files[slot].addr = addr;
+    host->files[slot].len = len;
+    host->files[slot].file_size = len;
+    host->files[slot].writable = (prot & PROT_WRITE) != 0;
+    host->files[slot].shared = (flags & MAP_SHARED) != 0;
+    return slot;
+}
+#endif
+
+int r5vm_host_map_file(r5vm_host_t* host, const char* path, uint32_t addr,
+                       bool writable)
+{
+#if !defined(_WIN32)
+    const uint32_t page = (uint32_t)r5vm_host_page_size();
+    struct stat st;
+
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0 ||
+        (uint64_t)st.st_size > host->vm.mem_size - (uint64_t)addr) {
+        close(fd);
+        return -1;
+    }
+    const uint32_t file_size = (uint32_t)st.st_size;
+    const uint32_t len = (file_size + page - 1) & ~(page - 1);
+    const int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    const int slot = host_map_fd(host, fd, addr, len, prot, MAP_PRIVATE);
+    close(fd);
+    if (slot >= 0)
+        host->files[slot].file_size = file_size;
+    return slot;
+#else
+    (void)host;
+    (void)path;
+    (void)addr;
+    (void)writable;
+    return -1; /* not supported without mmap */
+#endif
+}
+
+int r5vm_host_map_shared(r5vm_host_t* host, int fd, uint32_t addr,
+                         uint32_t len)
+{
+#if !defined(_WIN32)
+    const uint32_t page = (uint32_t)r5vm_host_page_size();
+    if (len > UINT32_MAX - page)
+        return -1;
+    len = (len + page - 1) & ~(page - 1);
+    return host_map_fd(host, fd, addr, len, PROT_READ | PROT_WRITE, MAP_SHARED);
+#else
+    (void)host;
+    (void)fd;
+    (void)addr;
+    (void)len;
+    return -1; /* not supported without mmap */
+#endif
+}
+
+void r5vm_host_unmap_file(r5vm_host_t* host, int slot)
+{
+#if !defined(_WIN32)
+    if (slot < 0 || slot >= R5VM_HOST_MAX_MAPS || !host->files[slot].len)
+        return;
+    mmap(host->map + host->files[slot].addr, host->files[slot].len,
+         PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    memset(&host->files[slot], 0, sizeof(host->files[slot]));
+#else
+    (void)host;
+    (void)slot;
+#endif
+}
+
+void* r5vm_host_take_pages(r5vm_host_t* host, uint32_t addr, uint32_t len)
+{
+#if defined(__linux__)
+    const uint32_t page = (uint32_t)r5vm_host_page_size();
+
+    len = (len + page - 1) & ~(page - 1);
+    if (host->shared || !host_plain_pages(host, addr, len))
+        return NULL; /* shared pages must not leave the VM, see recycle */
+    void* dst = mmap(NULL, len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (dst == MAP_FAILED)
+        return NULL;
+    if (mremap(host->map + addr, len, len, MREMAP_MAYMOVE | MREMAP_FIXED,
+               dst) == MAP_FAILED) {
+        munmap(dst, len);
+        return NULL;
+    }
+    /* the guest range is a hole now, refill it with zero pages */
+    if (mmap(host->map + addr, len, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED) {
+        mremap(dst, len, len, MREMAP_MAYMOVE | MREMAP_FIXED, host->map + addr);
+        return NULL;
+    }
+    return dst;
+#else
+    (void)host;
+    (void)addr;
+    (void)len;
+    return NULL; /* no mremap(), callers copy */
+#endif
+}
+
+bool r5vm_host_give_pages(r5vm_host_t* host, uint32_t addr, void* pages,
+                          uint32_t len)
+{
+#if defined(__linux__)
+    const uint32_t page = (uint32_t)r5vm_host_page_size();
+
+    len = (len + page - 1) & ~(page - 1);
+    if (!host_plain_pages(host, addr, len))
+        return false;
+    return mremap(pages, len, len, MREMAP_MAYMOVE | MREMAP_FIXED,
+                  host->map + addr) != MAP_FAILED;
+#else
+    (void)host;
+    (void)addr;
+    (void)pages;
+    (void)len;
+    return false;
+#endif
+}
+
+bool r5vm_host_share_page(r5vm_host_t* host, uint32_t addr, int fd,
+                          uint64_t offset)
+{
+#if defined(__linux__)
+    const uint32_t page = (uint32_t)r5vm_host_page_size();
+
+    if (!host_plain_pages(host, addr, page))
+        return false;
+    if (fd < 0) /* private anonymous pages read as zero once dropped */
+        return madvise(host->map + addr, page, MADV_DONTNEED) == 0;
+    if (mmap(host->map + addr, page, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_FIXED, fd, (off_t)offset) == MAP_FAILED)
+        return false;
+    host->shared = true;
+    return true;
+#else
+    (void)host;
+    (void)addr;
+    (void)fd;
+    (void)offset;
+    return false;
+#endif
+}
+
+bool r5vm_host_set_limit(r5vm_host_t* host, size_t limit)
+{
+    if (limit && host->map_size + host->charged > limit)
+        return false;
+    host->mem_limit = limit;
+    return true;
+}
+
+bool r5vm_host_charge(r5vm_host_t* host, size_t bytes)
+{
+#if !defined(_WIN32)
+    const size_t now = __sync_add_and_fetch(&host->charged, bytes);
+#else
+    const size_t now = host->charged += bytes;
+#endif
+    if (host->mem_limit && host->map_size + now > host->mem_limit) {
+        r5vm_host_uncharge(host, bytes);
+        host->denied++;
+        return false;
+    }
+    /* racy peak update, good enough for a statistic */
+    if (now > host->charged_peak)
+        host->charged_peak = now;
+    return true;
+}
+
+void r5vm_host_uncharge(r5vm_host_t* host, size_t bytes)
+{
+#if !defined(_WIN32)
+    __sync_sub_and_fetch(&host->charged, bytes);
+#else
+    host->charged -= bytes;
+#endif
+}
+
+void r5vm_host_stats(const r5vm_host_t* host, r5vm_host_stats_t* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->guest_bytes = host->map_size;
+    stats->resident_bytes = host->map_size;
+    stats->buffer_bytes = host->charged;
+    stats->peak_bytes = host->map_size + host->charged_peak;
+    stats->limit_bytes = host->mem_limit;
+    stats->denied = host->denied;
+    for (int i = 0; i < R5VM_HOST_MAX_MAPS; i++)
+        stats->mapped_bytes += host->files[i].len;
+#if defined(__linux__)
+    /* untouched guest pages are not backed by host memory yet */
+    const size_t page = r5vm_host_page_size();
+    unsigned char vec[256];
+    size_t resident = 0;
+    for (size_t off = 0; off < host->map_size; off += sizeof(vec) * page) {
+        size_t len = host->map_size - off;
+        if (len > sizeof(vec) * page)
+            len = sizeof(vec) * page;
+        if (mincore(host->map + off, len, vec) != 0)
+            return;
+        for (size_t i = 0; i < len / page; i++)
+            resident += (vec[i] & 1) * page;
+    }
+    stats->resident_bytes = resident;
+#endif
+}
+
+unsigned r5vm_host_run(r5vm_host_t* host, unsigned max_steps)
+{
+#if !defined(_WIN32)
+    r5vm_host_ctx_t ctx;
+    r5vm_host_ctx_t* prev = g_ctx;
+    unsigned steps = 0;
+
+    r5vm_host_install_handler();
+    ctx.host = host;
+    ctx.fault_addr = 0;
+    ctx.slice = 1;
+    g_ctx = &ctx;
+    for (;;) {
+        if (r5vm_host_run_guarded(&ctx, max_steps ? max_steps - steps : 0, &steps)) {
+            if (host->vm.status != R5VM_IDLE || !host->idle_ms)
+                break;
+            /* sleep instead of spinning, then resume the guest */
+            r5vm_host_idle_wait(host);
+            host->vm.status = R5VM_RUNNING;
+            steps += 1; /* the idle instruction */
+            if (max_steps)
+                break;
+            continue;
+        }
+        r5vm_host_protect_watches(host); /* in case a re-executed step faulted */
+        if (!r5vm_host_service_fault(&ctx, false))
+            break;
+        steps += 1; /* the single-stepped store */
+        if (max_steps && steps >= max_steps)
+            break;
+    }
+    g_ctx = prev;
+    return steps;
+#else
+    return r5vm_run(&host->vm, max_steps);
+#endif
+}
+
+void r5vm_host_wake(r5vm_host_t* host)
+{
+#if !defined(_WIN32)
+    pthread_mutex_lock(&host->idle_lock);
+    host->idle_wakes++;
+    pthread_cond_signal(&host->idle_cond);
+    pthread_mutex_unlock(&host->idle_lock);
+#else
+    (void)host;
+#endif
+}
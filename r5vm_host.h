@@ -0,0 +1,471 @@
+/*
+ * R5VM - Minimal RISC-V RV32I Virtual Machine
+ *       _____
+ *      | ____|
+ *  _ __| |____   ___ __ ___
+ * | '__|___ \ \ / / '_ ` _ \
+ * | |   ___) \ V /| | | | | |
+ * |_|  |____/ \_/ |_| |_| |_|
+ *
+ * Copyright (c) 2025 Jan Zwiener
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file r5vm_host.h
+ * @brief Optional POSIX host services for R5VM.
+ *
+ * The VM core (`r5vm.c`) is portable C and accesses guest memory through a
+ * plain byte buffer. This module backs that buffer with page-aligned host
+ * memory from `mmap()` so the host MMU can be used for checks that would
+ * otherwise cost a comparison on every guest load and store:
+ *
+ * - A no-access guard region below the guest stack turns a stack overflow
+ *   into a host fault, which is reported as an `r5vm_error()`.
+ * - Data watchpoints write-protect the host pages containing the watched
+ *   range. A store to such a page traps, is single-stepped with the page
+ *   unlocked and checked against the watch ranges, then execution resumes.
+ * - Host files can be mapped into a window of guest memory, read-only or
+ *   as a private copy-on-write view, so guests scan input without copies.
+ *   Shared memory maps the same pages into several VMs.
+ * - An idle guest (`wfi`, `pause`, spin loops) sleeps on a condition
+ *   variable instead of burning a host core, until r5vm_host_wake().
+ * - Whole pages move between VMs with `mremap()` instead of being copied,
+ *   identical pages of several VMs can share one host page.
+ * - Guest memory and host-side buffers held for a VM are accounted against
+ *   an optional per-VM quota, see r5vm_host_set_limit().
+ *
+ * Guest code runs at full speed; the host only pays when a fault actually
+ * happens. Requires a POSIX system (Linux, macOS, BSD).
+ */
+
+#ifndef R5VM_HOST_H
+#define R5VM_HOST_H
+
+#include "r5vm.h"
+
+#if !defined(_WIN32)
+#include <pthread.h>
+#endif
+
+// ---- Defines ---------------------------------------------------------------
+
+/** @brief Maximum number of data watchpoints per VM. */
+#define R5VM_HOST_MAX_WATCH  8
+
+/** @brief Maximum number of host file mappings per VM. */
+#define R5VM_HOST_MAX_MAPS   8
+
+// ---- Host VM data structure ------------------------------------------------
+
+struct r5vm_host_s;
+
+/**
+ * @brief Callback for a guest store that hit a watched range.
+ *
+ * Called after the store has been executed. Bulk writes of the memory
+ * ECALLs and HLE natives (see r5vm_write_probe()) report the part of the
+ * written range that overlaps the watch, at the ECALL or native entry.
+ *
+ * @param host     Host VM instance.
+ * @param pc       Address of the store instruction, ECALL or native.
+ * @param addr     Guest address written by the store.
+ * @param len      Store width in bytes (1, 2 or 4), any length for bulk
+ *                 writes.
+ * @param old_val  Little-endian value at `addr` before the store (first
+ *                 4 bytes of a bulk write).
+ * @return `true` to resume execution, `false` to stop the VM with
+ *         `vm.status == R5VM_BREAK` and `pc` after the store.
+ */
+typedef bool (*r5vm_watch_fn)(struct r5vm_host_s* host, uint32_t pc,
+                              uint32_t addr, uint32_t len, uint32_t old_val);
+
+/** @brief A watched guest address range. */
+typedef struct r5vm_watch_s
+{
+    uint32_t addr; /**< First watched guest address */
+    uint32_t len;  /**< Length of the range in bytes (0 = unused slot) */
+} r5vm_watch_t;
+
+/** @brief A host file mapped into guest memory. */
+typedef struct r5vm_file_map_s
+{
+    uint32_t addr;      /**< Guest address of the window (page aligned) */
+    uint32_t len;       /**< Window size, file size rounded up to pages (0 = unused) */
+    uint32_t file_size; /**< Size of the file in bytes */
+    bool     writable;  /**< Private copy-on-write view, else read-only */
+    bool     shared;    /**< Shared writable memory, see r5vm_host_map_shared() */
+} r5vm_file_map_t;
+
+/**
+ * @brief A VM instance together with its host memory mapping.
+ *
+ * `vm.mem` points to `map`, a page-aligned `mmap()` region owned by this
+ * structure. Guest addresses and offsets into `map` are identical. `vm` is
+ * the first member, so callbacks that receive the `r5vm_t*` can cast it
+ * back to the `r5vm_host_t*`.
+ */
+typedef struct r5vm_host_s
+{
+    r5vm_t   vm;       /**< Guest CPU state, vm.mem == map */
+    uint8_t* map;      /**< Page-aligned host mapping backing guest memory */
+    size_t   map_size; /**< Size of the mapping in bytes */
+    uint32_t guard_lo; /**< Stack guard start (guest address, inclusive) */
+    uint32_t guard_hi; /**< Stack guard end (guest address, exclusive) */
+    r5vm_watch_t  watch[R5VM_HOST_MAX_WATCH]; /**< Active watchpoints */
+    r5vm_watch_fn watch_fn; /**< Watch hit callback (NULL: r5vm_error) */
+    r5vm_file_map_t files[R5VM_HOST_MAX_MAPS]; /**< Mapped host files */
+#if !defined(_WIN32)
+    pthread_mutex_t idle_lock; /**< Protects idle_wakes */
+    pthread_cond_t  idle_cond; /**< Signalled by r5vm_host_wake() */
+#endif
+    unsigned idle_wakes; /**< Pending wake-ups for an idle guest */
+    uint32_t idle_ms;    /**< Max. sleep per idle stop (0: return R5VM_IDLE) */
+    size_t   mem_limit;  /**< Quota for guest memory and buffers (0: none) */
+    volatile size_t charged; /**< Host buffer bytes charged to this VM */
+    size_t   charged_peak;   /**< Highest value of `charged` */
+    unsigned denied;     /**< Charges refused by the quota */
+    bool     shared;     /**< Pages mapped by r5vm_host_share_page() */
+    void*    user;     /**< Opaque pointer for the embedding application */
+} r5vm_host_t;
+
+// ---- Lifecycle -------------------------------------------------------------
+
+/**
+ * @brief Allocate guest memory and initialize the VM.
+ *
+ * Guest memory is zero-filled and page aligned. Load the program image into
+ * `host->vm.mem` afterwards.
+ *
+ * @param host      Host VM instance to initialize.
+ * @param mem_size  Guest memory size in bytes (power of two).
+ * @return `true` on success, `false` on invalid size or allocation failure.
+ */
+bool r5vm_host_init(r5vm_host_t* host, uint32_t mem_size);
+
+/**
+ * @brief Release the guest memory mapping and clear the instance.
+ *
+ * @param host Host VM instance.
+ */
+void r5vm_host_destroy(r5vm_host_t* host);
+
+/**
+ * @brief Host memory page size in bytes.
+ */
+size_t r5vm_host_page_size(void);
+
+/**
+ * @brief Copy the guest state of `src` into `dst`.
+ *
+ * Copies registers, `pc`, guest memory, the stack guard and the HLE table
+ * (shared, not duplicated). Resetting a VM to a saved warm state this way
+ * only costs a memory copy. File mappings of `src` are copied as plain
+ * guest memory; hooks, watchpoints and file mappings are not copied.
+ *
+ * @param dst  Initialized host VM with the same memory size, without file
+ *             mappings or watchpoints.
+ * @param src  Host VM to copy, e.g. a template that no longer runs.
+ * @return `false` if the sizes differ or `dst` has mappings or watchpoints.
+ */
+bool r5vm_host_copy(r5vm_host_t* dst, const r5vm_host_t* src);
+
+/**
+ * @brief Return a used VM to the state right after r5vm_host_init().
+ *
+ * Watchpoints, file mappings and the stack guard are removed, hooks,
+ * quota and counters cleared, and guest memory reads as zero again. The
+ * host mapping itself is kept: on Linux its pages are dropped with
+ * `MADV_DONTNEED` and only zero-filled when the next guest touches them,
+ * elsewhere they are cleared with `memset()`. Cheaper than a destroy and
+ * init for VMs that are recycled, see r5vm_pool.h.
+ *
+ * @param host Initialized host VM instance.
+ * @return `false` if `host` holds no guest memory.
+ */
+bool r5vm_host_recycle(r5vm_host_t* host);
+
+// ---- Protection ------------------------------------------------------------
+
+/**
+ * @brief Place a no-access guard page below the guest stack.
+ *
+ * The stack grows down towards `stack_limit`, the lowest valid stack
+ * address. One host page directly below it is made inaccessible, so a
+ * guest access there raises a host fault that `r5vm_host_run()` reports
+ * as "Stack overflow" via `r5vm_error()`.
+ *
+ * @param host         Host VM instance.
+ * @param stack_limit  Lowest valid stack address (rounded down to a page).
+ * @return `true` on success, `false` if the guard does not fit into memory
+ *         or overlaps a file mapping.
+ */
+bool r5vm_host_stack_guard(r5vm_host_t* host, uint32_t stack_limit);
+
+/**
+ * @brief Add a data watchpoint on `[addr, addr + len)`.
+ *
+ * The host pages covering the range are write-protected. Guest stores to
+ * those pages are trapped and checked; stores that overlap the range call
+ * `host->watch_fn`. Without a callback, a hit is reported via
+ * `r5vm_error()` and stops the VM. Unwatched code runs at full speed.
+ *
+ * @param host  Host VM instance.
+ * @param addr  First guest address to watch.
+ * @param len   Number of bytes to watch (> 0).
+ * @return Watchpoint slot (>= 0), or -1 if the range is invalid, touches a
+ *         read-only file mapping or all R5VM_HOST_MAX_WATCH slots are in use.
+ */
+int r5vm_host_watch(r5vm_host_t* host, uint32_t addr, uint32_t len);
+
+/**
+ * @brief Remove a data watchpoint.
+ *
+ * @param host  Host VM instance.
+ * @param slot  Value returned by r5vm_host_watch().
+ */
+void r5vm_host_unwatch(r5vm_host_t* host, int slot);
+
+/**
+ * @brief Write to guest memory from the host, bypassing watchpoints.
+ *
+ * Use this instead of writing to `vm.mem` directly while watchpoints are
+ * active, since watched pages are read-only for the host as well.
+ *
+ * @param host  Host VM instance.
+ * @param addr  Guest destination address.
+ * @param src   Source buffer.
+ * @param len   Number of bytes to write.
+ * @return `false` if the range is out of bounds or touches the stack guard
+ *         or a read-only file mapping.
+ */
+bool r5vm_host_write(r5vm_host_t* host, uint32_t addr, const void* src,
+                     uint32_t len);
+
+/**
+ * @brief Check if the host can read guest memory without faulting.
+ *
+ * Debug output such as disassembly around a faulting `pc` must not read
+ * the stack guard, which is mapped without access.
+ *
+ * @param host  Host VM instance, or NULL for a plain VM (always readable).
+ * @param vm    VM whose memory is read.
+ * @param addr  Guest address.
+ * @param len   Number of bytes.
+ * @return `false` if the range is out of bounds or touches the stack guard.
+ */
+bool r5vm_host_readable(const r5vm_host_t* host, const r5vm_t* vm,
+                        uint32_t addr, uint32_t len);
+
+/**
+ * @brief Host VM of `vm` if the calling thread runs it in r5vm_host_run().
+ *
+ * Lets an r5vm_error() handler tell host VMs from plain ones.
+ *
+ * @return The host VM, or NULL.
+ */
+const r5vm_host_t* r5vm_host_active(const r5vm_t* vm);
+
+// ---- File mapping ----------------------------------------------------------
+
+/**
+ * @brief Map a host file into guest memory at `addr`.
+ *
+ * The file replaces the guest pages of the window `[addr, addr + size)`,
+ * rounded up to whole pages; bytes past the end of the file read as zero.
+ * A read-only window faults on guest stores ("Write to read-only mapping"). A
+ * writable window is a private copy-on-write view: guest stores never reach
+ * the file. The guest finds the window with `R5VM_ECALL_MAP_INFO`.
+ *
+ * @param host      Host VM instance.
+ * @param path      File to map.
+ * @param addr      Guest address of the window (page aligned).
+ * @param writable  `true` for a private copy-on-write view.
+ * @return Mapping slot (>= 0), or -1 if the file cannot be opened or the
+ *         window is unaligned, out of bounds or overlaps the stack guard,
+ *         a watchpoint or another mapping.
+ */
+int r5vm_host_map_file(r5vm_host_t* host, const char* path, uint32_t addr,
+                       bool writable);
+
+/**
+ * @brief Map shared memory into guest memory at `addr`.
+ *
+ * Maps `len` bytes of `fd` (e.g. from `shm_open()`) writable and shared:
+ * guest stores are visible to every VM and process that maps the same
+ * object. Several VMs can exchange data this way, each at its own guest
+ * address. The window shows up in `R5VM_ECALL_MAP_INFO` like a file.
+ *
+ * @param host  Host VM instance.
+ * @param fd    Shared memory object of at least `len` bytes, may be closed
+ *              after the call.
+ * @param addr  Guest address of the window (page aligned).
+ * @param len   Window size in bytes, rounded up to whole pages.
+ * @return Mapping slot (>= 0) for r5vm_host_unmap_file(), or -1 if the
+ *         window is unaligned, out of bounds or overlaps the stack guard,
+ *         a watchpoint or another mapping.
+ */
+int r5vm_host_map_shared(r5vm_host_t* host, int fd, uint32_t addr,
+                         uint32_t len);
+
+/**
+ * @brief Remove a file mapping. The window is zero-filled afterwards.
+ *
+ * @param host  Host VM instance.
+ * @param slot  Value returned by r5vm_host_map_file().
+ */
+void r5vm_host_unmap_file(r5vm_host_t* host, int slot);
+
+// ---- Page transfer ---------------------------------------------------------
+
+/**
+ * @brief Move guest pages out of the VM without copying them.
+ *
+ * The pages of `[addr, addr + len)` (`len` rounded up to whole pages) are
+ * moved to a new host mapping with `mremap()`, the guest range reads as
+ * zero afterwards. Hand them to another VM with r5vm_host_give_pages() or
+ * release them with `munmap()`. Linux only.
+ *
+ * @param host  Host VM instance.
+ * @param addr  Page-aligned guest address.
+ * @param len   Length in bytes.
+ * @return Host mapping of the pages, or NULL if the range is unaligned, out
+ *         of bounds, overlaps the stack guard, a watchpoint or a mapping,
+ *         the VM has shared pages (r5vm_host_share_page()) or pages cannot
+ *         be moved on this host. Copy the data in that case.
+ */
+void* r5vm_host_take_pages(r5vm_host_t* host, uint32_t addr, uint32_t len);
+
+/**
+ * @brief Move pages from r5vm_host_take_pages() into guest memory at `addr`.
+ *
+ * The pages replace the guest range, its old contents are dropped. On
+ * success `pages` is consumed.
+ *
+ * @return `false` under the same conditions as r5vm_host_take_pages(),
+ *         `pages` is still owned by the caller then.
+ */
+bool r5vm_host_give_pages(r5vm_host_t* host, uint32_t addr, void* pages,
+                          uint32_t len);
+
+/**
+ * @brief Replace a guest page with a copy-on-write view of a file page.
+ *
+ * The page at `addr` maps page `offset` of `fd` privately: reads share
+ * the host page with every other VM mapping it, the first store gives the
+ * VM its own copy again. With `fd` -1 the page is dropped and reads as
+ * zero. The caller makes sure the contents are equal and the VM does not
+ * run meanwhile, see r5vm_dedup.h. Every shared page is a host mapping of
+ * its own and counts against `vm.max_map_count`; afterwards
+ * r5vm_host_take_pages() refuses until the VM is recycled. Linux only.
+ *
+ * @param host    Host VM instance.
+ * @param addr    Page-aligned guest address.
+ * @param fd      File to share, or -1.
+ * @param offset  Page-aligned offset in `fd`.
+ * @return `false` if the page is unaligned, out of bounds, overlaps the
+ *         stack guard, a watchpoint or a mapping, or cannot be mapped.
+ */
+bool r5vm_host_share_page(r5vm_host_t* host, uint32_t addr, int fd,
+                          uint64_t offset);
+
+// ---- Memory accounting ---------------------------------------------------
+
+/** @brief Memory use of one VM, see r5vm_host_stats(). */
+typedef struct r5vm_host_stats_s
+{
+    size_t   guest_bytes;    /**< Guest memory mapping, incl. file windows */
+    size_t   resident_bytes; /**< Guest pages backed by host memory */
+    size_t   mapped_bytes;   /**< Part of guest_bytes mapped from files or shm */
+    size_t   buffer_bytes;   /**< Host buffers currently charged */
+    size_t   peak_bytes;     /**< guest_bytes plus the peak of buffer_bytes */
+    size_t   limit_bytes;    /**< Quota, 0 if unlimited */
+    unsigned denied;         /**< Charges refused by the quota */
+} r5vm_host_stats_t;
+
+/**
+ * @brief Limit the memory a VM may hold.
+ *
+ * The quota covers the guest memory mapping and every host-side buffer
+ * charged with r5vm_host_charge(), e.g. channel messages still in flight.
+ * Services that would exceed it fail into a guest-visible error code.
+ *
+ * @param host   Host VM instance.
+ * @param limit  Quota in bytes, 0 removes the limit.
+ * @return `false` if the VM already holds more than `limit`.
+ */
+bool r5vm_host_set_limit(r5vm_host_t* host, size_t limit);
+
+/**
+ * @brief Charge a host buffer of `bytes` to the VM. Thread-safe.
+ *
+ * @return `false` if the charge would exceed the quota; nothing is charged
+ *         then and `denied` is incremented.
+ */
+bool r5vm_host_charge(r5vm_host_t* host, size_t bytes);
+
+/**
+ * @brief Release a charge made with r5vm_host_charge(). Thread-safe.
+ */
+void r5vm_host_uncharge(r5vm_host_t* host, size_t bytes);
+
+/**
+ * @brief Report the memory use of a VM.
+ *
+ * @param host   Host VM instance.
+ * @param stats  Filled in on return.
+ */
+void r5vm_host_stats(const r5vm_host_t* host, r5vm_host_stats_t* stats);
+
+// ---- Execution control -----------------------------------------------------
+
+/**
+ * @brief Run the VM with host fault handling enabled.
+ *
+ * Same contract as `r5vm_run()`. Host memory faults caused by guest
+ * accesses are translated into VM errors instead of crashing the host,
+ * watchpoint traps are serviced and execution resumes.
+ *
+ * With `idle_ms == 0` an idle guest returns with `R5VM_IDLE`. Otherwise the
+ * thread sleeps until r5vm_host_wake() or for at most `idle_ms`, and the
+ * guest is resumed; with a step limit the call returns after the sleep with
+ * `R5VM_RUNNING`, so a scheduler gets its slice back.
+ *
+ * @param host       Host VM instance.
+ * @param max_steps  Maximum instruction count, or 0 for unlimited.
+ * @return Number of executed steps before halting. `max_steps` bounds the
+ *         whole call, including stores re-executed for watchpoint traps.
+ *         After a trap the count may exceed the steps actually executed
+ *         by a few instructions, never the other way round.
+ */
+unsigned r5vm_host_run(r5vm_host_t* host, unsigned max_steps);
+
+/**
+ * @brief Wake a guest sleeping in r5vm_host_run() after an idle stop.
+ *
+ * Call after changing memory the guest polls, e.g. from another thread. A
+ * wake-up sent while the guest is running is kept, so the next idle stop
+ * returns at once. Thread-safe.
+ *
+ * @param host Host VM instance.
+ */
+void r5vm_host_wake(r5vm_host_t* host);
+
+#endif // R5VM_HOST_H
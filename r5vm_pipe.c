@@ -0,0 +1,321 @@
+/*
+ * R5VM - Minimal RISC-V RV32I Virtual Machine
+ *       _____
+ *      | ____|
+ *  _ __| |____   ___ __ ___
+ * | '__|___ \ \ / / '_ ` _ \
+ * | |   ___) \ V /| | | | | |
+ * |_|  |____/ \_/ |_| |_| |_|
+ *
+ * Copyright (c) 2025 Jan Zwiener
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#if !defined(_WIN32)
+#define _GNU_SOURCE       /* pthread_setaffinity_np, cpu_set_t */
+#define _DARWIN_C_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#include "r5vm_pipe.h"
+
+uint32_t r5vm_pipe_ring_span(unsigned count, uint32_t ring_size)
+{
+    const uint32_t page = (uint32_t)r5vm_host_page_size();
+    const uint32_t len = (R5VM_RING_DATA + ring_size + page - 1) & ~(page - 1);
+
+    return count > 1 ? 2 * len : 0;
+}
+
+#if !defined(_WIN32)
+
+// ---- Pipeline state --------------------------------------------------------
+
+/** A ring between two stages */
+typedef struct r5vm_pipe_ring_s
+{
+    uint8_t*        mem;           /**< Host view of the shared ring */
+    uint32_t        len;           /**< Mapped size in bytes */
+    uint32_t        size;          /**< Data capacity (power of two) */
+    pthread_mutex_t lock;          /**< Protects the done flags */
+    pthread_cond_t  cond;          /**< Signalled by RING_WAKE and halts */
+    bool            producer_done; /**< Writing stage halted */
+    bool            consumer_done; /**< Reading stage halted */
+} r5vm_pipe_ring_t;
+
+/** Per-stage state, installed as `host->user` */
+typedef struct r5vm_pipe_stage_s
+{
+    r5vm_host_t*      host;
+    r5vm_ecall_fn     next;     /**< ECALL handler of the host layer */
+    void*             user;     /**< Saved `host->user` */
+    r5vm_pipe_ring_t* in;       /**< Input ring or NULL */
+    r5vm_pipe_ring_t* out;      /**< Output ring or NULL */
+    uint32_t          in_addr;  /**< Guest address of the input ring */
+    uint32_t          out_addr; /**< Guest address of the output ring */
+    int               cpu;      /**< Host core to pin to, -1: none */
+    pthread_t         thread;
+    bool              started;
+} r5vm_pipe_stage_t;
+
+static uint32_t ring_load(const r5vm_pipe_ring_t* r, uint32_t off)
+{
+    return *(const volatile uint32_t*)(r->mem + off);
+}
+
+static void ring_store(r5vm_pipe_ring_t* r, uint32_t off, uint32_t val)
+{
+    *(volatile uint32_t*)(r->mem + off) = val;
+}
+
+/** Block until the ring has data (consumer) or space (producer). */
+static uint32_t ring_wait(r5vm_pipe_ring_t* r, bool consumer)
+{
+    const uint32_t flag = consumer ? R5VM_RING_WAIT_DATA : R5VM_RING_WAIT_SPACE;
+    uint32_t n;
+
+    pthread_mutex_lock(&r->lock);
+    ring_store(r, flag, 1);
+    for (;;) {
+        /* pairs with the peer's fence between its counter update and
+           its check of the wait flag */
+        __sync_synchronize();
+        const uint32_t used = ring_load(r, R5VM_RING_HEAD) - ring_load(r, R5VM_RING_TAIL);
+        n = consumer ? used : r->size - used;
+        if (!consumer && r->consumer_done)
+            n = 0; /* nobody reads the output any more */
+        if (n || (consumer ? r->producer_done : r->consumer_done))
+            break;
+        pthread_cond_wait(&r->cond, &r->lock);
+    }
+    ring_store(r, flag, 0);
+    pthread_mutex_unlock(&r->lock);
+    return n;
+}
+
+static void ring_wake(r5vm_pipe_ring_t* r)
+{
+    pthread_mutex_lock(&r->lock);
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+}
+
+static void ring_close(r5vm_pipe_ring_t* r, bool consumer)
+{
+    pthread_mutex_lock(&r->lock);
+    if (consumer)
+        r->consumer_done = true;
+    else
+        r->producer_done = true;
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+}
+
+static bool pipe_ecall(r5vm_t* vm, uint32_t id)
+{
+    r5vm_pipe_stage_t* st = (r5vm_pipe_stage_t*)((r5vm_host_t*)vm)->user;
+    r5vm_pipe_ring_t* r;
+    bool consumer;
+
+    switch (id) {
+    case R5VM_ECALL_RING_INFO:
+        r = vm->a0 == 0 ? st->in : vm->a0 == 1 ? st->out : NULL;
+        vm->a1 = r ? r->size : 0;
+        vm->a0 = r ? (vm->a0 == 0 ? st->in_addr : st->out_addr) : 0;
+        return true;
+    case R5VM_ECALL_RING_WAIT:
+    case R5VM_ECALL_RING_WAKE:
+        consumer = st->in && vm->a0 == st->in_addr;
+        r = consumer ? st->in : st->out && vm->a0 == st->out_addr ? st->out : NULL;
+        if (!r) {
+            r5vm_error(vm, "Invalid ring", (vm->pc - 4) & vm->mem_mask, vm->a0);
+            return false;
+        }
+        if (id == R5VM_ECALL_RING_WAIT)
+            vm->a0 = ring_wait(r, consumer);
+        else
+            ring_wake(r);
+        return true;
+    default:
+        return st->next(vm, id);
+    }
+}
+
+static void* pipe_stage(void* arg)
+{
+    r5vm_pipe_stage_t* st = arg;
+    r5vm_host_t* host = st->host;
+
+#if defined(__linux__)
+    if (st->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(st->cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+#endif
+    do {
+        r5vm_host_run(host, 0);
+    } while (r5vm_paused(&host->vm));
+
+    /* let the neighbours drain or give up */
+    if (st->in)
+        ring_close(st->in, true);
+    if (st->out)
+        ring_close(st->out, false);
+    return NULL;
+}
+
+/** Create the shared memory of a ring and map it into both stages. */
+static bool ring_create(r5vm_pipe_ring_t* r, r5vm_pipe_stage_t* prod,
+                        r5vm_pipe_stage_t* cons, uint32_t len, uint32_t size)
+{
+    static unsigned serial;
+    char name[64];
+    int fd = -1;
+
+    for (unsigned tries = 0; fd < 0 && tries < 16; tries++) {
+        snprintf(name, sizeof(name), "/r5vm-ring-%ld-%u", (long)getpid(),
+                 __sync_fetch_and_add(&serial, 1));
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    }
+    if (fd < 0) {
+        perror("shm_open");
+        return false;
+    }
+    shm_unlink(name); /* anonymous from now on, freed with the last mapping */
+
+    bool ok = ftruncate(fd, len) == 0;
+    void* p = ok ? mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+                 : MAP_FAILED;
+    ok = p != MAP_FAILED &&
+         r5vm_host_map_shared(prod->host, fd, prod->out_addr, len) >= 0 &&
+         r5vm_host_map_shared(cons->host, fd, cons->in_addr, len) >= 0;
+    close(fd);
+    if (!ok) {
+        if (p != MAP_FAILED)
+            munmap(p, len);
+        return false;
+    }
+    r->mem = p;
+    r->len = len;
+    r->size = size;
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->cond, NULL);
+    prod->out = r;
+    cons->in = r;
+    return true;
+}
+
+bool r5vm_pipe_run(r5vm_host_t* const* stages, unsigned count,
+                   uint32_t ring_addr, uint32_t ring_size, bool pin)
+{
+    r5vm_pipe_stage_t st[R5VM_PIPE_MAX_STAGES];
+    r5vm_pipe_ring_t rings[R5VM_PIPE_MAX_STAGES];
+    const uint32_t page = (uint32_t)r5vm_host_page_size();
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned made = 0; /* rings created */
+    bool ok = true;
+
+    if (count == 0 || count > R5VM_PIPE_MAX_STAGES)
+        return false;
+    if ((ring_addr & (page - 1)) || ring_size == 0 ||
+        (ring_size & (ring_size - 1)) || ring_size > (1u << 30)) {
+        fprintf(stderr, "error: rings need a page-aligned address and a "
+                        "power-of-two size\n");
+        return false;
+    }
+    const uint32_t len = (R5VM_RING_DATA + ring_size + page - 1) & ~(page - 1);
+
+    memset(st, 0, sizeof(st));
+    memset(rings, 0, sizeof(rings));
+    for (unsigned i = 0; i < count; i++) {
+        st[i].host = stages[i];
+        st[i].in_addr = ring_addr;
+        st[i].out_addr = ring_addr + len;
+        st[i].cpu = pin && cpus > 0 ? (int)(i % (unsigned)cpus) : -1;
+    }
+    while (made + 1 < count &&
+           ring_create(&rings[made], &st[made], &st[made + 1], len, ring_size))
+        made++;
+    if (made + 1 < count) {
+        fprintf(stderr, "error: cannot map ring %u at 0x%08X\n", made + 1,
+                (unsigned)ring_addr);
+        ok = false;
+    }
+
+    for (unsigned i = 0; i < count && ok; i++) {
+        st[i].next = st[i].host->vm.ecall_fn;
+        st[i].user = st[i].host->user;
+        st[i].host->user = &st[i];
+        st[i].host->vm.ecall_fn = pipe_ecall;
+        st[i].started = pthread_create(&st[i].thread, NULL, pipe_stage, &st[i]) == 0;
+        if (!st[i].started) {
+            fprintf(stderr, "error: cannot start pipeline stage %u\n", i + 1);
+            st[i].host->vm.status = R5VM_ERROR;
+            /* the neighbours must not wait for a stage that never runs */
+            if (st[i].in)
+                ring_close(st[i].in, true);
+            if (st[i].out)
+                ring_close(st[i].out, false);
+        }
+    }
+    for (unsigned i = 0; i < count; i++) {
+        if (st[i].started)
+            pthread_join(st[i].thread, NULL);
+        if (st[i].next) {
+            st[i].host->vm.ecall_fn = st[i].next;
+            st[i].host->user = st[i].user;
+        }
+    }
+    for (unsigned i = 0; i < made; i++) {
+        munmap(rings[i].mem, rings[i].len);
+        pthread_cond_destroy(&rings[i].cond);
+        pthread_mutex_destroy(&rings[i].lock);
+    }
+    return ok;
+}
+
+#else /* _WIN32 */
+
+bool r5vm_pipe_run(r5vm_host_t* const* stages, unsigned count,
+                   uint32_t ring_addr, uint32_t ring_size, bool pin)
+{
+    (void)stages;
+    (void)count;
+    (void)ring_addr;
+    (void)ring_size;
+    (void)pin;
+    fprintf(stderr, "error: pipelines require a POSIX host\n");
+    return false;
+}
+
+#endif /* !_WIN32 */
@@ -0,0 +1,108 @@
+/*
+ * R5VM - Minimal RISC-V RV32I Virtual Machine
+ *       _____
+ *      | ____|
+ *  _ __| |____   ___ __ ___
+ * | '__|___ \ \ / / '_ ` _ \
+ * | |   ___) \ V /| | | | | |
+ * |_|  |____/ \_/ |_| |_| |_|
+ *
+ * Copyright (c) 2025 Jan Zwiener
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file r5vm_pipe.h
+ * @brief Multi-VM pipelines connected by single-producer/consumer rings.
+ *
+ * Each stage of a pipeline is a VM running on its own host thread, pinned
+ * to its own core on Linux. Neighbouring stages share a byte ring: shared
+ * memory mapped into both guests (r5vm_host_map_shared()), so pushing and
+ * popping data are plain guest loads and stores without host calls.
+ *
+ * A ring starts with a header of free-running 32-bit counters:
+ *
+ * | Offset | Field      | Written by                                  |
+ * |--------|------------|---------------------------------------------|
+ * | 0      | head       | producer: total bytes written               |
+ * | 64     | tail       | consumer: total bytes read                  |
+ * | 128    | wait data  | host: consumer blocked in RING_WAIT         |
+ * | 132    | wait space | host: producer blocked in RING_WAIT         |
+ * | 256    | data       | `capacity` bytes, index = counter % capacity |
+ *
+ * The producer writes data, `fence`, advances `head`, `fence`, and calls
+ * `R5VM_ECALL_RING_WAKE` if "wait data" is set. The consumer reads `head`,
+ * `fence`, reads the data, `fence`, advances `tail`, `fence`, and wakes the
+ * producer if "wait space" is set. Only an empty or full ring costs an
+ * ECALL: the stage blocks in `R5VM_ECALL_RING_WAIT` until its peer moves.
+ * `R5VM_ECALL_RING_INFO` returns the address and capacity of a stage's
+ * input (a0 = 0) and output (a0 = 1) ring, 0 if it has none.
+ */
+
+#ifndef R5VM_PIPE_H
+#define R5VM_PIPE_H
+
+#include "r5vm_host.h"
+
+// ---- Defines ---------------------------------------------------------------
+
+/** @brief Maximum number of pipeline stages. */
+#define R5VM_PIPE_MAX_STAGES  16
+
+/** @brief Ring header offsets, see the file description. */
+#define R5VM_RING_HEAD        0
+#define R5VM_RING_TAIL        64
+#define R5VM_RING_WAIT_DATA   128
+#define R5VM_RING_WAIT_SPACE  132
+#define R5VM_RING_DATA        256
+
+// ---- Functions -------------------------------------------------------------
+
+/**
+ * @brief Guest memory the rings of a pipeline take from `ring_addr` on.
+ *
+ * @param count      Number of stages; a single stage has no rings.
+ * @param ring_size  Data capacity of each ring.
+ * @return Bytes of the input and the output ring, 0 for one stage.
+ */
+uint32_t r5vm_pipe_ring_span(unsigned count, uint32_t ring_size);
+
+/**
+ * @brief Run `count` VMs as a pipeline until every stage halted.
+ *
+ * Stage `i` writes to the ring read by stage `i + 1`. In every stage the
+ * input ring is mapped at `ring_addr` and the output ring directly behind
+ * it, each ring is `R5VM_RING_DATA + ring_size` bytes rounded up to whole
+ * pages. A stage that halts closes its rings: the consumer reads the rest
+ * and then gets 0 from RING_WAIT, a blocked producer gets 0 as well.
+ *
+ * @param stages     Initialized and reset host VMs, without mappings at the
+ *                   ring addresses. The rings stay mapped afterwards.
+ * @param count      Number of stages (1..R5VM_PIPE_MAX_STAGES).
+ * @param ring_addr  Page-aligned guest address of the rings.
+ * @param ring_size  Data capacity of each ring (power of two).
+ * @param pin        Pin stage `i` to host core `i` (Linux only).
+ * @return `false` if the rings or threads could not be set up, the VM
+ *         status of each stage is set independently.
+ */
+bool r5vm_pipe_run(r5vm_host_t* const* stages, unsigned count,
+                   uint32_t ring_addr, uint32_t ring_size, bool pin);
+
+#endif // R5VM_PIPE_H
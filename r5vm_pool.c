@@ -0,0 +1,144 @@
+/*
+ * R5VM - Minimal RISC-V RV32I Virtual Machine
+ *       _____
+ *      | ____|
+ *  _ __| |____   ___ __ ___
+ * | '__|___ \ \ / / '_ ` _ \
+ * | |   ___) \ V /| | | | | |
+ * |_|  |____/ \_/ |_| |_| |_|
+ *
+ * Copyright (c) 2025 Jan Zwiener
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "r5vm_pool.h"
+
+// ---- Pool state ------------------------------------------------------------
+
+/** A pooled VM, `host` first so released hosts cast back */
+typedef struct r5vm_pool_vm_s
+{
+    r5vm_host_t            host;
+    struct r5vm_pool_vm_s* next; /**< Next free VM of the same size */
+} r5vm_pool_vm_t;
+
+#if !defined(_WIN32)
+#define POOL_LOCK(p)    pthread_mutex_lock(&(p)->lock)
+#define POOL_UNLOCK(p)  pthread_mutex_unlock(&(p)->lock)
+#else
+#define POOL_LOCK(p)    ((void)(p))
+#define POOL_UNLOCK(p)  ((void)(p))
+#endif
+
+/** Size class of a power-of-two memory size, -1 if invalid */
+static int pool_class(uint32_t mem_size)
+{
+    if (mem_size == 0 || (mem_size & (mem_size - 1)) != 0)
+        return -1;
+    int c = 0;
+    while (mem_size >>= 1)
+        c++;
+    return c < R5VM_POOL_CLASSES ? c : -1;
+}
+
+static void pool_free_vm(r5vm_pool_vm_t* v)
+{
+    r5vm_host_destroy(&v->host);
+    free(v);
+}
+
+// ---- Functions -------------------------------------------------------------
+
+void r5vm_pool_init(r5vm_pool_t* pool, unsigned max_free)
+{
+    memset(pool, 0, sizeof(*pool));
+#if !defined(_WIN32)
+    pthread_mutex_init(&pool->lock, NULL);
+#endif
+    pool->max_free = max_free;
+}
+
+void r5vm_pool_destroy(r5vm_pool_t* pool)
+{
+    for (int c = 0; c < R5VM_POOL_CLASSES; c++) {
+        while (pool->free[c]) {
+            r5vm_pool_vm_t* v = pool->free[c];
+            pool->free[c] = v->next;
+            pool_free_vm(v);
+        }
+    }
+#if !defined(_WIN32)
+    pthread_mutex_destroy(&pool->lock);
+#endif
+    memset(pool, 0, sizeof(*pool));
+}
+
+r5vm_host_t* r5vm_pool_acquire(r5vm_pool_t* pool, uint32_t mem_size)
+{
+    const int c = pool_class(mem_size);
+    if (c < 0)
+        return NULL;
+
+    POOL_LOCK(pool);
+    r5vm_pool_vm_t* v = pool->free[c];
+    if (v) {
+        pool->free[c] = v->next;
+        pool->count[c]--;
+        pool->hits++;
+    } else {
+        pool->misses++;
+    }
+    POOL_UNLOCK(pool);
+    if (v)
+        return &v->host; /* already scrubbed by r5vm_pool_release() */
+
+    v = malloc(sizeof(*v));
+    if (!v)
+        return NULL;
+    if (!r5vm_host_init(&v->host, mem_size)) {
+        free(v);
+        return NULL;
+    }
+    return &v->host;
+}
+
+void r5vm_pool_release(r5vm_pool_t* pool, r5vm_host_t* host)
+{
+    r5vm_pool_vm_t* v = (r5vm_pool_vm_t*)host;
+    const int c = pool_class(host->vm.mem_size);
+
+    if (c < 0 || !r5vm_host_recycle(host)) {
+        pool_free_vm(v);
+        return;
+    }
+    POOL_LOCK(pool);
+    if (pool->count[c] < pool->max_free) {
+        v->next = pool->free[c];
+        pool->free[c] = v;
+        pool->count[c]++;
+        v = NULL;
+    }
+    POOL_UNLOCK(pool);
+    if (v)
+        pool_free_vm(v);
+}
@@ -0,0 +1,114 @@
+/*
+ * R5VM - Minimal RISC-V RV32I Virtual Machine
+ *       _____
+ *      | ____|
+ *  _ __| |____   ___ __ ___
+ * | '__|___ \ \ / / '_ ` _ \
+ * | |   ___) \ V /| | | | | |
+ * |_|  |____/ \_/ |_| |_| |_|
+ *
+ * Copyright (c) 2025 Jan Zwiener
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file r5vm_pool.h
+ * @brief Recycling pool of host VMs with their guest memory.
+ *
+ * Creating a VM with r5vm_host_init() maps fresh guest memory, destroying
+ * it unmaps the memory again; both are system calls plus page-table work
+ * that dominate short jobs. A pool keeps released VMs, together with their
+ * mapping, in one free list per memory size. r5vm_host_recycle() scrubs a
+ * released VM lazily: its pages are dropped and zero-filled by the kernel
+ * only when the next guest touches them. Taking a VM from a warm pool is a
+ * lock, a list pop and an r5vm_init().
+ *
+ * Pools are thread-safe.
+ */
+
+#ifndef R5VM_POOL_H
+#define R5VM_POOL_H
+
+#include "r5vm_host.h"
+
+// ---- Defines ---------------------------------------------------------------
+
+/** @brief Number of memory size classes (powers of two up to 2 GiB). */
+#define R5VM_POOL_CLASSES  32
+
+// ---- Pool data structure ---------------------------------------------------
+
+struct r5vm_pool_vm_s;
+
+/** @brief A pool of released VMs, one free list per memory size. */
+typedef struct r5vm_pool_s
+{
+#if !defined(_WIN32)
+    pthread_mutex_t lock; /**< Protects the free lists and counters */
+#endif
+    struct r5vm_pool_vm_s* free[R5VM_POOL_CLASSES]; /**< Free VMs by log2 size */
+    unsigned count[R5VM_POOL_CLASSES]; /**< Length of each free list */
+    unsigned max_free; /**< Max. VMs kept per size class */
+    unsigned hits;     /**< Acquires served from a free list */
+    unsigned misses;   /**< Acquires that created a new VM */
+} r5vm_pool_t;
+
+// ---- Functions -------------------------------------------------------------
+
+/**
+ * @brief Initialize an empty pool.
+ *
+ * @param pool      Pool to initialize.
+ * @param max_free  VMs kept per memory size, more are destroyed on release.
+ */
+void r5vm_pool_init(r5vm_pool_t* pool, unsigned max_free);
+
+/**
+ * @brief Destroy the pool and every VM it holds.
+ *
+ * VMs still acquired are not tracked and must not be released afterwards.
+ *
+ * @param pool Pool instance.
+ */
+void r5vm_pool_destroy(r5vm_pool_t* pool);
+
+/**
+ * @brief Get a VM with `mem_size` bytes of zeroed guest memory.
+ *
+ * The VM is in the state r5vm_host_init() leaves it in, reused from the
+ * pool if one of that size is free.
+ *
+ * @param pool      Pool instance.
+ * @param mem_size  Guest memory size in bytes (power of two).
+ * @return The VM, or NULL on invalid size or allocation failure.
+ */
+r5vm_host_t* r5vm_pool_acquire(r5vm_pool_t* pool, uint32_t mem_size);
+
+/**
+ * @brief Give a VM from r5vm_pool_acquire() back to the pool.
+ *
+ * The VM is recycled with r5vm_host_recycle() outside the pool lock.
+ *
+ * @param pool  Pool instance.
+ * @param host  VM to release, must not be used afterwards.
+ */
+void r5vm_pool_release(r5vm_pool_t* pool, r5vm_host_t* host);
+
+#endif // R5VM_POOL_H
@@ -0,0 +1,496 @@
+/*
+ * R5VM - Minimal RISC-V RV32I Virtual Machine
+ *       _____
+ *      | ____|
+ *  _ __| |____   ___ __ ___
+ * | '__|___ \ \ / / '_ ` _ \
+ * | |   ___) \ V /| | | | | |
+ * |_|  |____/ \_/ |_| |_| |_|
+ *
+ * Copyright (c) 2025 Jan Zwiener
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#if !defined(_WIN32)
+#define _DEFAULT_SOURCE   /* struct sockaddr_un on glibc */
+#define _DARWIN_C_SOURCE
+#endif
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+
+#include "r5vm_serve.h"
+
+#if !defined(_WIN32)
+
+// ---- Server state ----------------------------------------------------------
+
+/** Per-VM request state, installed as `host->user` */
+typedef struct r5vm_serve_job_s
+{
+    r5vm_ecall_fn  next;      /**< ECALL handler of the host layer */
+    bool           warm;      /**< Checkpoint reached, deliver requests */
+    const uint8_t* req;       /**< Payload of the current request */
+    uint32_t       req_len;   /**< Payload length in bytes */
+    uint32_t       resp_addr; /**< Guest address of the response */
+    uint32_t       resp_len;  /**< Response length in bytes */
+    bool           responded; /**< Guest called R5VM_ECALL_RESPOND */
+} r5vm_serve_job_t;
+
+/** A warm image version, the template of the requests started on it */
+typedef struct r5vm_serve_image_s
+{
+    r5vm_host_t* tmpl;    /**< Warm template VM */
+    unsigned     version; /**< 1 for the initial image, +1 per reload */
+    unsigned     refs;    /**< Requests running on this version */
+    bool         owned;   /**< Loaded by a reload, released when drained */
+} r5vm_serve_image_t;
+
+/** State shared by all workers */
+typedef struct r5vm_serve_s
+{
+    pthread_mutex_t            lock;    /**< Protects cur, refs and alive */
+    r5vm_serve_image_t*        cur;     /**< Version for new requests */
+    const r5vm_serve_loader_t* loader;  /**< Reload callbacks or NULL */
+    unsigned                   alive;   /**< Running worker threads */
+    pthread_t                  main;    /**< Thread waiting for reloads */
+    uint64_t                   fuel;    /**< Instructions per request, 0: unlimited */
+} r5vm_serve_t;
+
+/** A worker thread with its own VM */
+typedef struct r5vm_serve_worker_s
+{
+    r5vm_host_t        host;    /**< Worker VM, reset to a template per request */
+    r5vm_serve_t*      srv;     /**< Shared server state */
+    r5vm_serve_job_t   job;     /**< Request state of `host` */
+    uint8_t*           buf;     /**< Request payload buffer */
+    uint32_t           buf_cap; /**< Size of `buf` in bytes */
+    int                lfd;     /**< Listening socket */
+    pthread_t          thread;
+    bool               started; /**< `thread` is running */
+} r5vm_serve_worker_t;
+
+/** Checkpoint and respond ECALLs, everything else goes to the host layer. */
+static bool serve_ecall(r5vm_t* vm, uint32_t id)
+{
+    r5vm_host_t* host = (r5vm_host_t*)vm;
+    r5vm_serve_job_t* job = (r5vm_serve_job_t*)host->user;
+
+    if (id == R5VM_ECALL_CHECKPOINT) {
+        if (!job->warm) {
+            /* end of the warm-up, workers execute the ECALL again */
+            vm->pc = (vm->pc - 4) & vm->mem_mask;
+            vm->status = R5VM_BREAK;
+            job->warm = true;
+            return false;
+        }
+        const uint32_t n = job->req_len < vm->a1 ? job->req_len : vm->a1;
+        if (n && !r5vm_host_write(host, vm->a0, job->req, n)) {
+            r5vm_error(vm, "ECALL memory out of bounds", (vm->pc - 4) & vm->mem_mask, id);
+            return false;
+        }
+        vm->a0 = n;
+        return true;
+    }
+    if (id == R5VM_ECALL_RESPOND) {
+        /* the response is sent after the run, it must not touch the guard */
+        if (vm->a1 && !r5vm_host_readable(host, vm, vm->a0, vm->a1)) {
+            r5vm_error(vm, "ECALL memory out of bounds", (vm->pc - 4) & vm->mem_mask, id);
+            return false;
+        }
+        job->resp_addr = vm->a0;
+        job->resp_len = vm->a1;
+        job->responded = true;
+        vm->a0 = 0;
+        vm->status = R5VM_EXIT;
+        return false;
+    }
+    return job->next(vm, id);
+}
+
+/** Run until the guest halts or used `fuel` instructions (0: no limit),
+    a `pause` hint only yields. */
+static void serve_run(r5vm_host_t* host, uint64_t fuel)
+{
+    uint64_t n = 0;
+    do {
+        const uint64_t left = fuel - n;
+        n += r5vm_host_run(host, !fuel ? 0 : left > UINT_MAX ? UINT_MAX : (unsigned)left);
+    } while (r5vm_paused(&host->vm) && (!fuel || n < fuel));
+}
+
+static bool serve_read(int fd, void* buf, uint32_t len)
+{
+    uint8_t* p = buf;
+    while (len) {
+        const ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        len -= (uint32_t)n;
+    }
+    return true;
+}
+
+static bool serve_write(int fd, const void* buf, uint32_t len)
+{
+    const uint8_t* p = buf;
+    while (len) {
+        const ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        len -= (uint32_t)n;
+    }
+    return true;
+}
+
+/** Warm up `host` to its checkpoint with `job` installed. */
+static bool serve_warm(r5vm_host_t* host, r5vm_serve_job_t* job)
+{
+    memset(job, 0, sizeof(*job));
+    job->next = host->vm.ecall_fn;
+    host->user = job;
+    host->vm.ecall_fn = serve_ecall;
+    serve_run(host, 0);
+    host->vm.ecall_fn = job->next;
+    if (!job->warm || host->vm.status != R5VM_BREAK) {
+        fprintf(stderr, "error: guest halted before the checkpoint ECALL\n");
+        return false;
+    }
+    return true;
+}
+
+/** Pin the current image version for one request. */
+static r5vm_serve_image_t* serve_acquire(r5vm_serve_t* srv)
+{
+    pthread_mutex_lock(&srv->lock);
+    r5vm_serve_image_t* img = srv->cur;
+    img->refs++;
+    pthread_mutex_unlock(&srv->lock);
+    return img;
+}
+
+/** Free a replaced version without requests. Called with `srv->lock` held. */
+static void serve_drop(r5vm_serve_t* srv, r5vm_serve_image_t* img)
+{
+    if (img == srv->cur || img->refs)
+        return;
+    fprintf(stderr, "[r5vm] serve: version %u drained\n", img->version);
+    if (img->owned)
+        srv->loader->release(img->tmpl, srv->loader->user);
+    free(img);
+}
+
+static void serve_release(r5vm_serve_t* srv, r5vm_serve_image_t* img)
+{
+    pthread_mutex_lock(&srv->lock);
+    img->refs--;
+    serve_drop(srv, img);
+    pthread_mutex_unlock(&srv->lock);
+}
+
+/** (Re)create the worker VM in the size of `tmpl`, e.g. after a reload. */
+static bool serve_vm(r5vm_serve_worker_t* w, const r5vm_host_t* tmpl)
+{
+    if (!w->host.map || w->host.vm.mem_size != tmpl->vm.mem_size) {
+        r5vm_host_destroy(&w->host);
+        if (!r5vm_host_init(&w->host, tmpl->vm.mem_size))
+            return false;
+        w->job.next = w->host.vm.ecall_fn;
+        w->job.warm = true;
+        w->host.user = &w->job;
+        w->host.vm.ecall_fn = serve_ecall;
+    }
+    return r5vm_host_set_limit(&w->host, tmpl->mem_limit);
+}
+
+/** Reset the worker VM to `tmpl`, including its watchpoints. */
+static bool serve_reset(r5vm_serve_worker_t* w, const r5vm_host_t* tmpl)
+{
+    /* r5vm_host_copy() writes the watched pages, add them back after it */
+    for (int i = 0; i < R5VM_HOST_MAX_WATCH; i++)
+        r5vm_host_unwatch(&w->host, i);
+    if (!serve_vm(w, tmpl) || !r5vm_host_copy(&w->host, tmpl))
+        return false;
+    for (int i = 0; i < R5VM_HOST_MAX_WATCH; i++) {
+        if (tmpl->watch[i].len &&
+            r5vm_host_watch(&w->host, tmpl->watch[i].addr, tmpl->watch[i].len) < 0)
+            return false;
+    }
+    w->host.watch_fn = tmpl->watch_fn;
+    return true;
+}
+
+/** Load, warm up and publish a new image version. */
+static void serve_reload(r5vm_serve_t* srv)
+{
+    r5vm_serve_job_t job;
+    r5vm_host_t* host = srv->loader->load(srv->loader->user);
+    r5vm_serve_image_t* img = host ? calloc(1, sizeof(*img)) : NULL;
+
+    if (!img || !serve_warm(host, &job)) {
+        fprintf(stderr, "error: reload failed, keeping version %u\n",
+                srv->cur->version);
+        if (host)
+            srv->loader->release(host, srv->loader->user);
+        free(img);
+        return;
+    }
+    host->user = NULL; /* `job` goes out of scope, copies install their own */
+    img->tmpl = host;
+    img->owned = true;
+
+    pthread_mutex_lock(&srv->lock);
+    r5vm_serve_image_t* old = srv->cur;
+    img->version = old->version + 1;
+    srv->cur = img;
+    fprintf(stderr, "[r5vm] serve: version %u warm at PC=0x%08X, "
+                    "%u request(s) left on version %u\n",
+            img->version, (unsigned)host->vm.pc, old->refs, old->version);
+    serve_drop(srv, old);
+    pthread_mutex_unlock(&srv->lock);
+}
+
+/** Read one request from `conn`, run it and send the response. */
+static bool serve_request(r5vm_serve_worker_t* w, int conn)
+{
+    uint8_t hdr[4];
+
+    if (!serve_read(conn, hdr, 4))
+        return false;
+    const uint32_t len = hdr[0] | (hdr[1] << 8) | (hdr[2] << 16) | ((uint32_t)hdr[3] << 24);
+    if (len > R5VM_SERVE_MAX_REQUEST)
+        return false;
+    if (len > w->buf_cap) {
+        uint8_t* buf = realloc(w->buf, len);
+        if (!buf)
+            return false;
+        w->buf = buf;
+        w->buf_cap = len;
+    }
+    if (!serve_read(conn, w->buf, len))
+        return false;
+
+    w->job.req = w->buf;
+    w->job.req_len = len;
+    w->job.responded = false;
+    uint32_t out = R5VM_SERVE_FAILED;
+    r5vm_serve_image_t* img = serve_acquire(w->srv);
+    if (serve_reset(w, img->tmpl)) {
+        serve_run(&w->host, w->srv->fuel);
+        if (w->host.vm.status == R5VM_EXIT)
+            out = w->job.responded ? w->job.resp_len : 0;
+    }
+    serve_release(w->srv, img);
+
+    for (int i = 0; i < 4; i++)
+        hdr[i] = (uint8_t)(out >> (8 * i));
+    if (!serve_write(conn, hdr, 4))
+        return false;
+    if (out == R5VM_SERVE_FAILED || !out)
+        return true;
+    return serve_write(conn, w->host.map + w->job.resp_addr, out);
+}
+
+static void* serve_worker(void* arg)
+{
+    r5vm_serve_worker_t* w = arg;
+
+    for (;;) {
+        const int conn = accept(w->lfd, NULL, NULL);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            perror("accept");
+            break;
+        }
+        while (serve_request(w, conn)) {
+        }
+        close(conn);
+    }
+
+    pthread_mutex_lock(&w->srv->lock);
+    if (--w->srv->alive == 0) /* nobody serves any more, stop waiting */
+        pthread_kill(w->srv->main, SIGHUP);
+    pthread_mutex_unlock(&w->srv->lock);
+    return NULL;
+}
+
+/** Remove a stale socket at `path`, refuse to replace anything else. */
+static bool serve_unlink(const char* path)
+{
+    struct stat st;
+
+    if (lstat(path, &st) != 0)
+        return true;
+    if (!S_ISSOCK(st.st_mode)) {
+        fprintf(stderr, "error: '%s' exists and is not a socket\n", path);
+        return false;
+    }
+    unlink(path);
+    return true;
+}
+
+// ---- Functions -------------------------------------------------------------
+
+bool r5vm_serve(r5vm_host_t* host, const char* path, unsigned workers,
+                uint64_t fuel, const r5vm_serve_loader_t* loader)
+{
+    struct sockaddr_un addr;
+    r5vm_serve_job_t tmpl_job;
+    r5vm_serve_worker_t* pool = NULL;
+    r5vm_serve_t srv;
+    sigset_t hup, saved_mask;
+    int lfd = -1;
+
+    if (!workers || strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "error: invalid worker count or socket path '%s'\n", path);
+        return false;
+    }
+
+    /* warm up: run the one-time setup of the guest in the template */
+    void* saved_user = host->user;
+    const bool warm = serve_warm(host, &tmpl_job);
+    host->user = saved_user;
+    if (!warm)
+        return false;
+
+    memset(&srv, 0, sizeof(srv));
+    srv.cur = calloc(1, sizeof(*srv.cur));
+    if (!srv.cur)
+        return false;
+    srv.cur->tmpl = host;
+    srv.cur->version = 1;
+    srv.loader = loader;
+    srv.fuel = fuel;
+    srv.main = pthread_self();
+    pthread_mutex_init(&srv.lock, NULL);
+    /* reloads are requested with SIGHUP, received by sigwait() below */
+    sigemptyset(&hup);
+    sigaddset(&hup, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &hup, &saved_mask);
+
+    lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (lfd < 0) {
+        perror("socket");
+        goto cleanup;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if (!serve_unlink(path))
+        goto cleanup;
+    if (bind(lfd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(lfd, SOMAXCONN) != 0) {
+        perror("bind");
+        goto cleanup;
+    }
+    signal(SIGPIPE, SIG_IGN); /* a client that went away is not fatal */
+
+    pool = calloc(workers, sizeof(*pool));
+    if (!pool)
+        goto cleanup;
+    for (unsigned i = 0; i < workers; i++) {
+        r5vm_serve_worker_t* w = &pool[i];
+        w->srv = &srv;
+        w->lfd = lfd;
+        if (!serve_vm(w, host)) {
+            fprintf(stderr, "error: cannot create worker VM %u\n", i);
+            goto cleanup;
+        }
+        pthread_mutex_lock(&srv.lock);
+        srv.alive++;
+        pthread_mutex_unlock(&srv.lock);
+        if (pthread_create(&w->thread, NULL, serve_worker, w) != 0) {
+            perror("pthread_create");
+            pthread_mutex_lock(&srv.lock);
+            srv.alive--;
+            pthread_mutex_unlock(&srv.lock);
+            goto cleanup;
+        }
+        w->started = true;
+    }
+    fprintf(stderr, "[r5vm] serve: %u VM(s) warm at PC=0x%08X, listening on %s%s\n",
+            workers, (unsigned)host->vm.pc, path,
+            loader ? ", SIGHUP reloads the image" : "");
+    for (;;) { /* workers only stop on errors */
+        int sig;
+        sigwait(&hup, &sig);
+        pthread_mutex_lock(&srv.lock);
+        const unsigned alive = srv.alive;
+        pthread_mutex_unlock(&srv.lock);
+        if (!alive)
+            break;
+        if (loader)
+            serve_reload(&srv);
+    }
+
+cleanup:
+    if (lfd >= 0)
+        shutdown(lfd, SHUT_RDWR); /* wake workers blocked in accept() */
+    for (unsigned i = 0; pool && i < workers; i++) {
+        if (pool[i].started)
+            pthread_join(pool[i].thread, NULL);
+        r5vm_host_destroy(&pool[i].host);
+        free(pool[i].buf);
+    }
+    free(pool);
+    if (lfd >= 0)
+        close(lfd);
+    if (srv.cur->owned)
+        loader->release(srv.cur->tmpl, loader->user);
+    free(srv.cur);
+    pthread_mutex_destroy(&srv.lock);
+    pthread_sigmask(SIG_SETMASK, &saved_mask, NULL);
+    return false;
+}
+
+#else /* _WIN32 */
+
+bool r5vm_serve(r5vm_host_t* host, const char* path, unsigned workers,
+                uint64_t fuel, const r5vm_serve_loader_t* loader)
+{
+    (void)host;
+    (void)path;
+    (void)workers;
+    (void)fuel;
+    (void)loader;
+    fprintf(stderr, "error: serve mode requires a POSIX host\n");
+    return false;
+}
+
+#endif /* !_WIN32 */
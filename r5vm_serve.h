@@ -0,0 +1,109 @@
+/*
+ * R5VM - Minimal RISC-V RV32I Virtual Machine
+ *       _____
+ *      | ____|
+ *  _ __| |____   ___ __ ___
+ * | '__|___ \ \ / / '_ ` _ \
+ * | |   ___) \ V /| | | | | |
+ * |_|  |____/ \_/ |_| |_| |_|
+ *
+ * Copyright (c) 2025 Jan Zwiener
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file r5vm_serve.h
+ * @brief Request-serving daemon: a pool of warm VMs behind a Unix socket.
+ *
+ * The guest runs once up to its checkpoint, `R5VM_ECALL_CHECKPOINT`. The
+ * warm VM becomes the template of a pool of worker VMs, one per thread.
+ * For every request a worker resets its VM to the template (a memory copy,
+ * no process spawn), delivers the payload at the checkpoint, runs the guest
+ * to `R5VM_ECALL_RESPOND` and sends the response buffer back. Workers take
+ * over the quota and watchpoints of the template.
+ *
+ * A new image version can be loaded while the server runs: on `SIGHUP` the
+ * loader builds a new template VM, it is warmed up next to the old one and
+ * every request that starts afterwards runs on it. Requests in flight
+ * finish on the version they started on; the old template (with its HLE
+ * table and any other per-image state) is released after the last one.
+ *
+ * Protocol, any number of requests per connection:
+ * - request:  `u32 length` (little endian), then `length` payload bytes
+ * - response: `u32 length`, then `length` bytes. An exit without response
+ *   sends length 0, a guest error or a request out of fuel
+ *   `R5VM_SERVE_FAILED` without payload.
+ */
+
+#ifndef R5VM_SERVE_H
+#define R5VM_SERVE_H
+
+#include "r5vm_host.h"
+
+// ---- Defines ---------------------------------------------------------------
+
+/** @brief Largest accepted request payload in bytes. */
+#define R5VM_SERVE_MAX_REQUEST  (16u << 20)
+
+/** @brief Response length sent when the guest failed. */
+#define R5VM_SERVE_FAILED       0xFFFFFFFFu
+
+/** @brief Default instruction budget per request of `r5vm --serve`. */
+#define R5VM_SERVE_FUEL         (1ull << 32)
+
+// ---- Types -----------------------------------------------------------------
+
+/** @brief Callbacks that load new image versions for hot reloads. */
+typedef struct r5vm_serve_loader_s
+{
+    /**
+     * Load the new image into a new host VM, initialized and reset.
+     * Returns NULL on errors, the old version keeps serving.
+     */
+    r5vm_host_t* (*load)(void* user);
+    /** Free a VM returned by `load` once no request runs on it. */
+    void (*release)(r5vm_host_t* host, void* user);
+    void* user; /**< Passed to both callbacks */
+} r5vm_serve_loader_t;
+
+// ---- Functions -------------------------------------------------------------
+
+/**
+ * @brief Warm up the guest and serve requests on `path` with `workers` VMs.
+ *
+ * The VM must be initialized and reset; it becomes the template of version
+ * 1 and does not run after the warm-up. The calling thread waits for
+ * `SIGHUP` and then loads the next version with `loader`, all server
+ * threads block the signal. Only returns on errors.
+ *
+ * @param host     Host VM instance to warm up.
+ * @param path     Unix socket path, a stale socket is replaced, any other
+ *                 existing file is an error.
+ * @param workers  Number of worker VMs and threads (>= 1).
+ * @param fuel     Instructions per request (0: unlimited), a request that
+ *                 runs out fails with `R5VM_SERVE_FAILED`.
+ * @param loader   Reload callbacks, NULL to ignore `SIGHUP`.
+ * @return `false` if the guest halted before the checkpoint, the pool could
+ *         not be created or the socket could not be set up.
+ */
+bool r5vm_serve(r5vm_host_t* host, const char* path, unsigned workers,
+                uint64_t fuel, const r5vm_serve_loader_t* loader);
+
+#endif // R5VM_SERVE_H
@@ -0,0 +1,173 @@
+/*
+ * R5VM - Minimal RISC-V RV32I Virtual Machine
+ *       _____
+ *      | ____|
+ *  _ __| |____   ___ __ ___
+ * | '__|___ \ \ / / '_ ` _ \
+ * | |   ___) \ V /| | | | | |
+ * |_|  |____/ \_/ |_| |_| |_|
+ *
+ * Copyright (c) 2025 Jan Zwiener
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#if !defined(_WIN32)
+#define _DEFAULT_SOURCE   /* MAP_ANONYMOUS, madvise, mincore on glibc */
+#define _DARWIN_C_SOURCE  /* MAP_ANON on macOS */
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#include "r5vm_slab.h"
+
+// ---- Macros ---------------------------------------------------------------
+
+#define IS_POWER_OF_TWO(n)  ((n) != 0 && ((n) & ((n) - 1)) == 0)
+
+// ---- Local helpers ---------------------------------------------------------
+
+static size_t slab_page_size(void)
+{
+#if !defined(_WIN32)
+    long ps = sysconf(_SC_PAGESIZE);
+    return ps > 0 ? (size_t)ps : 4096;
+#else
+    return 4096;
+#endif
+}
+
+/** Make slot `i` read as zero again */
+static void slab_scrub(r5vm_slab_t* slab, uint32_t i)
+{
+    uint8_t* mem = slab->mem + (size_t)i * slab->slot_size;
+#if defined(__linux__) && defined(MADV_DONTNEED)
+    /* drop the pages instead of clearing them, the slot costs no memory
+       until the next guest touches it */
+    if (slab->slot_size % slab_page_size() == 0 &&
+        madvise(mem, slab->slot_size, MADV_DONTNEED) == 0)
+        return;
+#endif
+    memset(mem, 0, slab->slot_size);
+}
+
+// ---- Functions -------------------------------------------------------------
+
+bool r5vm_slab_init(r5vm_slab_t* slab, uint32_t capacity, uint32_t slot_size)
+{
+    memset(slab, 0, sizeof(*slab));
+    if (!capacity || !IS_POWER_OF_TWO(slot_size) ||
+        capacity > SIZE_MAX / slot_size)
+        return false;
+
+    const size_t page = slab_page_size();
+    slab->map_size = ((size_t)capacity * slot_size + page - 1) & ~(page - 1);
+#if !defined(_WIN32)
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#if defined(MAP_NORESERVE)
+    flags |= MAP_NORESERVE; /* most slots are never touched in full */
+#endif
+    void* map = mmap(NULL, slab->map_size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (map == MAP_FAILED)
+        map = NULL;
+#else
+    void* map = calloc(slab->map_size, 1);
+#endif
+    slab->mem = map;
+    slab->vms = calloc(capacity, sizeof(*slab->vms));
+    slab->free_slots = malloc(capacity * sizeof(*slab->free_slots));
+    if (!slab->mem || !slab->vms || !slab->free_slots) {
+        r5vm_slab_destroy(slab);
+        return false;
+    }
+    slab->capacity = capacity;
+    slab->slot_size = slot_size;
+    /* pop slot 0 first, a part-used slab stays at the start of the mapping */
+    for (uint32_t i = 0; i < capacity; i++)
+        slab->free_slots[i] = capacity - 1 - i;
+    slab->free_count = capacity;
+    return true;
+}
+
+void r5vm_slab_destroy(r5vm_slab_t* slab)
+{
+    if (slab->mem) {
+#if !defined(_WIN32)
+        munmap(slab->mem, slab->map_size);
+#else
+        free(slab->mem);
+#endif
+    }
+    free(slab->vms);
+    free(slab->free_slots);
+    memset(slab, 0, sizeof(*slab));
+}
+
+r5vm_t* r5vm_slab_create(r5vm_slab_t* slab, const uint8_t* image,
+                         uint32_t image_size)
+{
+    if (!slab->free_count || image_size > slab->slot_size)
+        return NULL;
+
+    const uint32_t i = slab->free_slots[--slab->free_count];
+    uint8_t* mem = slab->mem + (size_t)i * slab->slot_size;
+    r5vm_t* vm = &slab->vms[i];
+    memcpy(mem, image, image_size);
+    r5vm_init(vm, mem, slab->slot_size);
+    r5vm_reset(vm);
+    return vm;
+}
+
+void r5vm_slab_free(r5vm_slab_t* slab, r5vm_t* vm)
+{
+    const uint32_t i = (uint32_t)(vm - slab->vms);
+
+    r5vm_destroy(vm);
+    slab_scrub(slab, i);
+    slab->free_slots[slab->free_count++] = i;
+}
+
+size_t r5vm_slab_resident(const r5vm_slab_t* slab)
+{
+    const size_t meta = slab->capacity * (sizeof(*slab->vms) + sizeof(*slab->free_slots));
+#if defined(__linux__)
+    const size_t page = slab_page_size();
+    unsigned char vec[256];
+    size_t resident = 0, off = 0;
+    for (; off < slab->map_size; off += sizeof(vec) * page) {
+        size_t len = slab->map_size - off;
+        if (len > sizeof(vec) * page)
+            len = sizeof(vec) * page;
+        if (mincore(slab->mem + off, len, vec) != 0)
+            break;
+        for (size_t i = 0; i < len / page; i++)
+            resident += (vec[i] & 1) * page;
+    }
+    if (off >= slab->map_size)
+        return meta + resident;
+#endif
+    return meta + (size_t)(slab->capacity - slab->free_count) * slab->slot_size;
+}
@@ -0,0 +1,122 @@
+/*
+ * R5VM - Minimal RISC-V RV32I Virtual Machine
+ *       _____
+ *      | ____|
+ *  _ __| |____   ___ __ ___
+ * | '__|___ \ \ / / '_ ` _ \
+ * | |   ___) \ V /| | | | | |
+ * |_|  |____/ \_/ |_| |_| |_|
+ *
+ * Copyright (c) 2025 Jan Zwiener
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file r5vm_slab.h
+ * @brief Densely packed tiny VMs carved out of one slab.
+ *
+ * For many small guests (16-64 KiB each) the per-instance overhead of
+ * r5vm_host_t (a mapping, a mutex and a condition variable per VM) and of
+ * a `calloc()`/`free()` per create and destroy dominates. A slab instead
+ * reserves one host mapping with a fixed-size memory slot per instance and
+ * a packed array of `r5vm_t`. Creating a VM pops a free slot index and
+ * copies the image, destroying it scrubs the slot and pushes the index
+ * back; neither allocates.
+ *
+ * Slot memory is only backed by host pages once a guest touches it, and
+ * a freed slot gives its pages back to the host (`madvise()` on Linux).
+ * Slab VMs run with plain r5vm_run(): guest accesses are masked to the
+ * slot, so there is no host fault handling, no guard page and no
+ * watchpoints. A slab is not thread-safe; use one slab per thread.
+ */
+
+#ifndef R5VM_SLAB_H
+#define R5VM_SLAB_H
+
+#include "r5vm.h"
+
+// ---- Slab data structure ---------------------------------------------------
+
+/** @brief A slab of equally sized VMs. */
+typedef struct r5vm_slab_s
+{
+    uint8_t*  mem;        /**< Slot `i` is guest memory of vms[i] */
+    size_t    map_size;   /**< Size of the `mem` mapping in bytes */
+    r5vm_t*   vms;        /**< Packed instances, index == slot */
+    uint32_t* free_slots; /**< Stack of free slot indices */
+    uint32_t  free_count; /**< Entries on the free stack */
+    uint32_t  capacity;   /**< Number of slots */
+    uint32_t  slot_size;  /**< Guest memory per VM (power of two) */
+} r5vm_slab_t;
+
+// ---- Functions -------------------------------------------------------------
+
+/**
+ * @brief Reserve a slab for `capacity` VMs of `slot_size` bytes each.
+ *
+ * Only address space is reserved up front; host memory is committed as
+ * guests touch their slots.
+ *
+ * @param slab       Slab to initialize.
+ * @param capacity   Maximum number of live VMs.
+ * @param slot_size  Guest memory size per VM in bytes (power of two).
+ * @return `false` on invalid sizes or allocation failure.
+ */
+bool r5vm_slab_init(r5vm_slab_t* slab, uint32_t capacity, uint32_t slot_size);
+
+/**
+ * @brief Release the slab and every VM still in it.
+ *
+ * @param slab Slab instance.
+ */
+void r5vm_slab_destroy(r5vm_slab_t* slab);
+
+/**
+ * @brief Create a VM from a free slot and load `image` at address 0.
+ *
+ * The VM is initialized and reset; the rest of its memory reads as zero.
+ *
+ * @param slab        Slab instance.
+ * @param image       Program image.
+ * @param image_size  Image size in bytes (<= slot size).
+ * @return The new VM, or NULL if the slab is full or the image too large.
+ */
+r5vm_t* r5vm_slab_create(r5vm_slab_t* slab, const uint8_t* image,
+                         uint32_t image_size);
+
+/**
+ * @brief Return a VM created by r5vm_slab_create() to the slab.
+ *
+ * @param slab Slab instance.
+ * @param vm   VM to release, invalid afterwards.
+ */
+void r5vm_slab_free(r5vm_slab_t* slab, r5vm_t* vm);
+
+/**
+ * @brief Host memory the slab currently uses, in bytes.
+ *
+ * Counts the resident pages of the slot mapping (Linux; elsewhere the
+ * slots of live VMs) plus the instance array and free stack.
+ *
+ * @param slab Slab instance.
+ */
+size_t r5vm_slab_resident(const r5vm_slab_t* slab);
+
+#endif // R5VM_SLAB_H
@@ -0,0 +1,326 @@
+/*
+ * r5vm Assembler Tests
+ * Checks r5vm_asm encodings against GNU as output and runs generated
+ * programs in the VM. Needs no RISC-V cross toolchain.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "r5vm.h"
+#include "r5vm_asm.h"
+
+// ANSI colors
+#define COLOR_RESET   "\033[0m"
+#define COLOR_RED     "\033[31m"
+#define COLOR_GREEN   "\033[32m"
+#define COLOR_CYAN    "\033[36m"
+
+#define TEST_MEM_SIZE (64 * 1024)
+
+static int tests_run = 0;
+static int tests_failed = 0;
+
+void r5vm_error(r5vm_t* vm, const char* msg, uint32_t pc, uint32_t instr)
+{
+    (void)vm;
+    fprintf(stderr, "%sVM ERROR at PC=0x%08X: %s (instr=0x%08X)%s\n",
+            COLOR_RED, pc, msg, instr, COLOR_RESET);
+}
+
+static void check(bool ok, const char* name)
+{
+    tests_run++;
+    if (!ok)
+        tests_failed++;
+    printf("%s[TEST]%s %-40s ... %s%s%s\n", COLOR_CYAN, COLOR_RESET, name,
+           ok ? COLOR_GREEN : COLOR_RED, ok ? "PASS" : "FAIL", COLOR_RESET);
+}
+
+static uint32_t word_at(const uint8_t* buf, int i)
+{
+    const uint8_t* p = buf + 4 * i;
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Reference encodings taken from riscv64-unknown-elf-objdump
+static void test_encodings(void)
+{
+    uint8_t buf[256];
+    r5vm_asm_t a;
+    r5vm_asm_init(&a, buf, sizeof(buf), 0);
+
+    r5vm_asm_add(&a, R5VM_A3, R5VM_A1, R5VM_A2);    // 0x00c586b3
+    r5vm_asm_sub(&a, R5VM_A0, R5VM_A1, R5VM_A2);    // 0x40c58533
+    r5vm_asm_addi(&a, R5VM_A0, R5VM_ZERO, -1);      // 0xfff00513
+    r5vm_asm_srai(&a, R5VM_A0, R5VM_A0, 3);         // 0x40355513
+    r5vm_asm_lui(&a, R5VM_A0, 0x12345000);          // 0x12345537
+    r5vm_asm_sw(&a, R5VM_RA, 12, R5VM_SP);          // 0x00112623
+    r5vm_asm_lw(&a, R5VM_RA, 12, R5VM_SP);          // 0x00c12083
+    r5vm_asm_sb(&a, R5VM_A0, -1, R5VM_SP);          // 0xfea10fa3
+    r5vm_asm_ret(&a);                               // 0x00008067
+    r5vm_asm_ecall(&a);                             // 0x00000073
+    r5vm_asm_fence(&a);                             // 0x0ff0000f
+    r5vm_asm_wfi(&a);                               // 0x10500073
+    r5vm_asm_pause(&a);                             // 0x0100000f
+    int fwd = r5vm_asm_label(&a);
+    r5vm_asm_beq(&a, R5VM_A0, R5VM_A1, fwd);        // 0x00b50463
+    r5vm_asm_jal(&a, R5VM_RA, fwd);                 // 0x004000ef
+    r5vm_asm_bind(&a, fwd);
+    r5vm_asm_bne(&a, R5VM_T0, R5VM_ZERO, fwd);      // 0x00029063
+    r5vm_asm_jal(&a, R5VM_ZERO, fwd);               // 0xffdff06f
+
+    static const uint32_t expect[] = {
+        0x00c586b3, 0x40c58533, 0xfff00513, 0x40355513, 0x12345537,
+        0x00112623, 0x00c12083, 0xfea10fa3, 0x00008067, 0x00000073,
+        0x0ff0000f, 0x10500073, 0x0100000f, 0x00b50463, 0x004000ef, 0x00029063, 0xffdff06f,
+    };
+    bool ok = r5vm_asm_finish(&a) && a.pos == sizeof(expect);
+    for (int i = 0; ok && i < (int)(sizeof(expect) / sizeof(expect[0])); i++) {
+        if (word_at(buf, i) != expect[i]) {
+            fprintf(stderr, "  word %d: 0x%08x, expected 0x%08x\n",
+                    i, word_at(buf, i), expect[i]);
+            ok = false;
+        }
+    }
+    check(ok, "asm: encodings");
+}
+
+static void test_errors(void)
+{
+    uint8_t buf[8];
+    r5vm_asm_t a;
+
+    r5vm_asm_init(&a, buf, sizeof(buf), 0);
+    r5vm_asm_addi(&a, R5VM_A0, R5VM_A0, 2048);
+    check(!r5vm_asm_finish(&a), "asm: immediate out of range");
+
+    r5vm_asm_init(&a, buf, sizeof(buf), 0);
+    r5vm_asm_j(&a, r5vm_asm_label(&a));
+    check(!r5vm_asm_finish(&a), "asm: unbound label");
+
+    r5vm_asm_init(&a, buf, sizeof(buf), 0);
+    r5vm_asm_nop(&a);
+    r5vm_asm_nop(&a);
+    r5vm_asm_nop(&a);
+    check(!r5vm_asm_finish(&a), "asm: buffer overflow");
+}
+
+/** Run generated code and return a0, or ~0 if the VM did not exit. */
+static uint32_t run(uint8_t* mem)
+{
+    r5vm_t vm;
+    if (!r5vm_init(&vm, mem, TEST_MEM_SIZE))
+        return ~0u;
+    r5vm_reset(&vm);
+    r5vm_run(&vm, 100000);
+    return vm.status == R5VM_EXIT ? vm.a0 : ~0u;
+}
+
+static void test_programs(void)
+{
+    uint8_t* mem = calloc(TEST_MEM_SIZE, 1);
+    r5vm_asm_t a;
+
+    // sum 1..100 with a backward branch
+    r5vm_asm_init(&a, mem, TEST_MEM_SIZE, 0);
+    int loop = r5vm_asm_label(&a);
+    r5vm_asm_li(&a, R5VM_A0, 0);
+    r5vm_asm_li(&a, R5VM_T0, 100);
+    r5vm_asm_bind(&a, loop);
+    r5vm_asm_add(&a, R5VM_A0, R5VM_A0, R5VM_T0);
+    r5vm_asm_addi(&a, R5VM_T0, R5VM_T0, -1);
+    r5vm_asm_bnez(&a, R5VM_T0, loop);
+    r5vm_asm_exit(&a);
+    check(r5vm_asm_finish(&a) && run(mem) == 5050, "asm: loop");
+
+    // li with all immediate shapes, call/ret and la + load of a data word
+    memset(mem, 0, TEST_MEM_SIZE);
+    r5vm_asm_init(&a, mem, TEST_MEM_SIZE, 0);
+    int func = r5vm_asm_label(&a);
+    int data = r5vm_asm_label(&a);
+    int fail = r5vm_asm_label(&a);
+    r5vm_asm_li(&a, R5VM_SP, 0x10000);
+    r5vm_asm_li(&a, R5VM_S0, 0xDEADBEEF);
+    r5vm_asm_li(&a, R5VM_S1, 0x00000800);
+    r5vm_asm_li(&a, R5VM_S2, 0xFFFFF800);
+    r5vm_asm_call(&a, func);
+    r5vm_asm_la(&a, R5VM_T0, data);
+    r5vm_asm_lw(&a, R5VM_T1, 0, R5VM_T0);
+    r5vm_asm_bne(&a, R5VM_T1, R5VM_S0, fail);
+    r5vm_asm_add(&a, R5VM_A0, R5VM_S1, R5VM_S2);    // 0x800 + -0x800 = 0
+    r5vm_asm_exit(&a);
+    r5vm_asm_bind(&a, fail);
+    r5vm_asm_li(&a, R5VM_A0, 1);
+    r5vm_asm_exit(&a);
+    r5vm_asm_bind(&a, func);
+    r5vm_asm_addi(&a, R5VM_SP, R5VM_SP, -16);
+    r5vm_asm_sw(&a, R5VM_S0, 0, R5VM_SP);
+    r5vm_asm_lw(&a, R5VM_S0, 0, R5VM_SP);
+    r5vm_asm_addi(&a, R5VM_SP, R5VM_SP, 16);
+    r5vm_asm_ret(&a);
+    r5vm_asm_bind(&a, data);
+    r5vm_asm_word(&a, 0xDEADBEEF);
+    check(r5vm_asm_finish(&a) && run(mem) == 0, "asm: li/la/call/ret");
+
+    free(mem);
+}
+
+static void test_idle(void)
+{
+    uint8_t* mem = calloc(TEST_MEM_SIZE, 1);
+    r5vm_asm_t a;
+    r5vm_t vm;
+
+    // jump to itself, as at the end of crt0.s
+    r5vm_asm_init(&a, mem, TEST_MEM_SIZE, 0);
+    int self = r5vm_asm_label(&a);
+    r5vm_asm_nop(&a);
+    r5vm_asm_bind(&a, self);
+    r5vm_asm_j(&a, self);
+    r5vm_init(&vm, mem, TEST_MEM_SIZE);
+    r5vm_reset(&vm);
+    r5vm_run(&vm, 100000);
+    check(r5vm_asm_finish(&a) && vm.status == R5VM_IDLE && vm.pc == 4,
+          "idle: jump to itself");
+
+    // wfi and pause stop behind the instruction and can be resumed
+    memset(mem, 0, TEST_MEM_SIZE);
+    r5vm_asm_init(&a, mem, TEST_MEM_SIZE, 0);
+    r5vm_asm_wfi(&a);
+    r5vm_asm_pause(&a);
+    r5vm_asm_li(&a, R5VM_A0, 42);
+    r5vm_asm_exit(&a);
+    r5vm_init(&vm, mem, TEST_MEM_SIZE);
+    r5vm_reset(&vm);
+    r5vm_run(&vm, 100000);
+    bool ok = vm.status == R5VM_IDLE && vm.pc == 4;
+    r5vm_run(&vm, 100000);
+    ok = ok && vm.status == R5VM_IDLE && vm.pc == 8;
+    r5vm_run(&vm, 100000);
+    check(r5vm_asm_finish(&a) && ok && vm.status == R5VM_EXIT && vm.a0 == 42,
+          "idle: wfi/pause");
+
+    // polling a flag stops at the load until the host writes the flag
+    memset(mem, 0, TEST_MEM_SIZE);
+    r5vm_asm_init(&a, mem, TEST_MEM_SIZE, 0);
+    int poll = r5vm_asm_label(&a);
+    r5vm_asm_li(&a, R5VM_A1, 0x1000);
+    r5vm_asm_bind(&a, poll);
+    r5vm_asm_lw(&a, R5VM_A0, 0, R5VM_A1);
+    r5vm_asm_beqz(&a, R5VM_A0, poll);
+    r5vm_asm_exit(&a);
+    r5vm_init(&vm, mem, TEST_MEM_SIZE);
+    r5vm_reset(&vm);
+    r5vm_run(&vm, 100000);
+    ok = vm.status == R5VM_IDLE && vm.pc == 4;
+    mem[0x1000] = 7;
+    r5vm_run(&vm, 100000);
+    check(r5vm_asm_finish(&a) && ok && vm.status == R5VM_EXIT && vm.a0 == 7,
+          "idle: polling loop");
+
+    // a load that overwrites its own base register walks a list, no spin
+    memset(mem, 0, TEST_MEM_SIZE);
+    r5vm_asm_init(&a, mem, TEST_MEM_SIZE, 0);
+    int walk = r5vm_asm_label(&a);
+    r5vm_asm_li(&a, R5VM_A0, 0x1000);
+    r5vm_asm_bind(&a, walk);
+    r5vm_asm_lw(&a, R5VM_A0, 0, R5VM_A0);
+    r5vm_asm_bnez(&a, R5VM_A0, walk);
+    r5vm_asm_li(&a, R5VM_A0, 5);
+    r5vm_asm_exit(&a);
+    mem[0x1001] = 0x20; // 0x1000 -> 0x2000 -> 0
+    check(r5vm_asm_finish(&a) && run(mem) == 5, "idle: list walk is not a spin");
+
+    free(mem);
+}
+
+// Assembles instructions and checks the disassembly of each word
+static void test_disasm(void)
+{
+    uint8_t buf[256];
+    r5vm_asm_t a;
+    char text[64];
+    r5vm_asm_init(&a, buf, sizeof(buf), 0x1000);
+
+    r5vm_asm_add(&a, R5VM_A3, R5VM_A1, R5VM_A2);
+    r5vm_asm_sub(&a, R5VM_A0, R5VM_A1, R5VM_A2);
+    r5vm_asm_addi(&a, R5VM_A0, R5VM_ZERO, -1);
+    r5vm_asm_mv(&a, R5VM_A0, R5VM_A1);
+    r5vm_asm_addi(&a, R5VM_A0, R5VM_A1, 5);
+    r5vm_asm_srai(&a, R5VM_A0, R5VM_A0, 3);
+    r5vm_asm_slli(&a, R5VM_T0, R5VM_T1, 31);
+    r5vm_asm_lui(&a, R5VM_A0, 0x12345000);
+    r5vm_asm_auipc(&a, R5VM_GP, 0x1000);
+    r5vm_asm_sw(&a, R5VM_RA, 12, R5VM_SP);
+    r5vm_asm_lw(&a, R5VM_RA, 12, R5VM_SP);
+    r5vm_asm_lbu(&a, R5VM_A0, -1, R5VM_SP);
+    r5vm_asm_sb(&a, R5VM_A0, -1, R5VM_SP);
+    int fwd = r5vm_asm_label(&a);
+    r5vm_asm_beq(&a, R5VM_A0, R5VM_A1, fwd);        // 0x1034
+    r5vm_asm_jal(&a, R5VM_RA, fwd);                 // 0x1038
+    r5vm_asm_bind(&a, fwd);
+    r5vm_asm_bge(&a, R5VM_T0, R5VM_ZERO, fwd);      // 0x103c
+    r5vm_asm_jal(&a, R5VM_ZERO, fwd);
+    r5vm_asm_jalr(&a, R5VM_RA, 8, R5VM_T1);
+    r5vm_asm_ret(&a);
+    r5vm_asm_nop(&a);
+    r5vm_asm_ecall(&a);
+    r5vm_asm_ebreak(&a);
+    r5vm_asm_wfi(&a);
+    r5vm_asm_pause(&a);
+    r5vm_asm_fence(&a);
+    r5vm_asm_word(&a, 0xffffffff);
+
+    static const char* const expect[] = {
+        "add     a3,a1,a2",  "sub     a0,a1,a2",   "li      a0,-1",
+        "mv      a0,a1",     "addi    a0,a1,5",    "srai    a0,a0,3",
+        "slli    t0,t1,31",  "lui     a0,0x12345", "auipc   gp,0x1",
+        "sw      ra,12(sp)", "lw      ra,12(sp)",  "lbu     a0,-1(sp)",
+        "sb      a0,-1(sp)", "beq     a0,a1,0x103c", "jal     ra,0x103c",
+        "bge     t0,zero,0x103c", "j       0x103c", "jalr    ra,8(t1)",
+        "ret", "nop", "ecall", "ebreak", "wfi", "pause", "fence",
+        ".word   0xffffffff",
+    };
+    const int n = (int)(sizeof(expect) / sizeof(expect[0]));
+    bool ok = r5vm_asm_finish(&a) && a.pos == 4u * (uint32_t)n;
+    for (int i = 0; ok && i < n; i++) {
+        r5vm_disasm(text, sizeof(text), word_at(buf, i), 0x1000 + 4u * (uint32_t)i, true);
+        if (strcmp(text, expect[i]) != 0) {
+            fprintf(stderr, "  word %d: got \"%s\", want \"%s\"\n", i, text, expect[i]);
+            ok = false;
+        }
+    }
+    check(ok, "disasm: assembled words round-trip");
+
+    r5vm_disasm(text, sizeof(text), word_at(buf, 0), 0x1000, false);
+    ok = strcmp(text, "add     x13,x11,x12") == 0;
+    r5vm_disasm(text, sizeof(text), word_at(buf, 9), 0x1024, false);
+    ok = ok && strcmp(text, "sw      x1,12(x2)") == 0;
+    check(ok, "disasm: numeric register names");
+
+    check(strcmp(r5vm_reg_name(0, true), "zero") == 0 &&
+          strcmp(r5vm_reg_name(2, true), "sp") == 0 &&
+          strcmp(r5vm_reg_name(10, true), "a0") == 0 &&
+          strcmp(r5vm_reg_name(31, true), "t6") == 0 &&
+          strcmp(r5vm_reg_name(31, false), "x31") == 0 &&
+          strcmp(r5vm_reg_name(33, true), "ra") == 0,
+          "disasm: register names");
+}
+
+int main(void)
+{
+    printf("%s=== r5vm Assembler Tests ===%s\n\n", COLOR_CYAN, COLOR_RESET);
+
+    test_encodings();
+    test_errors();
+    test_programs();
+    test_idle();
+    test_disasm();
+
+    printf("\nTests run: %d, failed: %s%d%s\n", tests_run,
+           tests_failed ? COLOR_RED : COLOR_GREEN, tests_failed, COLOR_RESET);
+    return tests_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,199 @@
+/*
+ * r5vm Batch Tests
+ * Writes small r5vm_asm guests to a temporary directory and runs them as
+ * batches (r5vm_batch.c) on worker threads and processes: exit codes, fuel
+ * limits, per-job output capture and workers that crash. POSIX only.
+ */
+
+#define _DEFAULT_SOURCE   /* mkdtemp on glibc */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <unistd.h>
+#include "r5vm.h"
+#include "r5vm_asm.h"
+#include "r5vm_host.h"
+#include "r5vm_batch.h"
+
+// ANSI colors
+#define COLOR_RESET   "\033[0m"
+#define COLOR_RED     "\033[31m"
+#define COLOR_GREEN   "\033[32m"
+#define COLOR_CYAN    "\033[36m"
+
+#define TEST_MEM_SIZE (64 * 1024)
+#define FUEL          5000
+
+static int tests_run = 0;
+static int tests_failed = 0;
+static char dir[64];
+static char path_a[96], path_b[96], path_code[96], path_spin[96], path_crash[96];
+
+void r5vm_error(r5vm_t* vm, const char* msg, uint32_t pc, uint32_t instr)
+{
+    (void)vm;
+    (void)msg;
+    (void)pc;
+    (void)instr;
+}
+
+static void check(bool ok, const char* name)
+{
+    tests_run++;
+    if (!ok)
+        tests_failed++;
+    printf("%s[TEST]%s %-40s ... %s%s%s\n", COLOR_CYAN, COLOR_RESET, name,
+           ok ? COLOR_GREEN : COLOR_RED, ok ? "PASS" : "FAIL", COLOR_RESET);
+}
+
+/** Write a guest to `dir/name`. `text` is printed, then the guest exits with
+    `code`; a NULL `text` spins forever instead. */
+static bool write_guest(char* path, size_t size, const char* name,
+                        const char* text, uint32_t code)
+{
+    uint8_t image[256];
+    r5vm_asm_t a;
+
+    snprintf(path, size, "%s/%s", dir, name);
+    r5vm_asm_init(&a, image, sizeof(image), 0);
+    if (text) {
+        for (const char* p = text; *p; p++) {
+            r5vm_asm_li(&a, R5VM_A0, (uint8_t)*p);
+            r5vm_asm_syscall(&a, R5VM_ECALL_PUTCHAR);
+        }
+        r5vm_asm_li(&a, R5VM_A0, code);
+        r5vm_asm_exit(&a);
+    } else {
+        const int loop = r5vm_asm_label(&a);
+        r5vm_asm_bind(&a, loop);
+        r5vm_asm_addi(&a, R5VM_T0, R5VM_T0, 1);
+        r5vm_asm_j(&a, loop);
+    }
+    FILE* f = fopen(path, "wb");
+    const bool ok = r5vm_asm_finish(&a) && f && fwrite(image, 1, a.pos, f) == a.pos;
+    if (f)
+        fclose(f);
+    return ok;
+}
+
+/** Batch loader: the image from `job->data` or its file into a pool VM.
+    Loading crash.bin kills the worker process. */
+static r5vm_host_t* load(r5vm_pool_t* pool, const r5vm_batch_job_t* job)
+{
+    uint8_t buf[256];
+    const uint8_t* data = job->data;
+    size_t size = job->data_size;
+
+    if (job->image == path_crash)
+        raise(SIGKILL);
+    if (!data) {
+        FILE* f = fopen(job->image, "rb");
+        size = f ? fread(buf, 1, sizeof(buf), f) : 0;
+        if (f)
+            fclose(f);
+        data = buf;
+    }
+    r5vm_host_t* host = size ? r5vm_pool_acquire(pool, TEST_MEM_SIZE) : NULL;
+    if (host)
+        memcpy(host->map, data, size);
+    return host;
+}
+
+static bool output_is(const r5vm_batch_job_t* job, const char* text)
+{
+    return job->output && job->output_size == strlen(text) &&
+           memcmp(job->output, text, job->output_size) == 0;
+}
+
+static void free_output(r5vm_batch_job_t* jobs, unsigned count)
+{
+    for (unsigned i = 0; i < count; i++)
+        free(jobs[i].output);
+}
+
+static void test_threads(void)
+{
+    r5vm_batch_job_t jobs[5];
+
+    memset(jobs, 0, sizeof(jobs));
+    jobs[0].image = path_a;
+    jobs[1].image = path_spin;
+    jobs[1].fuel = FUEL;
+    jobs[2].image = path_b;
+    jobs[3].image = path_code;
+    jobs[4].image = path_a;
+    const double seconds = r5vm_batch_run(jobs, 5, 3, load);
+
+    check(seconds >= 0.0 && jobs[0].status == R5VM_EXIT && jobs[0].exit_code == 0 &&
+          jobs[2].status == R5VM_EXIT && jobs[4].status == R5VM_EXIT,
+          "threads: jobs exit");
+    check(output_is(&jobs[0], "a\n") && output_is(&jobs[2], "bb\n") &&
+          output_is(&jobs[4], "a\n") && !jobs[1].output && !jobs[3].output,
+          "threads: output captured per job");
+    check(jobs[1].loaded && jobs[1].status == R5VM_RUNNING &&
+          jobs[1].steps >= FUEL && jobs[1].steps < FUEL + 16,
+          "threads: fuel stops a spinning job");
+    check(jobs[3].status == R5VM_EXIT && jobs[3].exit_code == 0xFF,
+          "threads: exit code is the low byte");
+    free_output(jobs, 5);
+}
+
+static void test_procs(void)
+{
+    r5vm_batch_job_t jobs[6];
+
+    memset(jobs, 0, sizeof(jobs));
+    jobs[0].image = path_a;
+    jobs[1].image = path_crash;
+    jobs[2].image = path_b;
+    jobs[3].image = path_spin;
+    jobs[3].fuel = FUEL;
+    jobs[4].image = path_a;
+    jobs[5].image = path_code;
+    const double seconds = r5vm_batch_run_procs(jobs, 6, 2, load);
+
+    check(seconds >= 0.0 && jobs[1].crashed && jobs[1].status == R5VM_ERROR &&
+          !jobs[0].crashed && !jobs[2].crashed && !jobs[4].crashed,
+          "procs: crash only fails its job");
+    check(jobs[0].status == R5VM_EXIT && jobs[2].status == R5VM_EXIT &&
+          jobs[4].status == R5VM_EXIT && jobs[5].status == R5VM_EXIT &&
+          jobs[5].exit_code == 0xFF, "procs: respawned worker runs the rest");
+    check(output_is(&jobs[0], "a\n") && output_is(&jobs[2], "bb\n") &&
+          output_is(&jobs[4], "a\n") && !jobs[1].output && !jobs[3].output,
+          "procs: output captured per job");
+    check(jobs[3].status == R5VM_RUNNING && jobs[3].steps >= FUEL &&
+          jobs[3].steps < FUEL + 16, "procs: fuel stops a spinning job");
+    free_output(jobs, 6);
+}
+
+int main(void)
+{
+    printf("%s=== r5vm Batch Tests ===%s\n\n", COLOR_CYAN, COLOR_RESET);
+
+    snprintf(dir, sizeof(dir), "/tmp/r5vm_test_batch.XXXXXX");
+    if (!mkdtemp(dir) ||
+        !write_guest(path_a, sizeof(path_a), "a.bin", "a\n", 0) ||
+        !write_guest(path_b, sizeof(path_b), "b.bin", "bb\n", 0) ||
+        !write_guest(path_code, sizeof(path_code), "code.bin", "", 0x1FF) ||
+        !write_guest(path_spin, sizeof(path_spin), "spin.bin", NULL, 0) ||
+        !write_guest(path_crash, sizeof(path_crash), "crash.bin", "", 0)) {
+        check(false, "batch: write guests");
+    } else {
+        test_threads();
+        test_procs();
+    }
+    unlink(path_a);
+    unlink(path_b);
+    unlink(path_code);
+    unlink(path_spin);
+    unlink(path_crash);
+    rmdir(dir);
+
+    printf("\nTests run: %d, failed: %s%d%s\n", tests_run,
+           tests_failed ? COLOR_RED : COLOR_GREEN, tests_failed, COLOR_RESET);
+    return tests_failed == 0 ? 0 : 1;
+}
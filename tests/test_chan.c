@@ -0,0 +1,490 @@
+/*
+ * r5vm Channel Tests
+ * Runs r5vm_asm guests as actors under r5vm_chan_run() and checks message
+ * passing between them: page moves that leave the rest of a partial last
+ * page alone, copied messages, blocking on a full channel and deadlock
+ * detection, memory quotas and poll timeouts, plus calls into exported
+ * entries.
+ */
+
+#define _DEFAULT_SOURCE   /* clock_gettime on glibc */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "r5vm.h"
+#include "r5vm_asm.h"
+#include "r5vm_host.h"
+#include "r5vm_chan.h"
+
+// ANSI colors
+#define COLOR_RESET   "\033[0m"
+#define COLOR_RED     "\033[31m"
+#define COLOR_GREEN   "\033[32m"
+#define COLOR_CYAN    "\033[36m"
+
+#define KEY           0x1234
+#define COUNT         200 /**< Messages for the full channel test, > R5VM_CHAN_DEPTH */
+#define KEY_A         0xA
+#define KEY_B         0xB
+#define COOKIE        1000
+#define SVC_STACK     0x8000
+#define SVC_BUF       0x4000
+#define SPIN          4000000 /**< Loop iterations before a cross call */
+#define POLL_MS       50      /**< CHAN_POLL timeout */
+
+static int tests_run = 0;
+static int tests_failed = 0;
+static char last_error[64];
+static volatile bool rpc_deadlock; /**< "RPC deadlock" was reported */
+
+void r5vm_error(r5vm_t* vm, const char* msg, uint32_t pc, uint32_t instr)
+{
+    (void)vm;
+    (void)pc;
+    (void)instr;
+    if (strcmp(msg, "RPC deadlock") == 0)
+        rpc_deadlock = true;
+    snprintf(last_error, sizeof(last_error), "%s", msg);
+}
+
+static void check(bool ok, const char* name)
+{
+    tests_run++;
+    if (!ok)
+        tests_failed++;
+    printf("%s[TEST]%s %-40s ... %s%s%s\n", COLOR_CYAN, COLOR_RESET, name,
+           ok ? COLOR_GREEN : COLOR_RED, ok ? "PASS" : "FAIL", COLOR_RESET);
+}
+
+/** Open channel KEY into s0 */
+static void emit_open(r5vm_asm_t* a)
+{
+    r5vm_asm_li(a, R5VM_A0, KEY);
+    r5vm_asm_syscall(a, R5VM_ECALL_CHAN_OPEN);
+    r5vm_asm_mv(a, R5VM_S0, R5VM_A0);
+}
+
+/** CHAN_SEND or CHAN_RECV on s0 with buffer `addr`, `len` bytes */
+static void emit_xfer(r5vm_asm_t* a, uint32_t id, uint32_t addr, uint32_t len)
+{
+    r5vm_asm_mv(a, R5VM_A0, R5VM_S0);
+    r5vm_asm_li(a, R5VM_A1, addr);
+    r5vm_asm_li(a, R5VM_A2, len);
+    r5vm_asm_syscall(a, id);
+}
+
+/** `count` fresh actors whose code `build` assembles at address 0 */
+static bool start(r5vm_host_t* hosts, r5vm_host_t** vms, unsigned count,
+                  uint32_t mem_size, void (*const* build)(r5vm_asm_t*))
+{
+    bool ok = true;
+    for (unsigned i = 0; i < count; i++) {
+        r5vm_asm_t a;
+        vms[i] = &hosts[i];
+        if (!r5vm_host_init(&hosts[i], mem_size))
+            return false;
+        r5vm_asm_init(&a, hosts[i].map, 0x1000, 0);
+        build[i](&a);
+        ok &= r5vm_asm_finish(&a);
+        r5vm_reset(&hosts[i].vm);
+    }
+    return ok;
+}
+
+// ---- Page moves ------------------------------------------------------------
+
+static uint32_t page;
+
+#define BUF       (2 * page)        /**< Sender buffer */
+#define MSG_LEN   (page + 100)      /**< One whole page and a partial one */
+#define SMALL     (10 * page + 8)   /**< Unaligned small message */
+#define RBUF      (6 * page)        /**< Receiver buffer, two pages */
+#define RSMALL    (11 * page + 4)
+
+static void build_sender(r5vm_asm_t* a)
+{
+    emit_open(a);
+    emit_xfer(a, R5VM_ECALL_CHAN_SEND, BUF, MSG_LEN);
+    r5vm_asm_mv(a, R5VM_S1, R5VM_A0);
+    emit_xfer(a, R5VM_ECALL_CHAN_SEND, SMALL, 16);
+    r5vm_asm_mv(a, R5VM_S2, R5VM_A0);
+    r5vm_asm_li(a, R5VM_A0, 0);
+    r5vm_asm_exit(a);
+}
+
+static void build_receiver(r5vm_asm_t* a)
+{
+    emit_open(a);
+    emit_xfer(a, R5VM_ECALL_CHAN_RECV, RBUF, 2 * page);
+    r5vm_asm_mv(a, R5VM_S1, R5VM_A0);
+    emit_xfer(a, R5VM_ECALL_CHAN_RECV, RSMALL, 64);
+    r5vm_asm_mv(a, R5VM_S2, R5VM_A0);
+    r5vm_asm_li(a, R5VM_A0, 0);
+    r5vm_asm_exit(a);
+}
+
+static void test_page_move(void)
+{
+    static void (*const build[2])(r5vm_asm_t*) = { build_sender, build_receiver };
+    r5vm_host_t hosts[2];
+    r5vm_host_t* vms[2];
+    uint8_t* pattern = malloc(MSG_LEN);
+
+    if (!pattern || !start(hosts, vms, 2, 16 * page, build)) {
+        check(false, "chan: start actors");
+        free(pattern);
+        return;
+    }
+    for (uint32_t i = 0; i < MSG_LEN; i++)
+        pattern[i] = (uint8_t)(i * 7 + 1);
+    memcpy(hosts[0].map + BUF, pattern, MSG_LEN);
+    memcpy(hosts[0].map + SMALL, "small message!!", 16);
+    hosts[0].map[BUF + MSG_LEN + 16] = 0x77; /* same page, not in the message */
+    hosts[1].map[RBUF + MSG_LEN + 16] = 0x55;
+
+    const bool ran = r5vm_chan_run(vms, 2, 2, NULL);
+    check(ran && hosts[0].vm.status == R5VM_EXIT && hosts[1].vm.status == R5VM_EXIT &&
+          hosts[0].vm.s1 == 0 && hosts[0].vm.s2 == 0, "chan: actors exit");
+    check(hosts[1].vm.s1 == MSG_LEN &&
+          memcmp(hosts[1].map + RBUF, pattern, MSG_LEN) == 0,
+          "chan: page message arrives");
+    check(hosts[0].map[BUF + MSG_LEN + 16] == 0x77 &&
+          memcmp(hosts[0].map + BUF + page, pattern + page, MSG_LEN - page) == 0,
+          "chan: sender keeps its partial last page");
+    check(hosts[1].map[RBUF + MSG_LEN + 16] == 0x55,
+          "chan: receiver keeps bytes behind message");
+    check(hosts[1].vm.s2 == 16 &&
+          memcmp(hosts[1].map + RSMALL, "small message!!", 16) == 0,
+          "chan: small message is copied");
+    for (unsigned i = 0; i < 2; i++)
+        r5vm_host_destroy(&hosts[i]);
+    free(pattern);
+}
+
+// ---- Blocking --------------------------------------------------------------
+
+/** Send 1 .. COUNT as 4-byte messages from 0x2000 */
+static void build_counter(r5vm_asm_t* a)
+{
+    const int loop = r5vm_asm_label(a);
+
+    emit_open(a);
+    r5vm_asm_li(a, R5VM_S1, 1);
+    r5vm_asm_li(a, R5VM_S2, COUNT + 1);
+    r5vm_asm_li(a, R5VM_S3, 0x2000);
+    r5vm_asm_bind(a, loop);
+    r5vm_asm_sw(a, R5VM_S1, 0, R5VM_S3);
+    emit_xfer(a, R5VM_ECALL_CHAN_SEND, 0x2000, 4);
+    r5vm_asm_addi(a, R5VM_S1, R5VM_S1, 1);
+    r5vm_asm_bne(a, R5VM_S1, R5VM_S2, loop);
+    r5vm_asm_li(a, R5VM_A0, 0);
+    r5vm_asm_exit(a);
+}
+
+/** Receive COUNT messages and exit with the sum of their values */
+static void build_summer(r5vm_asm_t* a)
+{
+    const int loop = r5vm_asm_label(a);
+
+    emit_open(a);
+    r5vm_asm_li(a, R5VM_S1, COUNT);
+    r5vm_asm_li(a, R5VM_S2, 0);
+    r5vm_asm_li(a, R5VM_S3, 0x2000);
+    r5vm_asm_bind(a, loop);
+    emit_xfer(a, R5VM_ECALL_CHAN_RECV, 0x2000, 4);
+    r5vm_asm_lw(a, R5VM_T0, 0, R5VM_S3);
+    r5vm_asm_add(a, R5VM_S2, R5VM_S2, R5VM_T0);
+    r5vm_asm_addi(a, R5VM_S1, R5VM_S1, -1);
+    r5vm_asm_bnez(a, R5VM_S1, loop);
+    r5vm_asm_mv(a, R5VM_A0, R5VM_S2);
+    r5vm_asm_exit(a);
+}
+
+static void test_full_channel(void)
+{
+    static void (*const build[2])(r5vm_asm_t*) = { build_counter, build_summer };
+    r5vm_host_t hosts[2];
+    r5vm_host_t* vms[2];
+
+    /* one thread: the sender must block on the full channel to let the
+       receiver run */
+    const bool ok = start(hosts, vms, 2, 64 * 1024, build) &&
+                    r5vm_chan_run(vms, 2, 1, NULL);
+    check(ok && hosts[0].vm.status == R5VM_EXIT && hosts[1].vm.status == R5VM_EXIT &&
+          hosts[1].vm.a0 == COUNT * (COUNT + 1) / 2, "chan: sender blocks on full channel");
+    for (unsigned i = 0; i < 2; i++)
+        r5vm_host_destroy(&hosts[i]);
+}
+
+static void build_waiter(r5vm_asm_t* a)
+{
+    emit_open(a);
+    emit_xfer(a, R5VM_ECALL_CHAN_RECV, 0x2000, 4);
+    r5vm_asm_exit(a);
+}
+
+static void test_deadlock(void)
+{
+    static void (*const build[2])(r5vm_asm_t*) = { build_waiter, build_waiter };
+    r5vm_host_t hosts[2];
+    r5vm_host_t* vms[2];
+
+    last_error[0] = '\0';
+    const bool ok = start(hosts, vms, 2, 64 * 1024, build) &&
+                    r5vm_chan_run(vms, 2, 2, NULL);
+    check(ok && hosts[0].vm.status == R5VM_ERROR && hosts[1].vm.status == R5VM_ERROR &&
+          strcmp(last_error, "Channel deadlock") == 0, "chan: deadlock is reported");
+    for (unsigned i = 0; i < 2; i++)
+        r5vm_host_destroy(&hosts[i]);
+}
+
+// ---- Quotas and timeouts ---------------------------------------------------
+
+/** Send two 64 byte messages nobody receives, results in s1 and s2 */
+static void build_hoarder(r5vm_asm_t* a)
+{
+    emit_open(a);
+    emit_xfer(a, R5VM_ECALL_CHAN_SEND, 0x2000, 64);
+    r5vm_asm_mv(a, R5VM_S1, R5VM_A0);
+    emit_xfer(a, R5VM_ECALL_CHAN_SEND, 0x2000, 64);
+    r5vm_asm_mv(a, R5VM_S2, R5VM_A0);
+    r5vm_asm_li(a, R5VM_A0, 0);
+    r5vm_asm_exit(a);
+}
+
+static void test_quota(void)
+{
+    static void (*const build[1])(r5vm_asm_t*) = { build_hoarder };
+    r5vm_host_t host;
+    r5vm_host_t* vms[1];
+    r5vm_host_stats_t st;
+
+    /* room for the guest memory and one message */
+    const bool ok = start(&host, vms, 1, 64 * 1024, build) &&
+                    r5vm_host_set_limit(&host, 64 * 1024 + 100) &&
+                    r5vm_chan_run(vms, 1, 1, NULL);
+    r5vm_host_stats(&host, &st);
+    check(ok && host.vm.status == R5VM_EXIT && host.vm.s1 == 0 &&
+          host.vm.s2 == UINT32_MAX && st.denied == 1,
+          "chan: send over quota returns -1");
+    r5vm_host_destroy(&host);
+}
+
+/** Poll KEY for POLL_MS, exit with the result */
+static void build_poller(r5vm_asm_t* a)
+{
+    emit_open(a);
+    r5vm_asm_mv(a, R5VM_A0, R5VM_S0);
+    r5vm_asm_li(a, R5VM_A1, POLL_MS);
+    r5vm_asm_syscall(a, R5VM_ECALL_CHAN_POLL);
+    r5vm_asm_exit(a);
+}
+
+/** Send one 4 byte message */
+static void build_poked(r5vm_asm_t* a)
+{
+    emit_open(a);
+    emit_xfer(a, R5VM_ECALL_CHAN_SEND, 0x2000, 4);
+    r5vm_asm_li(a, R5VM_A0, 0);
+    r5vm_asm_exit(a);
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void test_poll(void)
+{
+    static void (*const alone[1])(r5vm_asm_t*) = { build_poller };
+    static void (*const pair[2])(r5vm_asm_t*) = { build_poller, build_poked };
+    r5vm_host_t hosts[2];
+    r5vm_host_t* vms[2];
+
+    const double t0 = now_ms();
+    bool ok = start(hosts, vms, 1, 64 * 1024, alone) && r5vm_chan_run(vms, 1, 1, NULL);
+    const double waited = now_ms() - t0;
+    check(ok && hosts[0].vm.status == R5VM_EXIT && hosts[0].vm.a0 == UINT32_MAX &&
+          waited >= POLL_MS, "chan: poll times out with -1");
+    r5vm_host_destroy(&hosts[0]);
+
+    /* one thread: the poller blocks, the sender runs and wakes it */
+    ok = start(hosts, vms, 2, 64 * 1024, pair) && r5vm_chan_run(vms, 2, 1, NULL);
+    check(ok && hosts[0].vm.status == R5VM_EXIT && hosts[0].vm.a0 == 4,
+          "chan: poll returns the next length");
+    for (unsigned i = 0; i < 2; i++)
+        r5vm_host_destroy(&hosts[i]);
+}
+
+// ---- Calls -----------------------------------------------------------------
+
+/** Export `entry` as `key` with a 256 byte buffer and exit */
+static void emit_export(r5vm_asm_t* a, uint32_t key, int entry)
+{
+    r5vm_asm_li(a, R5VM_A0, key);
+    r5vm_asm_la(a, R5VM_A1, entry);
+    r5vm_asm_li(a, R5VM_A2, COOKIE);
+    r5vm_asm_li(a, R5VM_A3, SVC_STACK);
+    r5vm_asm_li(a, R5VM_A4, SVC_BUF);
+    r5vm_asm_li(a, R5VM_A5, 256);
+    r5vm_asm_syscall(a, R5VM_ECALL_RPC_EXPORT);
+    r5vm_asm_mv(a, R5VM_S1, R5VM_A0);
+    r5vm_asm_li(a, R5VM_A0, 0);
+    r5vm_asm_exit(a);
+}
+
+/** Entry: increment each buffer byte, return a0 + a1 + a2 + cookie */
+static void build_adder(r5vm_asm_t* a)
+{
+    const int entry = r5vm_asm_label(a);
+    const int loop = r5vm_asm_label(a);
+    const int done = r5vm_asm_label(a);
+
+    emit_export(a, KEY_A, entry);
+    r5vm_asm_bind(a, entry);
+    r5vm_asm_add(a, R5VM_A0, R5VM_A0, R5VM_A1);
+    r5vm_asm_add(a, R5VM_A0, R5VM_A0, R5VM_A2);
+    r5vm_asm_add(a, R5VM_A0, R5VM_A0, R5VM_A5);
+    r5vm_asm_bind(a, loop);
+    r5vm_asm_beqz(a, R5VM_A4, done);
+    r5vm_asm_lbu(a, R5VM_T0, 0, R5VM_A3);
+    r5vm_asm_addi(a, R5VM_T0, R5VM_T0, 1);
+    r5vm_asm_sb(a, R5VM_T0, 0, R5VM_A3);
+    r5vm_asm_addi(a, R5VM_A3, R5VM_A3, 1);
+    r5vm_asm_addi(a, R5VM_A4, R5VM_A4, -1);
+    r5vm_asm_j(a, loop);
+    r5vm_asm_bind(a, done);
+    r5vm_asm_syscall(a, R5VM_ECALL_RPC_RETURN);
+}
+
+/** Call `key` with the 16 bytes at 0x2000, exit with the result */
+static void emit_client(r5vm_asm_t* a, uint32_t key)
+{
+    r5vm_asm_li(a, R5VM_A0, key);
+    r5vm_asm_li(a, R5VM_A1, 1);
+    r5vm_asm_li(a, R5VM_A2, 2);
+    r5vm_asm_li(a, R5VM_A3, 3);
+    r5vm_asm_li(a, R5VM_A4, 0x2000);
+    r5vm_asm_li(a, R5VM_A5, 16);
+    r5vm_asm_syscall(a, R5VM_ECALL_RPC_CALL);
+    r5vm_asm_exit(a);
+}
+
+static void build_client_a(r5vm_asm_t* a) { emit_client(a, KEY_A); }
+static void build_client_b(r5vm_asm_t* a) { emit_client(a, KEY_B); }
+
+static void test_rpc(void)
+{
+    /* the client starts first and waits for the export */
+    static void (*const build[2])(r5vm_asm_t*) = { build_client_a, build_adder };
+    r5vm_host_t hosts[2];
+    r5vm_host_t* vms[2];
+    bool bytes = true;
+
+    if (!start(hosts, vms, 2, 64 * 1024, build)) {
+        check(false, "rpc: start actors");
+        return;
+    }
+    for (int i = 0; i < 16; i++)
+        hosts[0].map[0x2000 + i] = (uint8_t)(i * 3);
+    const bool ran = r5vm_chan_run(vms, 2, 1, NULL);
+    for (int i = 0; i < 16; i++)
+        bytes &= hosts[0].map[0x2000 + i] == (uint8_t)(i * 3 + 1);
+    check(ran && hosts[1].vm.status == R5VM_EXIT && hosts[1].vm.s1 == 0,
+          "rpc: service exports and exits");
+    check(hosts[0].vm.status == R5VM_EXIT && hosts[0].vm.a0 == 1 + 2 + 3 + COOKIE,
+          "rpc: call returns entry result");
+    check(bytes, "rpc: buffer copied back");
+    for (unsigned i = 0; i < 2; i++)
+        r5vm_host_destroy(&hosts[i]);
+}
+
+/** Entry: loop forever without going idle */
+static void build_looper(r5vm_asm_t* a)
+{
+    const int entry = r5vm_asm_label(a);
+
+    emit_export(a, KEY_A, entry);
+    r5vm_asm_bind(a, entry);
+    r5vm_asm_addi(a, R5VM_T0, R5VM_T0, 1);
+    r5vm_asm_j(a, entry);
+}
+
+static void test_rpc_budget(void)
+{
+    static void (*const build[2])(r5vm_asm_t*) = { build_looper, build_client_a };
+    r5vm_host_t hosts[2];
+    r5vm_host_t* vms[2];
+
+    last_error[0] = '\0';
+    const bool ok = start(hosts, vms, 2, 64 * 1024, build) &&
+                    r5vm_chan_run(vms, 2, 1, NULL);
+    check(ok && hosts[0].vm.status == R5VM_EXIT && hosts[1].vm.status == R5VM_ERROR &&
+          strcmp(last_error, "RPC call failed") == 0, "rpc: looping entry fails the call");
+    for (unsigned i = 0; i < 2; i++)
+        r5vm_host_destroy(&hosts[i]);
+}
+
+/** Entry: spin, then call `key` */
+static void emit_crossing(r5vm_asm_t* a, uint32_t own, uint32_t key)
+{
+    const int entry = r5vm_asm_label(a);
+    const int spin = r5vm_asm_label(a);
+
+    emit_export(a, own, entry);
+    r5vm_asm_bind(a, entry);
+    r5vm_asm_li(a, R5VM_T0, SPIN);
+    r5vm_asm_bind(a, spin);
+    r5vm_asm_addi(a, R5VM_T0, R5VM_T0, -1);
+    r5vm_asm_bnez(a, R5VM_T0, spin);
+    r5vm_asm_li(a, R5VM_A0, key);
+    r5vm_asm_li(a, R5VM_A5, 0);
+    r5vm_asm_syscall(a, R5VM_ECALL_RPC_CALL);
+    r5vm_asm_syscall(a, R5VM_ECALL_RPC_RETURN);
+}
+
+static void build_cross_a(r5vm_asm_t* a) { emit_crossing(a, KEY_A, KEY_B); }
+static void build_cross_b(r5vm_asm_t* a) { emit_crossing(a, KEY_B, KEY_A); }
+
+static void test_rpc_deadlock(void)
+{
+    /* A's entry calls B while B's entry calls A on another thread */
+    static void (*const build[4])(r5vm_asm_t*) = {
+        build_cross_a, build_cross_b, build_client_a, build_client_b
+    };
+    r5vm_host_t hosts[4];
+    r5vm_host_t* vms[4];
+
+    rpc_deadlock = false;
+    const bool ok = start(hosts, vms, 4, 64 * 1024, build) &&
+                    r5vm_chan_run(vms, 4, 4, NULL);
+    check(ok && hosts[2].vm.status == R5VM_ERROR && hosts[3].vm.status == R5VM_ERROR &&
+          rpc_deadlock, "rpc: crossed calls report deadlock");
+    for (unsigned i = 0; i < 4; i++)
+        r5vm_host_destroy(&hosts[i]);
+}
+
+int main(void)
+{
+    printf("%s=== r5vm Channel Tests ===%s\n\n", COLOR_CYAN, COLOR_RESET);
+
+    page = (uint32_t)r5vm_host_page_size();
+    test_page_move();
+    test_full_channel();
+    test_deadlock();
+    test_quota();
+    test_poll();
+    test_rpc();
+    test_rpc_budget();
+    test_rpc_deadlock();
+
+    printf("\nTests run: %d, failed: %s%d%s\n", tests_run,
+           tests_failed ? COLOR_RED : COLOR_GREEN, tests_failed, COLOR_RESET);
+    return tests_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,148 @@
+/*
+ * r5vm Page Dedup Tests
+ * Fills guest pages of several VMs from the host and checks the passes of
+ * the dedup scanner (r5vm_dedup.c): merging equal pages, dropping zero
+ * pages, splits by a later store, passes that cannot scan every VM and
+ * merges the host refuses.
+ * Linux only; other hosts skip the tests.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "r5vm.h"
+#include "r5vm_host.h"
+#include "r5vm_dedup.h"
+
+// ANSI colors
+#define COLOR_RESET   "\033[0m"
+#define COLOR_RED     "\033[31m"
+#define COLOR_GREEN   "\033[32m"
+#define COLOR_CYAN    "\033[36m"
+
+#define TEST_MEM_SIZE (64 * 1024)
+#define VMS           2
+
+static int tests_run = 0;
+static int tests_failed = 0;
+
+void r5vm_error(r5vm_t* vm, const char* msg, uint32_t pc, uint32_t instr)
+{
+    (void)vm;
+    (void)msg;
+    (void)pc;
+    (void)instr;
+}
+
+static void check(bool ok, const char* name)
+{
+    tests_run++;
+    if (!ok)
+        tests_failed++;
+    printf("%s[TEST]%s %-40s ... %s%s%s\n", COLOR_CYAN, COLOR_RESET, name,
+           ok ? COLOR_GREEN : COLOR_RED, ok ? "PASS" : "FAIL", COLOR_RESET);
+}
+
+/** `true` if guest page `index` of `host` holds the pattern `seed` */
+static bool page_is(const r5vm_host_t* host, uint32_t index, uint32_t page, uint8_t seed)
+{
+    for (uint32_t i = 0; i < page; i++)
+        if (host->map[index * page + i] != (uint8_t)(seed + i * 13))
+            return false;
+    return true;
+}
+
+static void fill_page(r5vm_host_t* host, uint32_t index, uint32_t page, uint8_t seed)
+{
+    for (uint32_t i = 0; i < page; i++)
+        host->map[index * page + i] = (uint8_t)(seed + i * 13);
+}
+
+static void test_dedup(void)
+{
+    const uint32_t page = (uint32_t)r5vm_host_page_size();
+    r5vm_host_t hosts[VMS];
+    r5vm_dedup_t d;
+    r5vm_dedup_stats_t st;
+
+    if (!r5vm_dedup_init(&d)) {
+        printf("%s[SKIP]%s dedup needs memfd and /proc/self/pagemap\n",
+               COLOR_CYAN, COLOR_RESET);
+        return;
+    }
+    for (int i = 0; i < VMS; i++) {
+        if (!r5vm_host_init(&hosts[i], TEST_MEM_SIZE) || !r5vm_dedup_add(&d, &hosts[i])) {
+            check(false, "dedup: init");
+            return;
+        }
+        fill_page(&hosts[i], 1, page, 0x11);           /* equal in both VMs */
+        fill_page(&hosts[i], 2, page, (uint8_t)(0x40 + i)); /* differs */
+        memset(hosts[i].map + 3 * page, 1, page);
+        memset(hosts[i].map + 3 * page, 0, page);      /* resident zero page */
+    }
+
+    r5vm_dedup_scan(&d);
+    r5vm_dedup_stats(&d, &st);
+    check(st.shared_pages == 2 && st.store_pages == 1 && st.zero_pages == 2,
+          "dedup: merge equal and zero pages");
+    check(page_is(&hosts[0], 1, page, 0x11) && page_is(&hosts[1], 1, page, 0x11) &&
+          page_is(&hosts[0], 2, page, 0x40) && page_is(&hosts[1], 2, page, 0x41) &&
+          hosts[0].map[3 * page] == 0, "dedup: contents unchanged");
+
+    /* a store splits the merged page again */
+    hosts[0].map[page] = 0xEE;
+    r5vm_dedup_scan(&d);
+    r5vm_dedup_stats(&d, &st);
+    check(st.shared_pages == 1 && st.store_pages == 1 && hosts[0].map[page] == 0xEE &&
+          page_is(&hosts[1], 1, page, 0x11), "dedup: store splits page");
+
+    /* a pass that cannot read the page map counts no references and must
+       not free store pages the VMs still map */
+    const int pagemap = d.pagemap;
+    d.pagemap = open("/dev/null", O_RDONLY);
+    r5vm_dedup_scan(&d);
+    close(d.pagemap);
+    d.pagemap = pagemap;
+    r5vm_dedup_scan(&d);
+    r5vm_dedup_stats(&d, &st);
+    check(page_is(&hosts[1], 1, page, 0x11) && st.shared_pages == 1 && st.store_pages == 1,
+          "dedup: unscanned VMs keep store pages");
+
+    /* a merge the host refuses (here: a store that cannot be mapped, in
+       practice vm.max_map_count) leaves the page private and is counted */
+    const int fd = d.fd;
+    for (int i = 0; i < VMS; i++)
+        fill_page(&hosts[i], 4, page, 0x66);
+    d.fd = open("/dev/null", O_RDONLY);
+    r5vm_dedup_scan(&d);
+    close(d.fd);
+    d.fd = fd;
+    r5vm_dedup_stats(&d, &st);
+    const bool failed = st.share_failed == VMS && st.shared_pages == 1;
+    r5vm_dedup_scan(&d);
+    r5vm_dedup_stats(&d, &st);
+    check(failed && st.share_failed == 0 && st.shared_pages == 3 &&
+          page_is(&hosts[0], 4, page, 0x66) && page_is(&hosts[1], 4, page, 0x66),
+          "dedup: refused merges are counted");
+
+    for (int i = 0; i < VMS; i++) {
+        r5vm_dedup_remove(&d, &hosts[i]);
+        r5vm_host_destroy(&hosts[i]);
+    }
+    r5vm_dedup_destroy(&d);
+}
+
+int main(void)
+{
+    printf("%s=== r5vm Page Dedup Tests ===%s\n\n", COLOR_CYAN, COLOR_RESET);
+
+    test_dedup();
+
+    printf("\nTests run: %d, failed: %s%d%s\n", tests_run,
+           tests_failed ? COLOR_RED : COLOR_GREEN, tests_failed, COLOR_RESET);
+    return tests_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,16 @@
+# Test EBREAK
+# EBREAK must trap to the host and stop the VM. It is not an ECALL, so the
+# syscall id in a7 must be ignored.
+
+.section .text
+.globl _start
+
+_start:
+    li a7, 1        # would print a character if EBREAK were an ECALL
+    li a0, 0        # success code seen by the test runner
+    ebreak
+
+    # Not reached: execution must not continue after EBREAK
+    li a0, 1
+    li a7, 0
+    ecall
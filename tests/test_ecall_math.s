@@ -0,0 +1,59 @@
+# Test math ECALLs (float bit patterns in integer registers)
+# Only results that every libm returns exactly are checked.
+
+.include "test_common.s"
+
+.section .text
+.globl _start
+
+_start:
+    # Test 1: sqrtf(4.0) = 2.0
+    LI32 a0, 0x40800000
+    li a7, 10           # ECALL_SQRTF
+    ecall
+    LI32 t0, 0x40000000
+    ASSERT_EQ_REG a0, t0
+
+    # Test 2: powf(2.0, 10.0) = 1024.0
+    LI32 a0, 0x40000000
+    LI32 a1, 0x41200000
+    li a7, 11           # ECALL_POWF
+    ecall
+    LI32 t0, 0x44800000
+    ASSERT_EQ_REG a0, t0
+
+    # Test 3: fmodf(7.0, 3.0) = 1.0
+    LI32 a0, 0x40E00000
+    LI32 a1, 0x40400000
+    li a7, 13           # ECALL_FMODF
+    ecall
+    LI32 t0, 0x3F800000
+    ASSERT_EQ_REG a0, t0
+
+    # Test 4: sinf(0.0) = 0.0, cosf(0.0) = 1.0, expf(0.0) = 1.0, logf(1.0) = 0.0
+    li a0, 0
+    li a7, 6            # ECALL_SINF
+    ecall
+    ASSERT_EQ a0, 0
+    li a0, 0
+    li a7, 7            # ECALL_COSF
+    ecall
+    LI32 t0, 0x3F800000
+    ASSERT_EQ_REG a0, t0
+    li a0, 0
+    li a7, 8            # ECALL_EXPF
+    ecall
+    ASSERT_EQ_REG a0, t0
+    LI32 a0, 0x3F800000
+    li a7, 9            # ECALL_LOGF
+    ecall
+    ASSERT_EQ a0, 0
+
+    # Test 5: atan2f(0.0, 1.0) = 0.0
+    li a0, 0
+    LI32 a1, 0x3F800000
+    li a7, 12           # ECALL_ATAN2F
+    ecall
+    ASSERT_EQ a0, 0
+
+    TEST_PASS
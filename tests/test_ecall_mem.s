@@ -0,0 +1,82 @@
+# Test bulk memory ECALLs (memcpy, memmove, memset, memcmp)
+
+.include "test_common.s"
+
+.section .text
+.globl _start
+
+_start:
+    li s0, 0x4000       # source buffer
+    li s1, 0x4100       # destination buffer
+
+    # Fill source with 0x11, 0x22, ... (32 bytes)
+    li t0, 0
+    li t1, 32
+1:  add t2, s0, t0
+    addi t3, t0, 1
+    slli t4, t3, 4
+    or t3, t3, t4
+    sb t3, 0(t2)
+    addi t0, t0, 1
+    blt t0, t1, 1b
+
+    # Test 1: memset(dst, 0xAB, 32), a0 must stay dst
+    mv a0, s1
+    li a1, 0x1AB        # only the low byte is used
+    li a2, 32
+    li a7, 4            # ECALL_MEMSET
+    ecall
+    ASSERT_EQ_REG a0, s1
+    lw t0, 28(s1)
+    LI32 t1, 0xABABABAB
+    ASSERT_EQ_REG t0, t1
+    lbu t0, 32(s1)      # byte behind the range is untouched
+    ASSERT_EQ t0, 0
+
+    # Test 2: memcpy(dst, src, 31)
+    mv a0, s1
+    mv a1, s0
+    li a2, 31
+    li a7, 2            # ECALL_MEMCPY
+    ecall
+    lw t0, 0(s1)
+    LI32 t1, 0x44332211
+    ASSERT_EQ_REG t0, t1
+    lbu t0, 30(s1)
+    ASSERT_EQ t0, 0xFF  # (31 << 4 | 31) & 0xFF
+    lbu t0, 31(s1)
+    ASSERT_EQ t0, 0xAB
+
+    # Test 3: memcmp equal and different
+    mv a0, s0
+    mv a1, s1
+    li a2, 31
+    li a7, 5            # ECALL_MEMCMP
+    ecall
+    ASSERT_EQ a0, 0
+    mv a0, s0
+    mv a1, s1
+    li a2, 32           # src[31] = 0x20 vs dst[31] = 0xAB
+    li a7, 5
+    ecall
+    ASSERT_EQ a0, -0x8B
+
+    # Test 4: overlapping memmove(dst + 1, dst, 8)
+    addi a0, s1, 1
+    mv a1, s1
+    li a2, 8
+    li a7, 3            # ECALL_MEMMOVE
+    ecall
+    lbu t0, 1(s1)
+    ASSERT_EQ t0, 0x11
+    lbu t0, 8(s1)
+    ASSERT_EQ t0, 0x88
+
+    # Test 5: zero length is valid at the end of memory
+    li a0, 0x10000
+    li a1, 0
+    li a2, 0
+    li a7, 4
+    ecall
+
+    TEST_PASS
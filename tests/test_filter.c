@@ -0,0 +1,186 @@
+/*
+ * r5vm Stream Filter Tests
+ * Runs an r5vm_asm guest that upper-cases its input through the stream
+ * windows of r5vm_filter_run() (r5vm_filter.c), from one file descriptor
+ * to another, and checks the round trip, empty input and a failing
+ * output. POSIX only.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "r5vm.h"
+#include "r5vm_asm.h"
+#include "r5vm_host.h"
+#include "r5vm_filter.h"
+
+// ANSI colors
+#define COLOR_RESET   "\033[0m"
+#define COLOR_RED     "\033[31m"
+#define COLOR_GREEN   "\033[32m"
+#define COLOR_CYAN    "\033[36m"
+
+#define TEST_MEM_SIZE (64 * 1024)
+#define STREAM_BUF    0x4000 /**< guest stream buffer, four windows */
+#define STREAM_SIZE   0x4000
+#define DATA_SIZE     100000 /**< many windows, the last one partial */
+
+static int tests_run = 0;
+static int tests_failed = 0;
+
+void r5vm_error(r5vm_t* vm, const char* msg, uint32_t pc, uint32_t instr)
+{
+    (void)vm;
+    (void)msg;
+    (void)pc;
+    (void)instr;
+}
+
+static void check(bool ok, const char* name)
+{
+    tests_run++;
+    if (!ok)
+        tests_failed++;
+    printf("%s[TEST]%s %-40s ... %s%s%s\n", COLOR_CYAN, COLOR_RESET, name,
+           ok ? COLOR_GREEN : COLOR_RED, ok ? "PASS" : "FAIL", COLOR_RESET);
+}
+
+/** Guest: copy every input byte to the output, 'a'..'z' upper-cased */
+static bool setup(r5vm_host_t* host)
+{
+    r5vm_asm_t a;
+
+    if (!r5vm_host_init(host, TEST_MEM_SIZE))
+        return false;
+    r5vm_asm_init(&a, host->map, STREAM_BUF, 0);
+    const int loop = r5vm_asm_label(&a);
+    const int inner = r5vm_asm_label(&a);
+    const int store = r5vm_asm_label(&a);
+    const int next = r5vm_asm_label(&a);
+    const int done = r5vm_asm_label(&a);
+    r5vm_asm_li(&a, R5VM_A0, STREAM_BUF);
+    r5vm_asm_li(&a, R5VM_A1, STREAM_SIZE);
+    r5vm_asm_syscall(&a, R5VM_ECALL_STREAM_INIT);
+    r5vm_asm_mv(&a, R5VM_S2, R5VM_A0);             /* window size */
+    r5vm_asm_li(&a, R5VM_A0, 0);
+    r5vm_asm_syscall(&a, R5VM_ECALL_STREAM_OUT);   /* first output window */
+    r5vm_asm_mv(&a, R5VM_S0, R5VM_A0);
+    r5vm_asm_li(&a, R5VM_S1, 0);                   /* bytes in the window */
+    r5vm_asm_bind(&a, loop);
+    r5vm_asm_syscall(&a, R5VM_ECALL_STREAM_IN);
+    r5vm_asm_beqz(&a, R5VM_A1, done);
+    r5vm_asm_mv(&a, R5VM_T0, R5VM_A0);
+    r5vm_asm_add(&a, R5VM_T1, R5VM_A0, R5VM_A1);
+    r5vm_asm_bind(&a, inner);
+    r5vm_asm_lbu(&a, R5VM_T2, 0, R5VM_T0);
+    r5vm_asm_addi(&a, R5VM_T3, R5VM_T2, -'a');
+    r5vm_asm_sltiu(&a, R5VM_T4, R5VM_T3, 26);
+    r5vm_asm_beqz(&a, R5VM_T4, store);
+    r5vm_asm_addi(&a, R5VM_T2, R5VM_T2, 'A' - 'a');
+    r5vm_asm_bind(&a, store);
+    r5vm_asm_add(&a, R5VM_T5, R5VM_S0, R5VM_S1);
+    r5vm_asm_sb(&a, R5VM_T2, 0, R5VM_T5);
+    r5vm_asm_addi(&a, R5VM_S1, R5VM_S1, 1);
+    r5vm_asm_bne(&a, R5VM_S1, R5VM_S2, next);
+    r5vm_asm_mv(&a, R5VM_A0, R5VM_S1);             /* window full */
+    r5vm_asm_syscall(&a, R5VM_ECALL_STREAM_OUT);
+    r5vm_asm_mv(&a, R5VM_S0, R5VM_A0);
+    r5vm_asm_li(&a, R5VM_S1, 0);
+    r5vm_asm_bind(&a, next);
+    r5vm_asm_addi(&a, R5VM_T0, R5VM_T0, 1);
+    r5vm_asm_bne(&a, R5VM_T0, R5VM_T1, inner);
+    r5vm_asm_j(&a, loop);
+    r5vm_asm_bind(&a, done);
+    r5vm_asm_mv(&a, R5VM_A0, R5VM_S1);             /* partial last window */
+    r5vm_asm_syscall(&a, R5VM_ECALL_STREAM_OUT);
+    r5vm_asm_li(&a, R5VM_A0, 0);
+    r5vm_asm_exit(&a);
+    if (!r5vm_asm_finish(&a)) {
+        r5vm_host_destroy(host);
+        return false;
+    }
+    r5vm_reset(&host->vm);
+    return true;
+}
+
+static void test_round_trip(void)
+{
+    static char data[DATA_SIZE], want[DATA_SIZE], got[DATA_SIZE + 1];
+    r5vm_host_t host;
+    FILE* in = tmpfile();
+    FILE* out = tmpfile();
+
+    for (int i = 0; i < DATA_SIZE; i++) {
+        data[i] = (char)(i % 61 == 60 ? '\n' : 'a' + (i * 7) % 30); /* some non-letters */
+        want[i] = data[i] >= 'a' && data[i] <= 'z' ? (char)(data[i] - 32) : data[i];
+    }
+    if (!in || !out || fwrite(data, 1, DATA_SIZE, in) != DATA_SIZE ||
+        fflush(in) != 0 || lseek(fileno(in), 0, SEEK_SET) != 0 || !setup(&host)) {
+        check(false, "filter: setup");
+        return;
+    }
+    const bool ok = r5vm_filter_run(&host, fileno(in), fileno(out));
+    const size_t n = lseek(fileno(out), 0, SEEK_SET) == 0 ?
+                     (size_t)read(fileno(out), got, sizeof(got)) : 0;
+    check(ok && host.vm.status == R5VM_EXIT && host.vm.a0 == 0,
+          "filter: guest runs to exit");
+    check(n == DATA_SIZE && memcmp(got, want, DATA_SIZE) == 0,
+          "filter: stdin to stdout round trip");
+    r5vm_host_destroy(&host);
+    fclose(in);
+    fclose(out);
+}
+
+/** Filter `in_fd` to `out_fd`, `ok` is the result of r5vm_filter_run() */
+static bool filter(int in_fd, int out_fd, bool* ok)
+{
+    r5vm_host_t host;
+
+    if (in_fd < 0 || out_fd < 0 || !setup(&host))
+        return false;
+    *ok = r5vm_filter_run(&host, in_fd, out_fd);
+    const bool exited = host.vm.status == R5VM_EXIT;
+    r5vm_host_destroy(&host);
+    return exited;
+}
+
+static void test_errors(void)
+{
+    FILE* in = tmpfile();
+    bool ok = false;
+
+    /* end of input right away: the guest flushes nothing and exits */
+    const int empty = open("/dev/null", O_RDONLY);
+    const bool exited = filter(empty, STDOUT_FILENO, &ok);
+    check(exited && ok, "filter: empty input");
+
+    /* the guest does not see write errors, the result reports them */
+    const int ro = open("/dev/null", O_RDONLY);
+    const bool written = in && fwrite("abc", 1, 3, in) == 3 && fflush(in) == 0 &&
+                         lseek(fileno(in), 0, SEEK_SET) == 0;
+    ok = true;
+    check(written && filter(fileno(in), ro, &ok) && !ok,
+          "filter: failed write reported");
+    if (empty >= 0)
+        close(empty);
+    if (ro >= 0)
+        close(ro);
+    if (in)
+        fclose(in);
+}
+
+int main(void)
+{
+    printf("%s=== r5vm Stream Filter Tests ===%s\n\n", COLOR_CYAN, COLOR_RESET);
+
+    test_round_trip();
+    test_errors();
+
+    printf("\nTests run: %d, failed: %s%d%s\n", tests_run,
+           tests_failed ? COLOR_RED : COLOR_GREEN, tests_failed, COLOR_RESET);
+    return tests_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,223 @@
+/*
+ * r5vm HLE Tests
+ * Binds guest functions to host natives (by address and via a minimal ELF
+ * symbol table) and checks the built-in libc/libgcc natives.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "r5vm.h"
+#include "r5vm_asm.h"
+#include "r5vm_hle.h"
+#include "r5vm_elf.h"
+
+// ANSI colors
+#define COLOR_RESET   "\033[0m"
+#define COLOR_RED     "\033[31m"
+#define COLOR_GREEN   "\033[32m"
+#define COLOR_CYAN    "\033[36m"
+
+#define TEST_MEM_SIZE (64 * 1024)
+#define FUNC_ADDR     0x100  /**< guest "function" replaced by a native */
+
+static int tests_run = 0;
+static int tests_failed = 0;
+static uint8_t mem[TEST_MEM_SIZE];
+
+void r5vm_error(r5vm_t* vm, const char* msg, uint32_t pc, uint32_t instr)
+{
+    (void)vm;
+    fprintf(stderr, "VM ERROR at PC=0x%08X: %s (instr=0x%08X)\n", pc, msg, instr);
+}
+
+static void check(bool ok, const char* name)
+{
+    tests_run++;
+    if (!ok)
+        tests_failed++;
+    printf("%s[TEST]%s %-40s ... %s%s%s\n", COLOR_CYAN, COLOR_RESET, name,
+           ok ? COLOR_GREEN : COLOR_RED, ok ? "PASS" : "FAIL", COLOR_RESET);
+}
+
+/**
+ * Program: call FUNC_ADDR, then ebreak. The function body is an ebreak too,
+ * so an unbound call stops at FUNC_ADDR instead of returning.
+ */
+static void build_caller(void)
+{
+    r5vm_asm_t a;
+    memset(mem, 0, sizeof(mem));
+    r5vm_asm_init(&a, mem, FUNC_ADDR + 4, 0);
+    int func = r5vm_asm_label(&a);
+    r5vm_asm_li(&a, R5VM_SP, TEST_MEM_SIZE);
+    r5vm_asm_call(&a, func);
+    r5vm_asm_ebreak(&a);
+    while (r5vm_asm_here(&a) < FUNC_ADDR)
+        r5vm_asm_nop(&a);
+    r5vm_asm_bind(&a, func);
+    r5vm_asm_ebreak(&a);
+    if (!r5vm_asm_finish(&a))
+        fprintf(stderr, "build_caller: assembler error\n");
+}
+
+/** Run the caller with a0..a3 set; true if the native returned normally */
+static bool call(r5vm_t* vm, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3)
+{
+    r5vm_reset(vm);
+    r5vm_run(vm, 2); // li sp (lui + addi)
+    vm->a0 = a0; vm->a1 = a1; vm->a2 = a2; vm->a3 = a3;
+    r5vm_run(vm, 100);
+    return vm->status == R5VM_BREAK && vm->pc != FUNC_ADDR;
+}
+
+/** Bind built-in `name` at FUNC_ADDR of the caller program and call it */
+static bool call_builtin(r5vm_t* vm, const char* name, uint32_t a0,
+                         uint32_t a1, uint32_t a2, uint32_t a3)
+{
+    static r5vm_hle_t hle;
+    r5vm_init(vm, mem, TEST_MEM_SIZE);
+    r5vm_hle_init(&hle, vm);
+    if (r5vm_hle_bind(&hle, vm, FUNC_ADDR, r5vm_hle_builtin(name)) < 0)
+        return false;
+    return call(vm, a0, a1, a2, a3);
+}
+
+static uint32_t f32_bits(float f) { uint32_t u; memcpy(&u, &f, 4); return u; }
+
+static bool native_add(r5vm_t* vm)
+{
+    vm->a0 = vm->a0 + vm->a1;
+    return true;
+}
+
+static void test_bind(void)
+{
+    r5vm_t vm;
+    r5vm_hle_t hle;
+
+    build_caller();
+    r5vm_init(&vm, mem, TEST_MEM_SIZE);
+    r5vm_hle_init(&hle, &vm);
+    check(call(&vm, 1, 2, 0, 0) == false && vm.pc == FUNC_ADDR,
+          "hle: unbound function is interpreted");
+
+    uint32_t orig;
+    memcpy(&orig, mem + FUNC_ADDR, 4);
+    int slot = r5vm_hle_bind(&hle, &vm, FUNC_ADDR, native_add);
+    check(slot == 0 && hle.orig[0] == orig && hle.addr[0] == FUNC_ADDR,
+          "hle: bind by address");
+    check(call(&vm, 40, 2, 0, 0) && vm.a0 == 42, "hle: native runs, returns to ra");
+    check(r5vm_hle_bind(&hle, &vm, FUNC_ADDR + 2, native_add) < 0 &&
+          r5vm_hle_bind(&hle, &vm, TEST_MEM_SIZE, native_add) < 0,
+          "hle: reject invalid address");
+}
+
+static void test_builtins(void)
+{
+    r5vm_t vm;
+
+    build_caller();
+    check(call_builtin(&vm, "__muldi3", 0, 1, 3, 0) && vm.a0 == 0 && vm.a1 == 3,
+          "hle: __muldi3");
+    check(call_builtin(&vm, "__divdi3", (uint32_t)-7, ~0u, 2, 0) &&
+          vm.a0 == (uint32_t)-3 && vm.a1 == ~0u, "hle: __divdi3");
+    check(call_builtin(&vm, "__divsi3", 5, 0, 0, 0) && vm.a0 == ~0u &&
+          call_builtin(&vm, "__divsi3", 0x80000000u, ~0u, 0, 0) && vm.a0 == 0x80000000u,
+          "hle: __divsi3 by zero and overflow");
+    check(call_builtin(&vm, "__addsf3", f32_bits(1.5f), f32_bits(2.25f), 0, 0) &&
+          vm.a0 == f32_bits(3.75f), "hle: __addsf3");
+    check(call_builtin(&vm, "__divsf3", 0, 0, 0, 0) && vm.a0 == 0x7FC00000u,
+          "hle: canonical NaN");
+    check(call_builtin(&vm, "__ltdf2", 0, 0x7FF80000u, 0, 0) && vm.a0 == 1 &&
+          call_builtin(&vm, "__gedf2", 0, 0x7FF80000u, 0, 0) && vm.a0 == ~0u,
+          "hle: unordered double compare");
+    check(call_builtin(&vm, "__fixsfsi", f32_bits(3e9f), 0, 0, 0) &&
+          vm.a0 == 0x7FFFFFFFu, "hle: __fixsfsi saturates");
+
+    build_caller();
+    strcpy((char*)mem + 0x1000, "hello");
+    check(call_builtin(&vm, "strlen", 0x1000, 0, 0, 0) && vm.a0 == 5, "hle: strlen");
+    check(call_builtin(&vm, "memcpy", 0x2000, 0x1000, 6, 0) && vm.a0 == 0x2000 &&
+          strcmp((char*)mem + 0x2000, "hello") == 0, "hle: memcpy");
+    check(!call_builtin(&vm, "memset", TEST_MEM_SIZE - 4, 0, 16, 0) &&
+          vm.status == R5VM_ERROR && vm.pc == FUNC_ADDR, "hle: out of bounds stops VM");
+}
+
+/** Append a little-endian word */
+static uint8_t* put32(uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16); p[3] = (uint8_t)(v >> 24);
+    return p + 4;
+}
+
+/**
+ * Minimal RISC-V ELF32: .symtab with "memset" (FUNC at FUNC_ADDR) and
+ * "buffer" (OBJECT), plus .strtab. Returns the image size.
+ */
+static size_t build_elf(uint8_t* elf)
+{
+    static const char strtab[] = "\0memset\0buffer";
+    const uint32_t sym_off = 52, str_off = sym_off + 3 * 16;
+    const uint32_t sh_off = (str_off + sizeof(strtab) + 3) & ~3u;
+    uint8_t* p;
+
+    memset(elf, 0, 512);
+    memcpy(elf, "\x7f" "ELF\x01\x01\x01", 7);
+    elf[16] = 2;   // ET_EXEC
+    elf[18] = 243; // EM_RISCV
+    put32(elf + 32, sh_off);
+    elf[40] = 52;  // e_ehsize
+    elf[46] = 40;  // e_shentsize
+    elf[48] = 3;   // e_shnum
+
+    p = elf + sym_off + 16;                       // symbol 0 is null
+    p = put32(p, 1); p = put32(p, FUNC_ADDR); p = put32(p, 4);
+    *p++ = 0x12; *p++ = 0; *p++ = 1; *p++ = 0;    // GLOBAL FUNC, shndx 1
+    p = put32(p, 8); p = put32(p, 0x1000); p = put32(p, 16);
+    *p++ = 0x11; *p++ = 0; *p++ = 1; *p++ = 0;    // GLOBAL OBJECT
+    memcpy(elf + str_off, strtab, sizeof(strtab));
+
+    p = elf + sh_off + 40;                        // section 0 is null
+    put32(p + 4, 2); put32(p + 16, sym_off); put32(p + 20, 48); put32(p + 24, 2);
+    p += 40;
+    put32(p + 4, 3); put32(p + 16, str_off); put32(p + 20, sizeof(strtab));
+    return sh_off + 3 * 40;
+}
+
+static void test_elf(void)
+{
+    uint8_t elf[512];
+    size_t size = build_elf(elf);
+    uint32_t addr = 0;
+    r5vm_t vm;
+    r5vm_hle_t hle;
+
+    check(r5vm_elf_lookup(elf, size, "memset", &addr) && addr == FUNC_ADDR &&
+          !r5vm_elf_lookup(elf, size, "buffer", &addr), "elf: function lookup");
+    check(!r5vm_elf_lookup(elf, size - 41, "memset", &addr) &&
+          !r5vm_elf_lookup(mem, size, "memset", &addr), "elf: reject bad image");
+
+    build_caller();
+    r5vm_init(&vm, mem, TEST_MEM_SIZE);
+    r5vm_hle_init(&hle, &vm);
+    check(r5vm_hle_bind_builtins(&hle, &vm, elf, size) == 1 &&
+          call(&vm, 0x3000, 0xAB, 8, 0) && mem[0x3007] == 0xAB && mem[0x3008] == 0,
+          "hle: bind builtins from ELF");
+}
+
+int main(void)
+{
+    printf("%s=== r5vm HLE Tests ===%s\n\n", COLOR_CYAN, COLOR_RESET);
+
+    test_bind();
+    test_builtins();
+    test_elf();
+
+    printf("\nTests run: %d, failed: %s%d%s\n", tests_run,
+           tests_failed ? COLOR_RED : COLOR_GREEN, tests_failed, COLOR_RESET);
+    return tests_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,670 @@
+/*
+ * r5vm Host Service Tests
+ * Runs small r5vm_asm guests under r5vm_host_run() and checks the host
+ * services around them: stack guard, watchpoints, step accounting, bulk
+ * reads and writes by ECALLs and HLE natives, the fork server ECALLs,
+ * state copies, memory quotas, VM pools and slabs, and the gdb stub
+ * (driven over loopback TCP by a minimal client).
+ */
+
+#define _DEFAULT_SOURCE   /* struct sockaddr_in on glibc */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "r5vm.h"
+#include "r5vm_asm.h"
+#include "r5vm_host.h"
+#include "r5vm_hle.h"
+#include "r5vm_gdb.h"
+#include "r5vm_pool.h"
+#include "r5vm_slab.h"
+
+// ANSI colors
+#define COLOR_RESET   "\033[0m"
+#define COLOR_RED     "\033[31m"
+#define COLOR_GREEN   "\033[32m"
+#define COLOR_CYAN    "\033[36m"
+
+#define TEST_MEM_SIZE (64 * 1024)
+#define STACK_LIMIT   0x8000 /**< guard page right below */
+
+static int tests_run = 0;
+static int tests_failed = 0;
+static char last_error[64];
+static uint32_t error_pc;
+static const r5vm_host_t* error_host; /**< r5vm_host_active() in r5vm_error() */
+
+void r5vm_error(r5vm_t* vm, const char* msg, uint32_t pc, uint32_t instr)
+{
+    (void)instr;
+    error_pc = pc;
+    error_host = r5vm_host_active(vm);
+    snprintf(last_error, sizeof(last_error), "%s", msg);
+}
+
+static void check(bool ok, const char* name)
+{
+    tests_run++;
+    if (!ok)
+        tests_failed++;
+    printf("%s[TEST]%s %-40s ... %s%s%s\n", COLOR_CYAN, COLOR_RESET, name,
+           ok ? COLOR_GREEN : COLOR_RED, ok ? "PASS" : "FAIL", COLOR_RESET);
+}
+
+/** Fresh host VM with the assembler pointed at address 0 */
+static bool setup(r5vm_host_t* host, r5vm_asm_t* a)
+{
+    if (!r5vm_host_init(host, TEST_MEM_SIZE))
+        return false;
+    r5vm_asm_init(a, host->map, 0x1000, 0);
+    last_error[0] = '\0';
+    return true;
+}
+
+/** Finish the program and run it from address 0 */
+static void run(r5vm_host_t* host, r5vm_asm_t* a, unsigned max_steps)
+{
+    if (!r5vm_asm_finish(a))
+        fprintf(stderr, "run: assembler error\n");
+    r5vm_reset(&host->vm);
+    r5vm_host_run(host, max_steps);
+}
+
+static void test_stack_guard(void)
+{
+    r5vm_host_t host;
+    r5vm_asm_t a;
+    const uint32_t page = (uint32_t)r5vm_host_page_size();
+    const uint32_t guard_lo = STACK_LIMIT - page;
+
+    if (!setup(&host, &a))
+        return;
+    check(r5vm_host_stack_guard(&host, STACK_LIMIT) &&
+          host.guard_lo == guard_lo && host.guard_hi == STACK_LIMIT,
+          "guard: placed below stack limit");
+    host.map[guard_lo - 1] = 0xA5;
+    host.map[guard_lo - 2] = 0x5A;
+    r5vm_asm_li(&a, R5VM_A1, guard_lo - 1);
+    r5vm_asm_lbu(&a, R5VM_A0, 0, R5VM_A1);
+    r5vm_asm_lh(&a, R5VM_A2, -1, R5VM_A1);
+    r5vm_asm_ebreak(&a);
+    run(&host, &a, 0);
+    check(host.vm.status == R5VM_BREAK && host.vm.a0 == 0xA5 &&
+          host.vm.a2 == 0xFFFFA55A, "guard: narrow loads right below guard");
+
+    r5vm_asm_init(&a, host.map, 0x1000, 0);
+    r5vm_asm_li(&a, R5VM_A1, guard_lo - 2);
+    r5vm_asm_lw(&a, R5VM_A0, 0, R5VM_A1);
+    r5vm_asm_ebreak(&a);
+    run(&host, &a, 0);
+    check(host.vm.status == R5VM_ERROR &&
+          strcmp(last_error, "Stack overflow") == 0,
+          "guard: word load into guard traps");
+
+    r5vm_asm_init(&a, host.map, 0x1000, 0);
+    r5vm_asm_li(&a, R5VM_SP, STACK_LIMIT);
+    r5vm_asm_sw(&a, R5VM_ZERO, -4, R5VM_SP);
+    r5vm_asm_ebreak(&a);
+    run(&host, &a, 0);
+    check(host.vm.status == R5VM_ERROR &&
+          strcmp(last_error, "Stack overflow") == 0,
+          "guard: push below stack limit traps");
+
+    /* an error handler dumping code around pc must skip the guard */
+    r5vm_asm_init(&a, host.map, 0x1000, 0);
+    r5vm_asm_li(&a, R5VM_T0, guard_lo);
+    r5vm_asm_jalr(&a, R5VM_ZERO, 0, R5VM_T0);
+    error_host = NULL;
+    run(&host, &a, 0);
+    check(host.vm.status == R5VM_ERROR && host.vm.pc == guard_lo && error_host == &host &&
+          !r5vm_host_readable(error_host, &host.vm, guard_lo, 4) &&
+          !r5vm_host_readable(error_host, &host.vm, guard_lo - 2, 4) &&
+          r5vm_host_readable(error_host, &host.vm, guard_lo - 4, 4) &&
+          r5vm_host_readable(NULL, &host.vm, guard_lo, 4) &&
+          r5vm_host_active(&host.vm) == NULL, "guard: readable ranges for dumps");
+    r5vm_host_destroy(&host);
+}
+
+static unsigned watch_hits;
+static uint32_t watch_pc, watch_addr, watch_len, watch_old;
+
+static bool on_watch(r5vm_host_t* host, uint32_t pc, uint32_t addr,
+                     uint32_t len, uint32_t old_val)
+{
+    (void)host;
+    watch_hits++;
+    watch_pc = pc;
+    watch_addr = addr;
+    watch_len = len;
+    watch_old = old_val;
+    return true;
+}
+
+/** Store loop: sw a0 to `data`, increment a0, repeat */
+static void build_store_loop(r5vm_host_t* host, uint32_t data)
+{
+    r5vm_asm_t a;
+    r5vm_asm_init(&a, host->map, 0x1000, 0);
+    int loop = r5vm_asm_label(&a);
+    r5vm_asm_li(&a, R5VM_A1, data);
+    r5vm_asm_bind(&a, loop);
+    r5vm_asm_sw(&a, R5VM_A0, 0, R5VM_A1);
+    r5vm_asm_addi(&a, R5VM_A0, R5VM_A0, 1);
+    r5vm_asm_j(&a, loop);
+    if (!r5vm_asm_finish(&a))
+        fprintf(stderr, "build_store_loop: assembler error\n");
+    r5vm_reset(&host->vm);
+}
+
+static void test_watch_steps(void)
+{
+    r5vm_host_t host;
+    r5vm_asm_t a;
+    const uint32_t page = (uint32_t)r5vm_host_page_size();
+    const uint32_t data = 2 * page;
+
+    if (!setup(&host, &a))
+        return;
+    host.watch_fn = on_watch;
+    build_store_loop(&host, data);
+    const unsigned plain = r5vm_host_run(&host, 100);
+    const uint32_t plain_pc = host.vm.pc, plain_a0 = host.vm.a0;
+
+    build_store_loop(&host, data);
+    int slot = r5vm_host_watch(&host, data, 4);
+    watch_hits = 0;
+    const unsigned watched = r5vm_host_run(&host, 100);
+    /* a trap may charge steps before it that did not run, never fewer */
+    check(slot >= 0 && plain == 100 && watched == 100 && watch_hits > 1 &&
+          host.vm.status == R5VM_RUNNING && host.vm.a0 <= plain_a0 &&
+          host.vm.a0 >= plain_a0 / 2, "watch: trapped stores count to max_steps");
+
+    build_store_loop(&host, data);
+    unsigned single = 0;
+    for (int i = 0; i < 100; i++)
+        single += r5vm_host_run(&host, 1) == 1;
+    check(single == 100 && host.vm.pc == plain_pc && host.vm.a0 == plain_a0,
+          "watch: single steps over trapped stores");
+    r5vm_host_unwatch(&host, slot);
+
+    /* misaligned store spanning an unwatched and a watched page */
+    const uint8_t old[4] = { 0x11, 0x22, 0x33, 0x44 };
+    memcpy(host.map + data - 2, old, sizeof(old));
+    slot = r5vm_host_watch(&host, data - 4, 4);
+    r5vm_asm_init(&a, host.map, 0x1000, 0);
+    r5vm_asm_li(&a, R5VM_A0, 0xAABBCCDD);
+    r5vm_asm_li(&a, R5VM_A1, data - 2);
+    r5vm_asm_sw(&a, R5VM_A0, 0, R5VM_A1);
+    r5vm_asm_ebreak(&a);
+    watch_hits = 0;
+    run(&host, &a, 0);
+    check(slot >= 0 && host.vm.status == R5VM_BREAK && watch_hits == 1 &&
+          watch_old == 0x44332211 && host.map[data + 1] == 0xAA,
+          "watch: old value of page-crossing store");
+    r5vm_host_destroy(&host);
+}
+
+/** ECALL `id` with a0..a2, then ebreak. Returns the address of the ECALL. */
+static uint32_t build_ecall(r5vm_host_t* host, uint32_t id, uint32_t a0,
+                        uint32_t a1, uint32_t a2)
+{
+    r5vm_asm_t a;
+    r5vm_asm_init(&a, host->map, 0x1000, 0);
+    r5vm_asm_li(&a, R5VM_A0, a0);
+    r5vm_asm_li(&a, R5VM_A1, a1);
+    r5vm_asm_li(&a, R5VM_A2, a2);
+    r5vm_asm_li(&a, R5VM_A7, id);
+    const uint32_t pc = a.pos;
+    r5vm_asm_ecall(&a);
+    r5vm_asm_ebreak(&a);
+    if (!r5vm_asm_finish(&a))
+        fprintf(stderr, "build_ecall: assembler error\n");
+    r5vm_reset(&host->vm);
+    return pc;
+}
+
+static void test_bulk_writes(void)
+{
+    r5vm_host_t host;
+    r5vm_asm_t a;
+    r5vm_hle_t hle;
+    const uint32_t page = (uint32_t)r5vm_host_page_size();
+    const uint32_t data = 2 * page;
+    const uint32_t src = 3 * page;
+    const uint32_t guard_lo = STACK_LIMIT - page;
+    const uint8_t old[4] = { 0x11, 0x22, 0x33, 0x44 };
+
+    if (!setup(&host, &a) || !r5vm_host_stack_guard(&host, STACK_LIMIT))
+        return;
+    host.watch_fn = on_watch;
+    for (uint32_t i = 0; i < 8; i++)
+        host.map[src + i] = (uint8_t)(0xA0 + i);
+    memcpy(host.map + data, old, sizeof(old));
+    int slot = r5vm_host_watch(&host, data, 4);
+
+    uint32_t ecall_pc = build_ecall(&host, R5VM_ECALL_MEMCPY, data - 2, src, 8);
+    watch_hits = 0;
+    r5vm_host_run(&host, 0);
+    check(slot >= 0 && host.vm.status == R5VM_BREAK && watch_hits == 1 &&
+          watch_pc == ecall_pc && watch_addr == data && watch_len == 4 &&
+          watch_old == 0x44332211 && memcmp(host.map + data - 2, host.map + src, 8) == 0,
+          "bulk: memcpy ECALL hits watchpoint");
+
+    build_ecall(&host, R5VM_ECALL_MEMSET, data + 2, 0x5A, 4);
+    watch_hits = 0;
+    r5vm_host_run(&host, 0);
+    check(host.vm.status == R5VM_BREAK && watch_hits == 1 && watch_addr == data + 2 &&
+          watch_len == 2 && watch_old == 0xA5A4 && host.map[data + 5] == 0x5A,
+          "bulk: memset ECALL hits watchpoint");
+    r5vm_host_unwatch(&host, slot);
+
+    /* a watched page first, then the guard: nothing is written */
+    host.map[guard_lo - 4] = 0x77;
+    slot = r5vm_host_watch(&host, guard_lo - 4, 4);
+    ecall_pc = build_ecall(&host, R5VM_ECALL_MEMSET, guard_lo - 4, 0, 8);
+    watch_hits = 0;
+    r5vm_host_run(&host, 0);
+    check(host.vm.status == R5VM_ERROR && strcmp(last_error, "Stack overflow") == 0 &&
+          watch_hits == 0 && host.map[guard_lo - 4] == 0x77 && host.vm.pc == ecall_pc,
+          "bulk: memset ECALL into guard traps");
+    r5vm_host_unwatch(&host, slot);
+
+    /* watched destination, source running into the guard: the step
+       re-executed for the watch faults again */
+    slot = r5vm_host_watch(&host, data, 4);
+    build_ecall(&host, R5VM_ECALL_MEMCPY, data, guard_lo - 4, 8);
+    watch_hits = 0;
+    last_error[0] = '\0';
+    r5vm_host_run(&host, 0);
+    check(host.vm.status == R5VM_ERROR && strcmp(last_error, "Stack overflow") == 0 &&
+          watch_hits == 0, "bulk: fault while re-executing a watch trap");
+    r5vm_host_unwatch(&host, slot);
+
+    /* read-only file window */
+    char path[] = "/tmp/r5vm_test_host_XXXXXX";
+    const int fd = mkstemp(path);
+    const bool wrote = fd >= 0 && write(fd, old, sizeof(old)) == (ssize_t)sizeof(old);
+    const uint32_t ro = 4 * page;
+    slot = wrote ? r5vm_host_map_file(&host, path, ro, false) : -1;
+    build_ecall(&host, R5VM_ECALL_MEMSET, ro, 0, 4);
+    last_error[0] = '\0';
+    r5vm_host_run(&host, 0);
+    check(slot >= 0 && host.vm.status == R5VM_ERROR && host.map[ro] == 0x11 &&
+          strcmp(last_error, "Write to read-only mapping") == 0,
+          "bulk: memset ECALL into read-only map");
+    r5vm_asm_init(&a, host.map, 0x1000, 0);
+    r5vm_asm_li(&a, R5VM_A1, ro);
+    r5vm_asm_sb(&a, R5VM_ZERO, 1, R5VM_A1);
+    r5vm_asm_ebreak(&a);
+    last_error[0] = '\0';
+    run(&host, &a, 0);
+    check(host.vm.status == R5VM_ERROR && host.map[ro + 1] == 0x22 &&
+          strcmp(last_error, "Write to read-only mapping") == 0,
+          "bulk: store into read-only map");
+    if (fd >= 0) {
+        close(fd);
+        unlink(path);
+    }
+
+    /* HLE memset native bound at `native`, called from address 0 */
+    const uint32_t native = 0x800;
+    r5vm_hle_init(&hle, &host.vm);
+    const int bound = r5vm_hle_bind(&hle, &host.vm, native, r5vm_hle_builtin("memset"));
+    memcpy(host.map + data, old, sizeof(old));
+    slot = r5vm_host_watch(&host, data, 4);
+    r5vm_asm_init(&a, host.map, native, 0);
+    r5vm_asm_li(&a, R5VM_A0, data - 4);
+    r5vm_asm_li(&a, R5VM_A1, 0x3C);
+    r5vm_asm_li(&a, R5VM_A2, 6);
+    r5vm_asm_li(&a, R5VM_T0, native);
+    r5vm_asm_jalr(&a, R5VM_RA, 0, R5VM_T0);
+    r5vm_asm_ebreak(&a);
+    watch_hits = 0;
+    run(&host, &a, 0);
+    check(bound >= 0 && host.vm.status == R5VM_BREAK && watch_hits == 1 &&
+          watch_pc == native && watch_addr == data && watch_len == 2 &&
+          watch_old == 0x2211 && host.map[data + 1] == 0x3C && host.map[data + 2] == 0x33,
+          "bulk: HLE memset hits watchpoint");
+    r5vm_host_unwatch(&host, slot);
+    r5vm_host_destroy(&host);
+}
+
+static void test_bulk_reads(void)
+{
+    r5vm_host_t host;
+    r5vm_asm_t a;
+    r5vm_hle_t hle;
+    const uint32_t page = (uint32_t)r5vm_host_page_size();
+    const uint32_t data = 2 * page;
+    const uint32_t guard_lo = STACK_LIMIT - page;
+
+    if (!setup(&host, &a) || !r5vm_host_stack_guard(&host, STACK_LIMIT))
+        return;
+
+    /* the source runs into the guard: the error names the ECALL */
+    const uint32_t ecall_pc = build_ecall(&host, R5VM_ECALL_MEMCPY, data, guard_lo - 4, 8);
+    last_error[0] = '\0';
+    r5vm_host_run(&host, 0);
+    check(host.vm.status == R5VM_ERROR && strcmp(last_error, "Stack overflow") == 0 &&
+          error_pc == ecall_pc && host.vm.pc == ecall_pc,
+          "bulk: memcpy ECALL source in guard");
+
+    /* same for an HLE memcpy native, called from address 0 */
+    const uint32_t native = 0x800;
+    r5vm_hle_init(&hle, &host.vm);
+    const int bound = r5vm_hle_bind(&hle, &host.vm, native, r5vm_hle_builtin("memcpy"));
+    r5vm_asm_init(&a, host.map, native, 0);
+    r5vm_asm_li(&a, R5VM_A0, data);
+    r5vm_asm_li(&a, R5VM_A1, guard_lo - 4);
+    r5vm_asm_li(&a, R5VM_A2, 8);
+    r5vm_asm_li(&a, R5VM_T0, native);
+    r5vm_asm_jalr(&a, R5VM_RA, 0, R5VM_T0);
+    r5vm_asm_ebreak(&a);
+    last_error[0] = '\0';
+    run(&host, &a, 0);
+    check(bound >= 0 && host.vm.status == R5VM_ERROR && error_pc == native &&
+          strcmp(last_error, "Stack overflow") == 0, "bulk: HLE memcpy source in guard");
+    r5vm_host_destroy(&host);
+}
+
+static void test_checkpoint_respond(void)
+{
+    r5vm_host_t host;
+    r5vm_asm_t a;
+    int fds[2];
+    char out[16] = { 0 };
+
+    if (!setup(&host, &a) || pipe(fds) != 0)
+        return;
+    const int saved = dup(STDIN_FILENO);
+    const bool piped = write(fds[1], "hello", 5) == 5 && close(fds[1]) == 0 &&
+                       dup2(fds[0], STDIN_FILENO) == STDIN_FILENO;
+    FILE* f = tmpfile();
+    host.vm.out = f;
+    r5vm_asm_li(&a, R5VM_A0, 0x2000);
+    r5vm_asm_li(&a, R5VM_A1, 64);
+    r5vm_asm_li(&a, R5VM_A7, R5VM_ECALL_CHECKPOINT);
+    r5vm_asm_ecall(&a);
+    r5vm_asm_mv(&a, R5VM_S0, R5VM_A0);
+    r5vm_asm_li(&a, R5VM_A0, 0x2001);
+    r5vm_asm_li(&a, R5VM_A1, 3);
+    r5vm_asm_li(&a, R5VM_A7, R5VM_ECALL_RESPOND);
+    r5vm_asm_ecall(&a);
+    r5vm_asm_ebreak(&a);
+    run(&host, &a, 0);
+    if (f) {
+        rewind(f);
+        if (!fgets(out, sizeof(out), f))
+            out[0] = '\0';
+        fclose(f);
+    }
+    dup2(saved, STDIN_FILENO);
+    close(saved);
+    close(fds[0]);
+    check(piped && host.vm.s0 == 5 && memcmp(host.map + 0x2000, "hello", 5) == 0,
+          "fork: checkpoint reads job input");
+    check(host.vm.status == R5VM_EXIT && host.vm.a0 == 0 && strcmp(out, "ell") == 0,
+          "fork: respond writes result and exits");
+
+    host.vm.out = NULL;
+    r5vm_asm_init(&a, host.map, 0x1000, 0);
+    r5vm_asm_li(&a, R5VM_A0, TEST_MEM_SIZE - 2);
+    r5vm_asm_li(&a, R5VM_A1, 4);
+    r5vm_asm_li(&a, R5VM_A7, R5VM_ECALL_RESPOND);
+    r5vm_asm_ecall(&a);
+    r5vm_asm_ebreak(&a);
+    run(&host, &a, 0);
+    check(host.vm.status == R5VM_ERROR &&
+          strcmp(last_error, "ECALL memory out of bounds") == 0,
+          "fork: respond out of bounds");
+    r5vm_host_destroy(&host);
+}
+
+static void test_host_copy(void)
+{
+    r5vm_host_t src, dst, small;
+    r5vm_asm_t a;
+
+    if (!setup(&src, &a))
+        return;
+    r5vm_host_stack_guard(&src, STACK_LIMIT);
+    memcpy(src.map + 0x2000, "state", 6);
+    src.map[STACK_LIMIT] = 0x5A;
+    src.vm.a0 = 42;
+    src.vm.pc = 0x100;
+    if (!r5vm_host_init(&dst, TEST_MEM_SIZE) ||
+        !r5vm_host_init(&small, TEST_MEM_SIZE / 2))
+        return;
+    dst.map[0x3000] = 0xFF;
+    check(r5vm_host_copy(&dst, &src) && dst.vm.a0 == 42 && dst.vm.pc == 0x100 &&
+          memcmp(dst.map + 0x2000, "state", 6) == 0 && dst.map[0x3000] == 0 &&
+          dst.map[STACK_LIMIT] == 0x5A && dst.guard_lo == src.guard_lo &&
+          dst.guard_hi == src.guard_hi, "copy: registers, memory and guard");
+
+    const int slot = r5vm_host_watch(&dst, 0x2000, 4);
+    check(!r5vm_host_copy(&small, &src) && slot >= 0 && !r5vm_host_copy(&dst, &src),
+          "copy: size mismatch and watched target refused");
+    r5vm_host_destroy(&small);
+    r5vm_host_destroy(&dst);
+    r5vm_host_destroy(&src);
+}
+
+static void test_quota(void)
+{
+    r5vm_host_t host;
+    r5vm_host_stats_t st;
+
+    if (!r5vm_host_init(&host, TEST_MEM_SIZE))
+        return;
+    check(!r5vm_host_set_limit(&host, TEST_MEM_SIZE - 1) && host.mem_limit == 0 &&
+          r5vm_host_set_limit(&host, TEST_MEM_SIZE + 100),
+          "quota: limit below guest memory refused");
+    const bool fits = r5vm_host_charge(&host, 60) && r5vm_host_charge(&host, 40);
+    const bool over = r5vm_host_charge(&host, 1);
+    r5vm_host_stats(&host, &st);
+    check(fits && !over && st.buffer_bytes == 100 && st.denied == 1 &&
+          st.limit_bytes == TEST_MEM_SIZE + 100 && st.peak_bytes == TEST_MEM_SIZE + 100,
+          "quota: charge beyond limit denied");
+    r5vm_host_uncharge(&host, 60);
+    const bool again = r5vm_host_charge(&host, 50);
+    r5vm_host_stats(&host, &st);
+    check(again && st.buffer_bytes == 90 && !r5vm_host_set_limit(&host, TEST_MEM_SIZE) &&
+          r5vm_host_set_limit(&host, 0) && r5vm_host_charge(&host, 1 << 20),
+          "quota: uncharge frees room, 0 unlimits");
+    r5vm_host_destroy(&host);
+}
+
+static void test_pool(void)
+{
+    r5vm_pool_t pool;
+
+    r5vm_pool_init(&pool, 2);
+    r5vm_host_t* h = r5vm_pool_acquire(&pool, TEST_MEM_SIZE);
+    if (!h)
+        return;
+    memset(h->map, 0xAB, TEST_MEM_SIZE);
+    h->vm.a0 = 7;
+    h->vm.pc = 0x40;
+    r5vm_host_watch(h, 0x2000, 4);
+    r5vm_pool_release(&pool, h);
+
+    r5vm_host_t* r = r5vm_pool_acquire(&pool, TEST_MEM_SIZE);
+    bool zero = r != NULL;
+    for (uint32_t i = 0; r && i < TEST_MEM_SIZE; i++)
+        zero &= r->map[i] == 0;
+    check(r == h && pool.hits == 1 && pool.misses == 1, "pool: released VM is reused");
+    check(zero && r->vm.a0 == 0 && r->vm.pc == 0 && r->watch[0].len == 0 &&
+          r->vm.mem == r->map && r->vm.mem_size == TEST_MEM_SIZE,
+          "pool: recycled VM reads zero");
+    if (r)
+        r5vm_pool_release(&pool, r);
+    r5vm_pool_destroy(&pool);
+}
+
+static void test_slab(void)
+{
+    r5vm_slab_t slab;
+    r5vm_asm_t a;
+    uint8_t image[16];
+    r5vm_t* vms[3];
+
+    if (!r5vm_slab_init(&slab, 2, TEST_MEM_SIZE))
+        return;
+    r5vm_asm_init(&a, image, sizeof(image), 0);
+    r5vm_asm_li(&a, R5VM_A0, 7);
+    r5vm_asm_ebreak(&a);
+    const bool built = r5vm_asm_finish(&a);
+    vms[0] = r5vm_slab_create(&slab, image, a.pos);
+    vms[1] = r5vm_slab_create(&slab, image, a.pos);
+    vms[2] = r5vm_slab_create(&slab, image, a.pos);
+    check(built && vms[0] && vms[1] && !vms[2] && vms[0]->mem != vms[1]->mem &&
+          slab.free_count == 0, "slab: create until full");
+    if (!vms[0] || !vms[1]) {
+        r5vm_slab_destroy(&slab);
+        return;
+    }
+    r5vm_run(vms[0], 0);
+    check(vms[0]->status == R5VM_BREAK && vms[0]->a0 == 7 &&
+          vms[1]->a0 == 0, "slab: VMs run independently");
+
+    vms[0]->mem[0x3000] = 0xCD;
+    r5vm_slab_free(&slab, vms[0]);
+    vms[2] = r5vm_slab_create(&slab, image, a.pos);
+    check(vms[2] == vms[0] && vms[2]->a0 == 0 && vms[2]->pc == 0 &&
+          vms[2]->mem[0x3000] == 0 && memcmp(vms[2]->mem, image, a.pos) == 0,
+          "slab: freed slot is reused zeroed");
+    r5vm_slab_destroy(&slab);
+}
+
+typedef struct gdb_target_s
+{
+    r5vm_host_t* host;
+    uint16_t     port;
+    bool         ok;
+} gdb_target_t;
+
+static void* gdb_thread(void* arg)
+{
+    gdb_target_t* t = arg;
+    t->ok = r5vm_gdb_serve(t->host, t->port);
+    return NULL;
+}
+
+/** Send packet `cmd` and read the reply packet into `reply`. */
+static bool gdb_cmd(int fd, const char* cmd, char* reply, size_t size)
+{
+    char frame[128];
+    unsigned cs = 0;
+    size_t len = 0;
+    char c;
+
+    for (const char* p = cmd; *p; p++)
+        cs += (unsigned char)*p;
+    snprintf(frame, sizeof(frame), "$%s#%02x", cmd, cs & 0xFF);
+    if (send(fd, frame, strlen(frame), 0) != (ssize_t)strlen(frame))
+        return false;
+    do { /* skip the ack */
+        if (recv(fd, &c, 1, 0) != 1)
+            return false;
+    } while (c != '$');
+    while (recv(fd, &c, 1, 0) == 1 && c != '#') {
+        if (len < size - 1)
+            reply[len++] = c;
+    }
+    reply[len] = '\0';
+    char sum[2];
+    return recv(fd, sum, 2, MSG_WAITALL) == 2 && send(fd, "+", 1, 0) == 1;
+}
+
+static void test_gdb(void)
+{
+    r5vm_host_t host;
+    r5vm_asm_t a;
+    const uint32_t page = (uint32_t)r5vm_host_page_size();
+    gdb_target_t t = { &host, (uint16_t)(20000 + getpid() % 20000), false };
+    pthread_t tid;
+    char cmd[64], reply[256];
+
+    if (!setup(&host, &a))
+        return;
+    r5vm_host_stack_guard(&host, STACK_LIMIT);
+    r5vm_asm_addi(&a, R5VM_A0, R5VM_ZERO, 1);
+    r5vm_asm_addi(&a, R5VM_A0, R5VM_A0, 1);
+    r5vm_asm_pause(&a); /* a detached guest runs on after a pause */
+    r5vm_asm_addi(&a, R5VM_A0, R5VM_A0, 1);
+    r5vm_asm_exit(&a);
+    r5vm_asm_finish(&a);
+    r5vm_reset(&host.vm);
+    if (pthread_create(&tid, NULL, gdb_thread, &t) != 0)
+        return;
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(t.port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int fd = -1;
+    for (int i = 0; i < 200 && fd < 0; i++) {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+            close(fd);
+            fd = -1;
+            usleep(10000);
+        }
+    }
+    check(fd >= 0, "gdb: connect");
+    if (fd < 0) {
+        pthread_cancel(tid);
+        return;
+    }
+
+    snprintf(cmd, sizeof(cmd), "m%x,4", (unsigned)(STACK_LIMIT - page));
+    bool ok = gdb_cmd(fd, cmd, reply, sizeof(reply)) && strcmp(reply, "E14") == 0;
+    snprintf(cmd, sizeof(cmd), "m%x,8", (unsigned)(STACK_LIMIT - page - 4));
+    ok = ok && gdb_cmd(fd, cmd, reply, sizeof(reply)) && strcmp(reply, "E14") == 0;
+    ok = ok && gdb_cmd(fd, "m0,4", reply, sizeof(reply)) &&
+         strcmp(reply, "13051000") == 0; /* addi a0,zero,1 */
+    check(ok, "gdb: read memory, guard answers E14");
+
+    ok = gdb_cmd(fd, "s", reply, sizeof(reply)) && strcmp(reply, "S05") == 0 &&
+         gdb_cmd(fd, "p20", reply, sizeof(reply)) && strcmp(reply, "04000000") == 0 &&
+         gdb_cmd(fd, "s", reply, sizeof(reply)) &&
+         gdb_cmd(fd, "p20", reply, sizeof(reply)) && strcmp(reply, "08000000") == 0 &&
+         gdb_cmd(fd, "pa", reply, sizeof(reply)) && strcmp(reply, "02000000") == 0;
+    check(ok, "gdb: step runs one instruction");
+
+    ok = gdb_cmd(fd, "D", reply, sizeof(reply)) && strcmp(reply, "OK") == 0;
+    close(fd);
+    pthread_join(tid, NULL);
+    check(ok && t.ok && host.vm.status == R5VM_EXIT && host.vm.a0 == 3,
+          "gdb: detached guest runs past pause");
+    r5vm_host_destroy(&host);
+}
+
+int main(void)
+{
+    printf("%s=== r5vm Host Service Tests ===%s\n\n", COLOR_CYAN, COLOR_RESET);
+
+    test_stack_guard();
+    test_watch_steps();
+    test_bulk_writes();
+    test_bulk_reads();
+    test_checkpoint_respond();
+    test_host_copy();
+    test_quota();
+    test_pool();
+    test_slab();
+    test_gdb();
+
+    printf("\nTests run: %d, failed: %s%d%s\n", tests_run,
+           tests_failed ? COLOR_RED : COLOR_GREEN, tests_failed, COLOR_RESET);
+    return tests_failed == 0 ? 0 : 1;
+}
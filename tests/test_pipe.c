@@ -0,0 +1,385 @@
+/*
+ * r5vm Pipeline Tests
+ * Runs r5vm_asm guests as pipeline stages (r5vm_pipe.c) that pass a word
+ * sequence through the shared rings and checks that it arrives complete
+ * and in order, and that aligned words shared between stages never tear.
+ * Runs `../r5vm --pipeline` on such guests to check its ring placement.
+ */
+
+#define _DEFAULT_SOURCE   /* mkdtemp on glibc */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "r5vm.h"
+#include "r5vm_asm.h"
+#include "r5vm_host.h"
+#include "r5vm_pipe.h"
+
+// ANSI colors
+#define COLOR_RESET   "\033[0m"
+#define COLOR_RED     "\033[31m"
+#define COLOR_GREEN   "\033[32m"
+#define COLOR_CYAN    "\033[36m"
+
+#define TEST_MEM_SIZE (64 * 1024)
+#define RING_ADDR     0x8000
+#define WORDS         200000 /**< Words sent through the pipeline */
+#define TEAR_OFF      192     /**< Unused ring header word */
+#define TEAR_DONE     196     /**< Set by the writer when it is done */
+#define TEAR_WRITES   2000000 /**< Alternating stores of 0 and ~0 */
+#define CLI           "../r5vm"
+#define CLI_PAD       0x3000  /**< Size of the padded consumer image */
+
+static int tests_run = 0;
+static int tests_failed = 0;
+
+void r5vm_error(r5vm_t* vm, const char* msg, uint32_t pc, uint32_t instr)
+{
+    (void)vm;
+    fprintf(stderr, "VM ERROR at PC=0x%08X: %s (instr=0x%08X)\n", pc, msg, instr);
+}
+
+static void check(bool ok, const char* name)
+{
+    tests_run++;
+    if (!ok)
+        tests_failed++;
+    printf("%s[TEST]%s %-40s ... %s%s%s\n", COLOR_CYAN, COLOR_RESET, name,
+           ok ? COLOR_GREEN : COLOR_RED, ok ? "PASS" : "FAIL", COLOR_RESET);
+}
+
+// ---- Guest code ------------------------------------------------------------
+// Input ring: s0 address, s5 mask, s6 tail. Output ring: s1 address,
+// s7 mask, s8 head, s9 capacity. Words travel in s2.
+
+/** Look up the input (`dir` 0) or output (`dir` 1) ring */
+static void emit_ring_info(r5vm_asm_t* a, int dir)
+{
+    r5vm_asm_li(a, R5VM_A0, (uint32_t)dir);
+    r5vm_asm_syscall(a, R5VM_ECALL_RING_INFO);
+    if (dir == 0) {
+        r5vm_asm_mv(a, R5VM_S0, R5VM_A0);
+        r5vm_asm_addi(a, R5VM_S5, R5VM_A1, -1);
+        r5vm_asm_li(a, R5VM_S6, 0);
+    } else {
+        r5vm_asm_mv(a, R5VM_S1, R5VM_A0);
+        r5vm_asm_mv(a, R5VM_S9, R5VM_A1);
+        r5vm_asm_addi(a, R5VM_S7, R5VM_A1, -1);
+        r5vm_asm_li(a, R5VM_S8, 0);
+    }
+}
+
+/** Pop one word into s2, jump to `closed` once the producer is gone */
+static void emit_pop(r5vm_asm_t* a, int closed)
+{
+    const int wait = r5vm_asm_label(a), have = r5vm_asm_label(a);
+    const int done = r5vm_asm_label(a);
+
+    r5vm_asm_bind(a, wait);
+    r5vm_asm_lw(a, R5VM_T0, R5VM_RING_HEAD, R5VM_S0);
+    r5vm_asm_fence(a);
+    r5vm_asm_sub(a, R5VM_T1, R5VM_T0, R5VM_S6);
+    r5vm_asm_li(a, R5VM_T2, 4);
+    r5vm_asm_bgeu(a, R5VM_T1, R5VM_T2, have);
+    r5vm_asm_mv(a, R5VM_A0, R5VM_S0);
+    r5vm_asm_syscall(a, R5VM_ECALL_RING_WAIT);
+    r5vm_asm_bnez(a, R5VM_A0, wait);
+    r5vm_asm_j(a, closed);
+    r5vm_asm_bind(a, have);
+    r5vm_asm_and(a, R5VM_T3, R5VM_S6, R5VM_S5);
+    r5vm_asm_add(a, R5VM_T3, R5VM_T3, R5VM_S0);
+    r5vm_asm_lw(a, R5VM_S2, R5VM_RING_DATA, R5VM_T3);
+    r5vm_asm_fence(a);
+    r5vm_asm_addi(a, R5VM_S6, R5VM_S6, 4);
+    r5vm_asm_sw(a, R5VM_S6, R5VM_RING_TAIL, R5VM_S0);
+    r5vm_asm_fence(a);
+    r5vm_asm_lw(a, R5VM_T4, R5VM_RING_WAIT_SPACE, R5VM_S0);
+    r5vm_asm_beqz(a, R5VM_T4, done);
+    r5vm_asm_mv(a, R5VM_A0, R5VM_S0);
+    r5vm_asm_syscall(a, R5VM_ECALL_RING_WAKE);
+    r5vm_asm_bind(a, done);
+}
+
+/** Push s2, jump to `closed` once the consumer is gone */
+static void emit_push(r5vm_asm_t* a, int closed)
+{
+    const int wait = r5vm_asm_label(a), room = r5vm_asm_label(a);
+    const int done = r5vm_asm_label(a);
+
+    r5vm_asm_bind(a, wait);
+    r5vm_asm_lw(a, R5VM_T0, R5VM_RING_TAIL, R5VM_S1);
+    r5vm_asm_fence(a);
+    r5vm_asm_sub(a, R5VM_T1, R5VM_S8, R5VM_T0);
+    r5vm_asm_sub(a, R5VM_T1, R5VM_S9, R5VM_T1);
+    r5vm_asm_li(a, R5VM_T2, 4);
+    r5vm_asm_bgeu(a, R5VM_T1, R5VM_T2, room);
+    r5vm_asm_mv(a, R5VM_A0, R5VM_S1);
+    r5vm_asm_syscall(a, R5VM_ECALL_RING_WAIT);
+    r5vm_asm_bnez(a, R5VM_A0, wait);
+    r5vm_asm_j(a, closed);
+    r5vm_asm_bind(a, room);
+    r5vm_asm_and(a, R5VM_T3, R5VM_S8, R5VM_S7);
+    r5vm_asm_add(a, R5VM_T3, R5VM_T3, R5VM_S1);
+    r5vm_asm_sw(a, R5VM_S2, R5VM_RING_DATA, R5VM_T3);
+    r5vm_asm_fence(a);
+    r5vm_asm_addi(a, R5VM_S8, R5VM_S8, 4);
+    r5vm_asm_sw(a, R5VM_S8, R5VM_RING_HEAD, R5VM_S1);
+    r5vm_asm_fence(a);
+    r5vm_asm_lw(a, R5VM_T4, R5VM_RING_WAIT_DATA, R5VM_S1);
+    r5vm_asm_beqz(a, R5VM_T4, done);
+    r5vm_asm_mv(a, R5VM_A0, R5VM_S1);
+    r5vm_asm_syscall(a, R5VM_ECALL_RING_WAKE);
+    r5vm_asm_bind(a, done);
+}
+
+/** Producer: send 0 .. WORDS - 1 */
+static void build_producer(r5vm_asm_t* a)
+{
+    const int loop = r5vm_asm_label(a), out = r5vm_asm_label(a);
+
+    emit_ring_info(a, 1);
+    r5vm_asm_li(a, R5VM_S2, 0);
+    r5vm_asm_li(a, R5VM_S3, WORDS);
+    r5vm_asm_bind(a, loop);
+    emit_push(a, out);
+    r5vm_asm_addi(a, R5VM_S2, R5VM_S2, 1);
+    r5vm_asm_bne(a, R5VM_S2, R5VM_S3, loop);
+    r5vm_asm_bind(a, out);
+    r5vm_asm_li(a, R5VM_A0, 0);
+    r5vm_asm_exit(a);
+}
+
+/** Middle stage: forward every word */
+static void build_forward(r5vm_asm_t* a)
+{
+    const int loop = r5vm_asm_label(a), out = r5vm_asm_label(a);
+
+    emit_ring_info(a, 0);
+    emit_ring_info(a, 1);
+    r5vm_asm_bind(a, loop);
+    emit_pop(a, out);
+    emit_push(a, out);
+    r5vm_asm_j(a, loop);
+    r5vm_asm_bind(a, out);
+    r5vm_asm_li(a, R5VM_A0, 0);
+    r5vm_asm_exit(a);
+}
+
+/** Consumer: exit with the number of in-order words, -1 on a mismatch;
+    with `status` 0 if all WORDS words arrived. */
+static void build_consumer(r5vm_asm_t* a, bool status)
+{
+    const int loop = r5vm_asm_label(a), out = r5vm_asm_label(a);
+    const int bad = r5vm_asm_label(a);
+
+    emit_ring_info(a, 0);
+    r5vm_asm_li(a, R5VM_S3, 0);
+    r5vm_asm_bind(a, loop);
+    emit_pop(a, out);
+    r5vm_asm_bne(a, R5VM_S2, R5VM_S3, bad);
+    r5vm_asm_addi(a, R5VM_S3, R5VM_S3, 1);
+    r5vm_asm_j(a, loop);
+    r5vm_asm_bind(a, bad);
+    r5vm_asm_li(a, R5VM_S3, 0xFFFFFFFF);
+    r5vm_asm_bind(a, out);
+    r5vm_asm_mv(a, R5VM_A0, R5VM_S3);
+    if (status) {
+        r5vm_asm_li(a, R5VM_T0, WORDS);
+        r5vm_asm_sub(a, R5VM_A0, R5VM_S3, R5VM_T0);
+    }
+    r5vm_asm_exit(a);
+}
+
+/** Writer: flip a ring header word between 0 and ~0, then set the done flag */
+static void build_tear_writer(r5vm_asm_t* a)
+{
+    const int loop = r5vm_asm_label(a);
+
+    emit_ring_info(a, 1);
+    r5vm_asm_li(a, R5VM_T5, 0xFFFFFFFF);
+    r5vm_asm_li(a, R5VM_S3, TEAR_WRITES);
+    r5vm_asm_bind(a, loop);
+    r5vm_asm_sw(a, R5VM_ZERO, TEAR_OFF, R5VM_S1);
+    r5vm_asm_sw(a, R5VM_T5, TEAR_OFF, R5VM_S1);
+    r5vm_asm_addi(a, R5VM_S3, R5VM_S3, -1);
+    r5vm_asm_bnez(a, R5VM_S3, loop);
+    r5vm_asm_li(a, R5VM_T0, 1);
+    r5vm_asm_sw(a, R5VM_T0, TEAR_DONE, R5VM_S1);
+    r5vm_asm_li(a, R5VM_A0, 0);
+    r5vm_asm_exit(a);
+}
+
+/** Reader: exit with the number of torn values seen until the writer is done */
+static void build_tear_reader(r5vm_asm_t* a)
+{
+    const int loop = r5vm_asm_label(a), whole = r5vm_asm_label(a);
+
+    emit_ring_info(a, 0);
+    r5vm_asm_li(a, R5VM_T5, 0xFFFFFFFF);
+    r5vm_asm_li(a, R5VM_S3, 0);
+    r5vm_asm_bind(a, loop);
+    r5vm_asm_lw(a, R5VM_T0, TEAR_OFF, R5VM_S0);
+    r5vm_asm_beqz(a, R5VM_T0, whole);
+    r5vm_asm_beq(a, R5VM_T0, R5VM_T5, whole);
+    r5vm_asm_addi(a, R5VM_S3, R5VM_S3, 1);
+    r5vm_asm_bind(a, whole);
+    r5vm_asm_lw(a, R5VM_T1, TEAR_DONE, R5VM_S0);
+    r5vm_asm_beqz(a, R5VM_T1, loop);
+    r5vm_asm_mv(a, R5VM_A0, R5VM_S3);
+    r5vm_asm_exit(a);
+}
+
+// ---- Tests -----------------------------------------------------------------
+
+/** Aligned words shared between two stages are never seen half written */
+static void test_no_tearing(void)
+{
+    r5vm_host_t hosts[2];
+    r5vm_host_t* stages[2] = { &hosts[0], &hosts[1] };
+    r5vm_asm_t a;
+    bool ok = true;
+
+    for (unsigned i = 0; i < 2; i++) {
+        if (!r5vm_host_init(&hosts[i], TEST_MEM_SIZE)) {
+            check(false, "pipe: shared words do not tear");
+            return;
+        }
+        r5vm_asm_init(&a, hosts[i].map, RING_ADDR, 0);
+        if (i == 0)
+            build_tear_writer(&a);
+        else
+            build_tear_reader(&a);
+        ok &= r5vm_asm_finish(&a);
+        r5vm_reset(&hosts[i].vm);
+    }
+    ok &= r5vm_pipe_run(stages, 2, RING_ADDR, 64, false);
+    check(ok && hosts[0].vm.status == R5VM_EXIT && hosts[1].vm.status == R5VM_EXIT &&
+          hosts[1].vm.a0 == 0, "pipe: shared words do not tear");
+    for (unsigned i = 0; i < 2; i++)
+        r5vm_host_destroy(&hosts[i]);
+}
+
+/** Run producer, `middle` forwarding stages and consumer over `ring_size` rings */
+static void test_pipeline(unsigned middle, uint32_t ring_size, const char* name)
+{
+    r5vm_host_t hosts[R5VM_PIPE_MAX_STAGES];
+    r5vm_host_t* stages[R5VM_PIPE_MAX_STAGES];
+    const unsigned count = middle + 2;
+    bool ok = true;
+
+    for (unsigned i = 0; i < count; i++) {
+        r5vm_asm_t a;
+        stages[i] = &hosts[i];
+        if (!r5vm_host_init(&hosts[i], TEST_MEM_SIZE)) {
+            check(false, name);
+            return;
+        }
+        r5vm_asm_init(&a, hosts[i].map, RING_ADDR, 0);
+        if (i == 0)
+            build_producer(&a);
+        else if (i == count - 1)
+            build_consumer(&a, false);
+        else
+            build_forward(&a);
+        ok &= r5vm_asm_finish(&a);
+        r5vm_reset(&hosts[i].vm);
+    }
+    ok &= r5vm_pipe_run(stages, count, RING_ADDR, ring_size, false);
+    for (unsigned i = 0; i < count; i++)
+        ok &= hosts[i].vm.status == R5VM_EXIT;
+    ok &= hosts[count - 1].vm.a0 == WORDS;
+    check(ok, name);
+    for (unsigned i = 0; i < count; i++)
+        r5vm_host_destroy(&hosts[i]);
+}
+
+/** Write a producer (`consumer` false) or consumer image of `size` bytes */
+static bool write_stage(const char* path, bool consumer, size_t size)
+{
+    static uint8_t image[CLI_PAD];
+    r5vm_asm_t a;
+
+    memset(image, 0, sizeof(image));
+    r5vm_asm_init(&a, image, sizeof(image), 0);
+    if (consumer)
+        build_consumer(&a, true);
+    else
+        build_producer(&a);
+    FILE* f = fopen(path, "wb");
+    const bool ok = r5vm_asm_finish(&a) && f && size >= a.pos &&
+                    fwrite(image, 1, size, f) == size;
+    if (f)
+        fclose(f);
+    return ok;
+}
+
+/** Run the CLI with `args`, its exit status; `out` gets the start of stderr */
+static int cli(const char* args, char* out, size_t size)
+{
+    char cmd[512];
+
+    snprintf(cmd, sizeof(cmd), CLI " --pipeline --no-pin %s 2>&1", args);
+    FILE* p = popen(cmd, "r");
+    if (!p)
+        return -1;
+    const size_t n = fread(out, 1, size - 1, p);
+    out[n] = '\0';
+    const int st = pclose(p);
+    return WIFEXITED(st) ? WEXITSTATUS(st) : -1;
+}
+
+/** `r5vm --pipeline` places the rings without --mem or --ring */
+static void test_cli(void)
+{
+    char dir[64], prod[96], cons[96], big[96], args[512], out[1024];
+
+    if (access(CLI, X_OK) != 0) {
+        printf("%s[SKIP]%s CLI tests need " CLI ", run make in the root\n",
+               COLOR_CYAN, COLOR_RESET);
+        return;
+    }
+    snprintf(dir, sizeof(dir), "/tmp/r5vm_test_pipe.XXXXXX");
+    const bool made = mkdtemp(dir) != NULL;
+    snprintf(prod, sizeof(prod), "%s/prod.bin", dir);
+    snprintf(cons, sizeof(cons), "%s/cons.bin", dir);
+    snprintf(big, sizeof(big), "%s/big.bin", dir);
+    if (!made || !write_stage(prod, false, 256) || !write_stage(cons, true, 512) ||
+        !write_stage(big, true, CLI_PAD)) {
+        check(false, "cli: write stages");
+    } else {
+        snprintf(args, sizeof(args), "%s %s", prod, cons);
+        check(cli(args, out, sizeof(out)) == 0, "cli: default ring placement");
+        snprintf(args, sizeof(args), "%s %s", prod, big);
+        check(cli(args, out, sizeof(out)) == 0, "cli: rings above a larger image");
+        snprintf(args, sizeof(args), "--ring 0x1000 %s %s", prod, big);
+        check(cli(args, out, sizeof(out)) == 1 && strstr(out, "overlap stage 2"),
+              "cli: rings overlapping an image");
+        snprintf(args, sizeof(args), "--mem 64k %s %s", prod, cons);
+        check(cli(args, out, sizeof(out)) == 1 && strstr(out, "do not fit"),
+              "cli: rings beyond --mem");
+    }
+    unlink(prod);
+    unlink(cons);
+    unlink(big);
+    rmdir(dir);
+}
+
+int main(void)
+{
+    printf("%s=== r5vm Pipeline Tests ===%s\n\n", COLOR_CYAN, COLOR_RESET);
+
+    test_pipeline(0, 64, "pipe: two stages, 64 byte ring");
+    test_pipeline(2, 64, "pipe: four stages, 64 byte ring");
+    test_pipeline(1, 4096, "pipe: three stages, 4 KiB ring");
+    test_no_tearing();
+    test_cli();
+
+    printf("\nTests run: %d, failed: %s%d%s\n", tests_run,
+           tests_failed ? COLOR_RED : COLOR_GREEN, tests_failed, COLOR_RESET);
+    return tests_failed == 0 ? 0 : 1;
+}
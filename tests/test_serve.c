@@ -0,0 +1,316 @@
+/*
+ * r5vm Request-Serving Daemon Tests
+ * Runs r5vm_serve() (r5vm_serve.c) on a thread with r5vm_asm guests and
+ * talks the length-prefixed protocol over its Unix socket: responses,
+ * failed guests and requests out of fuel, and a SIGHUP reload while a
+ * request is in flight. POSIX only.
+ */
+
+#define _DEFAULT_SOURCE   /* struct sockaddr_un on glibc */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "r5vm.h"
+#include "r5vm_asm.h"
+#include "r5vm_host.h"
+#include "r5vm_hle.h"
+#include "r5vm_serve.h"
+
+// ANSI colors
+#define COLOR_RESET   "\033[0m"
+#define COLOR_RED     "\033[31m"
+#define COLOR_GREEN   "\033[32m"
+#define COLOR_CYAN    "\033[36m"
+
+#define TEST_MEM_SIZE (64 * 1024)
+#define REQ_ADDR      0x2000 /**< request buffer of the guests */
+#define GATE_ADDR     0x0800 /**< guest function bound to gate() */
+#define WORKERS       2
+#define FUEL          1000000
+
+static int tests_run = 0;
+static int tests_failed = 0;
+static char sock_path[64];
+
+/** Holds version 1 requests starting with 'o' in gate() while `hold` is set */
+static pthread_mutex_t gate_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  gate_cond = PTHREAD_COND_INITIALIZER;
+static bool gate_hold;
+static unsigned gate_waiting;
+
+static volatile unsigned loads, releases;
+
+void r5vm_error(r5vm_t* vm, const char* msg, uint32_t pc, uint32_t instr)
+{
+    (void)vm;
+    (void)msg;
+    (void)pc;
+    (void)instr;
+}
+
+static void check(bool ok, const char* name)
+{
+    tests_run++;
+    if (!ok)
+        tests_failed++;
+    printf("%s[TEST]%s %-40s ... %s%s%s\n", COLOR_CYAN, COLOR_RESET, name,
+           ok ? COLOR_GREEN : COLOR_RED, ok ? "PASS" : "FAIL", COLOR_RESET);
+}
+
+static bool gate(r5vm_t* vm)
+{
+    if (vm->mem[REQ_ADDR] != 'o')
+        return true;
+    pthread_mutex_lock(&gate_lock);
+    gate_waiting++;
+    pthread_cond_broadcast(&gate_cond);
+    while (gate_hold)
+        pthread_cond_wait(&gate_cond, &gate_lock);
+    gate_waiting--;
+    pthread_mutex_unlock(&gate_lock);
+    return true;
+}
+
+/**
+ * Version 1 echoes the request after passing gate(), fails with `ebreak`
+ * on "x" and spins on "l". Version 2 answers with the first byte replaced
+ * by '2'.
+ */
+static bool build(r5vm_host_t* host, r5vm_hle_t* hle, int version)
+{
+    r5vm_asm_t a;
+
+    if (!r5vm_host_init(host, TEST_MEM_SIZE))
+        return false;
+    r5vm_asm_init(&a, host->map, GATE_ADDR, 0);
+    const int fail = r5vm_asm_label(&a);
+    const int spin = r5vm_asm_label(&a);
+    r5vm_asm_li(&a, R5VM_A0, REQ_ADDR);
+    r5vm_asm_li(&a, R5VM_A1, 64);
+    r5vm_asm_syscall(&a, R5VM_ECALL_CHECKPOINT);
+    r5vm_asm_mv(&a, R5VM_S0, R5VM_A0);
+    r5vm_asm_li(&a, R5VM_T1, REQ_ADDR);
+    if (version == 1) {
+        r5vm_asm_lbu(&a, R5VM_T0, 0, R5VM_T1);
+        r5vm_asm_li(&a, R5VM_T2, 'x');
+        r5vm_asm_beq(&a, R5VM_T0, R5VM_T2, fail);
+        r5vm_asm_li(&a, R5VM_T2, 'l');
+        r5vm_asm_beq(&a, R5VM_T0, R5VM_T2, spin);
+        r5vm_asm_li(&a, R5VM_T0, GATE_ADDR);
+        r5vm_asm_jalr(&a, R5VM_RA, 0, R5VM_T0);
+    } else {
+        r5vm_asm_li(&a, R5VM_T0, '2');
+        r5vm_asm_sb(&a, R5VM_T0, 0, R5VM_T1);
+    }
+    r5vm_asm_li(&a, R5VM_A0, REQ_ADDR);
+    r5vm_asm_mv(&a, R5VM_A1, R5VM_S0);
+    r5vm_asm_syscall(&a, R5VM_ECALL_RESPOND);
+    r5vm_asm_bind(&a, fail);
+    r5vm_asm_ebreak(&a);
+    r5vm_asm_bind(&a, spin);
+    r5vm_asm_addi(&a, R5VM_T3, R5VM_T3, 1);
+    r5vm_asm_j(&a, spin);
+    host->map[GATE_ADDR] = 0x67; /* ret, replaced by the trap */
+    host->map[GATE_ADDR + 1] = 0x80;
+    r5vm_hle_init(hle, &host->vm);
+    if (!r5vm_asm_finish(&a) ||
+        (version == 1 && r5vm_hle_bind(hle, &host->vm, GATE_ADDR, gate) < 0)) {
+        r5vm_host_destroy(host);
+        return false;
+    }
+    r5vm_reset(&host->vm);
+    return true;
+}
+
+typedef struct image_s
+{
+    r5vm_host_t host; /* first member, release() casts back */
+    r5vm_hle_t  hle;
+} image_t;
+
+static r5vm_host_t* load(void* user)
+{
+    (void)user;
+    image_t* img = malloc(sizeof(*img));
+    if (!img || !build(&img->host, &img->hle, 2)) {
+        free(img);
+        return NULL;
+    }
+    __sync_fetch_and_add(&loads, 1);
+    return &img->host;
+}
+
+static void release(r5vm_host_t* host, void* user)
+{
+    (void)user;
+    __sync_fetch_and_add(&releases, 1);
+    r5vm_host_destroy(host);
+    free((image_t*)host);
+}
+
+static const r5vm_serve_loader_t loader = { load, release, NULL };
+static image_t v1;
+
+static void* serve_thread(void* arg)
+{
+    (void)arg;
+    r5vm_serve(&v1.host, sock_path, WORKERS, FUEL, &loader);
+    return NULL;
+}
+
+static int connect_server(void)
+{
+    struct sockaddr_un addr;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, sock_path);
+    for (int i = 0; i < 200; i++) { /* the server warms up first */
+        const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            return -1;
+        if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0)
+            return fd;
+        close(fd);
+        usleep(10000);
+    }
+    return -1;
+}
+
+static bool send_request(int fd, const char* payload)
+{
+    const uint32_t len = (uint32_t)strlen(payload);
+    uint8_t hdr[4] = { len & 0xFF, (len >> 8) & 0xFF, (len >> 16) & 0xFF, len >> 24 };
+    return send(fd, hdr, 4, 0) == 4 && send(fd, payload, len, 0) == (ssize_t)len;
+}
+
+/** Read one response, returns its length field; the payload goes to `out`. */
+static uint32_t read_response(int fd, char* out, size_t size)
+{
+    uint8_t hdr[4];
+
+    out[0] = '\0';
+    if (recv(fd, hdr, 4, MSG_WAITALL) != 4)
+        return 0xDEAD;
+    const uint32_t len = hdr[0] | (hdr[1] << 8) | (hdr[2] << 16) | ((uint32_t)hdr[3] << 24);
+    if (len == R5VM_SERVE_FAILED || len == 0)
+        return len;
+    if (len >= size || recv(fd, out, len, MSG_WAITALL) != (ssize_t)len)
+        return 0xDEAD;
+    out[len] = '\0';
+    return len;
+}
+
+static uint32_t call(int fd, const char* payload, char* out, size_t size)
+{
+    return send_request(fd, payload) ? read_response(fd, out, size) : 0xDEAD;
+}
+
+static void test_requests(void)
+{
+    char out[64];
+    const int fd = connect_server();
+
+    if (fd < 0) {
+        check(false, "serve: connect");
+        return;
+    }
+    const uint32_t n1 = call(fd, "hello", out, sizeof(out));
+    const bool hello = n1 == 5 && strcmp(out, "hello") == 0;
+    const uint32_t n2 = call(fd, "abc", out, sizeof(out));
+    check(hello && n2 == 3 && strcmp(out, "abc") == 0,
+          "serve: requests on one connection");
+    check(call(fd, "x", out, sizeof(out)) == R5VM_SERVE_FAILED,
+          "serve: failed guest");
+    check(call(fd, "loop", out, sizeof(out)) == R5VM_SERVE_FAILED,
+          "serve: request out of fuel");
+    check(call(fd, "again", out, sizeof(out)) == 5 && strcmp(out, "again") == 0,
+          "serve: worker recovers after failure");
+    close(fd);
+}
+
+static void test_reload(pthread_t server)
+{
+    char out[64];
+
+    /* hold a version 1 request in gate() on one worker */
+    pthread_mutex_lock(&gate_lock);
+    gate_hold = true;
+    pthread_mutex_unlock(&gate_lock);
+    const int held = connect_server();
+    if (held < 0 || !send_request(held, "old")) {
+        check(false, "reload: connect");
+        return;
+    }
+    pthread_mutex_lock(&gate_lock);
+    while (!gate_waiting)
+        pthread_cond_wait(&gate_cond, &gate_lock);
+    pthread_mutex_unlock(&gate_lock);
+
+    /* reload; new requests on the other worker reach version 2 */
+    pthread_kill(server, SIGHUP);
+    const int fd = connect_server();
+    bool v2 = false;
+    for (int i = 0; fd >= 0 && i < 200 && !v2; i++) {
+        v2 = call(fd, "new", out, sizeof(out)) == 3 && strcmp(out, "2ew") == 0;
+        if (!v2)
+            usleep(10000);
+    }
+    check(v2 && loads == 1, "reload: new requests run on version 2");
+
+    pthread_mutex_lock(&gate_lock);
+    gate_hold = false;
+    pthread_cond_broadcast(&gate_cond);
+    pthread_mutex_unlock(&gate_lock);
+    check(read_response(held, out, sizeof(out)) == 3 && strcmp(out, "old") == 0,
+          "reload: in-flight request on version 1");
+    check(call(held, "next", out, sizeof(out)) == 4 && strcmp(out, "2ext") == 0,
+          "reload: connection moves to version 2");
+
+    /* a second reload drains version 2, the loader releases it */
+    pthread_kill(server, SIGHUP);
+    bool drained = false;
+    for (int i = 0; i < 200 && !drained; i++) {
+        drained = releases == 1;
+        if (!drained)
+            usleep(10000);
+    }
+    check(drained && loads == 2, "reload: drained version is released");
+    if (fd >= 0)
+        close(fd);
+    close(held);
+}
+
+int main(void)
+{
+    pthread_t server;
+    sigset_t hup;
+
+    printf("%s=== r5vm Request-Serving Daemon Tests ===%s\n\n", COLOR_CYAN, COLOR_RESET);
+
+    /* only the server thread takes SIGHUP, via sigwait() */
+    sigemptyset(&hup);
+    sigaddset(&hup, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &hup, NULL);
+    snprintf(sock_path, sizeof(sock_path), "/tmp/r5vm_test_serve.%d", (int)getpid());
+    if (!build(&v1.host, &v1.hle, 1) ||
+        pthread_create(&server, NULL, serve_thread, NULL) != 0) {
+        check(false, "serve: start");
+    } else {
+        test_requests();
+        test_reload(server);
+    }
+    unlink(sock_path);
+
+    printf("\nTests run: %d, failed: %s%d%s\n", tests_run,
+           tests_failed ? COLOR_RED : COLOR_GREEN, tests_failed, COLOR_RESET);
+    return tests_failed == 0 ? 0 : 1; /* exit() ends the server threads */
+}